@@ -0,0 +1,322 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <math.h>
+
+#include "util_math.h"
+#include "util_string.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+#include "cycles_benchmark.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Mesh Generation */
+
+static void benchmark_mesh(string& xml, const vector<float3>& P, const vector<int>& nverts, const vector<int>& verts)
+{
+	xml += "<mesh P=\"";
+	for(size_t i = 0; i < P.size(); i++)
+		xml += string_printf("%.4f %.4f %.4f ", P[i].x, P[i].y, P[i].z);
+
+	xml += "\" nverts=\"";
+	for(size_t i = 0; i < nverts.size(); i++)
+		xml += string_printf("%d ", nverts[i]);
+
+	xml += "\" verts=\"";
+	for(size_t i = 0; i < verts.size(); i++)
+		xml += string_printf("%d ", verts[i]);
+
+	xml += "\"/>\n";
+}
+
+static void benchmark_quad(string& xml, float3 p0, float3 p1, float3 p2, float3 p3)
+{
+	vector<float3> P;
+	vector<int> nverts, verts;
+
+	P.push_back(p0);
+	P.push_back(p1);
+	P.push_back(p2);
+	P.push_back(p3);
+
+	nverts.push_back(4);
+
+	for(int i = 0; i < 4; i++)
+		verts.push_back(i);
+
+	benchmark_mesh(xml, P, nverts, verts);
+}
+
+static void benchmark_sphere(string& xml, float radius, int segments, int rings)
+{
+	vector<float3> P;
+	vector<int> nverts, verts;
+
+	/* poles and rings of vertices in between */
+	P.push_back(make_float3(0.0f, radius, 0.0f));
+
+	for(int r = 1; r < rings; r++) {
+		float theta = M_PI*r/rings;
+		float y = cosf(theta)*radius;
+		float ring_radius = sinf(theta)*radius;
+
+		for(int s = 0; s < segments; s++) {
+			float phi = 2.0f*M_PI*s/segments;
+			P.push_back(make_float3(cosf(phi)*ring_radius, y, sinf(phi)*ring_radius));
+		}
+	}
+
+	P.push_back(make_float3(0.0f, -radius, 0.0f));
+
+	int bottom = P.size() - 1;
+
+	/* triangle fans at the poles, quads in between */
+	for(int s = 0; s < segments; s++) {
+		int s1 = (s + 1) % segments;
+
+		nverts.push_back(3);
+		verts.push_back(0);
+		verts.push_back(1 + s1);
+		verts.push_back(1 + s);
+
+		for(int r = 1; r < rings - 1; r++) {
+			int ring = 1 + (r - 1)*segments;
+			int next = ring + segments;
+
+			nverts.push_back(4);
+			verts.push_back(ring + s);
+			verts.push_back(ring + s1);
+			verts.push_back(next + s1);
+			verts.push_back(next + s);
+		}
+
+		int last = 1 + (rings - 2)*segments;
+
+		nverts.push_back(3);
+		verts.push_back(last + s);
+		verts.push_back(last + s1);
+		verts.push_back(bottom);
+	}
+
+	benchmark_mesh(xml, P, nverts, verts);
+}
+
+static void benchmark_heightfield_mesh(string& xml, float size, float height, int resolution)
+{
+	vector<float3> P;
+	vector<int> nverts, verts;
+
+	for(int j = 0; j <= resolution; j++) {
+		for(int i = 0; i <= resolution; i++) {
+			float x = size*(2.0f*i/resolution - 1.0f);
+			float z = size*(2.0f*j/resolution - 1.0f);
+			float y = height*(sinf(x*1.3f)*cosf(z*0.9f) + 0.25f*sinf(x*5.1f + z*4.3f));
+
+			P.push_back(make_float3(x, y, z));
+		}
+	}
+
+	for(int j = 0; j < resolution; j++) {
+		for(int i = 0; i < resolution; i++) {
+			int v = j*(resolution + 1) + i;
+
+			nverts.push_back(4);
+			verts.push_back(v);
+			verts.push_back(v + 1);
+			verts.push_back(v + resolution + 2);
+			verts.push_back(v + resolution + 1);
+		}
+	}
+
+	benchmark_mesh(xml, P, nverts, verts);
+}
+
+/* Shaders */
+
+static void benchmark_shader_diffuse(string& xml, const char *name, float3 color)
+{
+	xml += string_printf("<shader name=\"%s\">\n", name);
+	xml += string_printf("<diffuse_bsdf name=\"bsdf\" color=\"%.3f %.3f %.3f\"/>\n", color.x, color.y, color.z);
+	xml += "<connect from=\"bsdf bsdf\" to=\"output surface\"/>\n";
+	xml += "</shader>\n";
+}
+
+static void benchmark_shader_glossy(string& xml, const char *name, float3 color, float roughness)
+{
+	xml += string_printf("<shader name=\"%s\">\n", name);
+	xml += string_printf("<glossy_bsdf name=\"bsdf\" distribution=\"Beckmann\" color=\"%.3f %.3f %.3f\" roughness=\"%.3f\"/>\n",
+		color.x, color.y, color.z, roughness);
+	xml += "<connect from=\"bsdf bsdf\" to=\"output surface\"/>\n";
+	xml += "</shader>\n";
+}
+
+static void benchmark_shader_glass(string& xml, const char *name, float ior)
+{
+	xml += string_printf("<shader name=\"%s\">\n", name);
+	xml += string_printf("<glass_bsdf name=\"bsdf\" color=\"1 1 1\" ior=\"%.3f\"/>\n", ior);
+	xml += "<connect from=\"bsdf bsdf\" to=\"output surface\"/>\n";
+	xml += "</shader>\n";
+}
+
+static void benchmark_shader_emission(string& xml, const char *name, float strength)
+{
+	xml += string_printf("<shader name=\"%s\">\n", name);
+	xml += string_printf("<emission name=\"emission\" color=\"1 1 1\" strength=\"%.3f\"/>\n", strength);
+	xml += "<connect from=\"emission emission\" to=\"output surface\"/>\n";
+	xml += "</shader>\n";
+}
+
+static void benchmark_background(string& xml, float3 color, float strength)
+{
+	xml += "<background>\n";
+	xml += string_printf("<background name=\"bg\" color=\"%.3f %.3f %.3f\" strength=\"%.3f\"/>\n",
+		color.x, color.y, color.z, strength);
+	xml += "<connect from=\"bg background\" to=\"output surface\"/>\n";
+	xml += "</background>\n";
+}
+
+static void benchmark_camera(string& xml, int width, int height, float3 translate, float pitch, float fov)
+{
+	xml += string_printf("<film width=\"%d\" height=\"%d\"/>\n", width, height);
+	xml += string_printf("<transform translate=\"%.3f %.3f %.3f\" rotate=\"%.3f 1 0 0\">\n",
+		translate.x, translate.y, translate.z, pitch);
+	xml += string_printf("<camera type=\"perspective\" fov=\"%.3f\"/>\n", fov);
+	xml += "</transform>\n";
+}
+
+/* Scenes */
+
+/* closed box lit by an area light, mostly indirect light and glass */
+static void benchmark_cornell_box(BenchmarkScene& scene)
+{
+	string& xml = scene.xml;
+
+	benchmark_camera(xml, 400, 400, make_float3(0.0f, 0.0f, -3.4f), 0.0f, 40.0f);
+	xml += "<integrator min_bounce=\"3\" max_bounce=\"8\"/>\n";
+
+	benchmark_shader_diffuse(xml, "white", make_float3(0.75f, 0.75f, 0.75f));
+	benchmark_shader_diffuse(xml, "red", make_float3(0.75f, 0.1f, 0.1f));
+	benchmark_shader_diffuse(xml, "green", make_float3(0.1f, 0.75f, 0.1f));
+	benchmark_shader_glass(xml, "glass", 1.45f);
+	benchmark_shader_emission(xml, "light", 12.0f);
+	benchmark_background(xml, make_float3(0.0f, 0.0f, 0.0f), 0.0f);
+
+	xml += "<state shader=\"white\">\n";
+	benchmark_quad(xml, make_float3(-1, -1, -1), make_float3(1, -1, -1), make_float3(1, -1, 1), make_float3(-1, -1, 1));
+	benchmark_quad(xml, make_float3(-1, 1, -1), make_float3(-1, 1, 1), make_float3(1, 1, 1), make_float3(1, 1, -1));
+	benchmark_quad(xml, make_float3(-1, -1, 1), make_float3(1, -1, 1), make_float3(1, 1, 1), make_float3(-1, 1, 1));
+	xml += "<transform translate=\"-0.45 -0.55 0.3\">\n";
+	benchmark_sphere(xml, 0.45f, 48, 24);
+	xml += "</transform>\n";
+	xml += "</state>\n";
+
+	xml += "<state shader=\"red\">\n";
+	benchmark_quad(xml, make_float3(-1, -1, -1), make_float3(-1, -1, 1), make_float3(-1, 1, 1), make_float3(-1, 1, -1));
+	xml += "</state>\n";
+
+	xml += "<state shader=\"green\">\n";
+	benchmark_quad(xml, make_float3(1, -1, -1), make_float3(1, 1, -1), make_float3(1, 1, 1), make_float3(1, -1, 1));
+	xml += "</state>\n";
+
+	xml += "<state shader=\"glass\" interpolation=\"smooth\">\n";
+	xml += "<transform translate=\"0.45 -0.6 -0.2\">\n";
+	benchmark_sphere(xml, 0.4f, 48, 24);
+	xml += "</transform>\n";
+	xml += "</state>\n";
+
+	xml += "<state shader=\"light\">\n";
+	benchmark_quad(xml, make_float3(-0.3f, 0.99f, -0.3f), make_float3(-0.3f, 0.99f, 0.3f), make_float3(0.3f, 0.99f, 0.3f), make_float3(0.3f, 0.99f, -0.3f));
+	xml += "</state>\n";
+
+	scene.name = "cornell_box";
+	scene.samples = 64;
+}
+
+/* many small objects on a ground plane, stresses BVH build and traversal */
+static void benchmark_sphere_grid(BenchmarkScene& scene)
+{
+	string& xml = scene.xml;
+	const int grid = 16;
+
+	benchmark_camera(xml, 512, 288, make_float3(0.0f, 6.0f, -14.0f), 25.0f, 50.0f);
+	xml += "<integrator min_bounce=\"2\" max_bounce=\"4\"/>\n";
+
+	benchmark_shader_diffuse(xml, "ground", make_float3(0.5f, 0.5f, 0.5f));
+	benchmark_shader_diffuse(xml, "diffuse", make_float3(0.8f, 0.6f, 0.3f));
+	benchmark_shader_glossy(xml, "glossy", make_float3(0.7f, 0.7f, 0.8f), 0.15f);
+	benchmark_shader_emission(xml, "light", 400.0f);
+	benchmark_background(xml, make_float3(0.4f, 0.5f, 0.7f), 0.5f);
+
+	xml += "<state shader=\"ground\">\n";
+	benchmark_quad(xml, make_float3(-50, -0.5f, -50), make_float3(-50, -0.5f, 50), make_float3(50, -0.5f, 50), make_float3(50, -0.5f, -50));
+	xml += "</state>\n";
+
+	for(int j = 0; j < grid; j++) {
+		for(int i = 0; i < grid; i++) {
+			float x = (i - 0.5f*(grid - 1))*1.1f;
+			float z = (j - 0.5f*(grid - 1))*1.1f;
+
+			xml += string_printf("<state shader=\"%s\" interpolation=\"smooth\">\n", ((i + j) & 1)? "glossy": "diffuse");
+			xml += string_printf("<transform translate=\"%.3f 0 %.3f\">\n", x, z);
+			benchmark_sphere(xml, 0.5f, 32, 16);
+			xml += "</transform>\n";
+			xml += "</state>\n";
+		}
+	}
+
+	xml += "<state shader=\"light\">\n";
+	xml += "<light P=\"4 10 -6\"/>\n";
+	xml += "</state>\n";
+
+	scene.name = "sphere_grid";
+	scene.samples = 32;
+}
+
+/* single dense mesh, stresses scene sync and BVH build of one large object */
+static void benchmark_heightfield(BenchmarkScene& scene)
+{
+	string& xml = scene.xml;
+
+	benchmark_camera(xml, 512, 288, make_float3(0.0f, 5.0f, -12.0f), 25.0f, 50.0f);
+	xml += "<integrator min_bounce=\"2\" max_bounce=\"4\"/>\n";
+
+	benchmark_shader_glossy(xml, "terrain", make_float3(0.6f, 0.55f, 0.5f), 0.4f);
+	benchmark_background(xml, make_float3(0.8f, 0.85f, 1.0f), 1.0f);
+
+	xml += "<state shader=\"terrain\" interpolation=\"smooth\">\n";
+	benchmark_heightfield_mesh(xml, 8.0f, 0.8f, 512);
+	xml += "</state>\n";
+
+	scene.name = "heightfield";
+	scene.samples = 32;
+}
+
+void benchmark_scenes(vector<BenchmarkScene>& scenes)
+{
+	scenes.clear();
+	scenes.resize(3);
+
+	benchmark_cornell_box(scenes[0]);
+	benchmark_sphere_grid(scenes[1]);
+	benchmark_heightfield(scenes[2]);
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __CYCLES_BENCHMARK__
+#define __CYCLES_BENCHMARK__
+
+#include "util_string.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Benchmark Scenes
+ *
+ * Fixed set of scenes for cycles_test --benchmark. They are generated as XML
+ * and read back through the regular XML reader, so the same code paths are
+ * measured as for scene files, without depending on files on disk. Scenes and
+ * sample counts must not change, or results can't be compared anymore. */
+
+struct BenchmarkScene {
+	string name;
+	string xml;
+	int samples;
+};
+
+void benchmark_scenes(vector<BenchmarkScene>& scenes);
+
+CCL_NAMESPACE_END
+
+#endif /* __CYCLES_BENCHMARK__ */
+
@@ -34,6 +34,7 @@ int main(int argc, const char **argv)
 	/* device types */
 	string devices = "";
 	string devicename = "cpu";
+	int port = 5120;
 
 	vector<DeviceType> types = Device::available_types();
 
@@ -49,6 +50,7 @@ int main(int argc, const char **argv)
 
 	ap.options ("Usage: cycles_server [options]",
 		"--device %s", &devicename, ("Devices to use: " + devices).c_str(),
+		"--port %d", &port, "Port to listen on, for multiple servers on the same host",
 		NULL);
 
 	if(ap.parse(argc, argv) < 0) {
@@ -62,7 +64,7 @@ int main(int argc, const char **argv)
 	while(1) {
 		Device *device = Device::create(dtype);
 		printf("Cycles Server with device: %s\n", device->description().c_str());
-		device->server_run();
+		device->server_run(port);
 		delete device;
 	}
 
@@ -21,18 +21,26 @@
 #include "buffers.h"
 #include "camera.h"
 #include "device.h"
+#include "film.h"
+#include "integrator.h"
+#include "mesh.h"
 #include "scene.h"
 #include "session.h"
+#include "shader.h"
 
 #include "util_args.h"
 #include "util_foreach.h"
 #include "util_function.h"
 #include "util_path.h"
+#include "util_perf_counters.h"
 #include "util_progress.h"
 #include "util_string.h"
+#include "util_system.h"
+#include "util_texture_cache.h"
 #include "util_time.h"
 #include "util_view.h"
 
+#include "cycles_benchmark.h"
 #include "cycles_xml.h"
 
 CCL_NAMESPACE_BEGIN
@@ -44,7 +52,10 @@ struct Options {
 	int width, height;
 	SceneParams scene_params;
 	SessionParams session_params;
+	string passes;
+	string output_passes_path;
 	bool quiet;
+	bool benchmark;
 } options;
 
 static void session_print(const string& str)
@@ -98,12 +109,113 @@ static void session_init()
 	options.scene = NULL;
 }
 
+static PassType pass_type_from_string(const string& name)
+{
+	if(string_iequals(name, "depth"))
+		return PASS_DEPTH;
+	else if(string_iequals(name, "normal"))
+		return PASS_NORMAL;
+	else if(string_iequals(name, "object_id"))
+		return PASS_OBJECT_ID;
+	else if(string_iequals(name, "direct"))
+		return PASS_DIRECT;
+	else if(string_iequals(name, "indirect"))
+		return PASS_INDIRECT;
+
+	return PASS_NONE;
+}
+
 static void scene_init()
 {
 	options.scene = new Scene(options.scene_params);
 	xml_read_file(options.scene, options.filepath.c_str());
 	options.width = options.scene->camera->width;
 	options.height = options.scene->camera->height;
+
+	/* passes */
+	vector<string> tokens;
+	string_split(tokens, options.passes, ", ");
+
+	foreach(string& token, tokens) {
+		PassType type = pass_type_from_string(token);
+
+		if(type == PASS_NONE) {
+			fprintf(stderr, "Unknown pass: %s\n", token.c_str());
+			exit(EXIT_FAILURE);
+		}
+
+		options.scene->film->passes.push_back(type);
+	}
+}
+
+static void session_print_texture_cache_stats()
+{
+	TextureCacheStats stats;
+
+	if(!options.session->scene->image_manager->get_texture_cache_stats(stats))
+		return;
+
+	session_print(string_printf("Texture cache: %llu hits, %llu misses, %llu evictions, %.2f MB used, %.2f MB peak",
+		(unsigned long long)stats.hits,
+		(unsigned long long)stats.misses,
+		(unsigned long long)stats.evictions,
+		stats.mem_used/(1024.0*1024.0),
+		stats.mem_peak/(1024.0*1024.0)));
+	printf("\n");
+}
+
+static void session_print_shader_stats()
+{
+	foreach(Shader *shader, options.session->scene->shaders) {
+		if(shader->num_svm_nodes_unoptimized == -1)
+			continue;
+
+		session_print(string_printf("Shader %s: %d SVM nodes, %d without optimization",
+			shader->name.c_str(), shader->num_svm_nodes, shader->num_svm_nodes_unoptimized));
+		printf("\n");
+	}
+}
+
+static void session_print_perf_counters()
+{
+	if(!options.session_params.perf_counters)
+		return;
+
+	vector<Shader*>& shaders = options.session->scene->shaders;
+	PerfCounters counters;
+
+	options.session->progress.get_perf_counters(counters);
+
+	session_print(string_printf("Rays %llu, BVH nodes %llu, triangle tests %llu",
+		(unsigned long long)counters.rays,
+		(unsigned long long)counters.bvh_nodes,
+		(unsigned long long)counters.triangle_tests));
+	printf("\n");
+
+	for(size_t i = 0; i < counters.shader_evals.size() && i < shaders.size(); i++) {
+		if(counters.shader_evals[i] == 0)
+			continue;
+
+		session_print(string_printf("Shader %s: %llu evaluations, %llu SVM nodes executed",
+			shaders[i]->name.c_str(),
+			(unsigned long long)counters.shader_evals[i],
+			(unsigned long long)counters.shader_svm_nodes[i]));
+		printf("\n");
+	}
+}
+
+static void session_write_passes()
+{
+	Session *session = options.session;
+	int sample;
+	double total_time, sample_time;
+
+	session->progress.get_sample(sample, total_time, sample_time);
+
+	if(!options.quiet)
+		session_print("Writing Passes " + options.output_passes_path);
+
+	session->buffers->write(options.output_passes_path, session->scene->film->exposure, sample);
 }
 
 static void session_exit()
@@ -123,6 +235,108 @@ static void session_exit()
 	}
 }
 
+/* Benchmark
+ *
+ * Render the fixed benchmark scenes in background mode and print timings as
+ * JSON to stdout. Camera rays per second is the number of pixel samples per
+ * second. With --perf-counters, rays per second counts all rays traced by the
+ * kernel, including bounces and shadows, which is comparable across scenes. */
+
+static void benchmark_run()
+{
+	vector<BenchmarkScene> scenes;
+	benchmark_scenes(scenes);
+
+	SessionParams session_params = options.session_params;
+	session_params.background = true;
+	session_params.output_path = "";
+
+	SceneParams scene_params = options.scene_params;
+	scene_params.shader_statistics = true;
+
+	printf("{\n");
+	printf("  \"device\": \"%s\",\n", Device::string_from_type(session_params.device_type).c_str());
+	printf("  \"cpu\": \"%s\",\n", system_cpu_brand_string().c_str());
+	printf("  \"threads\": %d,\n", (session_params.threads)? session_params.threads: system_cpu_thread_count());
+	printf("  \"scenes\": [\n");
+
+	for(size_t i = 0; i < scenes.size(); i++) {
+		BenchmarkScene& bscene = scenes[i];
+
+		/* load scene with fixed seed */
+		Scene *scene = new Scene(scene_params);
+		xml_read_buffer(scene, bscene.xml.c_str());
+		scene->integrator->seed = 0;
+		scene->integrator->tag_update(scene);
+
+		int width = scene->camera->width;
+		int height = scene->camera->height;
+		size_t num_triangles = 0;
+
+		foreach(Mesh *mesh, scene->meshes)
+			num_triangles += mesh->triangles.size();
+
+		/* render */
+		session_params.samples = bscene.samples;
+
+		Session *session = new Session(session_params);
+		session->reset(width, height, bscene.samples);
+		session->scene = scene;
+		session->start();
+		session->wait();
+
+		/* gather statistics */
+		int sample;
+		double total_time, sample_time;
+
+		session->progress.get_sample(sample, total_time, sample_time);
+
+		double sync_time = scene->update_time;
+		double bvh_time = scene->mesh_manager->bvh_time;
+		double render_time = max(total_time - sync_time, 1e-6);
+		double num_camera_rays = (double)width*(double)height*(double)bscene.samples;
+		bool cancelled = session->progress.get_cancel();
+		PerfCounters counters;
+
+		if(session_params.perf_counters)
+			session->progress.get_perf_counters(counters);
+		int num_svm_nodes = 0, num_svm_nodes_unoptimized = 0;
+
+		foreach(Shader *shader, scene->shaders) {
+			num_svm_nodes += max(shader->num_svm_nodes, 0);
+			num_svm_nodes_unoptimized += max(shader->num_svm_nodes_unoptimized, 0);
+		}
+
+		delete session;
+
+		printf("    {\n");
+		printf("      \"name\": \"%s\",\n", bscene.name.c_str());
+		printf("      \"width\": %d,\n", width);
+		printf("      \"height\": %d,\n", height);
+		printf("      \"samples\": %d,\n", bscene.samples);
+		printf("      \"triangles\": %lu,\n", (unsigned long)num_triangles);
+		printf("      \"completed\": %s,\n", (cancelled)? "false": "true");
+		printf("      \"scene_sync_time\": %.6f,\n", sync_time);
+		printf("      \"bvh_build_time\": %.6f,\n", bvh_time);
+		printf("      \"svm_nodes\": %d,\n", num_svm_nodes);
+		printf("      \"svm_nodes_unoptimized\": %d,\n", num_svm_nodes_unoptimized);
+		printf("      \"render_time\": %.6f,\n", render_time);
+		printf("      \"samples_per_sec\": %.3f,\n", bscene.samples/render_time);
+		printf("      \"camera_rays_per_sec\": %.1f,\n", num_camera_rays/render_time);
+		if(session_params.perf_counters) {
+			printf("      \"rays\": %llu,\n", (unsigned long long)counters.rays);
+			printf("      \"rays_per_sec\": %.1f,\n", (double)counters.rays/render_time);
+		}
+		printf("      \"peak_memory\": %lu\n", (unsigned long)system_memory_peak());
+		printf("    }%s\n", (i + 1 < scenes.size())? ",": "");
+		fflush(stdout);
+	}
+
+	printf("  ],\n");
+	printf("  \"peak_memory\": %lu\n", (unsigned long)system_memory_peak());
+	printf("}\n");
+}
+
 static void display_info(Progress& progress)
 {
 	static double latency = 0.0;
@@ -188,6 +402,7 @@ static void options_parse(int argc, const char **argv)
 	options.filepath = "";
 	options.session = NULL;
 	options.quiet = false;
+	options.benchmark = false;
 
 	/* devices */
 	string devices = "";
@@ -213,6 +428,8 @@ static void options_parse(int argc, const char **argv)
 	/* parse options */
 	ArgParse ap;
 	bool help = false;
+	int texture_cache_size = -1;
+	bool no_shader_optimization = false;
 
 	ap.options ("Usage: cycles_test [options] file.xml",
 		"%*", files_parse, "",
@@ -223,6 +440,15 @@ static void options_parse(int argc, const char **argv)
 		"--samples %d", &options.session_params.samples, "Number of samples to render",
 		"--output %s", &options.session_params.output_path, "File path to write output image",
 		"--threads %d", &options.session_params.threads, "CPU Rendering Threads",
+		"--full-sample-tiles", &options.session_params.tile_full_samples, "In background mode, render each tile to its full number of samples (CPU and multi device only)",
+		"--servers %s", &options.session_params.servers, "Comma separated host[:port] render servers for network and multi device, discovered if not set",
+		"--texture-cache %d", &texture_cache_size, "Load image textures on demand, with cache size in megabytes, unlimited if 0 (CPU only)",
+		"--passes %s", &options.passes, "Comma separated passes to render besides combined: depth, normal, object_id, direct, indirect",
+		"--output-passes %s", &options.output_passes_path, "In background mode, file path to write all passes to as multilayer EXR",
+		"--shader-stats", &options.scene_params.shader_statistics, "In background mode, print the number of SVM nodes per shader with and without optimization",
+		"--no-shader-optimization", &no_shader_optimization, "Compile shader graphs as authored, without constant folding and merging nodes",
+		"--perf-counters", &options.session_params.perf_counters, "In background mode, print rays, BVH nodes, triangle tests and shader evaluations counted by the kernel (CPU only)",
+		"--benchmark", &options.benchmark, "Render the built-in benchmark scenes at fixed samples and print statistics as JSON, no file needed",
 		"--help", &help, "Print help message",
 		NULL);
 	
@@ -231,13 +457,21 @@ static void options_parse(int argc, const char **argv)
 		ap.usage();
 		exit(EXIT_FAILURE);
 	}
-	else if(help || options.filepath == "") {
+	else if(help || (options.filepath == "" && !options.benchmark)) {
 		ap.usage();
 		exit(EXIT_SUCCESS);
 	}
 
 	options.session_params.device_type = Device::type_from_string(devicename.c_str());
 
+	if(texture_cache_size >= 0) {
+		options.scene_params.use_texture_cache = true;
+		options.scene_params.texture_cache_size = texture_cache_size;
+	}
+
+	if(no_shader_optimization)
+		options.scene_params.use_shader_optimization = false;
+
 	if(ssname == "osl")
 		options.scene_params.shadingsystem = SceneParams::OSL;
 	else if(ssname == "svm")
@@ -270,13 +504,14 @@ static void options_parse(int argc, const char **argv)
 		fprintf(stderr, "Invalid number of samples: %d\n", options.session_params.samples);
 		exit(EXIT_FAILURE);
 	}
-	else if(options.filepath == "") {
+	else if(options.filepath == "" && !options.benchmark) {
 		fprintf(stderr, "No file path specified\n");
 		exit(EXIT_FAILURE);
 	}
 
-	/* load scene */
-	scene_init();
+	/* load scene, benchmark loads its own scenes */
+	if(!options.benchmark)
+		scene_init();
 }
 
 CCL_NAMESPACE_END
@@ -289,9 +524,22 @@ int main(int argc, const char **argv)
 
 	options_parse(argc, argv);
 
-	if(options.session_params.background) {
+	if(options.benchmark) {
+		benchmark_run();
+	}
+	else if(options.session_params.background) {
 		session_init();
 		options.session->wait();
+
+		if(options.output_passes_path != "")
+			session_write_passes();
+
+		if(!options.quiet) {
+			session_print_texture_cache_stats();
+			session_print_shader_stats();
+			session_print_perf_counters();
+		}
+
 		session_exit();
 	}
 	else {
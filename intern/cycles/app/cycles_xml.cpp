@@ -17,6 +17,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include <sstream>
 #include <algorithm>
@@ -259,6 +260,9 @@ static void xml_read_integrator(const XMLReadState& state, pugi::xml_node node)
 	xml_read_int(&integrator->max_bounce, node, "max_bounce");
 	xml_read_bool(&integrator->no_caustics, node, "no_caustics");
 	xml_read_float(&integrator->blur_caustics, node, "blur_caustics");
+	xml_read_float(&integrator->adaptive_threshold, node, "adaptive_threshold");
+	xml_read_int(&integrator->adaptive_min_samples, node, "adaptive_min_samples");
+	xml_read_bool(&integrator->use_light_tree, node, "use_light_tree");
 }
 
 /* Camera */
@@ -906,21 +910,45 @@ static void xml_read_include(const XMLReadState& state, const string& src)
 
 /* File */
 
-void xml_read_file(Scene *scene, const char *filepath)
+static void xml_init_state(XMLReadState& state, Scene *scene, const string& base)
 {
-	XMLReadState state;
-
 	state.scene = scene;
 	state.tfm = transform_identity();
 	state.shader = scene->default_surface;
 	state.smooth = false;
 	state.dicing_rate = 0.1f;
-	state.base = path_dirname(filepath);
+	state.displacement_method = Mesh::DISPLACE_BUMP;
+	state.base = base;
+}
+
+void xml_read_file(Scene *scene, const char *filepath)
+{
+	XMLReadState state;
 
+	xml_init_state(state, scene, path_dirname(filepath));
 	xml_read_include(state, path_filename(filepath));
 
 	scene->params.bvh_type = SceneParams::BVH_STATIC;
 }
 
+/* Buffer */
+
+void xml_read_buffer(Scene *scene, const char *buffer, const char *base)
+{
+	XMLReadState state;
+	pugi::xml_document doc;
+	pugi::xml_parse_result parse_result;
+
+	xml_init_state(state, scene, base);
+	parse_result = doc.load_buffer(buffer, strlen(buffer));
+
+	if(parse_result)
+		xml_read_scene(state, doc);
+	else
+		fprintf(stderr, "XML buffer read error: %s\n", parse_result.description());
+
+	scene->params.bvh_type = SceneParams::BVH_STATIC;
+}
+
 CCL_NAMESPACE_END
 
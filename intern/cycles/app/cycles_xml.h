@@ -24,6 +24,7 @@ CCL_NAMESPACE_BEGIN
 class Scene;
 
 void xml_read_file(Scene *scene, const char *filepath);
+void xml_read_buffer(Scene *scene, const char *buffer, const char *base = "");
 
 CCL_NAMESPACE_END
 
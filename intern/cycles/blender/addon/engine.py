@@ -54,6 +54,13 @@ def free(engine):
         del engine.session
 
 
+def reset(engine, data, scene):
+    import bcycles
+    data = data.as_pointer()
+    scene = scene.as_pointer()
+    bcycles.reset(engine.session, data, scene)
+
+
 def render(engine):
     import bcycles
     if hasattr(engine, "session"):
@@ -78,6 +85,13 @@ def draw(engine, region, v3d, rv3d):
     bcycles.draw(engine.session, v3d, rv3d)
 
 
+def perf_counters(engine):
+    import bcycles
+    if hasattr(engine, "session") and engine.session:
+        return bcycles.perf_counters(engine.session)
+    return None
+
+
 def available_devices():
     import bcycles
     return bcycles.available_devices()
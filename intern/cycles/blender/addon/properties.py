@@ -51,6 +51,12 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             default=10, min=1, max=2147483647)
         cls.preview_samples = IntProperty(name="Preview Samples", description="Number of samples to render in the viewport, unlimited if 0",
             default=10, min=0, max=2147483647)
+        cls.adaptive_threshold = FloatProperty(name="Adaptive Threshold", description="Stop sampling pixels once their relative noise drops below this threshold, disabled if 0",
+            default=0.0, min=0.0, max=1.0)
+        cls.adaptive_min_samples = IntProperty(name="Adaptive Min Samples", description="Minimum number of samples for each pixel before adaptive sampling can stop it",
+            default=16, min=2, max=2147483647)
+        cls.use_light_tree = BoolProperty(name="Light Tree", description="Sample lights by their estimated contribution at each shading point, reduces noise in scenes with many lights",
+            default=True)
         cls.preview_pause = BoolProperty(name="Pause Preview", description="Pause all viewport preview renders",
             default=False)
 
@@ -95,6 +101,8 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             default=1024, min=1, max=4096)
         cls.debug_min_size = IntProperty(name="Min Size", description="",
             default=64, min=1, max=4096)
+        cls.debug_use_full_sample_tiles = BoolProperty(name="Full Sample Tiles", description="In final CPU renders, render each tile to its full number of samples before moving on to the next",
+            default=False)
         cls.debug_reset_timeout = FloatProperty(name="Reset timeout", description="",
             default=0.1, min=0.01, max=10.0)
         cls.debug_cancel_timeout = FloatProperty(name="Cancel timeout", description="",
@@ -106,6 +114,16 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
             items=enums.bvh_types, default="DYNAMIC_BVH")
         cls.debug_use_spatial_splits = BoolProperty(name="Use Spatial Splits", description="Use BVH spatial splits: longer builder time, faster render",
             default=False)
+        cls.debug_use_compact_storage = BoolProperty(name="Use Compact Storage", description="Store mesh normals and UVs at reduced precision, to fit bigger scenes in memory",
+            default=False)
+
+        cls.debug_use_texture_cache = BoolProperty(name="Use Texture Cache", description="Load image textures on demand while rendering, in tiles and mip levels (CPU only)",
+            default=False)
+        cls.debug_texture_cache_size = IntProperty(name="Cache Size", description="Maximum memory in megabytes used by the texture cache, unlimited if 0",
+            default=1024, min=0, max=1048576)
+
+        cls.debug_use_perf_counters = BoolProperty(name="Performance Counters", description="Count rays, BVH nodes, triangle tests and shader evaluations while rendering (CPU only)",
+            default=False)
 
     @classmethod
     def unregister(cls):
@@ -68,6 +68,11 @@ class CyclesRender_PT_integrator(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "preview_samples", text="Preview")
         sub.prop(cscene, "seed")
 
+        sub = col.column(align=True)
+        sub.label(text="Adaptive:")
+        sub.prop(cscene, "adaptive_threshold", text="Threshold")
+        sub.prop(cscene, "adaptive_min_samples", text="Min Samples")
+
         sub = col.column(align=True)
         sub.label("Transparency:")
         sub.prop(cscene, "transparent_max_bounces", text="Max")
@@ -87,6 +92,7 @@ class CyclesRender_PT_integrator(CyclesButtonsPanel, Panel):
         sub.prop(cscene, "glossy_bounces", text="Glossy")
         sub.prop(cscene, "transmission_bounces", text="Transmission")
         sub.prop(cscene, "no_caustics")
+        sub.prop(cscene, "use_light_tree")
 
         #row = col.row()
         #row.prop(cscene, "blur_caustics")
@@ -140,6 +146,11 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.label(text="Tiles:")
         sub.prop(cscene, "debug_tile_size")
         sub.prop(cscene, "debug_min_size")
+        sub.prop(cscene, "debug_use_full_sample_tiles")
+
+        sub = col.column(align=True)
+        sub.label(text="Final Render:")
+        sub.prop(rd, "use_persistent_data", text="Persistent Data")
 
         col = split.column()
 
@@ -147,6 +158,16 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.label(text="Acceleration structure:")
         sub.prop(cscene, "debug_bvh_type", text="")
         sub.prop(cscene, "debug_use_spatial_splits")
+        sub.prop(cscene, "debug_use_compact_storage")
+
+        sub = col.column(align=True)
+        sub.label(text="Textures:")
+        sub.prop(cscene, "debug_use_texture_cache")
+        sub.prop(cscene, "debug_texture_cache_size")
+
+        sub = col.column(align=True)
+        sub.label(text="Profiling:")
+        sub.prop(cscene, "debug_use_perf_counters")
 
 
 class CyclesRender_PT_layers(CyclesButtonsPanel, Panel):
@@ -183,7 +183,7 @@ static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<
 	}
 }
 
-static void create_subd_mesh(Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders)
+static void create_subd_mesh(Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders, SubdDiceCache *cache)
 {
 	/* create subd mesh */
 	SubdMesh sdmesh;
@@ -216,7 +216,68 @@ static void create_subd_mesh(Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, con
 	dsplit.camera = NULL;
 	dsplit.dicing_rate = RNA_float_get(cmesh, "dicing_rate");
 
-	sdmesh.tesselate(&dsplit, false, mesh, used_shaders[0], true);
+	sdmesh.tesselate(&dsplit, false, mesh, used_shaders[0], true, cache);
+}
+
+/* Compare */
+
+static bool mesh_equals(Scene *scene, Mesh *mesh, Mesh *new_mesh)
+{
+	/* transform applied modifies the mesh in place */
+	if(mesh->transform_applied || mesh->displacement_method != new_mesh->displacement_method)
+		return false;
+
+	if(mesh->used_shaders != new_mesh->used_shaders ||
+	   mesh->shader != new_mesh->shader ||
+	   mesh->smooth != new_mesh->smooth)
+		return false;
+
+	if(mesh->verts.size() != new_mesh->verts.size() ||
+	   mesh->triangles.size() != new_mesh->triangles.size())
+		return false;
+
+	/* displacement modifies the mesh in place too, but keeps the original
+	   positions around so we can still compare. it also depends on the
+	   shaders, which may have changed without the mesh changing */
+	float3 *verts = (mesh->verts.size())? &mesh->verts[0]: NULL;
+	bool displaced = false;
+
+	if(new_mesh->displacement_method != Mesh::DISPLACE_BUMP) {
+		Attribute *attr = mesh->attributes.find(Attribute::STD_POSITION_UNDISPLACED);
+
+		if(attr) {
+			foreach(uint shader, mesh->used_shaders)
+				if(scene->shaders[shader]->need_update)
+					return false;
+
+			verts = attr->data_float3();
+			displaced = true;
+		}
+	}
+
+	if(mesh->verts.size() &&
+	   memcmp(verts, &new_mesh->verts[0], sizeof(float3)*mesh->verts.size()) != 0)
+		return false;
+
+	if(mesh->triangles.size() &&
+	   memcmp(&mesh->triangles[0], &new_mesh->triangles[0], sizeof(Mesh::Triangle)*mesh->triangles.size()) != 0)
+		return false;
+
+	/* the existing mesh can have more attributes, like normals computed by the
+	   mesh manager, only the ones from blender need to match */
+	foreach(Attribute& attr, new_mesh->attributes.attributes) {
+		/* recomputed after true displacement */
+		if(displaced && attr.std == Attribute::STD_VERTEX_NORMAL && mesh->displacement_method == Mesh::DISPLACE_TRUE)
+			continue;
+
+		Attribute *mattr = (attr.std == Attribute::STD_NONE)?
+			mesh->attributes.find(attr.name): mesh->attributes.find(attr.std);
+
+		if(!mattr || mattr->type != attr.type || mattr->element != attr.element || mattr->buffer != attr.buffer)
+			return false;
+	}
+
+	return true;
 }
 
 /* Sync */
@@ -270,21 +331,31 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated)
 	
 	mesh_synced.insert(mesh);
 
-	/* create derived mesh */
+	/* create derived mesh. this is done in a separate mesh first, so that if
+	   it turns out nothing changed, the existing normals, device data and BVH
+	   can be kept. this happens for modified objects on frame changes of an
+	   animation render with persistent data, or when only the object changed */
 	BL::Mesh b_mesh = object_to_mesh(b_ob, b_scene, true, !preview);
 	PointerRNA cmesh = RNA_pointer_get(&b_ob_data.ptr, "cycles");
+	Mesh new_mesh;
 
-	vector<Mesh::Triangle> oldtriangle = mesh->triangles;
-
-	mesh->clear();
-	mesh->used_shaders = used_shaders;
-	mesh->name = ustring(b_ob_data.name().c_str());
+	new_mesh.used_shaders = used_shaders;
 
 	if(b_mesh) {
-		if(cmesh.data && experimental && RNA_boolean_get(&cmesh, "use_subdivision"))
-			create_subd_mesh(mesh, b_mesh, &cmesh, used_shaders);
+		if(cmesh.data && experimental && RNA_boolean_get(&cmesh, "use_subdivision")) {
+			/* diced patches are cached per synced mesh, so unchanged patches
+			   are not diced again on the next frame. only when the scene is
+			   synced again, a still render would just keep a second copy */
+			if(preview || scene->params.persistent_data) {
+				subd_cache.begin(mesh);
+				create_subd_mesh(&new_mesh, b_mesh, &cmesh, used_shaders, &subd_cache);
+				subd_cache.end();
+			}
+			else
+				create_subd_mesh(&new_mesh, b_mesh, &cmesh, used_shaders, NULL);
+		}
 		else
-			create_mesh(scene, mesh, b_mesh, used_shaders);
+			create_mesh(scene, &new_mesh, b_mesh, used_shaders);
 
 		/* free derived mesh */
 		object_remove_mesh(b_data, b_mesh);
@@ -295,23 +366,36 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated)
 		int method = RNA_enum_get(&cmesh, "displacement_method");
 
 		if(method == 0 || !experimental)
-			mesh->displacement_method = Mesh::DISPLACE_BUMP;
+			new_mesh.displacement_method = Mesh::DISPLACE_BUMP;
 		else if(method == 1)
-			mesh->displacement_method = Mesh::DISPLACE_TRUE;
+			new_mesh.displacement_method = Mesh::DISPLACE_TRUE;
 		else
-			mesh->displacement_method = Mesh::DISPLACE_BOTH;
+			new_mesh.displacement_method = Mesh::DISPLACE_BOTH;
 	}
 
+	if(!mesh->need_update && mesh_equals(scene, mesh, &new_mesh))
+		return mesh;
+
 	/* tag update */
 	bool rebuild = false;
 
-	if(oldtriangle.size() != mesh->triangles.size())
+	if(mesh->triangles.size() != new_mesh.triangles.size())
 		rebuild = true;
-	else if(oldtriangle.size()) {
-		if(memcmp(&oldtriangle[0], &mesh->triangles[0], sizeof(Mesh::Triangle)*oldtriangle.size()) != 0)
+	else if(mesh->triangles.size()) {
+		if(memcmp(&mesh->triangles[0], &new_mesh.triangles[0], sizeof(Mesh::Triangle)*mesh->triangles.size()) != 0)
 			rebuild = true;
 	}
-	
+
+	mesh->clear();
+	mesh->name = ustring(b_ob_data.name().c_str());
+	mesh->used_shaders = used_shaders;
+	mesh->displacement_method = new_mesh.displacement_method;
+	mesh->verts.swap(new_mesh.verts);
+	mesh->triangles.swap(new_mesh.triangles);
+	mesh->shader.swap(new_mesh.shader);
+	mesh->smooth.swap(new_mesh.smooth);
+	mesh->attributes.attributes.swap(new_mesh.attributes.attributes);
+
 	mesh->tag_update(scene, rebuild);
 
 	return mesh;
@@ -173,6 +173,17 @@ void BlenderSync::sync_object(BL::Object b_parent, int b_index, BL::Object b_ob,
 
 	if(object_map.sync(&object, b_ob, b_parent, key))
 		object_updated = true;
+
+	visibility &= object_ray_visibility(b_ob);
+	if(b_parent.ptr.data != b_ob.ptr.data)
+		visibility &= object_ray_visibility(b_parent);
+
+	/* animated objects are not tagged for recalc on frame changes of an
+	   animation render with persistent data, so compare transform too. this
+	   can't be done once the transform was applied to the mesh */
+	if(!(object->mesh && object->mesh->transform_applied))
+		if(object->tfm != tfm || object->visibility != visibility)
+			object_updated = true;
 	
 	/* mesh sync */
 	object->mesh = sync_mesh(b_ob, object_updated);
@@ -181,10 +192,7 @@ void BlenderSync::sync_object(BL::Object b_parent, int b_index, BL::Object b_ob,
 	if(object_updated || (object->mesh && object->mesh->need_update)) {
 		object->name = b_ob.name().c_str();
 		object->tfm = tfm;
-		
-		object->visibility = object_ray_visibility(b_ob) & visibility;
-		if(b_parent.ptr.data != b_ob.ptr.data)
-			object->visibility &= object_ray_visibility(b_parent);
+		object->visibility = visibility;
 
 		object->tag_update(scene);
 	}
@@ -256,6 +264,10 @@ void BlenderSync::sync_objects(BL::SpaceView3D b_v3d)
 		scene->mesh_manager->tag_update(scene);
 	if(object_map.post_sync())
 		scene->object_manager->tag_update(scene);
+	if(preview || scene->params.persistent_data)
+		subd_cache.free_unused(scene->meshes);
+	else
+		subd_cache.clear();
 	mesh_synced.clear();
 }
 
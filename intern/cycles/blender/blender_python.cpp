@@ -21,8 +21,11 @@
 #include "blender_sync.h"
 #include "blender_session.h"
 
+#include "shader.h"
+
 #include "util_opengl.h"
 #include "util_path.h"
+#include "util_perf_counters.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -102,6 +105,29 @@ static PyObject *free_func(PyObject *self, PyObject *args)
 	return Py_None;
 }
 
+static PyObject *reset_func(PyObject *self, PyObject *args)
+{
+	PyObject *pysession, *pydata, *pyscene;
+
+	if(!PyArg_ParseTuple(args, "OOO", &pysession, &pydata, &pyscene))
+		return NULL;
+
+	BlenderSession *session = (BlenderSession*)PyLong_AsVoidPtr(pysession);
+
+	PointerRNA dataptr;
+	RNA_id_pointer_create((ID*)PyLong_AsVoidPtr(pydata), &dataptr);
+	BL::BlendData data(dataptr);
+
+	PointerRNA sceneptr;
+	RNA_id_pointer_create((ID*)PyLong_AsVoidPtr(pyscene), &sceneptr);
+	BL::Scene scene(sceneptr);
+
+	session->reset_session(data, scene);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 static PyObject *render_func(PyObject *self, PyObject *args)
 {
 	PyObject *pysession;
@@ -155,6 +181,55 @@ static PyObject *sync_func(PyObject *self, PyObject *args)
 	return Py_None;
 }
 
+static void perf_counters_dict_set(PyObject *dict, const char *key, uint64_t value)
+{
+	PyObject *item = PyLong_FromUnsignedLongLong(value);
+	PyDict_SetItemString(dict, key, item);
+	Py_DECREF(item);
+}
+
+static PyObject *perf_counters_func(PyObject *self, PyObject *args)
+{
+	PyObject *pysession;
+
+	if(!PyArg_ParseTuple(args, "O", &pysession))
+		return NULL;
+
+	BlenderSession *session = (BlenderSession*)PyLong_AsVoidPtr(pysession);
+	PerfCounters counters;
+
+	session->session->progress.get_perf_counters(counters);
+
+	PyObject *ret = PyDict_New();
+
+	perf_counters_dict_set(ret, "rays", counters.rays);
+	perf_counters_dict_set(ret, "bvh_nodes", counters.bvh_nodes);
+	perf_counters_dict_set(ret, "triangle_tests", counters.triangle_tests);
+
+	/* per shader statistics, in the order of the shaders in the scene */
+	vector<Shader*>& shaders = session->scene->shaders;
+	PyObject *pyshaders = PyList_New(0);
+
+	for(size_t i = 0; i < counters.shader_evals.size() && i < shaders.size(); i++) {
+		PyObject *pyshader = PyDict_New();
+		PyObject *name = PyUnicode_FromString(shaders[i]->name.c_str());
+
+		PyDict_SetItemString(pyshader, "name", name);
+		Py_DECREF(name);
+
+		perf_counters_dict_set(pyshader, "evaluations", counters.shader_evals[i]);
+		perf_counters_dict_set(pyshader, "svm_nodes", counters.shader_svm_nodes[i]);
+
+		PyList_Append(pyshaders, pyshader);
+		Py_DECREF(pyshader);
+	}
+
+	PyDict_SetItemString(ret, "shaders", pyshaders);
+	Py_DECREF(pyshaders);
+
+	return ret;
+}
+
 static PyObject *available_devices_func(PyObject *self, PyObject *args)
 {
 	vector<DeviceType> types = Device::available_types();
@@ -184,9 +259,11 @@ static PyMethodDef methods[] = {
 	{"init", init_func, METH_VARARGS, ""},
 	{"create", create_func, METH_VARARGS, ""},
 	{"free", free_func, METH_VARARGS, ""},
+	{"reset", reset_func, METH_VARARGS, ""},
 	{"render", render_func, METH_VARARGS, ""},
 	{"draw", draw_func, METH_VARARGS, ""},
 	{"sync", sync_func, METH_VARARGS, ""},
+	{"perf_counters", perf_counters_func, METH_VARARGS, ""},
 	{"available_devices", available_devices_func, METH_NOARGS, ""},
 	{"with_osl", with_osl_func, METH_NOARGS, ""},
 	{NULL, NULL, 0, NULL},
@@ -110,6 +110,41 @@ void BlenderSession::free_session()
 	delete session;
 }
 
+void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
+{
+	/* next frame of an animation render with persistent data. the previous
+	   frame is done, so the session thread is not running */
+	SceneParams scene_params = BlenderSync::get_scene_params(b_scene_, background);
+	SessionParams session_params = BlenderSync::get_session_params(b_scene_, background);
+	BL::RenderSettings r = b_scene_.render();
+
+	width = (int)(r.resolution_x()*r.resolution_percentage()*0.01f);
+	height = (int)(r.resolution_y()*r.resolution_percentage()*0.01f);
+
+	if(b_data.ptr.data != b_data_.ptr.data || b_scene.ptr.data != b_scene_.ptr.data ||
+	   !scene_params.persistent_data ||
+	   session->params.modified(session_params) ||
+	   scene->params.modified(scene_params)) {
+		/* can't reuse the existing data, create new session */
+		b_data = b_data_;
+		b_scene = b_scene_;
+
+		free_session();
+		create_session();
+		return;
+	}
+
+	/* sync only what changed since the previous frame */
+	sync->sync_recalc();
+	sync->sync_frame_recalc();
+	sync->sync_data(b_v3d);
+	sync->sync_camera(width, height);
+
+	/* start rendering */
+	session->reset(width, height, session_params.samples);
+	session->start();
+}
+
 void BlenderSession::render()
 {
 	session->wait();
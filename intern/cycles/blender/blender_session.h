@@ -41,6 +41,7 @@ public:
 	/* session */
 	void create_session();
 	void free_session();
+	void reset_session(BL::BlendData b_data, BL::Scene b_scene);
 
 	/* offline render */
 	void render();
@@ -120,6 +120,44 @@ bool BlenderSync::sync_recalc()
 	return recalc;
 }
 
+void BlenderSync::sync_frame_recalc()
+{
+	/* on frame changes of an animation render with persistent data, the
+	   depsgraph does not tag animated data for recalc. we tag everything
+	   that may be animated, mesh sync then only updates meshes that actually
+	   changed and object sync compares transforms */
+	BL::BlendData::materials_iterator b_mat;
+
+	for(b_data.materials.begin(b_mat); b_mat != b_data.materials.end(); ++b_mat)
+		if(id_is_animated(*b_mat, b_mat->node_tree()))
+			shader_map.set_recalc(*b_mat);
+
+	BL::BlendData::lamps_iterator b_lamp;
+
+	for(b_data.lamps.begin(b_lamp); b_lamp != b_data.lamps.end(); ++b_lamp)
+		if(id_is_animated(*b_lamp, b_lamp->node_tree()))
+			shader_map.set_recalc(*b_lamp);
+
+	BL::BlendData::objects_iterator b_ob;
+
+	for(b_data.objects.begin(b_ob); b_ob != b_data.objects.end(); ++b_ob) {
+		if(object_is_mesh(*b_ob)) {
+			/* modifiers and shape keys can change the mesh every frame */
+			if(object_is_modified(*b_ob))
+				mesh_map.set_recalc(*b_ob);
+		}
+		else if(object_is_light(*b_ob)) {
+			object_map.set_recalc(*b_ob);
+			light_map.set_recalc(*b_ob);
+		}
+	}
+
+	BL::World b_world = b_scene.world();
+
+	if(b_world && id_is_animated(b_world, b_world.node_tree()))
+		world_recalc = true;
+}
+
 void BlenderSync::sync_data(BL::SpaceView3D b_v3d)
 {
 	sync_integrator();
@@ -156,6 +194,11 @@ void BlenderSync::sync_integrator()
 
 	integrator->seed = get_int(cscene, "seed");
 
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
+
+	integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+
 	if(integrator->modified(previntegrator))
 		integrator->tag_update(scene);
 }
@@ -230,6 +273,12 @@ SceneParams BlenderSync::get_scene_params(BL::Scene b_scene, bool background)
 		params.bvh_type = (SceneParams::BVHType)RNA_enum_get(&cscene, "debug_bvh_type");
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
+	params.use_compact_storage = RNA_boolean_get(&cscene, "debug_use_compact_storage");
+
+	params.use_texture_cache = RNA_boolean_get(&cscene, "debug_use_texture_cache");
+	params.texture_cache_size = RNA_int_get(&cscene, "debug_texture_cache_size");
+
+	params.persistent_data = background && b_scene.render().use_persistent_data();
 
 	return params;
 }
@@ -299,14 +348,20 @@ SessionParams BlenderSync::get_session_params(BL::Scene b_scene, bool background
 	params.cancel_timeout = get_float(cscene, "debug_cancel_timeout");
 	params.reset_timeout = get_float(cscene, "debug_reset_timeout");
 	params.text_timeout = get_float(cscene, "debug_text_timeout");
+	params.perf_counters = get_boolean(cscene, "debug_use_perf_counters");
 
 	if(background) {
 		params.progressive = true;
+		params.tile_full_samples = get_boolean(cscene, "debug_use_full_sample_tiles");
 		params.min_size = INT_MAX;
 	}
-	else
+	else {
 		params.progressive = true;
 
+		/* keep rendering the viewport while scene changes are prepared */
+		params.async_scene_update = true;
+	}
+
 	return params;
 }
 
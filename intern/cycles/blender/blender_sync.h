@@ -29,6 +29,8 @@
 #include "scene.h"
 #include "session.h"
 
+#include "subd_cache.h"
+
 #include "util_map.h"
 #include "util_set.h"
 #include "util_transform.h"
@@ -54,6 +56,7 @@ public:
 
 	/* sync */
 	bool sync_recalc();
+	void sync_frame_recalc();
 	void sync_data(BL::SpaceView3D b_v3d);
 	void sync_camera(int width, int height);
 	void sync_view(BL::SpaceView3D b_v3d, BL::RegionView3D b_rv3d, int width, int height);
@@ -95,6 +98,7 @@ private:
 	id_map<void*, Mesh> mesh_map;
 	id_map<ObjectKey, Light> light_map;
 	set<Mesh*> mesh_synced;
+	SubdDiceCache subd_cache;
 	void *world_map;
 	bool world_recalc;
 
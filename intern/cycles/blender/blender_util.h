@@ -85,6 +85,12 @@ static inline bool object_is_modified(BL::Object self, BL::Scene scene, bool pre
 
 /* Utilities */
 
+template<typename T> static inline bool id_is_animated(T b_id, BL::NodeTree b_ntree)
+{
+	/* data may change over time if it or its node tree has animation data */
+	return b_id.animation_data() || (b_ntree && b_ntree.animation_data());
+}
+
 static inline Transform get_transform(BL::Array<float, 16> array)
 {
 	Transform tfm;
@@ -81,6 +81,8 @@ bool BVH::cache_read(CacheData& key)
 
 	if(Cache::global.lookup(key, value)) {
 		value.read(pack.root_index);
+		value.read(pack.num_prims);
+		value.read(pack.num_nodes);
 
 		value.read(pack.nodes);
 		value.read(pack.object_node);
@@ -90,6 +92,8 @@ bool BVH::cache_read(CacheData& key)
 		value.read(pack.prim_object);
 		value.read(pack.is_leaf);
 
+		pack.SAH = compute_SAH();
+
 		return true;
 	}
 
@@ -101,6 +105,8 @@ void BVH::cache_write(CacheData& key)
 	CacheData value;
 
 	value.add(pack.root_index);
+	value.add(pack.num_prims);
+	value.add(pack.num_nodes);
 
 	value.add(pack.nodes);
 	value.add(pack.object_node);
@@ -144,15 +150,7 @@ void BVH::build(Progress& progress)
 	/* todo: get rid of this copy */
 	pack.prim_index = prim_index;
 	pack.prim_object = prim_object;
-
-	/* compute SAH */
-	if(!params.top_level)
-		pack.SAH = root->computeSubtreeSAHCost(params);
-
-	if(progress.get_cancel()) {
-		root->deleteSubtree();
-		return;
-	}
+	pack.num_prims = prim_index.size();
 
 	/* pack triangles */
 	progress.set_substatus("Packing BVH triangles");
@@ -173,6 +171,9 @@ void BVH::build(Progress& progress)
 
 	if(progress.get_cancel()) return;
 
+	/* compute SAH of packed nodes, for comparing against after refitting */
+	pack.SAH = compute_SAH();
+
 	/* cache write */
 	if(params.use_cache) {
 		progress.set_substatus("Writing BVH cache");
@@ -182,25 +183,94 @@ void BVH::build(Progress& progress)
 
 /* Refitting */
 
-void BVH::refit(Progress& progress)
+bool BVH::refit(Progress& progress)
 {
+	/* the node topology is kept, only triangles and bounds are updated, which
+	   is much faster than rebuilding for meshes that only deformed. returns
+	   false if the tree got too inefficient, and must be rebuilt. */
 	progress.set_substatus("Packing BVH triangles");
-	pack_triangles();
+	refit_triangles();
 
-	if(progress.get_cancel()) return;
+	if(progress.get_cancel()) return true;
 
 	progress.set_substatus("Refitting BVH nodes");
 	refit_nodes();
+
+	if(progress.get_cancel()) return true;
+
+	/* copy refitted instance BVH's into top level BVH */
+	if(params.top_level) {
+		progress.set_substatus("Merging instance BVH's");
+		merge_instances();
+	}
+
+	/* compare quality against the tree as it was built */
+	float SAH = compute_SAH();
+
+	return !(pack.SAH > 0.0f && SAH > pack.SAH*params.max_refit_SAH_ratio);
+}
+
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	/* object instance leaf nodes store the negated primitive index */
+	if(start < 0) {
+		start = ~start;
+		end = start + 1;
+	}
+
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* object instance */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* triangles */
+			const Mesh *mesh = ob->mesh;
+			int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+			const int *vidx = mesh->triangles[pidx - tri_offset].v;
+			const float3 *vpos = &mesh->verts[0];
+
+			bbox.grow(vpos[vidx[0]]);
+			bbox.grow(vpos[vidx[1]]);
+			bbox.grow(vpos[vidx[2]]);
+		}
+
+		visibility |= ob->visibility;
+	}
+}
+
+void BVH::refit_triangles()
+{
+	/* instance BVH triangles are merged in afterwards */
+	for(size_t i = 0; i < pack.num_prims; i++) {
+		int tidx = pack.prim_index[i];
+
+		if(tidx != -1) {
+			Object *ob = objects[pack.prim_object[i]];
+			const Mesh *mesh = ob->mesh;
+			float4 woop[3];
+
+			/* top level BVH primitive index is into the global triangle array */
+			if(params.top_level)
+				tidx -= mesh->tri_offset;
+
+			pack_triangle(mesh, tidx, woop);
+			memcpy(&pack.tri_woop[i * TRI_NODE_SIZE], woop, sizeof(float4)*3);
+
+			pack.prim_visibility[i] = ob->visibility;
+		}
+	}
 }
 
 /* Triangles */
 
-void BVH::pack_triangle(int idx, float4 woop[3])
+void BVH::pack_triangle(const Mesh *mesh, int tidx, float4 woop[3])
 {
 	/* create Woop triangle */
-	int tob = pack.prim_object[idx];
-	const Mesh *mesh = objects[tob]->mesh;
-	int tidx = pack.prim_index[idx];
 	const int *vidx = mesh->triangles[tidx].v;
 	const float3* vpos = &mesh->verts[0];
 	float3 v0 = vpos[vidx[0]];
@@ -245,12 +315,12 @@ void BVH::pack_triangles()
 	for(unsigned int i = 0; i < tidx_size; i++) {
 		if(pack.prim_index[i] != -1) {
 			float4 woop[3];
+			int tob = pack.prim_object[i];
+			Object *ob = objects[tob];
 
-			pack_triangle(i, woop);
+			pack_triangle(ob->mesh, pack.prim_index[i], woop);
 			memcpy(&pack.tri_woop[i * nsize], woop, sizeof(float4)*3);
 
-			int tob = pack.prim_object[i];
-			Object *ob = objects[tob];
 			pack.prim_visibility[i] = ob->visibility;
 		}
 	}
@@ -272,22 +342,10 @@ void BVH::pack_instances(size_t nodes_size)
 		if(pack.prim_index[i] != -1)
 			pack.prim_index[i] += objects[pack.prim_object[i]]->mesh->tri_offset;
 
-	/* track offsets of instanced BVH data in global array */
-	size_t tri_offset = pack.prim_index.size();
-	size_t nodes_offset = nodes_size;
-
-	/* clear array that gives the node indexes for instanced objects */
-	pack.object_node.clear();
-
 	/* reserve */
 	size_t prim_index_size = pack.prim_index.size();
 	size_t tri_woop_size = pack.tri_woop.size();
 
-	size_t pack_prim_index_offset = prim_index_size;
-	size_t pack_tri_woop_offset = tri_woop_size;
-	size_t pack_nodes_offset = nodes_size;
-	size_t object_offset = 0;
-
 	map<Mesh*, int> mesh_map;
 
 	foreach(Object *ob, objects) {
@@ -298,7 +356,7 @@ void BVH::pack_instances(size_t nodes_size)
 			if(mesh_map.find(mesh) == mesh_map.end()) {
 				prim_index_size += bvh->pack.prim_index.size();
 				tri_woop_size += bvh->pack.tri_woop.size();
-				nodes_size += bvh->pack.nodes.size()*nsize;
+				nodes_size += bvh->pack.nodes.size();
 
 				mesh_map[mesh] = 1;
 			}
@@ -314,6 +372,28 @@ void BVH::pack_instances(size_t nodes_size)
 	pack.nodes.resize(nodes_size);
 	pack.object_node.resize(objects.size());
 
+	merge_instances();
+}
+
+void BVH::merge_instances()
+{
+	/* Copy instance BVH data into the arrays allocated by pack_instances(),
+	   after the primitives and nodes of the top level BVH itself. This is
+	   done again after refitting, as instance BVH's keep the same size then. */
+	bool use_qbvh = params.use_qbvh;
+	size_t nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+
+	/* track offsets of instanced BVH data in global array */
+	size_t tri_offset = pack.num_prims;
+	size_t nodes_offset = pack.num_nodes*nsize;
+
+	size_t pack_prim_index_offset = pack.num_prims;
+	size_t pack_tri_woop_offset = pack.num_prims*TRI_NODE_SIZE;
+	size_t pack_nodes_offset = pack.num_nodes*nsize;
+	size_t object_offset = 0;
+
+	map<Mesh*, int> mesh_map;
+
 	int *pack_prim_index = (pack.prim_index.size())? &pack.prim_index[0]: NULL;
 	int *pack_prim_object = (pack.prim_object.size())? &pack.prim_object[0]: NULL;
 	uint *pack_prim_visibility = (pack.prim_visibility.size())? &pack.prim_visibility[0]: NULL;
@@ -414,6 +494,9 @@ void BVH::pack_instances(size_t nodes_size)
 		nodes_offset += bvh->pack.nodes.size();
 		tri_offset += bvh->pack.prim_index.size();
 	}
+
+	assert(pack_prim_index_offset == pack.prim_index.size());
+	assert(pack_nodes_offset == pack.nodes.size());
 }
 
 /* Regular BVH */
@@ -459,6 +542,7 @@ void RegularBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 	pack.nodes.clear();
 	pack.is_leaf.clear();
 	pack.is_leaf.resize(node_size);
+	pack.num_nodes = node_size;
 
 	/* for top level BVH, first merge existing BVH's so we know the offsets */
 	if(params.top_level)
@@ -497,8 +581,6 @@ void RegularBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 
 void RegularBVH::refit_nodes()
 {
-	assert(!params.top_level);
-
 	BoundBox bbox;
 	uint visibility = 0;
 	refit_node(0, (pack.is_leaf[0])? true: false, bbox, visibility);
@@ -513,29 +595,7 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 
 	if(leaf) {
 		/* refit leaf node */
-		for(int tri = c0; tri < c1; tri++) {
-			int tidx = pack.prim_index[tri];
-			int tob = pack.prim_object[tri];
-			Object *ob = objects[tob];
-
-			if(tidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* triangles */
-				const Mesh *mesh = ob->mesh;
-				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-				const int *vidx = mesh->triangles[tidx - tri_offset].v;
-				const float3 *vpos = &mesh->verts[0];
-
-				bbox.grow(vpos[vidx[0]]);
-				bbox.grow(vpos[vidx[1]]);
-				bbox.grow(vpos[vidx[2]]);
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c0, c1, bbox, visibility);
 
 		pack_node(idx, bbox, bbox, c0, c1, visibility, visibility);
 	}
@@ -555,14 +615,59 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 	}
 }
 
+BoundBox RegularBVH::child_bounds(int idx, int child)
+{
+	int4 *data = &pack.nodes[idx*BVH_NODE_SIZE];
+	int4 bxy = data[child];
+
+	return BoundBox(
+		make_float3(__int_as_float(bxy.x), __int_as_float(bxy.z), __int_as_float(data[2][child*2])),
+		make_float3(__int_as_float(bxy.y), __int_as_float(bxy.w), __int_as_float(data[2][child*2+1])));
+}
+
+float RegularBVH::compute_SAH()
+{
+	/* SAH cost relative to the bounds of the root, from packed nodes */
+	if(pack.nodes.size() == 0)
+		return 0.0f;
+	if(pack.is_leaf[0])
+		return compute_node_SAH(0, true, 1.0f);
+
+	BoundBox bbox = child_bounds(0, 0);
+	bbox.grow(child_bounds(0, 1));
+
+	float area = bbox.area();
+
+	return (area > 0.0f)? compute_node_SAH(0, false, area)/area: 0.0f;
+}
+
+float RegularBVH::compute_node_SAH(int idx, bool leaf, float area)
+{
+	int4 *data = &pack.nodes[idx*BVH_NODE_SIZE];
+
+	int c0 = data[3].x;
+	int c1 = data[3].y;
+
+	if(leaf) {
+		/* object instance leaves contain a single primitive */
+		int num = (c0 < 0)? 1: c1 - c0;
+		return area*params.triangle_cost(num);
+	}
+
+	float SAH = area*params.node_cost(2);
+
+	SAH += compute_node_SAH((c0 < 0)? -c0-1: c0, (c0 < 0), child_bounds(idx, 0).area());
+	SAH += compute_node_SAH((c1 < 0)? -c1-1: c1, (c1 < 0), child_bounds(idx, 1).area());
+
+	return SAH;
+}
+
 /* QBVH */
 
 QBVH::QBVH(const BVHParams& params_, const vector<Object*>& objects_)
 : BVH(params_, objects_)
 {
 	params.use_qbvh = true;
-
-	/* todo: use visibility */
 }
 
 void QBVH::pack_leaf(const BVHStackEntry& e, const LeafNode *leaf)
@@ -601,7 +706,7 @@ void QBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num)
 		data[5][i] = bb_max.z;
 
 		data[6][i] = __int_as_float(en[i].encodeIdx());
-		data[7][i] = 0.0f;
+		data[7][i] = __uint_as_float(en[i].node->m_visibility);
 	}
 
 	for(int i = num; i < 4; i++) {
@@ -613,8 +718,9 @@ void QBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num)
 		data[4][i] = 0.0f;
 		data[5][i] = 0.0f;
 
+		/* empty child, the kernel never traverses it as no visibility is set */
 		data[6][i] = __int_as_float(0);
-		data[7][i] = 0.0f;
+		data[7][i] = __uint_as_float(0);
 	}
 
 	memcpy(&pack.nodes[e.idx * BVH_QNODE_SIZE], data, sizeof(float4)*BVH_QNODE_SIZE);
@@ -630,6 +736,7 @@ void QBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 	pack.nodes.clear();
 	pack.is_leaf.clear();
 	pack.is_leaf.resize(node_size);
+	pack.num_nodes = node_size;
 
 	/* for top level BVH, first merge existing BVH's so we know the offsets */
 	if(params.top_level)
@@ -694,7 +801,104 @@ void QBVH::pack_nodes(const array<int>& prims, const BVHNode *root)
 
 void QBVH::refit_nodes()
 {
-	assert(0); /* todo */
+	BoundBox bbox;
+	uint visibility = 0;
+	refit_node(0, (pack.is_leaf[0])? true: false, bbox, visibility);
+}
+
+void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+{
+	int4 *data = &pack.nodes[idx*BVH_QNODE_SIZE];
+
+	if(leaf) {
+		/* refit leaf node, bounds are stored in the parent */
+		refit_primitives(data[6].x, data[6].y, bbox, visibility);
+	}
+	else {
+		/* refit inner node, set bounds of all children */
+		for(int i = 0; i < 4; i++) {
+			int c = data[6][i];
+
+			/* empty child, root node is never a child */
+			if(c == 0)
+				continue;
+
+			BoundBox cbbox;
+			uint cvisibility = 0;
+
+			refit_node((c < 0)? -c-1: c, (c < 0), cbbox, cvisibility);
+
+			data[0][i] = __float_as_int(cbbox.min.x);
+			data[1][i] = __float_as_int(cbbox.max.x);
+			data[2][i] = __float_as_int(cbbox.min.y);
+			data[3][i] = __float_as_int(cbbox.max.y);
+			data[4][i] = __float_as_int(cbbox.min.z);
+			data[5][i] = __float_as_int(cbbox.max.z);
+			data[7][i] = cvisibility;
+
+			bbox.grow(cbbox);
+			visibility |= cvisibility;
+		}
+	}
+}
+
+BoundBox QBVH::child_bounds(int idx, int child)
+{
+	int4 *data = &pack.nodes[idx*BVH_QNODE_SIZE];
+
+	return BoundBox(
+		make_float3(__int_as_float(data[0][child]), __int_as_float(data[2][child]), __int_as_float(data[4][child])),
+		make_float3(__int_as_float(data[1][child]), __int_as_float(data[3][child]), __int_as_float(data[5][child])));
+}
+
+float QBVH::compute_SAH()
+{
+	/* SAH cost relative to the bounds of the root, from packed nodes */
+	if(pack.nodes.size() == 0)
+		return 0.0f;
+	if(pack.is_leaf[0])
+		return compute_node_SAH(0, true, 1.0f);
+
+	int4 *data = &pack.nodes[0];
+	BoundBox bbox;
+
+	for(int i = 0; i < 4; i++)
+		if(data[6][i] != 0)
+			bbox.grow(child_bounds(0, i));
+
+	float area = bbox.area();
+
+	return (area > 0.0f)? compute_node_SAH(0, false, area)/area: 0.0f;
+}
+
+float QBVH::compute_node_SAH(int idx, bool leaf, float area)
+{
+	int4 *data = &pack.nodes[idx*BVH_QNODE_SIZE];
+
+	if(leaf) {
+		/* object instance leaves contain a single primitive */
+		int c0 = data[6].x;
+		int c1 = data[6].y;
+		int num = (c0 < 0)? 1: c1 - c0;
+
+		return area*params.triangle_cost(num);
+	}
+
+	float SAH = 0.0f;
+	int num = 0;
+
+	for(int i = 0; i < 4; i++) {
+		int c = data[6][i];
+
+		/* empty child */
+		if(c == 0)
+			continue;
+
+		SAH += compute_node_SAH((c < 0)? -c-1: c, (c < 0), child_bounds(idx, i).area());
+		num++;
+	}
+
+	return SAH + area*params.node_cost(num);
 }
 
 CCL_NAMESPACE_END
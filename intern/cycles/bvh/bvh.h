@@ -31,6 +31,7 @@ class BVHParams;
 class BoundBox;
 class CacheData;
 class LeafNode;
+class Mesh;
 class Object;
 class Progress;
 
@@ -65,12 +66,20 @@ struct PackedBVH {
 	/* index of the root node. */
 	int root_index;
 
-	/* surface area heuristic, for building top level BVH */
+	/* number of primitives and nodes of the BVH itself, for the top level BVH
+	   the instance BVH's are merged in after these */
+	size_t num_prims;
+	size_t num_nodes;
+
+	/* surface area heuristic cost of the nodes as built, to detect when
+	   refitting degrades the tree too much */
 	float SAH;
 
 	PackedBVH()
 	{
 		root_index = 0;
+		num_prims = 0;
+		num_nodes = 0;
 		SAH = 0.0f;
 	}
 };
@@ -88,7 +97,7 @@ public:
 	virtual ~BVH() {}
 
 	void build(Progress& progress);
-	void refit(Progress& progress);
+	bool refit(Progress& progress);
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
@@ -97,16 +106,22 @@ protected:
 	bool cache_read(CacheData& key);
 	void cache_write(CacheData& key);
 
+	/* refit */
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
+	void refit_triangles();
+
 	/* triangles */
 	void pack_triangles();
-	void pack_triangle(int idx, float4 woop[3]);
+	void pack_triangle(const Mesh *mesh, int tidx, float4 woop[3]);
 
 	/* merge instance BVH's */
 	void pack_instances(size_t nodes_size);
+	void merge_instances();
 
 	/* for subclasses to implement */
 	virtual void pack_nodes(const array<int>& prims, const BVHNode *root) = 0;
 	virtual void refit_nodes() = 0;
+	virtual float compute_SAH() = 0;
 };
 
 /* Regular BVH
@@ -128,6 +143,11 @@ protected:
 	/* refit */
 	void refit_nodes();
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* SAH */
+	float compute_SAH();
+	float compute_node_SAH(int idx, bool leaf, float area);
+	BoundBox child_bounds(int idx, int child);
 };
 
 /* QBVH
@@ -147,6 +167,12 @@ protected:
 
 	/* refit */
 	void refit_nodes();
+	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* SAH */
+	float compute_SAH();
+	float compute_node_SAH(int idx, bool leaf, float area);
+	BoundBox child_bounds(int idx, int child);
 };
 
 CCL_NAMESPACE_END
@@ -44,6 +44,8 @@ BVHBuild::BVHBuild(const vector<Object*>& objects_,
   progress_start_time(0.0)
 {
 	spatial_min_overlap = 0.0f;
+	progress_count = 0;
+	progress_total = 0;
 	progress_num_duplicates = 0;
 }
 
@@ -117,6 +119,22 @@ void BVHBuild::add_references(NodeSpec& root)
 	root.num = references.size();
 }
 
+/* Build Task */
+
+class BVHBuildTask : public Task {
+public:
+	BVHBuildTask(BVHBuild *build, BVHNode **node, vector<BVHBuild::Reference>& refs_,
+		const BVHBuild::NodeSpec& spec, int level)
+	{
+		/* take ownership of references, caller's vector is left empty */
+		refs.swap(refs_);
+
+		run = function_bind(&BVHBuild::thread_build_node, build, node, &refs, spec, level);
+	}
+
+	vector<BVHBuild::Reference> refs;
+};
+
 /* Build */
 
 BVHNode* BVHBuild::run()
@@ -133,45 +151,90 @@ BVHNode* BVHBuild::run()
 		params.use_spatial_split = false;
 
 	spatial_min_overlap = root.bounds.area() * params.spatial_split_alpha;
-	spatial_right_bounds.clear();
-	spatial_right_bounds.resize(max(root.num, (int)BVHParams::NUM_SPATIAL_BINS) - 1);
 
 	/* init progress updates */
+	progress_count = 0;
+	progress_total = references.size();
 	progress_num_duplicates = 0;
 	progress_start_time = time_dt();
 
-	/* build recursively */
-	return build_node(root, 0, 0.0f, 1.0f);
+	/* build recursively, large subtrees are pushed as tasks into the pool,
+	   which we then help executing until the whole tree is built */
+	BVHNode *rootnode = NULL;
+
+	build_child(&rootnode, references, root, 0);
+	task_pool.wait_work();
+
+	if(progress.get_cancel()) {
+		if(rootnode) rootnode->deleteSubtree();
+		return NULL;
+	}
+
+	/* leafs were created in arbitrary order by the threads, reorder the
+	   primitives depth first so the result does not depend on scheduling */
+	vector<int> old_prim_index;
+	vector<int> old_prim_object;
+
+	old_prim_index.swap(prim_index);
+	old_prim_object.swap(prim_object);
+
+	prim_index.reserve(old_prim_index.size());
+	prim_object.reserve(old_prim_object.size());
+
+	finalize_node(rootnode, old_prim_index, old_prim_object);
+
+	return rootnode;
 }
 
-void BVHBuild::progress_update(float progress_start, float progress_end)
+void BVHBuild::progress_update(int num_done)
 {
+	thread_scoped_lock build_lock(build_mutex);
+
+	progress_count += num_done;
+
 	if(time_dt() - progress_start_time < 0.25f)
 		return;
 
-	float duplicates = (float)progress_num_duplicates/(float)references.size();
+	int total = max(progress_total, 1);
+	float duplicates = (float)progress_num_duplicates/(float)total;
+	float done = (float)progress_count/(float)(total + progress_num_duplicates);
 	string msg = string_printf("Building BVH %.0f%%, duplicates %.0f%%",
-		progress_start*100.0f, duplicates*100.0f);
+		done*100.0f, duplicates*100.0f);
 
 	progress.set_substatus(msg);
 	progress_start_time = time_dt();
 }
 
-BVHNode* BVHBuild::build_node(const NodeSpec& spec, int level, float progress_start, float progress_end)
+void BVHBuild::thread_build_node(BVHNode **node, vector<Reference> *refs, NodeSpec spec, int level)
+{
+	if(progress.get_cancel())
+		return;
+
+	*node = build_node(*refs, spec, level);
+}
+
+void BVHBuild::build_child(BVHNode **node, vector<Reference>& refs, const NodeSpec& spec, int level)
+{
+	if(spec.num >= THREAD_TASK_SIZE)
+		task_pool.push(new BVHBuildTask(this, node, refs, spec, level));
+	else
+		*node = build_node(refs, spec, level);
+}
+
+BVHNode* BVHBuild::build_node(vector<Reference>& refs, const NodeSpec& spec, int level)
 {
 	/* progress update */
-	progress_update(progress_start, progress_end);
 	if(progress.get_cancel()) return NULL;
 
 	/* small enough or too deep => create leaf. */
 	if(spec.num <= params.min_leaf_size || level >= BVHParams::MAX_DEPTH)
-		return create_leaf_node(spec);
+		return create_leaf_node(refs, spec);
 
 	/* find split candidates. */
 	float area = spec.bounds.area();
 	float leafSAH = area * params.triangle_cost(spec.num);
 	float nodeSAH = area * params.node_cost(2);
-	ObjectSplit object = find_object_split(spec, nodeSAH);
+	ObjectSplit object = find_object_split(refs, spec, nodeSAH);
 	SpatialSplit spatial;
 
 	if(params.use_spatial_split && level < BVHParams::MAX_SPATIAL_DEPTH) {
@@ -179,41 +242,39 @@ BVHNode* BVHBuild::build_node(const NodeSpec& spec, int level, float progress_st
 		overlap.intersect(object.right_bounds);
 
 		if(overlap.area() >= spatial_min_overlap)
-			spatial = find_spatial_split(spec, nodeSAH);
+			spatial = find_spatial_split(refs, spec, nodeSAH);
 	}
 
 	/* leaf SAH is the lowest => create leaf. */
 	float minSAH = min(min(leafSAH, object.sah), spatial.sah);
 
 	if(minSAH == leafSAH && spec.num <= params.max_leaf_size)
-		return create_leaf_node(spec);
+		return create_leaf_node(refs, spec);
 
 	/* perform split. */
 	NodeSpec left, right;
+	vector<Reference> left_refs, right_refs;
 
 	if(params.use_spatial_split && minSAH == spatial.sah)
-		do_spatial_split(left, right, spec, spatial);
+		do_spatial_split(refs, left_refs, right_refs, left, right, spec, spatial);
 	if(!left.num || !right.num)
-		do_object_split(left, right, spec, object);
+		do_object_split(refs, left_refs, right_refs, left, right, spec, object);
 
-	/* create inner node. */
-	progress_num_duplicates += left.num + right.num - spec.num;
+	/* free references of this node before descending */
+	vector<Reference>().swap(refs);
 
-	float progress_mid = lerp(progress_start, progress_end, (float)right.num / (float)(left.num + right.num));
-
-	BVHNode* rightNode = build_node(right, level + 1, progress_start, progress_mid);
-	if(progress.get_cancel()) {
-		if(rightNode) rightNode->deleteSubtree();
-		return NULL;
+	/* create inner node. */
+	if(left.num + right.num != spec.num) {
+		thread_scoped_lock build_lock(build_mutex);
+		progress_num_duplicates += left.num + right.num - spec.num;
 	}
 
-	BVHNode* leftNode = build_node(left, level + 1, progress_mid, progress_end);
-	if(progress.get_cancel()) {
-		if(leftNode) leftNode->deleteSubtree();
-		return NULL;
-	}
+	InnerNode *inner = new InnerNode(spec.bounds);
 
-	return new InnerNode(spec.bounds, leftNode, rightNode);
+	build_child(&inner->children[0], left_refs, left, level + 1);
+	build_child(&inner->children[1], right_refs, right, level + 1);
+
+	return inner;
 }
 
 BVHNode *BVHBuild::create_object_leaf_nodes(const Reference *ref, int num)
@@ -241,23 +302,30 @@ BVHNode *BVHBuild::create_object_leaf_nodes(const Reference *ref, int num)
 	}
 }
 
-BVHNode* BVHBuild::create_leaf_node(const NodeSpec& spec)
+BVHNode* BVHBuild::create_leaf_node(const vector<Reference>& refs, const NodeSpec& spec)
 {
+	progress_update(spec.num);
+
+	/* output arrays are shared between threads */
+	thread_scoped_lock build_lock(build_mutex);
+
 	vector<int>& p_index = prim_index;
 	vector<int>& p_object = prim_object;
+	vector<Reference> object_refs;
 	BoundBox bounds;
 	int num = 0;
 	uint visibility = 0;
 
 	for(int i = 0; i < spec.num; i++) {
-		if(references.back().prim_index != -1) {
-			p_index.push_back(references.back().prim_index);
-			p_object.push_back(references.back().prim_object);
-			bounds.grow(references.back().bounds);
-			visibility |= objects[references.back().prim_object]->visibility;
-			references.pop_back();
+		if(refs[i].prim_index != -1) {
+			p_index.push_back(refs[i].prim_index);
+			p_object.push_back(refs[i].prim_object);
+			bounds.grow(refs[i].bounds);
+			visibility |= objects[refs[i].prim_object]->visibility;
 			num++;
 		}
+		else
+			object_refs.push_back(refs[i]);
 	}
 
 	BVHNode *leaf = NULL;
@@ -272,10 +340,8 @@ BVHNode* BVHBuild::create_leaf_node(const NodeSpec& spec)
 	/* while there may be multiple triangles in a leaf, for object primitives
 	 * we want them to be the only one, so we  */
 	int ob_num = spec.num - num;
-	const Reference *ref = (ob_num)? &references.back() - (ob_num - 1): NULL;
+	const Reference *ref = (ob_num)? &object_refs[0]: NULL;
 	BVHNode *oleaf = create_object_leaf_nodes(ref, ob_num);
-	for(int i = 0; i < ob_num; i++)
-		references.pop_back();
 	
 	if(leaf)
 		return new InnerNode(spec.bounds, leaf, oleaf);
@@ -283,23 +349,59 @@ BVHNode* BVHBuild::create_leaf_node(const NodeSpec& spec)
 		return oleaf;
 }
 
+void BVHBuild::finalize_node(BVHNode *node, const vector<int>& old_prim_index,
+	const vector<int>& old_prim_object)
+{
+	if(node->is_leaf()) {
+		LeafNode *leaf = (LeafNode*)node;
+		int lo = prim_index.size();
+
+		for(int i = leaf->m_lo; i < leaf->m_hi; i++) {
+			prim_index.push_back(old_prim_index[i]);
+			prim_object.push_back(old_prim_object[i]);
+		}
+
+		leaf->m_lo = lo;
+		leaf->m_hi = prim_index.size();
+	}
+	else {
+		InnerNode *inner = (InnerNode*)node;
+
+		finalize_node(inner->children[0], old_prim_index, old_prim_object);
+		finalize_node(inner->children[1], old_prim_index, old_prim_object);
+
+		/* visibility of children was not yet known when creating the node */
+		inner->m_visibility = inner->children[0]->m_visibility|inner->children[1]->m_visibility;
+	}
+}
+
 /* Object Split */
 
-BVHBuild::ObjectSplit BVHBuild::find_object_split(const NodeSpec& spec, float nodeSAH)
+BVHBuild::ObjectSplit BVHBuild::find_object_split(vector<Reference>& refs, const NodeSpec& spec, float nodeSAH)
 {
+	/* for large nodes, binning is much faster than sorting in every dimension */
+	if(spec.num > params.num_object_bins) {
+		ObjectSplit split = find_object_split_binned(refs, spec, nodeSAH);
+
+		/* fall back to sorting if the centroids could not be binned */
+		if(split.sah != FLT_MAX)
+			return split;
+	}
+
 	ObjectSplit split;
-	const Reference *ref_ptr = &references[references.size() - spec.num];
+	const Reference *ref_ptr = &refs[0];
+	vector<BoundBox> right_bounds_array(spec.num);
 
 	for(int dim = 0; dim < 3; dim++) {
 		/* sort references */
-		bvh_reference_sort(references.size() - spec.num, references.size(), &references[0], dim);
+		bvh_reference_sort(0, spec.num, &refs[0], dim);
 
 		/* sweep right to left and determine bounds. */
 		BoundBox right_bounds;
 
 		for(int i = spec.num - 1; i > 0; i--) {
 			right_bounds.grow(ref_ptr[i].bounds);
-			spatial_right_bounds[i - 1] = right_bounds;
+			right_bounds_array[i - 1] = right_bounds;
 		}
 
 		/* sweep left to right and select lowest SAH. */
@@ -307,7 +409,7 @@ BVHBuild::ObjectSplit BVHBuild::find_object_split(const NodeSpec& spec, float no
 
 		for(int i = 1; i < spec.num; i++) {
 			left_bounds.grow(ref_ptr[i - 1].bounds);
-			right_bounds = spatial_right_bounds[i - 1];
+			right_bounds = right_bounds_array[i - 1];
 
 			float sah = nodeSAH +
 				left_bounds.area() * params.triangle_cost(i) +
@@ -326,25 +428,146 @@ BVHBuild::ObjectSplit BVHBuild::find_object_split(const NodeSpec& spec, float no
 	return split;
 }
 
-void BVHBuild::do_object_split(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const ObjectSplit& split)
+BVHBuild::ObjectSplit BVHBuild::find_object_split_binned(const vector<Reference>& refs, const NodeSpec& spec, float nodeSAH)
 {
-	/* sort references according to split */
-	int start = references.size() - spec.num;
-	int end = references.size(); /* todo: is this right? */
+	ObjectSplit split;
+	int num_bins = params.num_object_bins;
+
+	/* bounds of reference centroids, we use the sum of min and max to
+	   match the sorting order used for non-binned splits */
+	BoundBox centroid_bounds;
+
+	for(int i = 0; i < spec.num; i++)
+		centroid_bounds.grow(refs[i].bounds.min + refs[i].bounds.max);
+
+	vector<ObjectBin> bins(num_bins);
+	vector<BoundBox> right_bounds_array(num_bins);
+	vector<int> bin_index(spec.num);
+
+	for(int dim = 0; dim < 3; dim++) {
+		float origin = centroid_bounds.min[dim];
+		float extent = centroid_bounds.max[dim] - origin;
+
+		/* all centroids at the same position, can't split in this dimension */
+		if(!(extent > 0.0f))
+			continue;
+
+		float scale = (float)num_bins/extent;
+
+		/* initialize bins. */
+		for(int i = 0; i < num_bins; i++) {
+			bins[i].bounds = BoundBox();
+			bins[i].num = 0;
+		}
+
+		/* put references into bins. */
+		for(int i = 0; i < spec.num; i++) {
+			const Reference& ref = refs[i];
+			float c = ref.bounds.min[dim] + ref.bounds.max[dim];
+			int b = clamp((int)((c - origin)*scale), 0, num_bins - 1);
+
+			bins[b].bounds.grow(ref.bounds);
+			bins[b].num++;
+		}
+
+		/* sweep right to left and determine bounds. */
+		BoundBox right_bounds;
+
+		for(int i = num_bins - 1; i > 0; i--) {
+			right_bounds.grow(bins[i].bounds);
+			right_bounds_array[i - 1] = right_bounds;
+		}
+
+		/* sweep left to right and select lowest SAH. */
+		BoundBox left_bounds;
+		int left_num = 0;
+
+		for(int i = 1; i < num_bins; i++) {
+			left_bounds.grow(bins[i - 1].bounds);
+			left_num += bins[i - 1].num;
+
+			int right_num = spec.num - left_num;
+
+			if(left_num == 0 || right_num == 0)
+				continue;
+
+			float sah = nodeSAH +
+				left_bounds.area() * params.triangle_cost(left_num) +
+				right_bounds_array[i - 1].area() * params.triangle_cost(right_num);
 
-	bvh_reference_sort(start, end, &references[0], split.dim);
+			if(sah < split.sah) {
+				split.sah = sah;
+				split.dim = dim;
+				split.num_left = left_num;
+				split.left_bounds = left_bounds;
+				split.right_bounds = right_bounds_array[i - 1];
+				split.binned = true;
+				split.bin = i;
+				split.bin_origin = origin;
+				split.bin_scale = scale;
+			}
+		}
+	}
+
+	return split;
+}
+
+void BVHBuild::do_object_split(vector<Reference>& refs, vector<Reference>& left_refs, vector<Reference>& right_refs,
+	NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const ObjectSplit& split)
+{
+	left_refs.clear();
+	right_refs.clear();
+
+	if(split.binned) {
+		/* partition references by centroid bin, keeping their order */
+		int dim = split.dim;
 
-	/* split node specs */
-	left.num = split.num_left;
-	left.bounds = split.left_bounds;
-	right.num = spec.num - split.num_left;
-	right.bounds = split.right_bounds;
+		left_refs.reserve(split.num_left);
+		right_refs.reserve(spec.num - split.num_left);
+
+		for(int i = 0; i < spec.num; i++) {
+			const Reference& ref = refs[i];
+			float c = ref.bounds.min[dim] + ref.bounds.max[dim];
+			int b = clamp((int)((c - split.bin_origin)*split.bin_scale), 0, params.num_object_bins - 1);
+
+			if(b < split.bin)
+				left_refs.push_back(ref);
+			else
+				right_refs.push_back(ref);
+		}
+	}
+
+	if(left_refs.empty() || right_refs.empty()) {
+		/* sort references according to split */
+		int num_left = clamp(split.num_left, 1, spec.num - 1);
+
+		bvh_reference_sort(0, spec.num, &refs[0], split.dim);
+
+		left_refs.assign(refs.begin(), refs.begin() + num_left);
+		right_refs.assign(refs.begin() + num_left, refs.begin() + spec.num);
+	}
+
+	/* split node specs, bounds are computed from the actual partition so
+	   they are conservative regardless of how the split was found */
+	left.num = left_refs.size();
+	left.bounds = BoundBox();
+	right.num = right_refs.size();
+	right.bounds = BoundBox();
+
+	foreach(const Reference& ref, left_refs)
+		left.bounds.grow(ref.bounds);
+	foreach(const Reference& ref, right_refs)
+		right.bounds.grow(ref.bounds);
 }
 
 /* Spatial Split */
 
-BVHBuild::SpatialSplit BVHBuild::find_spatial_split(const NodeSpec& spec, float nodeSAH)
+BVHBuild::SpatialSplit BVHBuild::find_spatial_split(const vector<Reference>& refs, const NodeSpec& spec, float nodeSAH)
 {
+	/* bins are local so multiple threads can search for splits */
+	SpatialBin spatial_bins[3][BVHParams::NUM_SPATIAL_BINS];
+	BoundBox spatial_right_bounds[BVHParams::NUM_SPATIAL_BINS - 1];
+
 	/* initialize bins. */
 	float3 origin = spec.bounds.min;
 	float3 binSize = (spec.bounds.max - origin) * (1.0f / (float)BVHParams::NUM_SPATIAL_BINS);
@@ -361,8 +584,8 @@ BVHBuild::SpatialSplit BVHBuild::find_spatial_split(const NodeSpec& spec, float
 	}
 
 	/* chop references into bins. */
-	for(unsigned int refIdx = references.size() - spec.num; refIdx < references.size(); refIdx++) {
-		const Reference& ref = references[refIdx];
+	for(int refIdx = 0; refIdx < spec.num; refIdx++) {
+		const Reference& ref = refs[refIdx];
 		float3 firstBinf = (ref.bounds.min - origin) * invBinSize;
 		float3 lastBinf = (ref.bounds.max - origin) * invBinSize;
 		int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
@@ -425,7 +648,8 @@ BVHBuild::SpatialSplit BVHBuild::find_spatial_split(const NodeSpec& spec, float
 	return split;
 }
 
-void BVHBuild::do_spatial_split(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SpatialSplit& split)
+void BVHBuild::do_spatial_split(vector<Reference>& refs, vector<Reference>& left_refs, vector<Reference>& right_refs,
+	NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SpatialSplit& split)
 {
 	/* Categorize references and compute bounds.
 	 *
@@ -433,8 +657,7 @@ void BVHBuild::do_spatial_split(NodeSpec& left, NodeSpec& right, const NodeSpec&
 	 * Uncategorized/split:		[left_end, right_start[
 	 * Right-hand side:			[right_start, refs.size()[ */
 
-	vector<Reference>& refs = references;
-	int left_start = refs.size() - spec.num;
+	int left_start = 0;
 	int left_end = left_start;
 	int right_start = refs.size();
 
@@ -502,6 +725,13 @@ void BVHBuild::do_spatial_split(NodeSpec& left, NodeSpec& right, const NodeSpec&
 
 	left.num = left_end - left_start;
 	right.num = refs.size() - right_start;
+
+	/* if one side ended up empty, an object split is done instead on the
+	   same references, which are only reordered in that case */
+	if(left.num && right.num) {
+		left_refs.assign(refs.begin() + left_start, refs.begin() + left_end);
+		right_refs.assign(refs.begin() + right_start, refs.end());
+	}
 }
 
 void BVHBuild::split_reference(Reference& left, Reference& right, const Reference& ref, int dim, float pos)
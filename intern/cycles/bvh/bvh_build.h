@@ -23,10 +23,13 @@
 #include "bvh.h"
 
 #include "util_boundbox.h"
+#include "util_task.h"
+#include "util_thread.h"
 #include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+class BVHBuildTask;
 class BVHParams;
 class Mesh;
 class Object;
@@ -70,17 +73,25 @@ public:
 	BVHNode *run();
 
 protected:
+	friend class BVHBuildTask;
+
 	/* adding references */
 	void add_reference_mesh(NodeSpec& root, Mesh *mesh, int i);
 	void add_reference_object(NodeSpec& root, Object *ob, int i);
 	void add_references(NodeSpec& root);
 
 	/* building */
-	BVHNode *build_node(const NodeSpec& spec, int level, float progress_start, float progress_end);
-	BVHNode *create_leaf_node(const NodeSpec& spec);
+	BVHNode *build_node(vector<Reference>& refs, const NodeSpec& spec, int level);
+	void build_child(BVHNode **node, vector<Reference>& refs, const NodeSpec& spec, int level);
+	void thread_build_node(BVHNode **node, vector<Reference> *refs, NodeSpec spec, int level);
+	BVHNode *create_leaf_node(const vector<Reference>& refs, const NodeSpec& spec);
 	BVHNode *create_object_leaf_nodes(const Reference *ref, int num);
 
-	void progress_update(float progress_start, float progress_end);
+	/* reorder primitives to depth first order after threaded build */
+	void finalize_node(BVHNode *node, const vector<int>& old_prim_index,
+		const vector<int>& old_prim_object);
+
+	void progress_update(int num_done);
 
 	/* object splits */
 	struct ObjectSplit
@@ -91,14 +102,29 @@ protected:
 		BoundBox left_bounds;
 		BoundBox right_bounds;
 
+		/* binned splits partition by centroid bin, others by sort order */
+		bool binned;
+		int bin;
+		float bin_origin;
+		float bin_scale;
+
 		ObjectSplit()
-		: sah(FLT_MAX), dim(0), num_left(0)
+		: sah(FLT_MAX), dim(0), num_left(0),
+		  binned(false), bin(0), bin_origin(0.0f), bin_scale(0.0f)
 		{
 		}
 	};
 
-	ObjectSplit find_object_split(const NodeSpec& spec, float nodeSAH);
-	void do_object_split(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const ObjectSplit& split);
+	struct ObjectBin
+	{
+		BoundBox bounds;
+		int num;
+	};
+
+	ObjectSplit find_object_split(vector<Reference>& refs, const NodeSpec& spec, float nodeSAH);
+	ObjectSplit find_object_split_binned(const vector<Reference>& refs, const NodeSpec& spec, float nodeSAH);
+	void do_object_split(vector<Reference>& refs, vector<Reference>& left_refs, vector<Reference>& right_refs,
+		NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const ObjectSplit& split);
 
 	/* spatial splits */
 	struct SpatialSplit
@@ -120,10 +146,14 @@ protected:
 		int exit;
 	};
 
-	SpatialSplit find_spatial_split(const NodeSpec& spec, float nodeSAH);
-	void do_spatial_split(NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SpatialSplit& split);
+	SpatialSplit find_spatial_split(const vector<Reference>& refs, const NodeSpec& spec, float nodeSAH);
+	void do_spatial_split(vector<Reference>& refs, vector<Reference>& left_refs, vector<Reference>& right_refs,
+		NodeSpec& left, NodeSpec& right, const NodeSpec& spec, const SpatialSplit& split);
 	void split_reference(Reference& left, Reference& right, const Reference& ref, int dim, float pos);
 
+	/* subtrees with at least this many references are built as separate tasks */
+	enum { THREAD_TASK_SIZE = 4096 };
+
 	/* objects and primitive references */
 	vector<Object*> objects;
 	vector<Reference> references;
@@ -138,12 +168,16 @@ protected:
 	/* progress reporting */
 	Progress& progress;
 	double progress_start_time;
+	int progress_count;
+	int progress_total;
 	int progress_num_duplicates;
 
 	/* spatial splitting */
 	float spatial_min_overlap;
-	vector<BoundBox> spatial_right_bounds;
-	SpatialBin spatial_bins[3][BVHParams::NUM_SPATIAL_BINS];
+
+	/* threads */
+	TaskPool task_pool;
+	thread_mutex build_mutex;
 };
 
 CCL_NAMESPACE_END
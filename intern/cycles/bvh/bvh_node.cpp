@@ -59,7 +59,8 @@ int BVHNode::getSubtreeSize(BVH_STAT stat) const
 void BVHNode::deleteSubtree()
 {
 	for(int i=0;i<num_children();i++)
-		get_child(i)->deleteSubtree();
+		if(get_child(i))
+			get_child(i)->deleteSubtree();
 
 	delete this;
 }
@@ -63,6 +63,14 @@ public:
 class InnerNode : public BVHNode
 {
 public:
+	InnerNode(const BoundBox& bounds)
+	{
+		m_bounds = bounds;
+		m_visibility = 0;
+		children[0] = NULL;
+		children[1] = NULL;
+	}
+
 	InnerNode(const BoundBox& bounds, BVHNode* child0, BVHNode* child1)
 	{
 		m_bounds = bounds;
@@ -29,6 +29,9 @@ public:
 	bool use_spatial_split;
 	float spatial_split_alpha;
 
+	/* object split bins, nodes with fewer references are split by sorting */
+	int num_object_bins;
+
 	/* SAH costs */
 	float sah_node_cost;
 	float sah_triangle_cost;
@@ -46,6 +49,9 @@ public:
 	/* QBVH */
 	bool use_qbvh;
 
+	/* refit, rebuild instead when the SAH cost grows by more than this factor */
+	float max_refit_SAH_ratio;
+
 	/* fixed parameters */
 	enum {
 		MAX_DEPTH = 64,
@@ -58,6 +64,8 @@ public:
 		use_spatial_split = true;
 		spatial_split_alpha = 1e-5f;
 
+		num_object_bins = 32;
+
 		sah_node_cost = 1.0f;
 		sah_triangle_cost = 1.0f;
 
@@ -67,6 +75,8 @@ public:
 		top_level = false;
 		use_cache = false;
 		use_qbvh = false;
+
+		max_refit_SAH_ratio = 1.5f;
 	}
 
 	/* SAH costs */
@@ -36,12 +36,12 @@ CCL_NAMESPACE_BEGIN
 
 DeviceTask::DeviceTask(Type type_)
 : type(type_), x(0), y(0), w(0), h(0), rng_state(0), rgba(0), buffer(0),
-  sample(0), resolution(0),
+  sample(0), num_samples(1), resolution(0), stride(0), pass_stride(0),
   displace_input(0), displace_offset(0), displace_x(0), displace_w(0)
 {
 }
 
-void DeviceTask::split(ThreadQueue<DeviceTask>& tasks, int num)
+void DeviceTask::split(list<DeviceTask>& tasks, int num)
 {
 	if(type == DISPLACE) {
 		num = min(displace_w, num);
@@ -55,7 +55,7 @@ void DeviceTask::split(ThreadQueue<DeviceTask>& tasks, int num)
 			task.displace_x = tx;
 			task.displace_w = tw;
 
-			tasks.push(task);
+			tasks.push_back(task);
 		}
 	}
 	else {
@@ -70,7 +70,35 @@ void DeviceTask::split(ThreadQueue<DeviceTask>& tasks, int num)
 			task.y = ty;
 			task.h = th;
 
-			tasks.push(task);
+			tasks.push_back(task);
+		}
+	}
+}
+
+void DeviceTask::split_tiles(list<DeviceTask>& tasks, int num, int tile_size)
+{
+	/* square tiles, halved in size until there are at least num of them or
+	   they get too small for the per tile overhead to be worth it */
+	while(tile_size > 8) {
+		int tiles_x = (w + tile_size - 1)/tile_size;
+		int tiles_y = (h + tile_size - 1)/tile_size;
+
+		if(tiles_x*tiles_y >= num)
+			break;
+
+		tile_size /= 2;
+	}
+
+	for(int ty = y; ty < y + h; ty += tile_size) {
+		for(int tx = x; tx < x + w; tx += tile_size) {
+			DeviceTask task = *this;
+
+			task.x = tx;
+			task.y = ty;
+			task.w = min(tile_size, x + w - tx);
+			task.h = min(tile_size, y + h - ty);
+
+			tasks.push_back(task);
 		}
 	}
 }
@@ -119,7 +147,7 @@ void Device::draw_pixels(device_memory& rgba, int y, int w, int h, int width, in
 		glDisable(GL_BLEND);
 }
 
-Device *Device::create(DeviceType type, bool background, int threads)
+Device *Device::create(DeviceType type, bool background, int threads, const string& servers)
 {
 	Device *device;
 
@@ -137,12 +165,12 @@ Device *Device::create(DeviceType type, bool background, int threads)
 #endif
 #ifdef WITH_MULTI
 		case DEVICE_MULTI:
-			device = device_multi_create(background);
+			device = device_multi_create(background, threads, servers);
 			break;
 #endif
 #ifdef WITH_NETWORK
 		case DEVICE_NETWORK:
-			device = device_network_create("127.0.0.1");
+			device = device_network_create((servers == "")? "127.0.0.1": servers.c_str());
 			break;
 #endif
 #ifdef WITH_OPENCL
@@ -23,6 +23,7 @@
 
 #include "device_memory.h"
 
+#include "util_list.h"
 #include "util_string.h"
 #include "util_thread.h"
 #include "util_types.h"
@@ -30,7 +31,9 @@
 
 CCL_NAMESPACE_BEGIN
 
+class PerfCounters;
 class Progress;
+class TextureCache;
 
 enum DeviceType {
 	DEVICE_NONE,
@@ -59,14 +62,21 @@ public:
 	device_ptr rgba;
 	device_ptr buffer;
 	int sample;
+	int num_samples;
 	int resolution;
 
+	/* buffer layout, row stride in pixels and number of float4 passes per
+	   pixel, for devices that gather tiles rendered elsewhere */
+	int stride;
+	int pass_stride;
+
 	device_ptr displace_input;
 	device_ptr displace_offset;
 	int displace_x, displace_w;
 
 	DeviceTask(Type type = PATH_TRACE);
-	void split(ThreadQueue<DeviceTask>& tasks, int num);
+	void split(list<DeviceTask>& tasks, int num);
+	void split_tiles(list<DeviceTask>& tasks, int num, int tile_size);
 };
 
 /* Device */
@@ -83,6 +93,9 @@ public:
 
 	virtual bool support_full_kernel() = 0;
 
+	/* BVH layout used by the kernel, 4-wide QBVH or regular binary BVH */
+	virtual bool support_qbvh() { return false; }
+
 	/* info */
 	virtual string description() = 0;
 	const string& error_message() { return error_msg; }
@@ -111,6 +124,16 @@ public:
 	/* open shading language, only for CPU device */
 	virtual void *osl_memory() { return NULL; }
 
+	/* image textures loaded on demand, only for CPU device. returns false
+	   if not supported, images must then be allocated as textures */
+	virtual bool texture_cache_set(TextureCache *cache) { return false; }
+
+	/* kernel performance counters, only for CPU device. counters are kept per
+	   render thread, so these must not be called while tasks are running */
+	virtual void perf_counters_enable(bool enable) {}
+	virtual void perf_counters_reset() {}
+	virtual void perf_counters_get(PerfCounters& counters) {}
+
 	/* load/compile kernels, must be called before adding tasks */ 
 	virtual bool load_kernels(bool experimental) { return true; }
 
@@ -125,11 +148,13 @@ public:
 
 #ifdef WITH_NETWORK
 	/* networking */
-	void server_run();
+	void server_run(int port);
 #endif
 
-	/* static */
-	static Device *create(DeviceType type, bool background = true, int threads = 0);
+	/* static, servers is a comma separated list of host[:port] addresses for
+	   network and multi devices, if empty servers are discovered */
+	static Device *create(DeviceType type, bool background = true, int threads = 0,
+		const string& servers = "");
 
 	static DeviceType type_from_string(const char *name);
 	static string string_from_type(DeviceType type);
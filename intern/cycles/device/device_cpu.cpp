@@ -31,6 +31,7 @@
 #include "util_foreach.h"
 #include "util_function.h"
 #include "util_opengl.h"
+#include "util_perf_counters.h"
 #include "util_progress.h"
 #include "util_system.h"
 #include "util_thread.h"
@@ -41,12 +42,15 @@ class CPUDevice : public Device
 {
 public:
 	vector<thread*> threads;
-	ThreadQueue<DeviceTask> tasks;
+	ThreadStealQueue<DeviceTask> tasks;
 	KernelGlobals *kg;
+	vector<PerfCounters> perf_counters;
+	bool perf_counters_enabled;
 	
 	CPUDevice(int threads_num)
 	{
 		kg = kernel_globals_create();
+		perf_counters_enabled = false;
 
 		/* do now to avoid thread issues */
 		system_cpu_support_optimized();
@@ -55,6 +59,8 @@ public:
 			threads_num = system_cpu_thread_count();
 
 		threads.resize(threads_num);
+		tasks.set_num_workers(threads_num);
+		perf_counters.resize(threads_num);
 
 		for(size_t i = 0; i < threads.size(); i++)
 			threads[i] = new thread(function_bind(&CPUDevice::thread_run, this, i));
@@ -77,6 +83,16 @@ public:
 		return true;
 	}
 
+	bool support_qbvh()
+	{
+		/* the optimized kernel is the one using QBVH traversal */
+#ifdef WITH_OPTIMIZED_KERNEL
+		return system_cpu_support_optimized();
+#else
+		return false;
+#endif
+	}
+
 	string description()
 	{
 		return system_cpu_brand_string();
@@ -132,11 +148,36 @@ public:
 #endif
 	}
 
+	bool texture_cache_set(TextureCache *cache)
+	{
+		kernel_texture_cache_set(kg, cache);
+		return true;
+	}
+
+	void perf_counters_enable(bool enable)
+	{
+		perf_counters_enabled = enable;
+	}
+
+	void perf_counters_reset()
+	{
+		foreach(PerfCounters& counters, perf_counters)
+			counters.reset();
+	}
+
+	void perf_counters_get(PerfCounters& counters)
+	{
+		foreach(PerfCounters& thread_counters, perf_counters)
+			counters.add(thread_counters);
+	}
+
 	void thread_run(int t)
 	{
 		DeviceTask task;
 
-		while(tasks.worker_wait_pop(task)) {
+		while(tasks.worker_wait_pop(task, t)) {
+			kernel_perf_counters_set(kg, (perf_counters_enabled)? &perf_counters[t]: NULL);
+
 			if(task.type == DeviceTask::PATH_TRACE)
 				thread_path_trace(task);
 			else if(task.type == DeviceTask::TONEMAP)
@@ -158,11 +199,20 @@ public:
 			OSLShader::thread_init(kg);
 #endif
 
+		/* for tiles with multiple samples, the sample loop is outside the pixel
+		   loops so the tile stays in cache while it is being rendered */
+		int end_sample = task.sample + task.num_samples;
+
 #ifdef WITH_OPTIMIZED_KERNEL
 		if(system_cpu_support_optimized()) {
-			for(int y = task.y; y < task.y + task.h; y++) {
-				for(int x = task.x; x < task.x + task.w; x++)
-					kernel_cpu_optimized_path_trace(kg, (float4*)task.buffer, (unsigned int*)task.rng_state, task.sample, x, y);
+			for(int sample = task.sample; sample < end_sample; sample++) {
+				for(int y = task.y; y < task.y + task.h; y++) {
+					for(int x = task.x; x < task.x + task.w; x++)
+						kernel_cpu_optimized_path_trace(kg, (float4*)task.buffer, (unsigned int*)task.rng_state, sample, x, y);
+
+					if(tasks.worker_cancel())
+						break;
+				}
 
 				if(tasks.worker_cancel())
 					break;
@@ -171,9 +221,14 @@ public:
 		else
 #endif
 		{
-			for(int y = task.y; y < task.y + task.h; y++) {
-				for(int x = task.x; x < task.x + task.w; x++)
-					kernel_cpu_path_trace(kg, (float4*)task.buffer, (unsigned int*)task.rng_state, task.sample, x, y);
+			for(int sample = task.sample; sample < end_sample; sample++) {
+				for(int y = task.y; y < task.y + task.h; y++) {
+					for(int x = task.x; x < task.x + task.w; x++)
+						kernel_cpu_path_trace(kg, (float4*)task.buffer, (unsigned int*)task.rng_state, sample, x, y);
+
+					if(tasks.worker_cancel())
+						break;
+				}
 
 				if(tasks.worker_cancel())
 					break;
@@ -238,9 +293,22 @@ public:
 
 	void task_add(DeviceTask& task)
 	{
-		/* split task into smaller ones, more than number of threads for uneven
-		   workloads where some parts of the image render slower than others */
-		task.split(tasks, threads.size()*10);
+		list<DeviceTask> subtasks;
+
+		if(task.type == DeviceTask::PATH_TRACE && task.num_samples > 1) {
+			/* tiles rendered to their full sample count are split into small
+			   square tiles that stay in cache, several per thread so threads
+			   that run out of tiles can steal them from busy threads */
+			task.split_tiles(subtasks, threads.size()*8, 64);
+		}
+		else {
+			/* split task into smaller ones, more than number of threads for uneven
+			   workloads where some parts of the image render slower than others */
+			task.split(subtasks, threads.size()*10);
+		}
+
+		foreach(DeviceTask& subtask, subtasks)
+			tasks.push(subtask);
 	}
 
 	void task_wait()
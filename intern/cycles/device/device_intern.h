@@ -27,7 +27,7 @@ Device *device_cpu_create(int threads);
 Device *device_opencl_create(bool background);
 Device *device_cuda_create(bool background);
 Device *device_network_create(const char *address);
-Device *device_multi_create(bool background);
+Device *device_multi_create(bool background, int threads, const string& servers);
 
 CCL_NAMESPACE_END
 
@@ -233,6 +233,29 @@ public:
 		return data.size();
 	}
 
+	/* exchange host data with another vector without copying, the device
+	   pointers are left unchanged. this way data can be filled in a back
+	   buffer while the device is still using this one. */
+	void swap_data(device_vector<T>& other)
+	{
+		device_ptr tmp_pointer = data_pointer;
+		size_t tmp_size = data_size;
+		size_t tmp_width = data_width;
+		size_t tmp_height = data_height;
+
+		data.swap(other.data);
+
+		data_pointer = other.data_pointer;
+		data_size = other.data_size;
+		data_width = other.data_width;
+		data_height = other.data_height;
+
+		other.data_pointer = tmp_pointer;
+		other.data_size = tmp_size;
+		other.data_width = tmp_width;
+		other.data_height = tmp_height;
+	}
+
 private:
 	array<T> data;
 	bool referenced;
@@ -16,6 +16,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <stdlib.h>
 #include <sstream>
 
@@ -24,8 +25,10 @@
 #include "device_network.h"
 
 #include "util_foreach.h"
+#include "util_function.h"
 #include "util_list.h"
 #include "util_map.h"
+#include "util_math.h"
 #include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
@@ -35,22 +38,68 @@ class MultiDevice : public Device
 public:
 	struct SubDevice {
 		SubDevice(Device *device_)
-		: device(device_) {}
+		: device(device_), worker(NULL), num_tiles(0) {}
 
 		Device *device;
 		map<device_ptr, device_ptr> ptr_map;
+
+		/* tasks that must run on this device, and thread feeding them */
+		list<DeviceTask> tasks;
+		thread *worker;
+		int num_tiles;
+	};
+
+	/* Tiles that are rendered from their first sample can go to any device,
+	 * they are put in a shared queue and each device takes the next one when
+	 * done with the previous, so faster devices render more tiles. Devices
+	 * accumulate samples in their own buffer, so once rendered a tile stays
+	 * with its device for the following samples. */
+	struct TileKey {
+		TileKey(const DeviceTask& task)
+		: x(task.x), y(task.y), w(task.w), h(task.h) {}
+
+		bool operator<(const TileKey& other) const
+		{
+			if(y != other.y) return y < other.y;
+			if(x != other.x) return x < other.x;
+			if(h != other.h) return h < other.h;
+			return w < other.w;
+		}
+
+		int x, y, w, h;
+	};
+
+	/* pixel layout of memory written by tiles, to gather them on copy */
+	struct TileLayout {
+		TileLayout() : stride(0), pixel_size(0) {}
+		TileLayout(int stride_, int pixel_size_) : stride(stride_), pixel_size(pixel_size_) {}
+
+		int stride;
+		int pixel_size;
 	};
 
 	list<SubDevice> devices;
 	device_ptr unique_ptr;
 
-	MultiDevice(bool background_)
-	: unique_ptr(1)
+	map<TileKey, SubDevice*> tile_map;
+	map<device_ptr, TileLayout> tile_layout;
+	int tile_stride;
+
+	list<DeviceTask> tile_queue;
+	int num_pending;
+	bool stop_workers;
+	thread_mutex tile_mutex;
+	thread_condition_variable tile_cond;
+
+	MultiDevice(bool background_, int threads, const string& servers)
+	: unique_ptr(1), tile_stride(0), num_pending(0), stop_workers(false)
 	{
 		Device *device;
 
+		background = background_;
+
 		/* add CPU device */
-		device = Device::create(DEVICE_CPU, background);
+		device = Device::create(DEVICE_CPU, background, threads);
 		devices.push_back(SubDevice(device));
 
 #ifdef WITH_CUDA
@@ -70,24 +119,53 @@ public:
 		}
 
 #ifdef WITH_NETWORK
-		/* try to add network devices */
-		ServerDiscovery discovery(true);
-		time_sleep(1.0);
+		/* add network devices, given servers or discovered on the network */
+		list<string> server_list;
 
-		list<string> servers = discovery.get_server_list();
+		if(servers != "") {
+			vector<string> tokens;
+			string_split(tokens, servers, ", ");
 
-		foreach(string& server, servers) {
-			device = device_network_create(server.c_str());
-			if(device)
+			foreach(string& server, tokens)
+				server_list.push_back(server);
+		}
+		else {
+			ServerDiscovery discovery(true);
+			time_sleep(1.0);
+
+			server_list = discovery.get_server_list();
+		}
+
+		foreach(string& server, server_list) {
+			try {
+				device = device_network_create(server.c_str());
 				devices.push_back(SubDevice(device));
+			}
+			catch(exception& e) {
+				cerr << "Can't connect to render server " << server << ": " << e.what() << endl;
+			}
 		}
 #endif
+
+		/* start thread feeding tasks to each device */
+		foreach(SubDevice& sub, devices)
+			sub.worker = new thread(function_bind(&MultiDevice::thread_run, this, &sub));
 	}
 
 	~MultiDevice()
 	{
-		foreach(SubDevice& sub, devices)
+		{
+			thread_scoped_lock lock(tile_mutex);
+			stop_workers = true;
+		}
+
+		tile_cond.notify_all();
+
+		foreach(SubDevice& sub, devices) {
+			sub.worker->join();
+			delete sub.worker;
 			delete sub.device;
+		}
 	}
 
 	bool support_full_kernel()
@@ -100,6 +178,16 @@ public:
 		return true;
 	}
 
+	bool support_qbvh()
+	{
+		foreach(SubDevice& sub, devices) {
+			if(!sub.device->support_qbvh())
+				return false;
+		}
+
+		return true;
+	}
+
 	string description()
 	{
 		/* create map to find duplicate descriptions */
@@ -141,6 +229,25 @@ public:
 		return true;
 	}
 
+	void perf_counters_enable(bool enable)
+	{
+		foreach(SubDevice& sub, devices)
+			sub.device->perf_counters_enable(enable);
+	}
+
+	void perf_counters_reset()
+	{
+		foreach(SubDevice& sub, devices)
+			sub.device->perf_counters_reset();
+	}
+
+	void perf_counters_get(PerfCounters& counters)
+	{
+		/* sub devices add their counters to the total */
+		foreach(SubDevice& sub, devices)
+			sub.device->perf_counters_get(counters);
+	}
+
 	void mem_alloc(device_memory& mem, MemoryType type)
 	{
 		foreach(SubDevice& sub, devices) {
@@ -167,12 +274,85 @@ public:
 	void mem_copy_from(device_memory& mem, size_t offset, size_t size)
 	{
 		device_ptr tmp = mem.device_pointer;
+		map<TileKey, SubDevice*> tiles;
+		TileLayout layout;
+
+		{
+			/* pixels may be drawn while rendering the next tiles */
+			thread_scoped_lock lock(tile_mutex);
+			map<device_ptr, TileLayout>::iterator it = tile_layout.find(tmp);
+
+			if(it != tile_layout.end()) {
+				layout = it->second;
+				tiles = tile_map;
+			}
+		}
+
+		if(layout.stride && devices.size() > 1) {
+			/* gather tiles from the devices that rendered them */
+			foreach(SubDevice& sub, devices)
+				copy_tiles_from(sub, tiles, mem, layout, offset, size);
+		}
+		else {
+			/* not written by tiles, results are on the first device */
+			SubDevice& sub = devices.front();
 
-		/* todo: how does this work? */
-		foreach(SubDevice& sub, devices) {
 			mem.device_pointer = sub.ptr_map[tmp];
 			sub.device->mem_copy_from(mem, offset, size);
-			break;
+		}
+
+		mem.device_pointer = tmp;
+	}
+
+	void copy_tiles_from(SubDevice& sub, map<TileKey, SubDevice*>& tile_devices, device_memory& mem,
+		TileLayout& layout, size_t offset, size_t size)
+	{
+		/* byte range of the tiles of this device within the copied range */
+		vector<TileKey> tiles;
+		size_t stride = layout.stride, pixel_size = layout.pixel_size;
+		size_t begin = offset + size, end = offset;
+		map<TileKey, SubDevice*>::iterator it;
+
+		for(it = tile_devices.begin(); it != tile_devices.end(); it++) {
+			if(it->second != &sub)
+				continue;
+
+			const TileKey& tile = it->first;
+			size_t tile_begin = (tile.x + tile.y*stride)*pixel_size;
+			size_t tile_end = (tile.x + tile.w + (tile.y + tile.h - 1)*stride)*pixel_size;
+
+			begin = std::min(begin, std::max(tile_begin, offset));
+			end = std::max(end, std::min(tile_end, offset + size));
+
+			tiles.push_back(tile);
+		}
+
+		if(begin >= end)
+			return;
+
+		/* devices that render into host memory have their tiles there already,
+		   others copy the range to a temporary buffer to pick the tiles from */
+		device_ptr host_pointer = mem.data_pointer;
+		device_ptr tmp = mem.device_pointer;
+
+		mem.device_pointer = sub.ptr_map[tmp];
+
+		if(mem.device_pointer != host_pointer) {
+			vector<uchar> data(end - begin);
+
+			mem.data_pointer = (device_ptr)&data[0] - begin;
+			sub.device->mem_copy_from(mem, begin, end - begin);
+			mem.data_pointer = host_pointer;
+
+			foreach(TileKey& tile, tiles) {
+				for(int y = tile.y; y < tile.y + tile.h; y++) {
+					size_t row_begin = std::max((tile.x + y*stride)*pixel_size, begin);
+					size_t row_end = std::min((tile.x + tile.w + y*stride)*pixel_size, end);
+
+					if(row_begin < row_end)
+						memcpy((uchar*)host_pointer + row_begin, &data[row_begin - begin], row_end - row_begin);
+				}
+			}
 		}
 
 		mem.device_pointer = tmp;
@@ -200,6 +380,7 @@ public:
 			sub.ptr_map.erase(sub.ptr_map.find(tmp));
 		}
 
+		tile_layout.erase(tmp);
 		mem.device_pointer = 0;
 	}
 
@@ -259,77 +440,160 @@ public:
 
 	void pixels_copy_from(device_memory& mem, int y, int w, int h)
 	{
-		device_ptr tmp = mem.device_pointer;
-		int i = 0, sub_h = h/devices.size();
+		/* gather tiles tonemapped by each device, draw_pixels of the base
+		   class then draws them all at once */
+		mem_copy_from(mem, sizeof(uint8_t)*4*y*w, sizeof(uint8_t)*4*w*h);
+	}
 
-		foreach(SubDevice& sub, devices) {
-			int sy = y + i*sub_h;
-			int sh = (i == (int)devices.size() - 1)? h - sub_h*i: sub_h;
+	void task_add(DeviceTask& task)
+	{
+		thread_scoped_lock lock(tile_mutex);
 
-			mem.device_pointer = sub.ptr_map[tmp];
-			sub.device->pixels_copy_from(mem, sy, w, sh);
-			i++;
+		if(task.type == DeviceTask::PATH_TRACE) {
+			/* tiles of a previous resolution are not used anymore */
+			if(task.stride != tile_stride) {
+				tile_map.clear();
+				tile_stride = task.stride;
+			}
+
+			tile_layout[task.buffer] = TileLayout(task.stride, task.pass_stride*sizeof(float4));
+
+			map<TileKey, SubDevice*>::iterator it = tile_map.find(TileKey(task));
+
+			if(task.sample > 0 && it != tile_map.end())
+				it->second->tasks.push_back(task);
+			else
+				tile_queue.push_back(task);
+
+			num_pending++;
 		}
+		else if(task.type == DeviceTask::TONEMAP) {
+			/* each device tonemaps the tiles it rendered */
+			tile_layout[task.rgba] = TileLayout(task.stride, sizeof(uchar4));
 
-		mem.device_pointer = tmp;
-	}
+			map<TileKey, SubDevice*>::iterator it;
 
-	void draw_pixels(device_memory& rgba, int y, int w, int h, int width, int height, bool transparent)
-	{
-		device_ptr tmp = rgba.device_pointer;
-		int i = 0, sub_h = h/devices.size();
-		int sub_height = height/devices.size();
+			for(it = tile_map.begin(); it != tile_map.end(); it++) {
+				const TileKey& tile = it->first;
+				DeviceTask subtask = task;
 
-		foreach(SubDevice& sub, devices) {
-			int sy = y + i*sub_h;
-			int sh = (i == (int)devices.size() - 1)? h - sub_h*i: sub_h;
-			int sheight = (i == (int)devices.size() - 1)? height - sub_height*i: sub_height;
-			/* adjust math for w/width */
-
-			rgba.device_pointer = sub.ptr_map[tmp];
-			sub.device->draw_pixels(rgba, sy, w, sh, width, sheight, transparent);
-			i++;
+				subtask.x = max(task.x, tile.x);
+				subtask.y = max(task.y, tile.y);
+				subtask.w = min(task.x + task.w, tile.x + tile.w) - subtask.x;
+				subtask.h = min(task.y + task.h, tile.y + tile.h) - subtask.y;
+
+				if(subtask.w > 0 && subtask.h > 0) {
+					it->second->tasks.push_back(subtask);
+					num_pending++;
+				}
+			}
+		}
+		else {
+			/* displacement results are read back from the first device */
+			devices.front().tasks.push_back(task);
+			num_pending++;
 		}
 
-		rgba.device_pointer = tmp;
+		tile_cond.notify_all();
 	}
 
-	void task_add(DeviceTask& task)
+	void task_wait()
 	{
-		ThreadQueue<DeviceTask> tasks;
-		task.split(tasks, devices.size());
+		thread_scoped_lock lock(tile_mutex);
+
+		while(num_pending > 0)
+			tile_cond.wait(lock);
+
+		lock.unlock();
 
 		foreach(SubDevice& sub, devices) {
-			DeviceTask subtask;
+			if(sub.device->error_message() != "" && error_msg == "")
+				error_msg = sub.device->error_message();
+		}
+	}
 
-			if(tasks.worker_wait_pop(subtask)) {
-				if(task.buffer) subtask.buffer = sub.ptr_map[task.buffer];
-				if(task.rng_state) subtask.rng_state = sub.ptr_map[task.rng_state];
-				if(task.rgba) subtask.rgba = sub.ptr_map[task.rgba];
-				if(task.displace_input) subtask.displace_input = sub.ptr_map[task.displace_input];
-				if(task.displace_offset) subtask.displace_offset = sub.ptr_map[task.displace_offset];
+	void task_cancel()
+	{
+		{
+			thread_scoped_lock lock(tile_mutex);
+
+			num_pending -= tile_queue.size();
+			tile_queue.clear();
 
-				sub.device->task_add(subtask);
+			foreach(SubDevice& sub, devices) {
+				num_pending -= sub.tasks.size();
+				sub.tasks.clear();
 			}
+
+			tile_cond.notify_all();
 		}
+
+		foreach(SubDevice& sub, devices)
+			sub.device->task_cancel();
+
+		task_wait();
 	}
 
-	void task_wait()
+protected:
+	void map_task_pointers(SubDevice& sub, DeviceTask& task)
 	{
-		foreach(SubDevice& sub, devices)
-			sub.device->task_wait();
+		if(task.buffer) task.buffer = sub.ptr_map[task.buffer];
+		if(task.rng_state) task.rng_state = sub.ptr_map[task.rng_state];
+		if(task.rgba) task.rgba = sub.ptr_map[task.rgba];
+		if(task.displace_input) task.displace_input = sub.ptr_map[task.displace_input];
+		if(task.displace_offset) task.displace_offset = sub.ptr_map[task.displace_offset];
 	}
 
-	void task_cancel()
+	void thread_run(SubDevice *sub)
 	{
-		foreach(SubDevice& sub, devices)
-			sub.device->task_cancel();
+		/* number of tasks given to the device at once, so that a network
+		   device receives the next task while still rendering */
+		const int max_tasks = 2;
+
+		thread_scoped_lock lock(tile_mutex);
+
+		while(!stop_workers) {
+			list<DeviceTask> tasks;
+
+			/* own tasks first, then tiles that any device can take */
+			while((int)tasks.size() < max_tasks && !sub->tasks.empty()) {
+				tasks.push_back(sub->tasks.front());
+				sub->tasks.pop_front();
+			}
+
+			while((int)tasks.size() < max_tasks && !tile_queue.empty()) {
+				DeviceTask& task = tile_queue.front();
+
+				tile_map[TileKey(task)] = sub;
+				tasks.push_back(task);
+				tile_queue.pop_front();
+			}
+
+			if(tasks.empty()) {
+				tile_cond.wait(lock);
+				continue;
+			}
+
+			lock.unlock();
+
+			foreach(DeviceTask& task, tasks) {
+				map_task_pointers(*sub, task);
+				sub->device->task_add(task);
+			}
+
+			sub->device->task_wait();
+
+			lock.lock();
+
+			num_pending -= tasks.size();
+			tile_cond.notify_all();
+		}
 	}
 };
 
-Device *device_multi_create(bool background)
+Device *device_multi_create(bool background, int threads, const string& servers)
 {
-	return new MultiDevice(background);
+	return new MultiDevice(background, threads, servers);
 }
 
 CCL_NAMESPACE_END
@@ -21,6 +21,8 @@
 #include "device_network.h"
 
 #include "util_foreach.h"
+#include "util_map.h"
+#include "util_set.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -32,14 +34,33 @@ public:
 	boost::asio::io_service io_service;
 	tcp::socket socket;
 
+	/* memory is identified by ids assigned here, so allocations don't need
+	   to wait for the server to return a pointer */
+	device_ptr mem_counter;
+	boost::uint32_t call_counter;
+	thread_mutex rpc_mutex;
+
+	/* remote device info, queried once on connect */
+	string remote_description;
+	bool remote_full_kernel;
+	bool remote_qbvh;
+
 	NetworkDevice(const char *address)
-	: socket(io_service)
+	: socket(io_service), mem_counter(0), call_counter(0),
+	  remote_full_kernel(false), remote_qbvh(false)
 	{
-		stringstream portstr;
-		portstr << SERVER_PORT;
+		/* address is host[:port] */
+		string host = address;
+		string port = string_printf("%d", SERVER_PORT);
+		size_t pos = host.rfind(':');
+
+		if(pos != string::npos) {
+			port = host.substr(pos + 1);
+			host = host.substr(0, pos);
+		}
 
 		tcp::resolver resolver(io_service);
-		tcp::resolver::query query(address, portstr.str());
+		tcp::resolver::query query(host, port);
 		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
 		tcp::resolver::iterator end;
 
@@ -51,172 +72,239 @@ public:
 		}
 		if(error)
 			throw boost::system::system_error(error);
+
+		/* small calls must not wait for more data to fill a packet */
+		socket.set_option(tcp::no_delay(true));
+
+		/* device info */
+		thread_scoped_lock lock(rpc_mutex);
+		boost::uint32_t id = send_call("info");
+
+		RPCReceive rcv(socket);
+		if(receive_reply(rcv, id))
+			*rcv.archive & remote_description & remote_full_kernel & remote_qbvh;
 	}
 
 	~NetworkDevice()
 	{
 	}
 
+	/* send call without waiting, returns id to match the reply */
+	boost::uint32_t send_call(RPCSend& snd)
+	{
+		if(!snd.write())
+			error_msg = "Network send error";
+
+		return snd.id;
+	}
+
+	boost::uint32_t send_call(const char *name)
+	{
+		RPCSend snd(socket, name, ++call_counter);
+		return send_call(snd);
+	}
+
+	bool receive_reply(RPCReceive& rcv, boost::uint32_t id)
+	{
+		if(!rcv.valid() || rcv.id != id) {
+			error_msg = "Network receive error, lost connection to server";
+			return false;
+		}
+
+		return true;
+	}
+
 	bool support_full_kernel()
 	{
-		return false;
+		return remote_full_kernel;
+	}
+
+	bool support_qbvh()
+	{
+		return remote_qbvh;
 	}
 
 	string description()
 	{
-		RPCSend snd(socket, "description");
-		snd.write();
+		return remote_description + " (remote)";
+	}
+
+	bool load_kernels(bool experimental)
+	{
+		thread_scoped_lock lock(rpc_mutex);
+
+		RPCSend snd(socket, "load_kernels", ++call_counter);
+		snd.archive & experimental;
+		send_call(snd);
 
 		RPCReceive rcv(socket);
-		string desc_string;
+		bool result = false;
 
-		*rcv.archive & desc_string;
+		if(receive_reply(rcv, snd.id))
+			*rcv.archive & result;
 
-		return desc_string + " (remote)";
+		return result;
 	}
 
-	void mem_alloc(device_memory& mem, MemoryType type)
+	void send_mem_info(RPCSend& snd, device_memory& mem)
 	{
-#if 0
-		RPCSend snd(socket, "mem_alloc");
+		int data_type = mem.data_type;
+		size_t data_size = mem.data_size;
+		size_t data_width = mem.data_width;
+		size_t data_height = mem.data_height;
 
-		snd.archive & size & type;
-		snd.write();
+		snd.archive & mem.device_pointer & data_type & mem.data_elements;
+		snd.archive & data_size & data_width & data_height;
+	}
 
-		RPCReceive rcv(socket);
+	void mem_alloc(device_memory& mem, MemoryType type)
+	{
+		thread_scoped_lock lock(rpc_mutex);
 
-		device_ptr mem;
-		*rcv.archive & mem;
+		mem.device_pointer = ++mem_counter;
 
-		return mem;
-#endif
+		RPCSend snd(socket, "mem_alloc", ++call_counter);
+		int mem_type = type;
+
+		send_mem_info(snd, mem);
+		snd.archive & mem_type;
+		send_call(snd);
 	}
 
 	void mem_copy_to(device_memory& mem)
 	{
-#if 0
-		RPCSend snd(socket, "mem_copy_to");
+		thread_scoped_lock lock(rpc_mutex);
 
-		snd.archive & mem & size;
-		snd.write();
-		snd.write_buffer(host, size);
-#endif
+		RPCSend snd(socket, "mem_copy_to", ++call_counter);
+
+		snd.archive & mem.device_pointer;
+		snd.add_buffer((void*)mem.data_pointer, mem.memory_size());
+		send_call(snd);
 	}
 
 	void mem_copy_from(device_memory& mem, size_t offset, size_t size)
 	{
-#if 0
-		RPCSend snd(socket, "mem_copy_from");
+		thread_scoped_lock lock(rpc_mutex);
 
-		snd.archive & mem & offset & size;
-		snd.write();
+		RPCSend snd(socket, "mem_copy_from", ++call_counter);
+
+		snd.archive & mem.device_pointer & offset & size;
+		send_call(snd);
 
+		/* data is received straight into host memory */
 		RPCReceive rcv(socket);
-		rcv.read_buffer(host, size);
-#endif
+
+		if(receive_reply(rcv, snd.id))
+			rcv.read_buffer((uchar*)mem.data_pointer + offset, size);
 	}
 
 	void mem_zero(device_memory& mem)
 	{
-#if 0
-		RPCSend snd(socket, "mem_zero");
+		thread_scoped_lock lock(rpc_mutex);
 
-		snd.archive & mem & size;
-		snd.write();
-#endif
+		RPCSend snd(socket, "mem_zero", ++call_counter);
+
+		snd.archive & mem.device_pointer;
+		send_call(snd);
 	}
 
 	void mem_free(device_memory& mem)
 	{
-#if 0
-		if(mem) {
-			RPCSend snd(socket, "mem_free");
+		if(mem.device_pointer) {
+			thread_scoped_lock lock(rpc_mutex);
 
-			snd.archive & mem;
-			snd.write();
+			RPCSend snd(socket, "mem_free", ++call_counter);
+
+			snd.archive & mem.device_pointer;
+			send_call(snd);
+
+			mem.device_pointer = 0;
 		}
-#endif
 	}
 
 	void const_copy_to(const char *name, void *host, size_t size)
 	{
-		RPCSend snd(socket, "const_copy_to");
+		thread_scoped_lock lock(rpc_mutex);
+
+		RPCSend snd(socket, "const_copy_to", ++call_counter);
 
 		string name_string(name);
 
-		snd.archive & name_string & size;
-		snd.write();
-		snd.write_buffer(host, size);
+		snd.archive & name_string;
+		snd.add_buffer(host, size);
+		send_call(snd);
 	}
 
 	void tex_alloc(const char *name, device_memory& mem, bool interpolation, bool periodic)
 	{
-#if 0
-		RPCSend snd(socket, "tex_alloc");
+		thread_scoped_lock lock(rpc_mutex);
 
-		string name_string(name);
-
-		snd.archive & name_string & width & height & datatype & components & interpolation;
-		snd.write();
+		mem.device_pointer = ++mem_counter;
 
-		size_t size = width*height*components*datatype_size(datatype);
-		snd.write_buffer(host, size);
+		RPCSend snd(socket, "tex_alloc", ++call_counter);
 
-		RPCReceive rcv(socket);
-
-		device_ptr mem;
-		*rcv.archive & mem;
+		string name_string(name);
 
-		return mem;
-#endif
+		snd.archive & name_string;
+		send_mem_info(snd, mem);
+		snd.archive & interpolation & periodic;
+		snd.add_buffer((void*)mem.data_pointer, mem.memory_size());
+		send_call(snd);
 	}
 
 	void tex_free(device_memory& mem)
 	{
-#if 0
-		if(mem) {
-			RPCSend snd(socket, "tex_free");
-
-			snd.archive & mem;
-			snd.write();
-		}
-#endif
-	}
-
-	void path_trace(int x, int y, int w, int h, device_ptr buffer, device_ptr rng_state, int sample)
-	{
-#if 0
-		RPCSend snd(socket, "path_trace");
+		if(mem.device_pointer) {
+			thread_scoped_lock lock(rpc_mutex);
 
-		snd.archive & x & y & w & h & buffer & rng_state & sample;
-		snd.write();
-#endif
-	}
+			RPCSend snd(socket, "tex_free", ++call_counter);
 
-	void tonemap(int x, int y, int w, int h, device_ptr rgba, device_ptr buffer, int sample, int resolution)
-	{
-#if 0
-		RPCSend snd(socket, "tonemap");
+			snd.archive & mem.device_pointer;
+			send_call(snd);
 
-		snd.archive & x & y & w & h & rgba & buffer & sample & resolution;
-		snd.write();
-#endif
+			mem.device_pointer = 0;
+		}
 	}
 
 	void task_add(DeviceTask& task)
 	{
-		if(task.type == DeviceTask::TONEMAP)
-			tonemap(task.x, task.y, task.w, task.h, task.rgba, task.buffer, task.sample, task.resolution);
-		else if(task.type == DeviceTask::PATH_TRACE)
-			path_trace(task.x, task.y, task.w, task.h, task.buffer, task.rng_state, task.sample);
+		thread_scoped_lock lock(rpc_mutex);
+
+		RPCSend snd(socket, "task_add", ++call_counter);
+		int type = task.type;
+
+		snd.archive & type & task.x & task.y & task.w & task.h;
+		snd.archive & task.rng_state & task.rgba & task.buffer;
+		snd.archive & task.sample & task.num_samples & task.resolution;
+		snd.archive & task.stride & task.pass_stride;
+		snd.archive & task.displace_input & task.displace_offset;
+		snd.archive & task.displace_x & task.displace_w;
+		send_call(snd);
 	}
 
 	void task_wait()
 	{
+		thread_scoped_lock lock(rpc_mutex);
+
+		boost::uint32_t id = send_call("task_wait");
+
+		/* all calls before this one are done when the reply arrives */
+		RPCReceive rcv(socket);
+		string error_message;
+
+		if(receive_reply(rcv, id)) {
+			*rcv.archive & error_message;
+
+			if(error_message != "")
+				error_msg = error_message;
+		}
 	}
 
 	void task_cancel()
 	{
+		thread_scoped_lock lock(rpc_mutex);
+
+		send_call("task_cancel");
 	}
 };
 
@@ -225,158 +313,266 @@ Device *device_network_create(const char *address)
 	return new NetworkDevice(address);
 }
 
+/* Device Server
+ *
+ * Executes calls received from a client on a local device. Memory is kept
+ * in a map from the ids assigned by the client to local memory, which also
+ * holds the host data for devices that use it directly. */
 
-void Device::server_run()
+class network_device_memory : public device_memory
 {
-	try
+public:
+	network_device_memory() { device_pointer = 0; }
+	~network_device_memory() {}
+
+	vector<char> local_data;
+};
+
+class DeviceServer {
+public:
+	DeviceServer(Device *device_, tcp::socket& socket_)
+	: device(device_), socket(socket_)
 	{
-		/* starts thread that responds to discovery requests */
-		ServerDiscovery discovery;
+	}
 
-		for(;;)
-		{
+	~DeviceServer()
+	{
+		/* free memory left by a client that disconnected */
+		device->task_cancel();
 
-			/* accept connection */
-			boost::asio::io_service io_service;
-			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), SERVER_PORT));
+		map<device_ptr, network_device_memory*>::iterator it;
 
-			tcp::socket socket(io_service);
-			acceptor.accept(socket);
+		for(it = mem_data.begin(); it != mem_data.end(); it++) {
+			if(it->second->device_pointer) {
+				if(tex_data.find(it->first) != tex_data.end())
+					device->tex_free(*it->second);
+				else
+					device->mem_free(*it->second);
+			}
 
-			/* receive remote function calls */
-			for(;;) {
-				RPCReceive rcv(socket);
-
-				if(rcv.name == "description") {
-					string desc = description();
-
-					RPCSend snd(socket);
-					snd.archive & desc;
-					snd.write();
-				}
-				else if(rcv.name == "mem_alloc") {
-#if 0
-					MemoryType type;
-					size_t size;
-					device_ptr mem;
-
-					*rcv.archive & size & type;
-					mem = mem_alloc(size, type);
-
-					RPCSend snd(socket);
-					snd.archive & mem;
-					snd.write();
-#endif
-				}
-				else if(rcv.name == "mem_copy_to") {
-#if 0
-					device_ptr mem;
-					size_t size;
+			delete it->second;
+		}
+	}
 
-					*rcv.archive & mem & size;
+	void listen()
+	{
+		/* receive remote function calls until the connection is closed */
+		for(;;) {
+			RPCReceive rcv(socket);
 
-					vector<char> host_vector(size);
-					rcv.read_buffer(&host_vector[0], size);
+			if(!rcv.valid())
+				break;
 
-					mem_copy_to(mem, &host_vector[0], size);
-#endif
-				}
-				else if(rcv.name == "mem_copy_from") {
-#if 0
-					device_ptr mem;
-					size_t offset, size;
+			process(rcv);
+		}
+	}
 
-					*rcv.archive & mem & offset & size;
+protected:
+	network_device_memory *mem_create(RPCReceive& rcv, device_ptr& client_pointer)
+	{
+		network_device_memory *mem = new network_device_memory();
+		int data_type;
 
-					vector<char> host_vector(size);
+		*rcv.archive & client_pointer & data_type & mem->data_elements;
+		*rcv.archive & mem->data_size & mem->data_width & mem->data_height;
 
-					mem_copy_from(&host_vector[0], mem, offset, size);
+		mem->data_type = (DataType)data_type;
+		mem->local_data.resize(mem->memory_size());
+		mem->data_pointer = (mem->local_data.size())? (device_ptr)&mem->local_data[0]: 0;
 
-					RPCSend snd(socket);
-					snd.write();
-					snd.write_buffer(&host_vector[0], size);
-#endif
-				}
-				else if(rcv.name == "mem_zero") {
-#if 0
-					device_ptr mem;
-					size_t size;
-
-					*rcv.archive & mem & size;
-					mem_zero(mem, size);
-#endif
-				}
-				else if(rcv.name == "mem_free") {
-#if 0
-					device_ptr mem;
+		mem_data[client_pointer] = mem;
 
-					*rcv.archive & mem;
-					mem_free(mem);
-#endif
-				}
-				else if(rcv.name == "const_copy_to") {
-					string name_string;
-					size_t size;
+		return mem;
+	}
 
-					*rcv.archive & name_string & size;
+	network_device_memory *mem_find(RPCReceive& rcv, device_ptr& client_pointer)
+	{
+		*rcv.archive & client_pointer;
 
-					vector<char> host_vector(size);
-					rcv.read_buffer(&host_vector[0], size);
+		map<device_ptr, network_device_memory*>::iterator it = mem_data.find(client_pointer);
+		return (it != mem_data.end())? it->second: NULL;
+	}
 
-					const_copy_to(name_string.c_str(), &host_vector[0], size);
-				}
-				else if(rcv.name == "tex_alloc") {
-#if 0
-					string name_string;
-					DataType datatype;
-					device_ptr mem;
-					size_t width, height;
-					int components;
-					bool interpolation;
+	device_ptr device_pointer(device_ptr client_pointer)
+	{
+		if(!client_pointer)
+			return 0;
 
-					*rcv.archive & name_string & width & height & datatype & components & interpolation;
+		map<device_ptr, network_device_memory*>::iterator it = mem_data.find(client_pointer);
+		return (it != mem_data.end())? it->second->device_pointer: 0;
+	}
 
-					size_t size = width*height*components*datatype_size(datatype);
+	void reply(RPCReceive& rcv, RPCSend& snd)
+	{
+		snd.id = rcv.id;
+		snd.write();
+	}
 
-					vector<char> host_vector(size);
-					rcv.read_buffer(&host_vector[0], size);
+	void process(RPCReceive& rcv)
+	{
+		device_ptr client_pointer;
 
-					mem = tex_alloc(name_string.c_str(), &host_vector[0], width, height, datatype, components, interpolation);
+		if(rcv.name == "info") {
+			string desc = device->description();
+			bool full_kernel = device->support_full_kernel();
+			bool qbvh = device->support_qbvh();
 
-					RPCSend snd(socket);
-					snd.archive & mem;
-					snd.write();
-#endif
-				}
-				else if(rcv.name == "tex_free") {
-#if 0
-					device_ptr mem;
+			RPCSend snd(socket, "info");
+			snd.archive & desc & full_kernel & qbvh;
+			reply(rcv, snd);
+		}
+		else if(rcv.name == "load_kernels") {
+			bool experimental;
 
-					*rcv.archive & mem;
-					tex_free(mem);
-#endif
-				}
-				else if(rcv.name == "path_trace") {
-#if 0
-					device_ptr buffer, rng_state;
-					int x, y, w, h;
-					int sample;
-
-					*rcv.archive & x & y & w & h & buffer & rng_state & sample;
-					path_trace(x, y, w, h, buffer, rng_state, sample);
-#endif
-				}
-				else if(rcv.name == "tonemap") {
-#if 0
-					device_ptr rgba, buffer;
-					int x, y, w, h;
-					int sample, resolution;
-
-					*rcv.archive & x & y & w & h & rgba & buffer & sample & resolution;
-					tonemap(x, y, w, h, rgba, buffer, sample, resolution);
-#endif
-				}
+			*rcv.archive & experimental;
+			bool result = device->load_kernels(experimental);
+
+			RPCSend snd(socket, "load_kernels");
+			snd.archive & result;
+			reply(rcv, snd);
+		}
+		else if(rcv.name == "mem_alloc") {
+			network_device_memory *mem = mem_create(rcv, client_pointer);
+			int type;
+
+			*rcv.archive & type;
+			device->mem_alloc(*mem, (MemoryType)type);
+		}
+		else if(rcv.name == "mem_copy_to") {
+			network_device_memory *mem = mem_find(rcv, client_pointer);
+
+			if(mem && rcv.read_buffer((void*)mem->data_pointer, mem->memory_size()))
+				device->mem_copy_to(*mem);
+		}
+		else if(rcv.name == "mem_copy_from") {
+			network_device_memory *mem = mem_find(rcv, client_pointer);
+			size_t offset, size;
+
+			*rcv.archive & offset & size;
+
+			RPCSend snd(socket, "mem_copy_from");
+
+			if(mem && offset + size <= mem->memory_size()) {
+				device->mem_copy_from(*mem, offset, size);
+				snd.add_buffer((uchar*)mem->data_pointer + offset, size);
 			}
+
+			reply(rcv, snd);
+		}
+		else if(rcv.name == "mem_zero") {
+			network_device_memory *mem = mem_find(rcv, client_pointer);
+
+			if(mem)
+				device->mem_zero(*mem);
+		}
+		else if(rcv.name == "mem_free") {
+			network_device_memory *mem = mem_find(rcv, client_pointer);
+
+			if(mem) {
+				device->mem_free(*mem);
+				mem_data.erase(client_pointer);
+				delete mem;
+			}
+		}
+		else if(rcv.name == "const_copy_to") {
+			string name_string;
+
+			*rcv.archive & name_string;
+
+			vector<char> host_vector(rcv.buffer_size);
+			if(host_vector.size() && rcv.read_buffer(&host_vector[0], host_vector.size()))
+				device->const_copy_to(name_string.c_str(), &host_vector[0], host_vector.size());
+		}
+		else if(rcv.name == "tex_alloc") {
+			string name_string;
+			bool interpolation, periodic;
+
+			*rcv.archive & name_string;
+			network_device_memory *mem = mem_create(rcv, client_pointer);
+			*rcv.archive & interpolation & periodic;
+
+			if(mem->data_pointer)
+				rcv.read_buffer((void*)mem->data_pointer, mem->memory_size());
+
+			device->tex_alloc(name_string.c_str(), *mem, interpolation, periodic);
+			tex_data.insert(client_pointer);
+		}
+		else if(rcv.name == "tex_free") {
+			network_device_memory *mem = mem_find(rcv, client_pointer);
+
+			if(mem) {
+				device->tex_free(*mem);
+				mem_data.erase(client_pointer);
+				tex_data.erase(client_pointer);
+				delete mem;
+			}
+		}
+		else if(rcv.name == "task_add") {
+			DeviceTask task;
+			int type;
+
+			*rcv.archive & type & task.x & task.y & task.w & task.h;
+			*rcv.archive & task.rng_state & task.rgba & task.buffer;
+			*rcv.archive & task.sample & task.num_samples & task.resolution;
+			*rcv.archive & task.stride & task.pass_stride;
+			*rcv.archive & task.displace_input & task.displace_offset;
+			*rcv.archive & task.displace_x & task.displace_w;
+
+			task.type = (DeviceTask::Type)type;
+			task.rng_state = device_pointer(task.rng_state);
+			task.rgba = device_pointer(task.rgba);
+			task.buffer = device_pointer(task.buffer);
+			task.displace_input = device_pointer(task.displace_input);
+			task.displace_offset = device_pointer(task.displace_offset);
+
+			/* runs asynchronously, while we receive the next calls */
+			device->task_add(task);
+		}
+		else if(rcv.name == "task_wait") {
+			device->task_wait();
+
+			string error_message = device->error_message();
+
+			RPCSend snd(socket, "task_wait");
+			snd.archive & error_message;
+			reply(rcv, snd);
+		}
+		else if(rcv.name == "task_cancel") {
+			device->task_cancel();
+		}
+		else
+			cout << "Network receive error: unknown call " << rcv.name << "\n";
+	}
+
+	Device *device;
+	tcp::socket& socket;
+
+	/* client memory ids to local memory */
+	map<device_ptr, network_device_memory*> mem_data;
+	set<device_ptr> tex_data;
+};
+
+void Device::server_run(int port)
+{
+	try
+	{
+		/* starts thread that responds to discovery requests */
+		ServerDiscovery discovery(false, port);
+
+		boost::asio::io_service io_service;
+		tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
+
+		for(;;)
+		{
+			/* accept connection */
+			tcp::socket socket(io_service);
+			acceptor.accept(socket);
+
+			socket.set_option(tcp::no_delay(true));
+
+			/* receive remote function calls until the client disconnects */
+			DeviceServer server(this, socket);
+			server.listen();
 		}
 	}
 	catch(exception& e)
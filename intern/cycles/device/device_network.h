@@ -21,11 +21,12 @@
 
 #ifdef WITH_NETWORK
 
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/thread.hpp>
 
@@ -51,123 +52,194 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* Remote Procedure Calls
+ *
+ * Each message is a fixed size binary header, followed by the call name and
+ * arguments in a binary archive, and optionally a raw data buffer. Buffers
+ * are sent directly from and received directly into device memory, without
+ * conversion or an intermediate copy.
+ *
+ * Calls without a result are not acknowledged, so the client can have many
+ * of them in flight on a connection. Replies carry the id of the call they
+ * answer, to verify they arrive in order. */
+
+static const boost::uint32_t RPC_MAGIC = 0x43594352; /* "CYCR" */
+
+typedef struct RPCHeader {
+	boost::uint32_t magic;
+	boost::uint32_t id;
+	boost::uint32_t archive_size;
+	boost::uint32_t pad;
+	boost::uint64_t buffer_size;
+} RPCHeader;
+
 typedef struct RPCSend {
-	RPCSend(tcp::socket& socket_, const string& name_ = "")
-	: name(name_), socket(socket_), archive(archive_stream)
+	RPCSend(tcp::socket& socket_, const string& name_ = "", boost::uint32_t id_ = 0)
+	: name(name_), id(id_), socket(socket_),
+	  archive(archive_stream, boost::archive::no_header),
+	  buffer(NULL), buffer_size(0)
 	{
 		archive & name_;
 	}
 
-	void write()
+	/* data buffer to send along with the call, must stay valid until write */
+	void add_buffer(void *buffer_, size_t size)
+	{
+		buffer = buffer_;
+		buffer_size = size;
+	}
+
+	bool write()
 	{
 		boost::system::error_code error;
 
 		/* get string from stream */
 		string archive_str = archive_stream.str();
 
-		/* first send fixed size header with size of following data */
-		ostringstream header_stream;
-		header_stream << setw(8) << hex << archive_str.size();
-		string header_str = header_stream.str();
+		RPCHeader header;
+		header.magic = RPC_MAGIC;
+		header.id = id;
+		header.archive_size = archive_str.size();
+		header.pad = 0;
+		header.buffer_size = buffer_size;
 
-		boost::asio::write(socket,
-			boost::asio::buffer(header_str),
-			boost::asio::transfer_all(), error);
+		/* send header, arguments and buffer with a single gathering write */
+		vector<boost::asio::const_buffer> buffers;
 
-		if(error.value())
-			cout << "Network send error: " << error.message() << "\n";
-
-		/* then send actual data */
-		boost::asio::write(socket,
-			boost::asio::buffer(archive_str),
-			boost::asio::transfer_all(), error);
-		
-		if(error.value())
-			cout << "Network send error: " << error.message() << "\n";
-	}
+		buffers.push_back(boost::asio::buffer(&header, sizeof(header)));
+		buffers.push_back(boost::asio::buffer(archive_str));
+		if(buffer_size)
+			buffers.push_back(boost::asio::buffer(buffer, buffer_size));
 
-	void write_buffer(void *buffer, size_t size)
-	{
-		boost::system::error_code error;
+		boost::asio::write(socket, buffers, boost::asio::transfer_all(), error);
 
-		boost::asio::write(socket,
-			boost::asio::buffer(buffer, size),
-			boost::asio::transfer_all(), error);
-		
-		if(error.value())
+		if(error.value()) {
 			cout << "Network send error: " << error.message() << "\n";
+			return false;
+		}
+
+		return true;
 	}
 
 	string name;
+	boost::uint32_t id;
 	tcp::socket& socket;
 	ostringstream archive_stream;
-	boost::archive::text_oarchive archive;
+	boost::archive::binary_oarchive archive;
+	void *buffer;
+	size_t buffer_size;
 } RPCSend;
 
 typedef struct RPCReceive {
 	RPCReceive(tcp::socket& socket_)
-	: socket(socket_), archive_stream(NULL), archive(NULL)
+	: id(0), buffer_size(0), socket(socket_), archive_stream(NULL), archive(NULL)
 	{
-		/* read head with fixed size */
-  		vector<char> header(8);
-		size_t len = boost::asio::read(socket, boost::asio::buffer(header));
+		boost::system::error_code error;
+
+		/* read header with fixed size */
+		RPCHeader header;
+		size_t len = boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)), error);
 
 		/* verify if we got something */
-		if(len == header.size()) {
-			/* decode header */
-			string header_str(&header[0], header.size());
-			istringstream header_stream(header_str);
+		if(error == boost::asio::error::eof)
+			return;
 
-			size_t data_size;
+		if(len == sizeof(header) && header.magic == RPC_MAGIC) {
+			vector<char> data(header.archive_size);
+			len = boost::asio::read(socket, boost::asio::buffer(data), error);
 
-			if((header_stream >> hex >> data_size)) {
-				vector<char> data(data_size);
-				size_t len = boost::asio::read(socket, boost::asio::buffer(data));
+			if(len == data.size()) {
+				archive_str = (data.size())? string(&data[0], data.size()): string("");
+				archive_stream = new istringstream(archive_str);
+				archive = new boost::archive::binary_iarchive(*archive_stream, boost::archive::no_header);
 
-				if(len == data_size) {
-					archive_str = (data.size())? string(&data[0], data.size()): string("");
-					/*istringstream archive_stream(archive_str);
-					boost::archive::text_iarchive archive(archive_stream);*/
-					archive_stream = new istringstream(archive_str);
-					archive = new boost::archive::text_iarchive(*archive_stream);
+				*archive & name;
 
-					*archive & name;
-				}
-				else
-					cout << "Network receive error: data size doens't match header\n";
+				id = header.id;
+				buffer_size = header.buffer_size;
 			}
 			else
-				cout << "Network receive error: can't decode data size from header\n";
+				cout << "Network receive error: data size doesn't match header\n";
 		}
+		else if(error.value())
+			cout << "Network receive error: " << error.message() << "\n";
 		else
-			cout << "Network receive error: invalid header size\n";
+			cout << "Network receive error: invalid header\n";
 	}
 
 	~RPCReceive()
 	{
+		/* a buffer that was not read would be parsed as the next header */
+		skip_buffer();
+
 		delete archive;
 		delete archive_stream;
 	}
 
-	void read_buffer(void *buffer, size_t size)
+	/* read data buffer sent along with the call */
+	bool read_buffer(void *buffer, size_t size)
 	{
-		size_t len = boost::asio::read(socket, boost::asio::buffer(buffer, size));
-
-		if(len != size)
+		if(size != buffer_size) {
 			cout << "Network receive error: buffer size doesn't match expected size\n";
+			skip_buffer();
+			return false;
+		}
+
+		boost::system::error_code error;
+		size_t len = boost::asio::read(socket, boost::asio::buffer(buffer, size), error);
+
+		buffer_size = 0;
+
+		if(len != size) {
+			/* the rest of the stream can't be trusted anymore */
+			cout << "Network receive error: " << error.message() << "\n";
+			socket.close(error);
+			return false;
+		}
+
+		return true;
+	}
+
+	/* read and discard the data buffer, keeping the stream in sync */
+	void skip_buffer()
+	{
+		boost::system::error_code error;
+		char scratch[4096];
+
+		while(buffer_size > 0 && socket.is_open()) {
+			size_t size = (buffer_size < sizeof(scratch))? buffer_size: sizeof(scratch);
+			size_t len = boost::asio::read(socket, boost::asio::buffer(scratch, size), error);
+
+			if(len != size) {
+				socket.close(error);
+				break;
+			}
+
+			buffer_size -= size;
+		}
+
+		buffer_size = 0;
+	}
+
+	/* false if the connection was closed or the message is invalid */
+	bool valid()
+	{
+		return (archive != NULL);
 	}
 
 	string name;
+	boost::uint32_t id;
+	size_t buffer_size;
 	tcp::socket& socket;
 	string archive_str;
 	istringstream *archive_stream;
-	boost::archive::text_iarchive *archive;
+	boost::archive::binary_iarchive *archive;
 } RPCReceive;
 
 class ServerDiscovery {
 public:
-	ServerDiscovery(bool discover = false)
-	: listen_socket(io_service), collect_servers(false)
+	ServerDiscovery(bool discover = false, int server_port_ = SERVER_PORT)
+	: listen_socket(io_service), collect_servers(false), server_port(server_port_)
 	{
 		/* setup listen socket */
 	  	listen_endpoint.address(boost::asio::ip::address_v4::any());
@@ -226,10 +298,12 @@ private:
 		if(size > 0) {
 			string msg = string(receive_buffer, size);
 
-			/* handle incoming message */
+			/* handle incoming message, replies contain the server port
+			   so multiple servers can run on the same host */
 			if(collect_servers) {
-				if(msg == DISCOVER_REPLY_MSG) {
+				if(msg.compare(0, DISCOVER_REPLY_MSG.size(), DISCOVER_REPLY_MSG) == 0) {
 					string address = receive_endpoint.address().to_string();
+					address += msg.substr(DISCOVER_REPLY_MSG.size());
 
 					mutex.lock();
 
@@ -249,7 +323,7 @@ private:
 			else {
 				/* reply to request */
 				if(msg == DISCOVER_REQUEST_MSG)
-					broadcast_message(DISCOVER_REPLY_MSG);
+					broadcast_message(DISCOVER_REPLY_MSG + string_printf(":%d", server_port));
 			}
 		}
 
@@ -298,6 +372,9 @@ private:
 	/* collection of server addresses in list */
 	bool collect_servers;
 	list<string> servers;
+
+	/* port of server announced in replies */
+	int server_port;
 };
 
 CCL_NAMESPACE_END
@@ -31,17 +31,22 @@ CCL_NAMESPACE_BEGIN
 
 /* Globals */
 
+tls_ptr(PerfCounters, KernelGlobals::perf_counters);
+
 KernelGlobals *kernel_globals_create()
 {
 	KernelGlobals *kg = new KernelGlobals();
+	kg->texture_cache = NULL;
 #ifdef WITH_OSL
 	kg->osl.use = false;
 #endif
+	tls_create(PerfCounters, kg->perf_counters);
 	return kg;
 }
 
 void kernel_globals_free(KernelGlobals *kg)
 {
+	tls_delete(PerfCounters, kg->perf_counters);
 	delete kg;
 }
 
@@ -61,6 +66,21 @@ bool kernel_osl_use(KernelGlobals *kg)
 
 #endif
 
+/* Texture Cache */
+
+void kernel_texture_cache_set(KernelGlobals *kg, TextureCache *cache)
+{
+	kg->texture_cache = cache;
+}
+
+/* Performance Counters */
+
+void kernel_perf_counters_set(KernelGlobals *kg, PerfCounters *counters)
+{
+	/* only affects the calling thread */
+	tls_set(kg->perf_counters, counters);
+}
+
 /* Memory Copy */
 
 void kernel_const_copy(KernelGlobals *kg, const char *name, void *host, size_t size)
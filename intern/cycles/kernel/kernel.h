@@ -26,6 +26,8 @@
 CCL_NAMESPACE_BEGIN
 
 struct KernelGlobals;
+class PerfCounters;
+class TextureCache;
 
 KernelGlobals *kernel_globals_create();
 void kernel_globals_free(KernelGlobals *kg);
@@ -33,6 +35,9 @@ void kernel_globals_free(KernelGlobals *kg);
 void *kernel_osl_memory(KernelGlobals *kg);
 bool kernel_osl_use(KernelGlobals *kg);
 
+void kernel_texture_cache_set(KernelGlobals *kg, TextureCache *cache);
+void kernel_perf_counters_set(KernelGlobals *kg, PerfCounters *counters);
+
 void kernel_const_copy(KernelGlobals *kg, const char *name, void *host, size_t size);
 void kernel_tex_copy(KernelGlobals *kg, const char *name, device_ptr mem, size_t width, size_t height);
 
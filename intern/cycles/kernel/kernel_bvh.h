@@ -198,6 +198,10 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const ui
 	isect->u = 0.0f;
 	isect->v = 0.0f;
 
+#ifdef __PERF_COUNTERS__
+	int num_nodes = 0, num_triangles = 0;
+#endif
+
 	/* traversal loop */
 	do {
 		do
@@ -211,6 +215,7 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const ui
 				bvh_node_intersect(kg, &traverseChild0, &traverseChild1,
 					&closestChild1, &nodeAddr, &nodeAddrChild1,
 					P, idir, isect->t, visibility, nodeAddr);
+				PERF_COUNT(num_nodes);
 
 				if(traverseChild0 != traverseChild1) {
 					/* one child was intersected */
@@ -256,10 +261,13 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const ui
 					while(primAddr < primAddr2) {
 						/* intersect ray against triangle */
 						bvh_triangle_intersect(kg, isect, P, idir, visibility, object, primAddr);
+						PERF_COUNT(num_triangles);
 
 						/* shadow ray early termination */
-						if(visibility == PATH_RAY_SHADOW_OPAQUE && isect->prim != ~0)
+						if(visibility == PATH_RAY_SHADOW_OPAQUE && isect->prim != ~0) {
+							kernel_perf_count_ray(kg, num_nodes, num_triangles);
 							return true;
+						}
 
 						primAddr++;
 					}
@@ -293,6 +301,8 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const ui
 #endif
 	} while(nodeAddr != ENTRYPOINT_SENTINEL);
 
+	kernel_perf_count_ray(kg, num_nodes, num_triangles);
+
 	return (isect->prim != ~0);
 }
 
@@ -43,17 +43,20 @@ template<typename T> struct texture  {
 		return data[index];
 	}
 
-	/*__m128 fetch_m128(int index)
+#ifdef __KERNEL_SSE__
+	/* unaligned loads, array memory is not guaranteed to be 16 byte aligned */
+	__m128 fetch_m128(int index)
 	{
 		kernel_assert(index >= 0 && index < width);
-		return ((__m128*)data)[index];
+		return _mm_loadu_ps((const float*)&data[index]);
 	}
 
 	__m128i fetch_m128i(int index)
 	{
 		kernel_assert(index >= 0 && index < width);
-		return ((__m128i*)data)[index];
-	}*/
+		return _mm_loadu_si128((const __m128i*)&data[index]);
+	}
+#endif
 
 	float interp(float x, int size)
 	{
@@ -60,7 +60,8 @@ __device bool direct_emission(KernelGlobals *kg, ShaderData *sd, int lindex,
 #endif
 	{
 		/* sample a light and position on int */
-		light_sample(kg, randt, randu, randv, sd->P, &ls);
+		if(!light_sample(kg, randt, randu, randv, sd->P, &ls))
+			return false;
 	}
 
 	/* compute pdf */
@@ -125,8 +126,11 @@ __device float3 indirect_emission(KernelGlobals *kg, ShaderData *sd, float t, in
 	float3 L = shader_emissive_eval(kg, sd);
 
 	if(!(path_flag & PATH_RAY_MIS_SKIP) && (sd->flag & SD_SAMPLE_AS_LIGHT)) {
-		/* multiple importance sampling */
-		float pdf = triangle_light_pdf(kg, sd->Ng, sd->I, t);
+		/* multiple importance sampling, the ray was traced from the
+		   previous shading point, where the light would have been picked */
+		float3 P = sd->P + sd->I*t;
+		float select_pdf = triangle_light_select_pdf(kg, sd->object, sd->prim, P);
+		float pdf = triangle_light_pdf(kg, select_pdf, sd->Ng, sd->I, t);
 		float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
 		return L*mis_weight;
@@ -48,11 +48,131 @@ __device uchar4 film_float_to_byte(float4 color)
 	return result;
 }
 
+/* Passes
+ *
+ * Values gathered along the path, written to the render buffer after the
+ * path is done. Light passes are accumulated like the combined pass, depth
+ * keeps the closest hit of all samples along with its object id. */
+
+typedef struct PathPasses {
+	float3 direct;
+	float3 normal;
+	float depth;
+	float object_id;
+} PathPasses;
+
+#ifdef __PASSES__
+
+__device_inline void film_passes_init(PathPasses *passes)
+{
+	passes->direct = make_float3(0.0f, 0.0f, 0.0f);
+	passes->normal = make_float3(0.0f, 0.0f, 0.0f);
+	passes->depth = FLT_MAX;
+	passes->object_id = 0.0f;
+}
+
+__device_inline void film_passes_first_hit(PathPasses *passes, ShaderData *sd, float t)
+{
+	passes->normal = sd->N;
+	passes->depth = t;
+	passes->object_id = (sd->object == ~0)? 0.0f: (float)(sd->object + 1);
+}
+
+__device_inline void film_pass_accumulate(__global float4 *pass, float4 value, int sample)
+{
+	if(sample == 0)
+		*pass = value;
+	else
+		*pass += value;
+}
+
+__device void film_write_passes(KernelGlobals *kg, __global float4 *pixel, float4 L, PathPasses *passes, int sample)
+{
+	if(kernel_data.film.pass_depth) {
+		__global float4 *pass = pixel + kernel_data.film.pass_depth;
+
+		if(sample == 0 || passes->depth < pass->x)
+			*pass = make_float4(passes->depth, 0.0f, 0.0f, 0.0f);
+	}
+
+	if(kernel_data.film.pass_object_id) {
+		__global float4 *pass = pixel + kernel_data.film.pass_object_id;
+
+		if(sample == 0 || passes->depth < pass->y)
+			*pass = make_float4(passes->object_id, passes->depth, 0.0f, 0.0f);
+	}
+
+	if(kernel_data.film.pass_normal) {
+		float3 N = passes->normal;
+		film_pass_accumulate(pixel + kernel_data.film.pass_normal, make_float4(N.x, N.y, N.z, 0.0f), sample);
+	}
+
+	if(kernel_data.film.pass_direct) {
+		float3 direct = passes->direct;
+		film_pass_accumulate(pixel + kernel_data.film.pass_direct, make_float4(direct.x, direct.y, direct.z, 0.0f), sample);
+	}
+
+	if(kernel_data.film.pass_indirect) {
+		float3 indirect = make_float3(L.x, L.y, L.z) - passes->direct;
+		film_pass_accumulate(pixel + kernel_data.film.pass_indirect, make_float4(indirect.x, indirect.y, indirect.z, 0.0f), sample);
+	}
+}
+
+#endif
+
+#ifdef __ADAPTIVE_SAMPLING__
+
+/* Adaptive sampling statistics are stored per pixel as: sum of luminance,
+ * sum of squared luminance, number of samples and a converged flag. */
+
+__device void film_adaptive_accumulate(KernelGlobals *kg, __global float4 *pixel, float4 L, int sample)
+{
+	__global float4 *stats = pixel + kernel_data.film.pass_adaptive;
+	float4 S = (sample == 0)? make_float4(0.0f, 0.0f, 0.0f, 0.0f): *stats;
+	float lum = linear_rgb_to_gray(make_float3(L.x, L.y, L.z));
+
+	S.x += lum;
+	S.y += lum*lum;
+	S.z += 1.0f;
+
+	/* pixel converged once the standard error of its mean, relative to
+	   the mean, drops below the threshold */
+	if(S.z >= (float)kernel_data.integrator.adaptive_min_samples) {
+		float n = S.z;
+		float mean = S.x/n;
+		float variance = max(S.y/n - mean*mean, 0.0f)/(n - 1.0f);
+		float error = sqrtf(variance)/max(mean, 1e-3f);
+
+		if(error < kernel_data.integrator.adaptive_threshold)
+			S.w = 1.0f;
+	}
+
+	*stats = S;
+}
+
+__device bool film_adaptive_converged(KernelGlobals *kg, __global float4 *pixel, int sample)
+{
+	return (sample > 0 && pixel[kernel_data.film.pass_adaptive].w != 0.0f);
+}
+
+#endif
+
 __device void kernel_film_tonemap(KernelGlobals *kg, __global uchar4 *rgba, __global float4 *buffer, int sample, int resolution, int x, int y)
 {
 	int w = kernel_data.cam.width;
 	int index = x + y*w;
-	float4 irradiance = buffer[index];
+	__global float4 *pixel = buffer + index*kernel_data.film.pass_stride;
+	float4 irradiance = pixel[0];
+
+#ifdef __ADAPTIVE_SAMPLING__
+	/* converged pixels received fewer samples than the others */
+	if(kernel_data.film.pass_adaptive) {
+		float num_samples = pixel[kernel_data.film.pass_adaptive].z;
+
+		if(num_samples > 0.0f)
+			sample = min(sample, (int)num_samples - 1);
+	}
+#endif
 
 	float4 float_result = film_map(kg, irradiance, sample);
 	uchar4 byte_result = film_float_to_byte(float_result);
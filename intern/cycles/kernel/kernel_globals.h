@@ -24,6 +24,10 @@
 #include "osl_globals.h"
 #endif
 
+#include "util_perf_counters.h"
+#include "util_texture_cache.h"
+#include "util_thread.h"
+
 #endif
 
 CCL_NAMESPACE_BEGIN
@@ -43,16 +47,66 @@ typedef struct KernelGlobals {
 
 	KernelData __data;
 
+	/* image textures loaded on demand, if used */
+	TextureCache *texture_cache;
+
 #ifdef __OSL__
 	/* On the CPU, we also have the OSL globals here. Most data structures are shared
 	   with SVM, the difference is in the shaders and object/mesh attributes. */
 	OSLGlobals osl;
 #endif
 
+#ifdef __PERF_COUNTERS__
+	/* render threads share the globals, so each thread sets its own counters,
+	   NULL if profiling is disabled */
+	static tls_ptr(PerfCounters, perf_counters);
+#endif
+
 } KernelGlobals;
 
 #endif
 
+/* Performance Counters
+ *
+ * Counting happens in local variables inside the traversal and shader loops,
+ * these functions then add the totals once to the counters of the thread. */
+
+#ifdef __PERF_COUNTERS__
+
+__device_inline PerfCounters *kernel_perf_counters(KernelGlobals *kg)
+{
+	return tls_get(PerfCounters, kg->perf_counters);
+}
+
+__device_inline void kernel_perf_count_ray(KernelGlobals *kg, int bvh_nodes, int triangle_tests)
+{
+	PerfCounters *counters = kernel_perf_counters(kg);
+
+	if(counters) {
+		counters->rays++;
+		counters->bvh_nodes += bvh_nodes;
+		counters->triangle_tests += triangle_tests;
+	}
+}
+
+__device_inline void kernel_perf_count_shader(KernelGlobals *kg, int shader, int svm_nodes)
+{
+	PerfCounters *counters = kernel_perf_counters(kg);
+
+	if(counters)
+		counters->add_shader(shader, svm_nodes);
+}
+
+#define PERF_COUNT(var) (var)++
+
+#else
+
+#define kernel_perf_count_ray(kg, bvh_nodes, triangle_tests)
+#define kernel_perf_count_shader(kg, shader, svm_nodes)
+#define PERF_COUNT(var)
+
+#endif
+
 /* For CUDA, constant memory textures must be globals, so we can't put them
    into a struct. As a result we don't actually use this struct and use actual
    globals and simply pass along a NULL pointer everywhere, which we hope gets
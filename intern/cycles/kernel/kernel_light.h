@@ -23,6 +23,7 @@ typedef struct LightSample {
 	float3 D;
 	float3 Ng;
 	float t;
+	float pdf; /* probability of picking the light, per area for triangles */
 	int object;
 	int prim;
 	int shader;
@@ -112,11 +113,9 @@ __device void regular_light_sample(KernelGlobals *kg, int point,
 	ls->prim = ~0;
 }
 
-__device float regular_light_pdf(KernelGlobals *kg,
+__device float regular_light_pdf(KernelGlobals *kg, float pdf,
 	const float3 Ng, const float3 I, float t)
 {
-	float pdf = kernel_data.integrator.pdf_lights;
-
 	if(t == FLT_MAX)
 		return pdf;
 
@@ -149,7 +148,7 @@ __device void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 #endif
 }
 
-__device float triangle_light_pdf(KernelGlobals *kg,
+__device float triangle_light_pdf(KernelGlobals *kg, float pdf,
 	const float3 Ng, const float3 I, float t)
 {
 	float cos_pi = fabsf(dot(Ng, I));
@@ -157,7 +156,7 @@ __device float triangle_light_pdf(KernelGlobals *kg,
 	if(cos_pi == 0.0f)
 		return 0.0f;
 	
-	return (t*t*kernel_data.integrator.pdf_triangles)/cos_pi;
+	return (t*t*pdf)/cos_pi;
 }
 
 /* Light Distribution */
@@ -190,12 +189,216 @@ __device int light_distribution_sample(KernelGlobals *kg, float randt)
 	return first;
 }
 
+/* Light Tree
+ *
+ * Emitters in the first part of the light distribution are grouped in a tree
+ * built on the host, see light_tree.cpp. From the root we descend into either
+ * child with probability proportional to an estimate of its contribution at
+ * the shading point, based on energy, distance and a cone bounding emission
+ * directions. In the leaf an emitter is picked by energy. Distant lights are
+ * not in the tree and picked from the remaining part of the distribution. */
+
+__device float light_tree_node_importance(KernelGlobals *kg, int node, float3 P)
+{
+	float4 data0 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 0);
+	float energy = data0.w;
+
+	if(energy == 0.0f)
+		return 0.0f;
+
+	float4 data1 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1);
+	float4 data2 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 2);
+
+	float3 bmin = make_float3(data0.x, data0.y, data0.z);
+	float3 bmax = make_float3(data1.x, data1.y, data1.z);
+	float3 V = P - 0.5f*(bmin + bmax);
+	float dist2 = dot(V, V);
+	float radius2 = 0.25f*dot(bmax - bmin, bmax - bmin);
+	float theta_o = data2.w;
+	float cos_theta = 1.0f;
+
+	/* bound angle between emission cone and shading point, only when the
+	   point is outside the bounding sphere and emission is not omnidirectional */
+	if(theta_o < M_PI_F && dist2 > radius2) {
+		float4 data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+		float theta_e = data3.x;
+
+		float3 axis = make_float3(data2.x, data2.y, data2.z);
+		float dist = sqrtf(dist2);
+		float theta = acosf(clamp(dot(axis, V)/dist, -1.0f, 1.0f));
+		float theta_u = asinf(sqrtf(radius2/dist2));
+		float theta_p = max(theta - theta_o - theta_u, 0.0f);
+
+		if(theta_p >= theta_e)
+			return 0.0f;
+
+		cos_theta = cosf(theta_p);
+	}
+
+	/* distance is clamped to the bounding sphere, so nodes containing the
+	   shading point don't get a too high importance */
+	return energy*cos_theta/max(max(dist2, radius2), 1e-10f);
+}
+
+__device float light_tree_leaf_pdf(KernelGlobals *kg, int index, int leaf)
+{
+	float4 l = kernel_tex_fetch(__light_distribution, index);
+
+	/* triangles are picked by area, which is their energy, so we can
+	   directly give the probability per area */
+	if(__float_as_int(l.y) >= 0) {
+		float4 data0 = kernel_tex_fetch(__light_tree_nodes, leaf*LIGHT_TREE_NODE_SIZE + 0);
+		return 1.0f/data0.w;
+	}
+
+	float4 data3 = kernel_tex_fetch(__light_tree_nodes, leaf*LIGHT_TREE_NODE_SIZE + 3);
+	int first = __float_as_int(data3.y);
+	int num = __float_as_int(data3.w);
+
+	float cdf_first = kernel_tex_fetch(__light_distribution, first).x;
+	float cdf_last = kernel_tex_fetch(__light_distribution, first + num).x;
+	float cdf_next = kernel_tex_fetch(__light_distribution, index + 1).x;
+
+	return (cdf_next - l.x)/(cdf_last - cdf_first);
+}
+
+__device int light_tree_sample(KernelGlobals *kg, float randt, float3 P, float *pdf)
+{
+	int num_emitters = kernel_data.integrator.num_light_tree_emitters;
+	float tree_cdf = kernel_tex_fetch(__light_distribution, num_emitters).x;
+
+	/* distant lights */
+	if(randt >= tree_cdf) {
+		int index = light_distribution_sample(kg, randt);
+
+		*pdf = kernel_tex_fetch(__light_distribution, index + 1).x - kernel_tex_fetch(__light_distribution, index).x;
+		return index;
+	}
+
+	/* descend tree, reusing the random number at every level */
+	int node = 0;
+	float4 data3 = kernel_tex_fetch(__light_tree_nodes, 3);
+
+	randt = randt/tree_cdf;
+	*pdf = tree_cdf;
+
+	while(__float_as_int(data3.w) == 0) {
+		int left = node + 1;
+		int right = __float_as_int(data3.z);
+
+		float importance_left = light_tree_node_importance(kg, left, P);
+		float importance_right = light_tree_node_importance(kg, right, P);
+		float importance = importance_left + importance_right;
+
+		/* no light in the tree can contribute */
+		if(importance == 0.0f)
+			return -1;
+
+		float p_left = importance_left/importance;
+
+		if(randt < p_left || importance_right == 0.0f) {
+			node = left;
+			randt = randt/p_left;
+			*pdf *= p_left;
+		}
+		else {
+			node = right;
+			randt = (randt - p_left)/(1.0f - p_left);
+			*pdf *= 1.0f - p_left;
+		}
+
+		data3 = kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 3);
+	}
+
+	/* pick emitter in leaf by energy */
+	int first = __float_as_int(data3.y);
+	int num = __float_as_int(data3.w);
+
+	float cdf_first = kernel_tex_fetch(__light_distribution, first).x;
+	float cdf_last = kernel_tex_fetch(__light_distribution, first + num).x;
+	float cdf_target = cdf_first + randt*(cdf_last - cdf_first);
+	int index = first;
+
+	while(index < first + num - 1 && cdf_target >= kernel_tex_fetch(__light_distribution, index + 1).x)
+		index++;
+
+	*pdf *= light_tree_leaf_pdf(kg, index, node);
+
+	return index;
+}
+
+__device float light_tree_pdf(KernelGlobals *kg, int index, float3 P)
+{
+	int num_emitters = kernel_data.integrator.num_light_tree_emitters;
+	float4 l = kernel_tex_fetch(__light_distribution, index);
+	int node = __float_as_int(l.z);
+
+	float pdf = kernel_tex_fetch(__light_distribution, num_emitters).x;
+	pdf *= light_tree_leaf_pdf(kg, index, node);
+
+	/* walk up to the root, with the same probabilities as for sampling */
+	while(node != 0) {
+		int parent = __float_as_int(kernel_tex_fetch(__light_tree_nodes, node*LIGHT_TREE_NODE_SIZE + 1).w);
+		int right = __float_as_int(kernel_tex_fetch(__light_tree_nodes, parent*LIGHT_TREE_NODE_SIZE + 3).z);
+		int sibling = (node == right)? parent + 1: right;
+
+		float importance = light_tree_node_importance(kg, node, P);
+		float importance_sibling = light_tree_node_importance(kg, sibling, P);
+
+		if(importance == 0.0f)
+			return 0.0f;
+
+		pdf *= importance/(importance + importance_sibling);
+		node = parent;
+	}
+
+	return pdf;
+}
+
+__device int light_tree_triangle_index(KernelGlobals *kg, int object, int prim)
+{
+	/* binary search in map sorted by object and triangle */
+	int first = 0;
+	int len = kernel_data.integrator.num_light_tree_triangles;
+
+	while(len > 0) {
+		int half_len = len >> 1;
+		int middle = first + half_len;
+		uint4 m = kernel_tex_fetch(__light_tree_triangles, middle);
+
+		if(m.x < (uint)object || (m.x == (uint)object && m.y < (uint)prim)) {
+			first = middle + 1;
+			len = len - half_len - 1;
+		}
+		else
+			len = half_len;
+	}
+
+	if(first < kernel_data.integrator.num_light_tree_triangles) {
+		uint4 m = kernel_tex_fetch(__light_tree_triangles, first);
+
+		if(m.x == (uint)object && m.y == (uint)prim)
+			return m.z;
+	}
+
+	return -1;
+}
+
 /* Generic Light */
 
-__device void light_sample(KernelGlobals *kg, float randt, float randu, float randv, float3 P, LightSample *ls)
+__device bool light_sample(KernelGlobals *kg, float randt, float randu, float randv, float3 P, LightSample *ls)
 {
 	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	int index;
+
+	if(kernel_data.integrator.use_light_tree) {
+		index = light_tree_sample(kg, randt, P, &ls->pdf);
+
+		if(index == -1)
+			return false;
+	}
+	else
+		index = light_distribution_sample(kg, randt);
 
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
@@ -204,15 +407,23 @@ __device void light_sample(KernelGlobals *kg, float randt, float randu, float ra
 	if(prim >= 0) {
 		int object = __float_as_int(l.w);
 		triangle_light_sample(kg, prim, object, randu, randv, ls);
+
+		if(!kernel_data.integrator.use_light_tree)
+			ls->pdf = kernel_data.integrator.pdf_triangles;
 	}
 	else {
 		int point = -prim-1;
 		regular_light_sample(kg, point, randu, randv, P, ls);
+
+		if(!kernel_data.integrator.use_light_tree)
+			ls->pdf = kernel_data.integrator.pdf_lights;
 	}
 
 	/* compute incoming direction and distance */
 	if(ls->t != FLT_MAX)
 		ls->D = normalize_len(ls->P - P, &ls->t);
+
+	return true;
 }
 
 __device float light_sample_pdf(KernelGlobals *kg, LightSample *ls, float3 I, float t)
@@ -220,21 +431,33 @@ __device float light_sample_pdf(KernelGlobals *kg, LightSample *ls, float3 I, fl
 	float pdf;
 
 	if(ls->prim != ~0)
-		pdf = triangle_light_pdf(kg, ls->Ng, I, t);
+		pdf = triangle_light_pdf(kg, ls->pdf, ls->Ng, I, t);
 	else
-		pdf = regular_light_pdf(kg, ls->Ng, I, t);
+		pdf = regular_light_pdf(kg, ls->pdf, ls->Ng, I, t);
 	
 	return pdf;
 }
 
+__device float triangle_light_select_pdf(KernelGlobals *kg, int object, int prim, float3 P)
+{
+	/* probability per area of picking the triangle from shading point P */
+	if(kernel_data.integrator.use_light_tree) {
+		int index = light_tree_triangle_index(kg, object, prim);
+		return (index == -1)? 0.0f: light_tree_pdf(kg, index, P);
+	}
+
+	return kernel_data.integrator.pdf_triangles;
+}
+
 __device void light_select(KernelGlobals *kg, int index, float randu, float randv, float3 P, LightSample *ls)
 {
 	regular_light_sample(kg, index, randu, randv, P, ls);
+	ls->pdf = kernel_data.integrator.pdf_lights;
 }
 
 __device float light_select_pdf(KernelGlobals *kg, LightSample *ls, float3 I, float t)
 {
-	return regular_light_pdf(kg, ls->Ng, I, t);
+	return regular_light_pdf(kg, ls->pdf, ls->Ng, I, t);
 }
 
 CCL_NAMESPACE_END
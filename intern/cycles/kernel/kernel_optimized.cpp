@@ -22,6 +22,9 @@
 
 #ifdef WITH_OPTIMIZED_KERNEL
 
+/* enables SSE intrinsics and QBVH traversal in the kernel headers */
+#define __KERNEL_SSE__
+
 #include "kernel.h"
 #include "kernel_compat_cpu.h"
 #include "kernel_math.h"
@@ -231,7 +231,7 @@ __device_inline bool shadow_blocked(KernelGlobals *kg, PathState *state, Ray *ra
 	return result;
 }
 
-__device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, float3 throughput)
+__device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, float3 throughput, PathPasses *passes)
 {
 	/* initialize */
 	float3 L = make_float3(0.0f, 0.0f, 0.0f);
@@ -245,6 +245,10 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 
 	path_state_init(&state);
 
+#ifdef __PASSES__
+	film_passes_init(passes);
+#endif
+
 	/* path iteration */
 	for(;; rng_offset += PRNG_BOUNCE_NUM) {
 		/* intersect scene */
@@ -260,10 +264,16 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 #ifdef __BACKGROUND__
 				ShaderData sd;
 				shader_setup_from_background(kg, &sd, &ray);
-				L += throughput*shader_eval_background(kg, &sd, state.flag);
+				float3 Lbackground = throughput*shader_eval_background(kg, &sd, state.flag);
 				shader_release(kg, &sd);
 #else
-				L += throughput*make_float3(0.8f, 0.8f, 0.8f);
+				float3 Lbackground = throughput*make_float3(0.8f, 0.8f, 0.8f);
+#endif
+				L += Lbackground;
+
+#ifdef __PASSES__
+				if(state.bounce == 0)
+					passes->direct += Lbackground;
 #endif
 			}
 
@@ -276,6 +286,11 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 		float rbsdf = path_rng(kg, rng, sample, rng_offset + PRNG_BSDF);
 		shader_eval_surface(kg, &sd, rbsdf, state.flag);
 
+#ifdef __PASSES__
+		if(state.bounce == 0)
+			film_passes_first_hit(passes, &sd, isect.t);
+#endif
+
 #ifdef __HOLDOUT__
 		if((sd.flag & SD_HOLDOUT) && (state.flag & PATH_RAY_CAMERA)) {
 			float3 holdout_weight = shader_holdout_eval(kg, &sd);
@@ -287,8 +302,15 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 
 #ifdef __EMISSION__
 		/* emission */
-		if(sd.flag & SD_EMISSION)
-			L += throughput*indirect_emission(kg, &sd, isect.t, state.flag, ray_pdf);
+		if(sd.flag & SD_EMISSION) {
+			float3 Lemission = throughput*indirect_emission(kg, &sd, isect.t, state.flag, ray_pdf);
+			L += Lemission;
+
+#ifdef __PASSES__
+			if(state.bounce == 0)
+				passes->direct += Lemission;
+#endif
+		}
 #endif
 
 		/* path termination. this is a strange place to put the termination, it's
@@ -324,8 +346,14 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 #endif
 					if(direct_emission(kg, &sd, i, light_t, light_o, light_u, light_v, &light_ray, &light_L)) {
 						/* trace shadow ray */
-						if(!shadow_blocked(kg, &state, &light_ray, &isect, &light_L))
+						if(!shadow_blocked(kg, &state, &light_ray, &isect, &light_L)) {
 							L += throughput*light_L;
+
+#ifdef __PASSES__
+							if(state.bounce == 0)
+								passes->direct += throughput*light_L;
+#endif
+						}
 					}
 #ifdef __MULTI_LIGHT__
 				}
@@ -381,6 +409,15 @@ __device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, R
 
 __device void kernel_path_trace(KernelGlobals *kg, __global float4 *buffer, __global uint *rng_state, int sample, int x, int y)
 {
+	int index = x + y*kernel_data.cam.width;
+	__global float4 *pixel = buffer + index*kernel_data.film.pass_stride;
+
+#ifdef __ADAPTIVE_SAMPLING__
+	/* skip pixels that already converged */
+	if(kernel_data.film.pass_adaptive && film_adaptive_converged(kg, pixel, sample))
+		return;
+#endif
+
 	/* initialize random numbers */
 	RNG rng;
 
@@ -398,21 +435,30 @@ __device void kernel_path_trace(KernelGlobals *kg, __global float4 *buffer, __gl
 	camera_sample(kg, x, y, filter_u, filter_v, lens_u, lens_v, &ray);
 
 	/* integrate */
+	PathPasses passes;
+
 #ifdef __MODIFY_TP__
 	float3 throughput = path_terminate_modified_throughput(kg, buffer, x, y, sample);
-	float4 L = kernel_path_integrate(kg, &rng, sample, ray, throughput)/throughput;
+	float4 L = kernel_path_integrate(kg, &rng, sample, ray, throughput, &passes)/throughput;
 #else
 	float3 throughput = make_float3(1.0f, 1.0f, 1.0f);
-	float4 L = kernel_path_integrate(kg, &rng, sample, ray, throughput);
+	float4 L = kernel_path_integrate(kg, &rng, sample, ray, throughput, &passes);
 #endif
 
 	/* accumulate result in output buffer */
-	int index = x + y*kernel_data.cam.width;
-
 	if(sample == 0)
-		buffer[index] = L;
+		pixel[0] = L;
 	else
-		buffer[index] += L;
+		pixel[0] += L;
+
+#ifdef __PASSES__
+	film_write_passes(kg, pixel, L, &passes, sample);
+#endif
+
+#ifdef __ADAPTIVE_SAMPLING__
+	if(kernel_data.film.pass_adaptive)
+		film_adaptive_accumulate(kg, pixel, L, sample);
+#endif
 
 	path_rng_end(kg, rng_state, rng, x, y);
 }
@@ -74,10 +74,15 @@ __device_inline void qbvh_instance_pop(KernelGlobals *kg, int object, const Ray
 	*idir = qbvh_inverse_direction(ray->D);
 }
 
-#ifdef __KERNEL_CPU__
+/* Intersect the four child bounding boxes of a node. Returns a mask with a
+   bit set for each child that was hit, and fills in the entry distances of
+   all children so they can be traversed front to back. Empty child slots have
+   no visibility flags set, and are never hit. */
 
-__device_inline void qbvh_node_intersect(KernelGlobals *kg, int *traverseChild,
-	int nodeAddrChild[4], float3 P, float3 idir, float t, int nodeAddr)
+#ifdef __KERNEL_SSE__
+
+__device_inline int qbvh_node_intersect(KernelGlobals *kg, float dist[4],
+	int nodeAddrChild[4], float3 P, float3 idir, float t, uint visibility, int nodeAddr)
 {
 	/* X axis */
 	const __m128 bminx = kernel_tex_fetch_m128(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+0);
@@ -106,8 +111,18 @@ __device_inline void qbvh_node_intersect(KernelGlobals *kg, int *traverseChild,
 	tmin = _mm_max_ps(_mm_min_ps(t0z, t1z), tmin);
 	tmax = _mm_min_ps(_mm_max_ps(t0z, t1z), tmax);
 
+	/* visibility test, also culls empty child slots */
+#ifndef __VISIBILITY_FLAG__
+	visibility = ~0;
+#endif
+	const __m128i cvisibility = _mm_and_si128(kernel_tex_fetch_m128i(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+7),
+		_mm_set1_epi32(visibility));
+	const __m128 culled = _mm_castsi128_ps(_mm_cmpeq_epi32(cvisibility, _mm_setzero_si128()));
+
 	/* compare and get mask */
-	*traverseChild = _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+	int traverseChild = _mm_movemask_ps(_mm_andnot_ps(culled, _mm_cmple_ps(tmin, tmax)));
+
+	_mm_storeu_ps(dist, tmin);
 
 	/* get node addresses */
 	float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+6);
@@ -116,11 +131,13 @@ __device_inline void qbvh_node_intersect(KernelGlobals *kg, int *traverseChild,
 	nodeAddrChild[1] = __float_as_int(cnodes.y);
 	nodeAddrChild[2] = __float_as_int(cnodes.z);
 	nodeAddrChild[3] = __float_as_int(cnodes.w);
+
+	return traverseChild;
 }
 
 #else
 
-__device_inline bool qbvh_bb_intersect(float3 bmin, float3 bmax, float3 P, float3 idir, float t)
+__device_inline bool qbvh_bb_intersect(float3 bmin, float3 bmax, float3 P, float3 idir, float t, float *dist)
 {
 	float t0x = (bmin.x - P.x)*idir.x;
 	float t1x = (bmax.x - P.x)*idir.x;
@@ -139,12 +156,13 @@ __device_inline bool qbvh_bb_intersect(float3 bmin, float3 bmax, float3 P, float
 	float tmin = max4(0.0f, minx, miny, minz);
 	float tmax = min4(t, maxx, maxy, maxz);
 
+	*dist = tmin;
+
 	return (tmin <= tmax);
 }
 
-/* intersect four bounding boxes */
-__device_inline void qbvh_node_intersect(KernelGlobals *kg, int *traverseChild,
-	int nodeAddrChild[4], float3 P, float3 idir, float t, int nodeAddr)
+__device_inline int qbvh_node_intersect(KernelGlobals *kg, float dist[4],
+	int nodeAddrChild[4], float3 P, float3 idir, float t, uint visibility, int nodeAddr)
 {
 	/* fetch node data */
 	float4 minx = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+0);
@@ -153,32 +171,41 @@ __device_inline void qbvh_node_intersect(KernelGlobals *kg, int *traverseChild,
 	float4 maxx = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+1);
 	float4 maxy = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+3);
 	float4 maxz = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+5);
+	float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+6);
+	float4 cvisibility = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+7);
+
+#ifndef __VISIBILITY_FLAG__
+	visibility = ~0;
+#endif
 
 	/* intersect bounding boxes */
-	bool traverseChild0 = qbvh_bb_intersect(make_float3(minx.x, miny.x, minz.x), make_float3(maxx.x, maxy.x, maxz.x), P, idir, t);
-	bool traverseChild1 = qbvh_bb_intersect(make_float3(minx.y, miny.y, minz.y), make_float3(maxx.y, maxy.y, maxz.y), P, idir, t);
-	bool traverseChild2 = qbvh_bb_intersect(make_float3(minx.z, miny.z, minz.z), make_float3(maxx.z, maxy.z, maxz.z), P, idir, t);
-	bool traverseChild3 = qbvh_bb_intersect(make_float3(minx.w, miny.w, minz.w), make_float3(maxx.w, maxy.w, maxz.w), P, idir, t);
+	int traverseChild = 0;
 
-	*traverseChild = 0;
-	if(traverseChild0) *traverseChild |= 1;
-	if(traverseChild1) *traverseChild |= 2;
-	if(traverseChild2) *traverseChild |= 4;
-	if(traverseChild3) *traverseChild |= 8;
+	for(int i = 0; i < 4; i++) {
+		if(!(__float_as_int(cvisibility[i]) & visibility)) {
+			dist[i] = FLT_MAX;
+			continue;
+		}
 
-	/* get node addresses */
-	float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*QBVH_NODE_SIZE+6);
+		if(qbvh_bb_intersect(make_float3(minx[i], miny[i], minz[i]),
+		   make_float3(maxx[i], maxy[i], maxz[i]), P, idir, t, &dist[i]))
+			traverseChild |= (1 << i);
+	}
 
+	/* get node addresses */
 	nodeAddrChild[0] = __float_as_int(cnodes.x);
 	nodeAddrChild[1] = __float_as_int(cnodes.y);
 	nodeAddrChild[2] = __float_as_int(cnodes.z);
 	nodeAddrChild[3] = __float_as_int(cnodes.w);
+
+	return traverseChild;
 }
 
 #endif
 
 /* Sven Woop's algorithm */
-__device_inline void qbvh_triangle_intersect(KernelGlobals *kg, Intersection *isect, float3 P, float3 idir, int object, int triAddr)
+__device_inline void qbvh_triangle_intersect(KernelGlobals *kg, Intersection *isect,
+	float3 P, float3 idir, uint visibility, int object, int triAddr)
 {
 	/* compute and check intersection t-value */
 	float4 v00 = kernel_tex_fetch(__tri_woop, triAddr*TRI_NODE_SIZE+0);
@@ -203,18 +230,25 @@ __device_inline void qbvh_triangle_intersect(KernelGlobals *kg, Intersection *is
 			float v = Oy + t*Dy;
 
 			if(v >= 0.0f && u + v <= 1.0f) {
-				/* record intersection */
-				isect->prim = triAddr;
-				isect->object = object;
-				isect->u = u;
-				isect->v = v;
-				isect->t = t;
+#ifdef __VISIBILITY_FLAG__
+				/* visibility flag test. we do it here under the assumption
+				   that most triangles are culled by node flags */
+				if(kernel_tex_fetch(__prim_visibility, triAddr) & visibility)
+#endif
+				{
+					/* record intersection */
+					isect->prim = triAddr;
+					isect->object = object;
+					isect->u = u;
+					isect->v = v;
+					isect->t = t;
+				}
 			}
 		}
 	}
 }
 
-__device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const bool isshadowray, Intersection *isect)
+__device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const uint visibility, Intersection *isect)
 {
 	/* traversal stack in CUDA thread-local memory */
 	int traversalStack[QBVH_STACK_SIZE];
@@ -236,6 +270,10 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const bo
 	isect->u = 0.0f;
 	isect->v = 0.0f;
 
+#ifdef __PERF_COUNTERS__
+	int num_nodes = 0, num_triangles = 0;
+#endif
+
 	/* traversal loop */
 	do {
 		do
@@ -243,32 +281,47 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const bo
 			/* traverse internal nodes */
 			while(nodeAddr >= 0 && nodeAddr != ENTRYPOINT_SENTINEL)
 			{
-				int traverseChild, nodeAddrChild[4];
+				int nodeAddrChild[4];
+				float dist[4];
 
-				qbvh_node_intersect(kg, &traverseChild, nodeAddrChild,
-					P, idir, isect->t, nodeAddr);
+				int traverseChild = qbvh_node_intersect(kg, dist, nodeAddrChild,
+					P, idir, isect->t, visibility, nodeAddr);
+				PERF_COUNT(num_nodes);
 
-				if(traverseChild & 1) {
-					++stackPtr;
-					traversalStack[stackPtr] = nodeAddrChild[0];
+				if(traverseChild == 0) {
+					/* no child was intersected */
+					nodeAddr = traversalStack[stackPtr];
+					--stackPtr;
+					continue;
 				}
 
-				if(traverseChild & 2) {
-					++stackPtr;
-					traversalStack[stackPtr] = nodeAddrChild[1];
-				}
-				if(traverseChild & 4) {
-					++stackPtr;
-					traversalStack[stackPtr] = nodeAddrChild[2];
+				/* sort intersected children by decreasing distance */
+				int childAddr[4];
+				float childDist[4];
+				int numChild = 0;
+
+				for(int i = 0; i < 4; i++) {
+					if(traverseChild & (1 << i)) {
+						int j = numChild++;
+
+						while(j > 0 && childDist[j-1] < dist[i]) {
+							childAddr[j] = childAddr[j-1];
+							childDist[j] = childDist[j-1];
+							j--;
+						}
+
+						childAddr[j] = nodeAddrChild[i];
+						childDist[j] = dist[i];
+					}
 				}
 
-				if(traverseChild & 8) {
+				/* push the farther children, and continue with the closest */
+				for(int i = 0; i < numChild-1; i++) {
 					++stackPtr;
-					traversalStack[stackPtr] = nodeAddrChild[3];
+					traversalStack[stackPtr] = childAddr[i];
 				}
 
-				nodeAddr = traversalStack[stackPtr];
-				--stackPtr;
+				nodeAddr = childAddr[numChild-1];
 			}
 
 			/* if node is leaf, fetch triangle list */
@@ -288,11 +341,14 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const bo
 					/* triangle intersection */
 					while(primAddr < primAddr2) {
 						/* intersect ray against triangle */
-						qbvh_triangle_intersect(kg, isect, P, idir, object, primAddr);
+						qbvh_triangle_intersect(kg, isect, P, idir, visibility, object, primAddr);
+						PERF_COUNT(num_triangles);
 
 						/* shadow ray early termination */
-						if(isshadowray && isect->prim != ~0)
+						if(visibility == PATH_RAY_SHADOW_OPAQUE && isect->prim != ~0) {
+							kernel_perf_count_ray(kg, num_nodes, num_triangles);
 							return true;
+						}
 
 						primAddr++;
 					}
@@ -326,6 +382,8 @@ __device_inline bool scene_intersect(KernelGlobals *kg, const Ray *ray, const bo
 #endif
 	} while(nodeAddr != ENTRYPOINT_SENTINEL);
 
+	kernel_perf_count_ray(kg, num_nodes, num_triangles);
+
 	return (isect->prim != ~0);
 }
 
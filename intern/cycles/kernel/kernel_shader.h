@@ -50,9 +50,8 @@ __device_inline void shader_setup_from_ray(KernelGlobals *kg, ShaderData *sd,
 {
 	/* fetch triangle data */
 	int prim = kernel_tex_fetch(__prim_index, isect->prim);
-	float4 Ns = kernel_tex_fetch(__tri_normal, prim);
-	float3 Ng = make_float3(Ns.x, Ns.y, Ns.z);
-	int shader = __float_as_int(Ns.w);
+	int shader;
+	float3 Ng = triangle_normal_MT(kg, prim, &shader);
 
 	/* vectors */
 	sd->P = bvh_triangle_refine(kg, isect, ray);
@@ -478,6 +477,7 @@ __device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 {
 #ifdef __OSL__
 	OSLShader::eval_surface(kg, sd, randb, path_flag);
+	kernel_perf_count_shader(kg, (sd->shader & SHADER_MASK)/2, 0);
 #else
 
 #ifdef __SVM__
@@ -495,6 +495,7 @@ __device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 __device float3 shader_eval_background(KernelGlobals *kg, ShaderData *sd, int path_flag)
 {
 #ifdef __OSL__
+	kernel_perf_count_shader(kg, (sd->shader & SHADER_MASK)/2, 0);
 	return OSLShader::eval_background(kg, sd, path_flag);
 #else
 
@@ -560,6 +561,7 @@ __device void shader_eval_volume(KernelGlobals *kg, ShaderData *sd,
 #ifdef __SVM__
 #ifdef __OSL__
 	OSLShader::eval_volume(kg, sd, randb, path_flag);
+	kernel_perf_count_shader(kg, (sd->shader & SHADER_MASK)/2, 0);
 #else
 	svm_eval_nodes(kg, sd, SHADER_TYPE_VOLUME, randb, path_flag);
 #endif
@@ -574,6 +576,7 @@ __device void shader_eval_displacement(KernelGlobals *kg, ShaderData *sd)
 #ifdef __SVM__
 #ifdef __OSL__
 	OSLShader::eval_displacement(kg, sd);
+	kernel_perf_count_shader(kg, (sd->shader & SHADER_MASK)/2, 0);
 #else
 	svm_eval_nodes(kg, sd, SHADER_TYPE_DISPLACEMENT, 0.0f, 0);
 #endif
@@ -586,8 +589,7 @@ __device void shader_eval_displacement(KernelGlobals *kg, ShaderData *sd)
 __device bool shader_transparent_shadow(KernelGlobals *kg, Intersection *isect)
 {
 	int prim = kernel_tex_fetch(__prim_index, isect->prim);
-	float4 Ns = kernel_tex_fetch(__tri_normal, prim);
-	int shader = __float_as_int(Ns.w);
+	int shader = triangle_shader(kg, prim);
 	int flag = kernel_tex_fetch(__shader_flag, shader & SHADER_MASK);
 
 	return (flag & SD_HAS_SURFACE_TRANSPARENT) != 0;
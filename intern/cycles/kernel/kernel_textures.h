@@ -25,14 +25,22 @@ KERNEL_TEX(float4, texture_float4, __tri_vnormal)
 KERNEL_TEX(float4, texture_float4, __tri_vindex)
 KERNEL_TEX(float4, texture_float4, __tri_verts)
 
+/* triangles, compact storage */
+KERNEL_TEX(uint, texture_uint, __tri_shader)
+KERNEL_TEX(uint, texture_uint, __tri_normal_oct)
+KERNEL_TEX(uint, texture_uint, __tri_vnormal_oct)
+
 /* attributes */
 KERNEL_TEX(uint4, texture_uint4, __attributes_map)
 KERNEL_TEX(float, texture_float, __attributes_float)
 KERNEL_TEX(float4, texture_float4, __attributes_float3)
+KERNEL_TEX(uint, texture_uint, __attributes_half2)
 
 /* lights */
 KERNEL_TEX(float4, texture_float4, __light_distribution)
 KERNEL_TEX(float4, texture_float4, __light_data)
+KERNEL_TEX(float4, texture_float4, __light_tree_nodes)
+KERNEL_TEX(uint4, texture_uint4, __light_tree_triangles)
 
 /* shaders */
 KERNEL_TEX(uint4, texture_uint4, __svm_nodes)
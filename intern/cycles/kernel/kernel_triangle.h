@@ -59,20 +59,42 @@ __device_inline float3 triangle_normal_MT(KernelGlobals *kg, int tri_index, int
 	/* compute normal */
 	return normalize(cross(v2 - v0, v1 - v0));
 #else
+	if(kernel_data.bvh.compact_storage) {
+		*shader = kernel_tex_fetch(__tri_shader, tri_index);
+		return octahedral_decode(kernel_tex_fetch(__tri_normal_oct, tri_index));
+	}
+
 	float4 Nm = kernel_tex_fetch(__tri_normal, tri_index);
 	*shader = __float_as_int(Nm.w);
 	return make_float3(Nm.x, Nm.y, Nm.z);
 #endif
 }
 
+/* Shader of triangle, without decoding the normal */
+__device_inline int triangle_shader(KernelGlobals *kg, int tri_index)
+{
+	if(kernel_data.bvh.compact_storage)
+		return kernel_tex_fetch(__tri_shader, tri_index);
+
+	return __float_as_int(kernel_tex_fetch(__tri_normal, tri_index).w);
+}
+
+__device_inline float3 triangle_vertex_normal(KernelGlobals *kg, int vert_index)
+{
+	if(kernel_data.bvh.compact_storage)
+		return octahedral_decode(kernel_tex_fetch(__tri_vnormal_oct, vert_index));
+
+	return float4_to_float3(kernel_tex_fetch(__tri_vnormal, vert_index));
+}
+
 __device_inline float3 triangle_smooth_normal(KernelGlobals *kg, int tri_index, float u, float v)
 {
 	/* load triangle vertices */
 	float3 tri_vindex = float4_to_float3(kernel_tex_fetch(__tri_vindex, tri_index));
 
-	float3 n0 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.x)));
-	float3 n1 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.y)));
-	float3 n2 = float4_to_float3(kernel_tex_fetch(__tri_vnormal, __float_as_int(tri_vindex.z)));
+	float3 n0 = triangle_vertex_normal(kg, __float_as_int(tri_vindex.x));
+	float3 n1 = triangle_vertex_normal(kg, __float_as_int(tri_vindex.y));
+	float3 n2 = triangle_vertex_normal(kg, __float_as_int(tri_vindex.z));
 
 	return normalize((1.0f - u - v)*n2 + u*n0 + v*n1);
 }
@@ -164,6 +186,19 @@ __device float3 triangle_attribute_float3(KernelGlobals *kg, const ShaderData *s
 		float3 f1 = float4_to_float3(kernel_tex_fetch(__attributes_float3, tri + 1));
 		float3 f2 = float4_to_float3(kernel_tex_fetch(__attributes_float3, tri + 2));
 
+#ifdef __RAY_DIFFERENTIALS__
+		if(dx) *dx = sd->du.dx*f0 + sd->dv.dx*f1 - (sd->du.dx + sd->dv.dx)*f2;
+		if(dy) *dy = sd->du.dy*f0 + sd->dv.dy*f1 - (sd->du.dy + sd->dv.dy)*f2;
+#endif
+
+		return sd->u*f0 + sd->v*f1 + (1.0f - sd->u - sd->v)*f2;
+	}
+	else if(elem == ATTR_ELEMENT_CORNER_HALF2) {
+		int tri = offset + sd->prim*3;
+		float3 f0 = half2_to_float3(kernel_tex_fetch(__attributes_half2, tri + 0));
+		float3 f1 = half2_to_float3(kernel_tex_fetch(__attributes_half2, tri + 1));
+		float3 f2 = half2_to_float3(kernel_tex_fetch(__attributes_half2, tri + 2));
+
 #ifdef __RAY_DIFFERENTIALS__
 		if(dx) *dx = sd->du.dx*f0 + sd->dv.dx*f1 - (sd->du.dx + sd->dv.dx)*f2;
 		if(dy) *dy = sd->du.dy*f0 + sd->dv.dy*f1 - (sd->du.dy + sd->dv.dy)*f2;
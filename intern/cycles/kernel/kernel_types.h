@@ -28,6 +28,7 @@ CCL_NAMESPACE_BEGIN
 /* constants */
 #define OBJECT_SIZE 		16
 #define LIGHT_SIZE			4
+#define LIGHT_TREE_NODE_SIZE	4
 #define FILTER_TABLE_SIZE	256
 
 /* device capabilities */
@@ -59,6 +60,8 @@ CCL_NAMESPACE_BEGIN
 #define __RAY_DIFFERENTIALS__
 #define __CAMERA_CLIPPING__
 #define __INTERSECTION_REFINE__
+#define __ADAPTIVE_SAMPLING__
+#define __PASSES__
 
 #ifdef __KERNEL_SHADING__
 #define __SVM__
@@ -76,7 +79,19 @@ CCL_NAMESPACE_BEGIN
 //#define __OSL__
 //#define __SOBOL_FULL_SCREEN__
 //#define __MODIFY_TP__
-//#define __QBVH__
+
+/* 4-wide SIMD BVH traversal, only in the SSE optimized CPU kernel. The device
+   reports support through Device::support_qbvh() so the scene BVH gets built
+   in the matching layout. */
+#ifdef __KERNEL_SSE__
+#define __QBVH__
+#endif
+
+/* Statistics for profiling, only gathered when the device enables them for
+   the render threads, see util_perf_counters.h */
+#ifdef __KERNEL_CPU__
+#define __PERF_COUNTERS__
+#endif
 
 /* Path Tracing */
 
@@ -156,6 +171,22 @@ typedef enum LightType {
 	LIGHT_AREA
 } LightType;
 
+/* Render Passes
+ *
+ * Passes stored in the render buffer next to the combined pass, written
+ * together in a single path tracing pass. */
+
+typedef enum PassType {
+	PASS_NONE = 0,
+	PASS_COMBINED,
+	PASS_DEPTH,
+	PASS_NORMAL,
+	PASS_OBJECT_ID,
+	PASS_DIRECT,
+	PASS_INDIRECT,
+	PASS_ADAPTIVE
+} PassType;
+
 /* Differential */
 
 typedef struct differential3 {
@@ -195,6 +226,7 @@ typedef enum AttributeElement {
 	ATTR_ELEMENT_FACE,
 	ATTR_ELEMENT_VERTEX,
 	ATTR_ELEMENT_CORNER,
+	ATTR_ELEMENT_CORNER_HALF2, /* float2 stored as half floats in compact storage */
 	ATTR_ELEMENT_VALUE,
 	ATTR_ELEMENT_NONE
 } AttributeElement;
@@ -345,7 +377,17 @@ typedef struct KernelCamera {
 
 typedef struct KernelFilm {
 	float exposure;
-	int pad1, pad2, pad3;
+
+	/* render buffer layout, in float4 per pixel, offsets of passes
+	   after the combined pass or 0 if not used */
+	int pass_stride;
+	int pass_adaptive;
+	int pass_depth;
+
+	int pass_normal;
+	int pass_object_id;
+	int pass_direct;
+	int pass_indirect;
 } KernelFilm;
 
 typedef struct KernelBackground {
@@ -377,6 +419,13 @@ typedef struct KernelIntegrator {
 	float pdf_triangles;
 	float pdf_lights;
 
+	/* light tree, the first num_light_tree_emitters entries of the light
+	   distribution are in the tree, distant lights after that are not */
+	int use_light_tree;
+	int num_light_tree_emitters;
+	int num_light_tree_triangles;
+	int pad1;
+
 	/* bounces */
 	int min_bounce;
 	int max_bounce;
@@ -396,13 +445,19 @@ typedef struct KernelIntegrator {
 
 	/* seed */
 	int seed;
+
+	/* adaptive sampling */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+	int pad2, pad3;
 } KernelIntegrator;
 
 typedef struct KernelBVH {
 	/* root node */
 	int root;
 	int attributes_map_stride;
-	int pad1, pad2;
+	int compact_storage;
+	int pad1;
 } KernelBVH;
 
 typedef struct KernelData {
@@ -161,8 +161,13 @@ __device_noinline void svm_eval_nodes(KernelGlobals *kg, ShaderData *sd, ShaderT
 	sd->closure.type = NBUILTIN_CLOSURES;
 #endif
 
+#ifdef __PERF_COUNTERS__
+	int num_nodes = 0;
+#endif
+
 	while(1) {
 		uint4 node = read_node(kg, &offset);
+		PERF_COUNT(num_nodes);
 
 		switch(node.x) {
 			case NODE_SHADER_JUMP: {
@@ -320,6 +325,7 @@ __device_noinline void svm_eval_nodes(KernelGlobals *kg, ShaderData *sd, ShaderT
 #ifndef __MULTI_CLOSURE__
 				sd->closure.weight *= closure_weight;
 #endif
+				kernel_perf_count_shader(kg, (sd->shader & SHADER_MASK)/2, num_nodes);
 				return;
 		}
 	}
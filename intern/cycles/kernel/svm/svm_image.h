@@ -18,10 +18,16 @@
 
 CCL_NAMESPACE_BEGIN
 
-__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y)
+__device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, float width)
 {
 	float4 r;
 
+#ifdef __KERNEL_CPU__
+	/* images loaded on demand */
+	if(kg->texture_cache)
+		return kg->texture_cache->lookup(id, x, y, width);
+#endif
+
 	/* not particularly proud of this massive switch, what are the
 	   alternatives?
 	   - use a single big 1D texture, and do our own lookup/filtering
@@ -144,6 +150,29 @@ __device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y)
 	return r;
 }
 
+__device float svm_image_filter_width(KernelGlobals *kg, ShaderData *sd, uint uv_id)
+{
+#if defined(__KERNEL_CPU__) && defined(__RAY_DIFFERENTIALS__)
+	/* filter width from the ray differentials mapped to the UV map, only known
+	   when the image uses the default UV map coordinates */
+	if(kg->texture_cache && uv_id && sd->object != ~0) {
+		NodeAttributeType type, mesh_type;
+		AttributeElement elem;
+		uint offset, out_offset;
+		uint4 node = make_uint4(NODE_ATTR, uv_id - 1, 0, NODE_ATTR_FLOAT3);
+
+		svm_node_attr_init(kg, sd, node, &type, &mesh_type, &elem, &offset, &out_offset);
+
+		float3 dx, dy;
+		triangle_attribute_float3(kg, sd, elem, offset, &dx, &dy);
+
+		return max(max(fabsf(dx.x), fabsf(dx.y)), max(fabsf(dy.x), fabsf(dy.y)));
+	}
+#endif
+
+	return 0.0f;
+}
+
 __device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node)
 {
 	uint id = node.y;
@@ -152,7 +181,8 @@ __device void svm_node_tex_image(KernelGlobals *kg, ShaderData *sd, float *stack
 	decode_node_uchar4(node.z, &co_offset, &out_offset, &alpha_offset, &srgb);
 
 	float3 co = stack_load_float3(stack, co_offset);
-	float4 f = svm_image_texture(kg, id, co.x, co.y);
+	float width = svm_image_filter_width(kg, sd, node.w);
+	float4 f = svm_image_texture(kg, id, co.x, co.y, width);
 	float3 r = make_float3(f.x, f.y, f.z);
 
 	if(srgb) {
@@ -177,7 +207,7 @@ __device void svm_node_tex_environment(KernelGlobals *kg, ShaderData *sd, float
 	float3 co = stack_load_float3(stack, co_offset);
 	float u = (atan2f(co.y, co.x) + M_PI_F)/(2*M_PI_F);
 	float v = atan2f(co.z, hypotf(co.x, co.y))/M_PI_F + 0.5f;
-	float4 f = svm_image_texture(kg, id, u, v);
+	float4 f = svm_image_texture(kg, id, u, v, 0.0f);
 	float3 r = make_float3(f.x, f.y, f.z);
 
 	if(srgb) {
@@ -22,6 +22,7 @@
 #include "device.h"
 
 #include "util_debug.h"
+#include "util_foreach.h"
 #include "util_hash.h"
 #include "util_image.h"
 #include "util_math.h"
@@ -31,13 +32,52 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Buffer Params */
+
+BufferParams::BufferParams()
+{
+	width = 0;
+	height = 0;
+
+	passes.push_back(PASS_COMBINED);
+}
+
+void BufferParams::add_pass(PassType type)
+{
+	if(get_pass_offset(type) == -1)
+		passes.push_back(type);
+}
+
+int BufferParams::get_pass_offset(PassType type)
+{
+	for(size_t i = 0; i < passes.size(); i++)
+		if(passes[i] == type)
+			return i;
+
+	return -1;
+}
+
+/* layer and channel names for writing multilayer images, each character of
+   the channels string is the name of one channel */
+
+static bool pass_layer(PassType type, const char **name, const char **channels)
+{
+	switch(type) {
+		case PASS_COMBINED: *name = "Combined"; *channels = "RGBA"; return true;
+		case PASS_DEPTH: *name = "Depth"; *channels = "Z"; return true;
+		case PASS_NORMAL: *name = "Normal"; *channels = "XYZ"; return true;
+		case PASS_OBJECT_ID: *name = "IndexOB"; *channels = "X"; return true;
+		case PASS_DIRECT: *name = "Direct"; *channels = "RGB"; return true;
+		case PASS_INDIRECT: *name = "Indirect"; *channels = "RGB"; return true;
+		default: return false;
+	}
+}
+
 /* Render Buffers */
 
 RenderBuffers::RenderBuffers(Device *device_)
 {
 	device = device_;
-	width = 0;
-	height = 0;
 }
 
 RenderBuffers::~RenderBuffers()
@@ -58,16 +98,18 @@ void RenderBuffers::device_free()
 	}
 }
 
-void RenderBuffers::reset(Device *device, int width_, int height_)
+void RenderBuffers::reset(Device *device, BufferParams& params_)
 {
-	width = width_;
-	height = height_;
+	params = params_;
+
+	int width = params.width;
+	int height = params.height;
 
 	/* free existing buffers */
 	device_free();
 	
 	/* allocate buffer */
-	buffer.resize(width, height);
+	buffer.resize(width*params.get_passes_size(), height);
 	device->mem_alloc(buffer, MEM_READ_WRITE);
 	device->mem_zero(buffer);
 
@@ -85,31 +127,171 @@ void RenderBuffers::reset(Device *device, int width_, int height_)
 	device->mem_copy_to(rng_state);
 }
 
-float4 *RenderBuffers::copy_from_device(float exposure, int sample)
+float4 *RenderBuffers::copy_from_device(float exposure, int sample, PassType type)
 {
 	if(!buffer.device_pointer)
 		return NULL;
 
+	if(params.get_pass_offset(type) == -1)
+		return NULL;
+
 	device->mem_copy_from(buffer, 0, buffer.memory_size());
 
-	float4 *out = new float4[width*height];
+	float4 *out = new float4[params.width*params.height];
+	get_pass(type, exposure, sample, out);
+
+	return out;
+}
+
+void RenderBuffers::get_pass(PassType type, float exposure, int sample, float4 *out)
+{
+	int pass_offset = params.get_pass_offset(type);
+	int pass_stride = params.get_passes_size();
+	int pass_adaptive = max(params.get_pass_offset(PASS_ADAPTIVE), 0);
+
 	float4 *in = (float4*)buffer.data_pointer;
-	float scale = 1.0f/(float)sample;
 	
-	for(int i = width*height - 1; i >= 0; i--) {
-		float4 rgba = in[i]*scale;
+	for(int i = params.width*params.height - 1; i >= 0; i--) {
+		float4 *pixel = in + i*pass_stride;
+		float4 value = pixel[pass_offset];
+
+		/* depth and object id are not accumulated */
+		if(type == PASS_DEPTH || type == PASS_OBJECT_ID) {
+			out[i] = make_float4(value.x, 0.0f, 0.0f, 0.0f);
+			continue;
+		}
 
-		rgba.x = rgba.x*exposure;
-		rgba.y = rgba.y*exposure;
-		rgba.z = rgba.z*exposure;
+		float scale = 1.0f/(float)sample;
+
+		/* converged pixels received fewer samples than the others */
+		if(pass_adaptive && pixel[pass_adaptive].z > 0.0f)
+			scale = 1.0f/min((float)sample, pixel[pass_adaptive].z);
+
+		value = value*scale;
+
+		if(type != PASS_NORMAL) {
+			value.x = value.x*exposure;
+			value.y = value.y*exposure;
+			value.z = value.z*exposure;
+		}
 
 		/* clamp since alpha might be > 1.0 due to russian roulette */
-		rgba.w = clamp(rgba.w, 0.0f, 1.0f);
+		value.w = clamp(value.w, 0.0f, 1.0f);
 
-		out[i] = rgba;
+		out[i] = value;
 	}
+}
 
-	return out;
+void RenderBuffers::write(const string& filename, float exposure, int sample)
+{
+	if(!buffer.device_pointer)
+		return;
+
+	device->mem_copy_from(buffer, 0, buffer.memory_size());
+
+	/* collect layers and channels, named layer.channel as in multilayer exr */
+	vector<PassType> types;
+	vector<string> channelnames;
+
+	foreach(PassType type, params.passes) {
+		const char *name, *channels;
+
+		if(!pass_layer(type, &name, &channels))
+			continue;
+
+		types.push_back(type);
+
+		for(const char *c = channels; *c; c++)
+			channelnames.push_back(string_printf("%s.%c", name, *c));
+	}
+
+	int w = params.width;
+	int h = params.height;
+	int nchannels = channelnames.size();
+
+	/* interleave passes */
+	float4 *pass = new float4[w*h];
+	float *pixels = new float[w*h*nchannels];
+	int channel = 0;
+
+	foreach(PassType type, types) {
+		const char *name, *channels;
+		pass_layer(type, &name, &channels);
+
+		int components = strlen(channels);
+
+		get_pass(type, exposure, sample, pass);
+
+		for(int i = 0; i < w*h; i++) {
+			float *p = pixels + i*nchannels + channel;
+			float4 value = pass[i];
+
+			p[0] = value.x;
+			if(components > 1) p[1] = value.y;
+			if(components > 2) p[2] = value.z;
+			if(components > 3) p[3] = value.w;
+		}
+
+		channel += components;
+	}
+
+	/* write image */
+	ImageOutput *out = ImageOutput::create(filename);
+
+	if(out) {
+		ImageSpec spec(w, h, nchannels, TypeDesc::FLOAT);
+		spec.channelnames = channelnames;
+		spec.alpha_channel = -1;
+		int scanlinesize = w*nchannels*sizeof(float);
+
+		out->open(filename, spec);
+
+		/* conversion for different top/bottom convention */
+		out->write_image(TypeDesc::FLOAT,
+			(uchar*)pixels + (h-1)*scanlinesize,
+			AutoStride,
+			-scanlinesize,
+			AutoStride);
+
+		out->close();
+
+		delete out;
+	}
+
+	delete [] pixels;
+	delete [] pass;
+}
+
+void RenderBuffers::copy_rows_from_device(int y, int h)
+{
+	if(!buffer.device_pointer)
+		return;
+
+	size_t row_size = params.width*params.get_passes_size()*sizeof(float4);
+
+	device->mem_copy_from(buffer, y*row_size, h*row_size);
+}
+
+bool RenderBuffers::adaptive_converged(int x, int y, int w, int h)
+{
+	int pass_adaptive = params.get_pass_offset(PASS_ADAPTIVE);
+	int pass_stride = params.get_passes_size();
+
+	if(pass_adaptive == -1 || !buffer.data_pointer)
+		return false;
+
+	float4 *in = (float4*)buffer.data_pointer;
+
+	for(int j = y; j < y + h; j++) {
+		for(int i = x; i < x + w; i++) {
+			float4 *pixel = in + (i + j*params.width)*pass_stride;
+
+			if(pixel[pass_adaptive].w == 0.0f)
+				return false;
+		}
+	}
+
+	return true;
 }
 
 /* Display Buffer */
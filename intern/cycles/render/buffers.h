@@ -21,21 +21,48 @@
 
 #include "device_memory.h"
 
+#include "kernel_types.h"
+
 #include "util_string.h"
 #include "util_thread.h"
 #include "util_types.h"
+#include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
 class Device;
 struct float4;
 
-/* Render Buffers */
+/* Buffer Parameters
+ *
+ * Dimensions and layout of the passes stored for each pixel, as float4
+ * values following each other in the render buffer. */
 
-class RenderBuffers {
+class BufferParams {
 public:
 	/* buffer dimensions */
 	int width, height;
+	/* passes stored for each pixel, combined pass is always first */
+	vector<PassType> passes;
+
+	BufferParams();
+
+	void add_pass(PassType type);
+	int get_pass_offset(PassType type);
+	int get_passes_size() { return passes.size(); }
+
+	bool modified(const BufferParams& params)
+	{ return !(width == params.width
+		&& height == params.height
+		&& passes == params.passes); }
+};
+
+/* Render Buffers */
+
+class RenderBuffers {
+public:
+	/* buffer parameters */
+	BufferParams params;
 	/* float buffer */
 	device_vector<float4> buffer;
 	/* random number generator state */
@@ -46,11 +73,17 @@ public:
 	RenderBuffers(Device *device);
 	~RenderBuffers();
 
-	void reset(Device *device, int width, int height);
-	float4 *copy_from_device(float exposure, int sample);
+	void reset(Device *device, BufferParams& params);
+	float4 *copy_from_device(float exposure, int sample, PassType type = PASS_COMBINED);
+	void write(const string& filename, float exposure, int sample);
+
+	/* adaptive sampling, call after copying the rows from the device */
+	void copy_rows_from_device(int y, int h);
+	bool adaptive_converged(int x, int y, int w, int h);
 
 protected:
 	void device_free();
+	void get_pass(PassType type, float exposure, int sample, float4 *out);
 
 	Device *device;
 };
@@ -16,11 +16,16 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "buffers.h"
 #include "camera.h"
 #include "device.h"
 #include "film.h"
+#include "integrator.h"
 #include "scene.h"
 
+#include "util_foreach.h"
+#include "util_math.h"
+
 CCL_NAMESPACE_BEGIN
 
 Film::Film()
@@ -33,15 +38,45 @@ Film::~Film()
 {
 }
 
-void Film::device_update(Device *device, DeviceScene *dscene)
+void Film::get_buffer_params(Scene *scene, BufferParams& params)
+{
+	/* combined pass is always first */
+	params.passes.clear();
+	params.passes.push_back(PASS_COMBINED);
+
+	foreach(PassType type, passes)
+		if(type != PASS_NONE && type != PASS_ADAPTIVE)
+			params.add_pass(type);
+
+	if(scene->integrator->adaptive_threshold > 0.0f)
+		params.add_pass(PASS_ADAPTIVE);
+}
+
+static int film_pass_offset(BufferParams& params, PassType type)
+{
+	/* kernel uses 0 for passes that are not used, combined is always 0 */
+	return max(params.get_pass_offset(type), 0);
+}
+
+void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 {
 	if(!need_update)
 		return;
 
 	KernelFilm *kfilm = &dscene->data.film;
+	BufferParams params;
+
+	get_buffer_params(scene, params);
 
 	/* update __data */
 	kfilm->exposure = exposure;
+	kfilm->pass_stride = params.get_passes_size();
+	kfilm->pass_adaptive = film_pass_offset(params, PASS_ADAPTIVE);
+	kfilm->pass_depth = film_pass_offset(params, PASS_DEPTH);
+	kfilm->pass_normal = film_pass_offset(params, PASS_NORMAL);
+	kfilm->pass_object_id = film_pass_offset(params, PASS_OBJECT_ID);
+	kfilm->pass_direct = film_pass_offset(params, PASS_DIRECT);
+	kfilm->pass_indirect = film_pass_offset(params, PASS_INDIRECT);
 
 	need_update = false;
 }
@@ -52,7 +87,8 @@ void Film::device_free(Device *device, DeviceScene *dscene)
 
 bool Film::modified(const Film& film)
 {
-	return !(exposure == film.exposure);
+	return !(exposure == film.exposure &&
+		passes == film.passes);
 }
 
 void Film::tag_update(Scene *scene)
@@ -20,9 +20,13 @@
 #define __FILM_H__
 
 #include "util_string.h"
+#include "util_vector.h"
+
+#include "kernel_types.h"
 
 CCL_NAMESPACE_BEGIN
 
+class BufferParams;
 class Device;
 class DeviceScene;
 class Scene;
@@ -30,12 +34,16 @@ class Scene;
 class Film {
 public:
 	float exposure;
+	/* passes to render in addition to the combined pass */
+	vector<PassType> passes;
 	bool need_update;
 
 	Film();
 	~Film();
 
-	void device_update(Device *device, DeviceScene *dscene);
+	void get_buffer_params(Scene *scene, BufferParams& params);
+
+	void device_update(Device *device, DeviceScene *dscene, Scene *scene);
 	void device_free(Device *device, DeviceScene *dscene);
 
 	bool modified(const Film& film);
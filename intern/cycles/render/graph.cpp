@@ -115,6 +115,10 @@ ShaderOutput *ShaderNode::add_output(const char *name, ShaderSocketType type)
 	return output;
 }
 
+void ShaderNode::image_files(vector<string>& filenames)
+{
+}
+
 void ShaderNode::attributes(AttributeRequestSet *attributes)
 {
 	foreach(ShaderInput *input, inputs) {
@@ -127,6 +131,34 @@ void ShaderNode::attributes(AttributeRequestSet *attributes)
 	}
 }
 
+bool ShaderNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	/* by default nodes can't be evaluated at compile time */
+	return false;
+}
+
+bool ShaderNode::equals(const ShaderNode *other)
+{
+	/* nodes with the same name, sample position and inputs compute the same
+	   outputs, node types with extra parameters must compare those too */
+	if(name != other->name || bump != other->bump)
+		return false;
+	if(inputs.size() != other->inputs.size() || outputs.size() != other->outputs.size())
+		return false;
+
+	for(size_t i = 0; i < inputs.size(); i++) {
+		ShaderInput *input = inputs[i];
+		ShaderInput *other_input = other->inputs[i];
+
+		if(input->link != other_input->link)
+			return false;
+		if(!input->link && !(input->value == other_input->value))
+			return false;
+	}
+
+	return true;
+}
+
 /* Graph */
 
 ShaderGraph::ShaderGraph()
@@ -215,18 +247,20 @@ void ShaderGraph::disconnect(ShaderInput *to)
 	from->links.erase(remove(from->links.begin(), from->links.end(), to), from->links.end());
 }
 
-void ShaderGraph::finalize(bool do_bump, bool do_osl)
+void ShaderGraph::finalize(bool do_bump, bool do_osl, bool do_optimize)
 {
 	/* before compiling, the shader graph may undergo a number of modifications.
-	 * currently we set default geometry shader inputs, and create automatic bump
-	 * from displacement. a graph can be finalized only once, and should not be
-	 * modified afterwards. */
+	 * currently we set default geometry shader inputs, create automatic bump
+	 * from displacement and optionally optimize the graph. a graph can be
+	 * finalized only once, and should not be modified afterwards. */
 
 	if(!finalized) {
 		clean();
 		default_inputs(do_osl);
 		if(do_bump)
 			bump_from_displacement();
+		if(do_optimize)
+			optimize();
 
 		finalized = true;
 	}
@@ -329,15 +363,34 @@ void ShaderGraph::clean()
 	break_cycles(output(), visited, on_stack);
 
 	/* remove unused nodes */
+	set<ShaderNode*> used;
+
+	foreach(ShaderNode *node, nodes)
+		if(visited[node->id])
+			used.insert(node);
+
+	remove_unused_nodes(used);
+}
+
+void ShaderGraph::remove_unused_nodes(const set<ShaderNode*>& used)
+{
+	/* unused nodes may still be linked to outputs of used nodes, first remove
+	   those links so no dangling pointers are left behind, then delete */
+	foreach(ShaderNode *node, nodes)
+		if(used.find(node) == used.end())
+			foreach(ShaderInput *input, node->inputs)
+				if(input->link)
+					disconnect(input);
+
 	list<ShaderNode*> newnodes;
-	
+
 	foreach(ShaderNode *node, nodes) {
-		if(visited[node->id])
+		if(used.find(node) != used.end())
 			newnodes.push_back(node);
 		else
 			delete node;
 	}
-	
+
 	nodes = newnodes;
 }
 
@@ -464,5 +517,219 @@ void ShaderGraph::bump_from_displacement()
 		add(pair.second);
 }
 
+void ShaderGraph::sort_nodes(ShaderNode *node, set<ShaderNode*>& done, vector<ShaderNode*>& order)
+{
+	/* append node after all nodes it depends on, cycles were already broken */
+	if(done.find(node) != done.end())
+		return;
+
+	done.insert(node);
+
+	foreach(ShaderInput *input, node->inputs)
+		if(input->link)
+			sort_nodes(input->link->parent, done, order);
+
+	order.push_back(node);
+}
+
+void ShaderGraph::optimize()
+{
+	/* the graph as authored often contains nodes that compute constants,
+	 * closure mixes that always pick one side and identical nodes, e.g. the
+	 * same texture used by several mix nodes. each node costs instructions
+	 * for every shading point, so we simplify the graph before compiling.
+	 *
+	 * nodes are visited in dependency order, so the inputs of a node are
+	 * already simplified by the time it is visited itself. */
+	vector<ShaderNode*> order;
+	set<ShaderNode*> done;
+
+	sort_nodes(output(), done, order);
+
+	constant_fold(order);
+	bypass_closures(order);
+	deduplicate_nodes(order);
+
+	/* remove nodes that no longer feed into the output */
+	vector<ShaderNode*> used_order;
+	set<ShaderNode*> used;
+
+	sort_nodes(output(), used, used_order);
+	remove_unused_nodes(used);
+}
+
+void ShaderGraph::constant_fold(const vector<ShaderNode*>& order)
+{
+	/* outputs with a value known at compile time. value and color nodes stay
+	 * in the graph as they are no more expensive than a constant input, but
+	 * nodes computing only from constants are replaced by their result in the
+	 * inputs they are linked to. */
+	map<ShaderOutput*, float3> constants;
+
+	foreach(ShaderNode *node, order) {
+		if(node->outputs.empty())
+			continue;
+
+		/* all inputs must be constant */
+		bool constant = true;
+
+		foreach(ShaderInput *input, node->inputs) {
+			if(input->type == SHADER_SOCKET_CLOSURE)
+				constant = false;
+			else if(input->link && constants.find(input->link) == constants.end())
+				constant = false;
+		}
+
+		if(!constant)
+			continue;
+
+		/* fill in values of linked inputs and try to evaluate all outputs */
+		vector<float3> input_values;
+
+		foreach(ShaderInput *input, node->inputs) {
+			input_values.push_back(input->value);
+
+			if(input->link)
+				input->value = constants[input->link];
+		}
+
+		vector<float3> output_values(node->outputs.size());
+		bool folded = true;
+
+		for(size_t i = 0; i < node->outputs.size() && folded; i++) {
+			output_values[i] = make_float3(0.0f, 0.0f, 0.0f);
+			folded = node->constant_fold(node->outputs[i], &output_values[i]);
+		}
+
+		if(!folded) {
+			/* restore input values */
+			for(size_t i = 0; i < node->inputs.size(); i++)
+				node->inputs[i]->value = input_values[i];
+
+			continue;
+		}
+
+		for(size_t i = 0; i < node->outputs.size(); i++)
+			constants[node->outputs[i]] = output_values[i];
+
+		if(node->inputs.empty())
+			continue;
+
+		/* replace links to this node by values, the node itself will then be
+		   removed if unused. inputs that get a geometry default when unlinked
+		   keep their link, OSL would ignore the value. */
+		for(size_t i = 0; i < node->outputs.size(); i++) {
+			ShaderOutput *output = node->outputs[i];
+			vector<ShaderInput*> links = output->links;
+
+			output->links.clear();
+
+			foreach(ShaderInput *to, links) {
+				if(to->default_value == ShaderInput::NONE) {
+					to->link = NULL;
+					to->value = output_values[i];
+				}
+				else
+					output->links.push_back(to);
+			}
+		}
+	}
+}
+
+void ShaderGraph::bypass_closures(const vector<ShaderNode*>& order)
+{
+	/* a mix closure with a constant factor of 0 or 1 only passes on one of its
+	 * closures, and an add closure with one closure unlinked only the other.
+	 * in that case link the closure directly, skipping the mix. */
+	foreach(ShaderNode *node, order) {
+		ShaderInput *bypass = NULL;
+
+		if(node->name == ustring("mix_closure")) {
+			ShaderInput *fac_in = node->input("Fac");
+
+			if(!fac_in->link && fac_in->value.x == 0.0f)
+				bypass = node->input("Closure1");
+			else if(!fac_in->link && fac_in->value.x == 1.0f)
+				bypass = node->input("Closure2");
+		}
+		else if(node->name == ustring("add_closure")) {
+			ShaderInput *cl1_in = node->input("Closure1");
+			ShaderInput *cl2_in = node->input("Closure2");
+
+			if(!cl1_in->link)
+				bypass = cl2_in;
+			else if(!cl2_in->link)
+				bypass = cl1_in;
+		}
+
+		/* only bypass to an actual closure, an unlinked closure input is not
+		   the same as no closure for all outputs */
+		if(!bypass || !bypass->link)
+			continue;
+
+		ShaderOutput *output = node->outputs[0];
+		ShaderOutput *from = bypass->link;
+
+		foreach(ShaderInput *to, output->links) {
+			to->link = from;
+			from->links.push_back(to);
+		}
+
+		output->links.clear();
+	}
+}
+
+void ShaderGraph::deduplicate_nodes(const vector<ShaderNode*>& order)
+{
+	/* merge nodes that compute the same outputs from the same inputs. since
+	 * the inputs of a node are merged before the node itself, chains of
+	 * duplicate nodes get merged entirely. closures are left alone, the SVM
+	 * compiler expects every closure to be used from a single place. */
+	map<ustring, vector<ShaderNode*> > candidates;
+
+	foreach(ShaderNode *node, order) {
+		if(node->outputs.empty())
+			continue;
+
+		bool has_closure = false;
+
+		foreach(ShaderOutput *output, node->outputs)
+			if(output->type == SHADER_SOCKET_CLOSURE)
+				has_closure = true;
+
+		if(has_closure)
+			continue;
+
+		/* find node to merge with */
+		vector<ShaderNode*>& same_name = candidates[node->name];
+		ShaderNode *merge = NULL;
+
+		foreach(ShaderNode *other, same_name) {
+			if(other->equals(node)) {
+				merge = other;
+				break;
+			}
+		}
+
+		if(!merge) {
+			same_name.push_back(node);
+			continue;
+		}
+
+		/* move links to the outputs of the node we merge with */
+		for(size_t i = 0; i < node->outputs.size(); i++) {
+			ShaderOutput *output = node->outputs[i];
+			ShaderOutput *merge_output = merge->outputs[i];
+
+			foreach(ShaderInput *to, output->links) {
+				to->link = merge_output;
+				merge_output->links.push_back(to);
+			}
+
+			output->links.clear();
+		}
+	}
+}
+
 CCL_NAMESPACE_END
 
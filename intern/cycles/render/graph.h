@@ -25,6 +25,7 @@
 #include "util_map.h"
 #include "util_param.h"
 #include "util_set.h"
+#include "util_string.h"
 #include "util_types.h"
 #include "util_vector.h"
 
@@ -158,9 +159,16 @@ public:
 
 	virtual ShaderNode *clone() const = 0;
 	virtual void attributes(AttributeRequestSet *attributes);
+	/* image files that compiling the node will load, to read them ahead */
+	virtual void image_files(vector<string>& filenames);
 	virtual void compile(SVMCompiler& compiler) = 0;
 	virtual void compile(OSLCompiler& compiler) = 0;
 
+	/* optimization: evaluate output at compile time if all inputs are
+	   constant, and test if two nodes compute the same outputs */
+	virtual bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	virtual bool equals(const ShaderNode *other);
+
 	vector<ShaderInput*> inputs;
 	vector<ShaderOutput*> outputs;
 
@@ -191,7 +199,9 @@ public:
 /* Graph
  *
  * Shader graph of nodes. Also does graph manipulations for default inputs,
- * bump mapping from displacement, and possibly other things in the future. */
+ * bump mapping from displacement, and optimizations that reduce the number of
+ * nodes to execute: constant folding, bypassing closure mixes with a constant
+ * factor, merging duplicate nodes and removing nodes that are not used. */
 
 class ShaderGraph {
 public:
@@ -209,7 +219,7 @@ public:
 	void connect(ShaderOutput *from, ShaderInput *to);
 	void disconnect(ShaderInput *to);
 
-	void finalize(bool do_bump = false, bool do_osl = false);
+	void finalize(bool do_bump = false, bool do_osl = false, bool do_optimize = false);
 
 protected:
 	typedef pair<ShaderNode* const, ShaderNode*> NodePair;
@@ -221,6 +231,13 @@ protected:
 	void clean();
 	void bump_from_displacement();
 	void default_inputs(bool do_osl);
+
+	void sort_nodes(ShaderNode *node, set<ShaderNode*>& done, vector<ShaderNode*>& order);
+	void remove_unused_nodes(const set<ShaderNode*>& used);
+	void optimize();
+	void constant_fold(const vector<ShaderNode*>& order);
+	void bypass_closures(const vector<ShaderNode*>& order);
+	void deduplicate_nodes(const vector<ShaderNode*>& order);
 };
 
 CCL_NAMESPACE_END
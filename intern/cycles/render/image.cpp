@@ -24,6 +24,7 @@
 #include "util_image.h"
 #include "util_path.h"
 #include "util_progress.h"
+#include "util_texture_cache.h"
 
 #ifdef WITH_OSL
 #include <OSL/oslexec.h>
@@ -35,6 +36,7 @@ ImageManager::ImageManager()
 {
 	need_update = true;
 	osl_texture_system = NULL;
+	texture_cache = NULL;
 }
 
 ImageManager::~ImageManager()
@@ -42,6 +44,9 @@ ImageManager::~ImageManager()
 	for(size_t slot = 0; slot < images.size(); slot++) {
 		assert(!images[slot]);
 	}
+
+	free_prepared_images();
+	delete texture_cache;
 }
 
 void ImageManager::set_osl_texture_system(void *texture_system)
@@ -49,6 +54,35 @@ void ImageManager::set_osl_texture_system(void *texture_system)
 	osl_texture_system = texture_system;
 }
 
+void ImageManager::set_texture_cache(bool use, size_t max_mem)
+{
+	if(use) {
+		if(!texture_cache)
+			texture_cache = new TextureCache(max_mem);
+		else
+			texture_cache->set_max_mem(max_mem);
+	}
+	else if(texture_cache) {
+		/* images must be reloaded as textures */
+		foreach(Image *img, images)
+			if(img)
+				img->need_load = true;
+
+		delete texture_cache;
+		texture_cache = NULL;
+		need_update = true;
+	}
+}
+
+bool ImageManager::get_texture_cache_stats(TextureCacheStats& stats)
+{
+	if(!texture_cache)
+		return false;
+
+	texture_cache->get_stats(stats);
+	return true;
+}
+
 int ImageManager::add_image(const string& filename)
 {
 	Image *img;
@@ -173,7 +207,7 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	return true;
 }
 
-void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int slot)
+void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int slot, bool use_cache)
 {
 	if(osl_texture_system)
 		return;
@@ -184,7 +218,21 @@ void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int sl
 	if(tex_img.device_pointer)
 		device->tex_free(tex_img);
 
-	if(!file_load_image(img, tex_img)) {
+	if(use_cache) {
+		/* only opens the file, pixels are read during rendering */
+		texture_cache->set_image(slot, img->filename);
+		return;
+	}
+
+	/* use pixels read ahead if available */
+	map<string, device_vector<uchar4>*>::iterator it = prepared_images.find(img->filename);
+
+	if(it != prepared_images.end()) {
+		tex_img.swap_data(*it->second);
+		delete it->second;
+		prepared_images.erase(it);
+	}
+	else if(!file_load_image(img, tex_img)) {
 		/* on failure to load, we set a 1x1 pixels black image */
 		uchar *pixels = (uchar*)tex_img.resize(1, 1);
 
@@ -212,6 +260,9 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int sl
 #endif
 		}
 		else {
+			if(texture_cache)
+				texture_cache->remove_image(slot);
+
 			device->tex_free(dscene->tex_image[slot]);
 			dscene->tex_image[slot].clear();
 		}
@@ -221,11 +272,56 @@ void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int sl
 	}
 }
 
+void ImageManager::device_prepare(const vector<string>& filenames, Progress& progress)
+{
+	/* read image files ahead of the device update, into memory the device is
+	   not using so this can be done while rendering. with OSL or the texture
+	   cache, files are read on demand during rendering instead */
+	if(osl_texture_system || texture_cache)
+		return;
+
+	foreach(const string& filename, filenames) {
+		if(prepared_images.find(filename) != prepared_images.end())
+			continue;
+
+		/* skip images that are already loaded */
+		bool loaded = false;
+
+		foreach(Image *img, images)
+			if(img && img->filename == filename && !img->need_load)
+				loaded = true;
+
+		if(loaded)
+			continue;
+
+		progress.set_status("Preparing Images", "Loading " + path_filename(filename));
+
+		Image img;
+		img.filename = filename;
+
+		device_vector<uchar4> *tex_img = new device_vector<uchar4>();
+
+		/* on failure, loading is tried again in the device update */
+		if(file_load_image(&img, *tex_img))
+			prepared_images[filename] = tex_img;
+		else
+			delete tex_img;
+
+		if(progress.get_cancel()) return;
+	}
+}
+
 void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress& progress)
 {
 	if(!need_update)
 		return;
 
+	/* texture cache is used on devices that support it */
+	bool use_cache = false;
+
+	if(!osl_texture_system)
+		use_cache = device->texture_cache_set(texture_cache) && texture_cache;
+
 	for(size_t slot = 0; slot < images.size(); slot++) {
 		if(images[slot]) {
 			if(images[slot]->users == 0) {
@@ -234,7 +330,7 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 			else if(images[slot]->need_load) {
 				string name = path_filename(images[slot]->filename);
 				progress.set_status("Updating Images", "Loading " + name);
-				device_load_image(device, dscene, slot);
+				device_load_image(device, dscene, slot, use_cache);
 				images[slot]->need_load = false;
 			}
 
@@ -242,6 +338,9 @@ void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress&
 		}
 	}
 
+	/* images read ahead but not used in the end */
+	free_prepared_images();
+
 	need_update = false;
 }
 
@@ -251,6 +350,19 @@ void ImageManager::device_free(Device *device, DeviceScene *dscene)
 		device_free_image(device, dscene, slot);
 
 	images.clear();
+	free_prepared_images();
+
+	device->texture_cache_set(NULL);
+}
+
+void ImageManager::free_prepared_images()
+{
+	map<string, device_vector<uchar4>*>::iterator it;
+
+	for(it = prepared_images.begin(); it != prepared_images.end(); it++)
+		delete it->second;
+
+	prepared_images.clear();
 }
 
 CCL_NAMESPACE_END
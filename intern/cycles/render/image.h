@@ -21,6 +21,7 @@
 
 #include "device_memory.h"
 
+#include "util_map.h"
 #include "util_string.h"
 #include "util_vector.h"
 
@@ -31,6 +32,8 @@ CCL_NAMESPACE_BEGIN
 class Device;
 class DeviceScene;
 class Progress;
+class TextureCache;
+class TextureCacheStats;
 
 class ImageManager {
 public:
@@ -40,11 +43,16 @@ public:
 	int add_image(const string& filename);
 	void remove_image(const string& filename);
 
+	void device_prepare(const vector<string>& filenames, Progress& progress);
 	void device_update(Device *device, DeviceScene *dscene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
 
 	void set_osl_texture_system(void *texture_system);
 
+	/* load images on demand on devices that support it, max_mem 0 is unlimited */
+	void set_texture_cache(bool use, size_t max_mem);
+	bool get_texture_cache_stats(TextureCacheStats& stats);
+
 	bool need_update;
 
 private:
@@ -57,11 +65,16 @@ private:
 
 	vector<Image*> images;
 	void *osl_texture_system;
+	TextureCache *texture_cache;
+
+	/* pixels read ahead by device_prepare, by filename */
+	map<string, device_vector<uchar4>*> prepared_images;
 
 	bool file_load_image(Image *img, device_vector<uchar4>& tex_img);
 
-	void device_load_image(Device *device, DeviceScene *dscene, int slot);
+	void device_load_image(Device *device, DeviceScene *dscene, int slot, bool use_cache);
 	void device_free_image(Device *device, DeviceScene *dscene, int slot);
+	void free_prepared_images();
 };
 
 CCL_NAMESPACE_END
@@ -17,7 +17,9 @@
  */
 
 #include "device.h"
+#include "film.h"
 #include "integrator.h"
+#include "light.h"
 #include "scene.h"
 #include "sobol.h"
 
@@ -45,6 +47,11 @@ Integrator::Integrator()
 
 	seed = 0;
 
+	adaptive_threshold = 0.0f;
+	adaptive_min_samples = 16;
+
+	use_light_tree = true;
+
 	need_update = true;
 }
 
@@ -85,6 +92,9 @@ void Integrator::device_update(Device *device, DeviceScene *dscene)
 
 	kintegrator->seed = hash_int(seed);
 
+	kintegrator->adaptive_threshold = adaptive_threshold;
+	kintegrator->adaptive_min_samples = max(adaptive_min_samples, 2);
+
 	/* sobol directions table */
 	int dimensions = PRNG_BASE_NUM + (max_bounce + transparent_max_bounce + 2)*PRNG_BOUNCE_NUM;
 	uint *directions = dscene->sobol_directions.resize(SOBOL_BITS*dimensions);
@@ -116,12 +126,21 @@ bool Integrator::modified(const Integrator& integrator)
 		transparent_shadows == integrator.transparent_shadows &&
 		no_caustics == integrator.no_caustics &&
 		blur_caustics == integrator.blur_caustics &&
-		seed == integrator.seed);
+		seed == integrator.seed &&
+		adaptive_threshold == integrator.adaptive_threshold &&
+		adaptive_min_samples == integrator.adaptive_min_samples &&
+		use_light_tree == integrator.use_light_tree);
 }
 
 void Integrator::tag_update(Scene *scene)
 {
 	need_update = true;
+
+	/* render buffer layout depends on adaptive sampling */
+	scene->film->tag_update(scene);
+
+	/* light distribution depends on light tree use */
+	scene->light_manager->tag_update(scene);
 }
 
 CCL_NAMESPACE_END
@@ -45,6 +45,13 @@ public:
 
 	int seed;
 
+	/* adaptive sampling, disabled if threshold is zero */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+
+	/* sample lights with a light tree instead of by power only */
+	bool use_light_tree;
+
 	bool need_update;
 
 	Integrator();
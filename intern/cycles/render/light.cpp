@@ -16,8 +16,12 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
+
 #include "device.h"
+#include "integrator.h"
 #include "light.h"
+#include "light_tree.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -64,10 +68,23 @@ LightManager::~LightManager()
 {
 }
 
+static bool object_has_emission(Scene *scene, Object *object)
+{
+	foreach(uint sindex, object->mesh->used_shaders) {
+		Shader *shader = scene->shaders[sindex];
+
+		if(shader->sample_as_light && shader->has_surface_emission)
+			return true;
+	}
+
+	return false;
+}
+
 void LightManager::device_update_distribution(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	/* option to always sample all point lights */
 	bool multi_light = false;
+	bool use_light_tree = scene->integrator->use_light_tree && !multi_light;
 
 	/* count */
 	size_t num_lights = scene->lights.size();
@@ -75,26 +92,17 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 	foreach(Object *object, scene->objects) {
 		Mesh *mesh = object->mesh;
-		bool have_emission = false;
 
 		/* skip if we have no emission shaders */
-		foreach(uint sindex, mesh->used_shaders) {
-			Shader *shader = scene->shaders[sindex];
-
-			if(shader->sample_as_light && shader->has_surface_emission) {
-				have_emission = true;
-				break;
-			}
-		}
+		if(!object_has_emission(scene, object))
+			continue;
 
 		/* count triangles */
-		if(have_emission) {
-			for(size_t i = 0; i < mesh->triangles.size(); i++) {
-				Shader *shader = scene->shaders[mesh->shader[i]];
+		for(size_t i = 0; i < mesh->triangles.size(); i++) {
+			Shader *shader = scene->shaders[mesh->shader[i]];
 
-				if(shader->sample_as_light && shader->has_surface_emission)
-					num_triangles++;
-			}
+			if(shader->sample_as_light && shader->has_surface_emission)
+				num_triangles++;
 		}
 	}
 
@@ -107,26 +115,23 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	float4 *distribution = dscene->light_distribution.resize(num_distribution + 1);
 	float totarea = 0.0f;
 
+	/* bounds and emission cones for the light tree, distant lights are
+	   sampled separately since they have no position */
+	vector<LightTreeEmitter> emitters;
+	vector<int> distant_lights;
+
+	if(use_light_tree)
+		emitters.reserve(num_distribution);
+
 	/* triangles */
 	size_t offset = 0;
 	size_t j = 0;
 
 	foreach(Object *object, scene->objects) {
 		Mesh *mesh = object->mesh;
-		bool have_emission = false;
-
-		/* skip if we have no emission shaders */
-		foreach(uint sindex, mesh->used_shaders) {
-			Shader *shader = scene->shaders[sindex];
-
-			if(shader->sample_as_light && shader->has_surface_emission) {
-				have_emission = true;
-				break;
-			}
-		}
 
 		/* sum area */
-		if(have_emission) {
+		if(object_has_emission(scene, object)) {
 			Transform tfm = object->tfm;
 			int object_id = (mesh->transform_applied)? -j-1: j;
 
@@ -138,14 +143,30 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					distribution[offset].y = __int_as_float(i + mesh->tri_offset);
 					distribution[offset].z = 1.0f;
 					distribution[offset].w = __int_as_float(object_id);
-					offset++;
 
 					Mesh::Triangle t = mesh->triangles[i];
 					float3 p1 = transform(&tfm, mesh->verts[t.v[0]]);
 					float3 p2 = transform(&tfm, mesh->verts[t.v[1]]);
 					float3 p3 = transform(&tfm, mesh->verts[t.v[2]]);
+					float area = triangle_area(p1, p2, p3);
 
-					totarea += triangle_area(p1, p2, p3);
+					if(use_light_tree) {
+						/* triangles emit from both sides */
+						float3 N = cross(p2 - p1, p3 - p1);
+						LightTreeEmitter emitter;
+
+						emitter.bounds.grow(p1);
+						emitter.bounds.grow(p2);
+						emitter.bounds.grow(p3);
+						emitter.cone = LightCone((len(N) > 0.0f)? normalize(N): make_float3(0.0f, 0.0f, 1.0f), M_PI_F, M_PI_2_F);
+						emitter.energy = area;
+						emitter.index = offset;
+
+						emitters.push_back(emitter);
+					}
+
+					totarea += area;
+					offset++;
 				}
 			}
 		}
@@ -162,11 +183,47 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		float lightarea = (totarea > 0.0f)? totarea/scene->lights.size(): 1.0f;
 
 		for(size_t i = 0; i < scene->lights.size(); i++, offset++) {
+			Light *light = scene->lights[i];
+
 			distribution[offset].x = totarea;
 			distribution[offset].y = __int_as_float(-i-1);
 			distribution[offset].z = 1.0f;
-			distribution[offset].w = scene->lights[i]->size;
+			distribution[offset].w = light->size;
 			totarea += lightarea;
+
+			if(!use_light_tree)
+				continue;
+
+			if(light->type == LIGHT_DISTANT) {
+				distant_lights.push_back(offset);
+				continue;
+			}
+
+			LightTreeEmitter emitter;
+
+			if(light->type == LIGHT_AREA) {
+				/* one sided */
+				float3 axisu = light->axisu*(0.5f*light->sizeu*light->size);
+				float3 axisv = light->axisv*(0.5f*light->sizev*light->size);
+
+				emitter.bounds.grow(light->co - axisu - axisv);
+				emitter.bounds.grow(light->co - axisu + axisv);
+				emitter.bounds.grow(light->co + axisu - axisv);
+				emitter.bounds.grow(light->co + axisu + axisv);
+				emitter.cone = LightCone(normalize(light->dir), 0.0f, M_PI_2_F);
+			}
+			else {
+				float3 size = make_float3(light->size, light->size, light->size);
+
+				emitter.bounds.grow(light->co - size);
+				emitter.bounds.grow(light->co + size);
+				emitter.cone = LightCone(make_float3(0.0f, 0.0f, 1.0f), M_PI_F, M_PI_2_F);
+			}
+
+			emitter.energy = lightarea;
+			emitter.index = offset;
+
+			emitters.push_back(emitter);
 		}
 	}
 
@@ -176,6 +233,21 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	distribution[num_distribution].z = 0.0f;
 	distribution[num_distribution].w = 0.0f;
 
+	/* light tree */
+	int num_tree_triangles = 0;
+
+	use_light_tree = use_light_tree && emitters.size() > 1 && totarea > 0.0f;
+
+	if(use_light_tree) {
+		progress.set_status("Updating Lights", "Building light tree");
+
+		LightTree tree(emitters);
+
+		if(progress.get_cancel()) return;
+
+		num_tree_triangles = device_update_light_tree(dscene, distribution, num_distribution, tree, emitters, distant_lights);
+	}
+
 	if(totarea > 0.0f) {
 		for(size_t i = 0; i < num_distribution; i++)
 			distribution[i].x /= totarea;
@@ -187,6 +259,9 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 	/* update device */
 	KernelIntegrator *kintegrator = &dscene->data.integrator;
 	kintegrator->use_direct_light = (totarea > 0.0f) || (multi_light && num_lights);
+	kintegrator->use_light_tree = use_light_tree;
+	kintegrator->num_light_tree_emitters = (use_light_tree)? emitters.size(): 0;
+	kintegrator->num_light_tree_triangles = num_tree_triangles;
 
 	if(kintegrator->use_direct_light) {
 		/* number of emissives */
@@ -224,9 +299,102 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 		/* CDF */
 		device->tex_alloc("__light_distribution", dscene->light_distribution);
+
+		if(use_light_tree) {
+			device->tex_alloc("__light_tree_nodes", dscene->light_tree_nodes);
+			device->tex_alloc("__light_tree_triangles", dscene->light_tree_triangles);
+		}
 	}
-	else
+	else {
 		dscene->light_distribution.clear();
+		dscene->light_tree_nodes.clear();
+		dscene->light_tree_triangles.clear();
+	}
+}
+
+static bool light_tree_triangle_less(const uint4& a, const uint4& b)
+{
+	return (a.x < b.x) || (a.x == b.x && a.y < b.y);
+}
+
+int LightManager::device_update_light_tree(DeviceScene *dscene, float4 *old_distribution, size_t num_distribution,
+	const LightTree& tree, const vector<LightTreeEmitter>& emitters, const vector<int>& distant_lights)
+{
+	/* reorder distribution to match the tree, with distant lights at the end.
+	   cumulative values are not normalized yet */
+	vector<float4> distribution(num_distribution + 1);
+	vector<int> emitter_leaf(emitters.size());
+	float total = 0.0f;
+	size_t offset = 0;
+
+	for(size_t i = 0; i < tree.nodes.size(); i++) {
+		const LightTreeNode& node = tree.nodes[i];
+
+		for(int k = 0; k < node.num; k++)
+			emitter_leaf[node.first + k] = i;
+	}
+
+	for(size_t i = 0; i < emitters.size(); i++, offset++) {
+		int index = emitters[i].index;
+
+		distribution[offset] = old_distribution[index];
+		distribution[offset].x = total;
+		distribution[offset].z = __int_as_float(emitter_leaf[i]);
+		total += old_distribution[index + 1].x - old_distribution[index].x;
+	}
+
+	foreach(int index, distant_lights) {
+		distribution[offset] = old_distribution[index];
+		distribution[offset].x = total;
+		total += old_distribution[index + 1].x - old_distribution[index].x;
+		offset++;
+	}
+
+	distribution[num_distribution] = old_distribution[num_distribution];
+	memcpy(old_distribution, &distribution[0], sizeof(float4)*distribution.size());
+
+	/* pack nodes */
+	float4 *nodes = dscene->light_tree_nodes.resize(tree.nodes.size()*LIGHT_TREE_NODE_SIZE);
+
+	for(size_t i = 0; i < tree.nodes.size(); i++) {
+		const LightTreeNode& node = tree.nodes[i];
+		float4 *data = nodes + i*LIGHT_TREE_NODE_SIZE;
+
+		data[0] = make_float4(node.bounds.min.x, node.bounds.min.y, node.bounds.min.z, node.energy);
+		data[1] = make_float4(node.bounds.max.x, node.bounds.max.y, node.bounds.max.z, __int_as_float(node.parent));
+		data[2] = make_float4(node.cone.axis.x, node.cone.axis.y, node.cone.axis.z, node.cone.theta_o);
+		data[3] = make_float4(node.cone.theta_e, __int_as_float(node.first), __int_as_float(node.right), __int_as_float(node.num));
+	}
+
+	/* map sorted by object and triangle to position in the distribution, to
+	   find the pdf of emissive triangles hit by rays */
+	vector<uint4> triangles;
+
+	for(size_t i = 0; i < emitters.size(); i++) {
+		float4 l = distribution[i];
+		int prim = __float_as_int(l.y);
+
+		if(prim >= 0) {
+			int object = __float_as_int(l.w);
+
+			if(object < 0)
+				object = -object-1;
+
+			triangles.push_back(make_uint4(object, prim, i, 0));
+		}
+	}
+
+	std::sort(triangles.begin(), triangles.end(), light_tree_triangle_less);
+
+	/* always allocate one element, empty textures are not supported */
+	uint4 *map = dscene->light_tree_triangles.resize(std::max(triangles.size(), (size_t)1));
+
+	if(triangles.size())
+		memcpy(map, &triangles[0], sizeof(uint4)*triangles.size());
+	else
+		map[0] = make_uint4(0, 0, 0, 0);
+
+	return triangles.size();
 }
 
 void LightManager::device_update_points(Device *device, DeviceScene *dscene, Scene *scene)
@@ -295,9 +463,13 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->light_distribution);
 	device->tex_free(dscene->light_data);
+	device->tex_free(dscene->light_tree_nodes);
+	device->tex_free(dscene->light_tree_triangles);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
+	dscene->light_tree_nodes.clear();
+	dscene->light_tree_triangles.clear();
 }
 
 void LightManager::tag_update(Scene *scene)
@@ -28,8 +28,10 @@ CCL_NAMESPACE_BEGIN
 
 class Device;
 class DeviceScene;
+class LightTree;
 class Progress;
 class Scene;
+struct LightTreeEmitter;
 
 class Light {
 public:
@@ -68,6 +70,8 @@ public:
 protected:
 	void device_update_points(Device *device, DeviceScene *dscene, Scene *scene);
 	void device_update_distribution(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+	int device_update_light_tree(DeviceScene *dscene, float4 *distribution, size_t num_distribution,
+		const LightTree& tree, const vector<LightTreeEmitter>& emitters, const vector<int>& distant_lights);
 };
 
 CCL_NAMESPACE_END
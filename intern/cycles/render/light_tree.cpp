@@ -0,0 +1,288 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+
+#include "light_tree.h"
+
+#include "util_math.h"
+#include "util_transform.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Light Cone */
+
+LightCone light_cone_union(const LightCone& a_, const LightCone& b_)
+{
+	if(a_.empty())
+		return b_;
+	if(b_.empty())
+		return a_;
+
+	/* make a the widest cone */
+	LightCone a = a_, b = b_;
+
+	if(a.theta_o < b.theta_o)
+		std::swap(a, b);
+
+	float theta_e = std::max(a.theta_e, b.theta_e);
+	float theta_d = acosf(clamp(dot(a.axis, b.axis), -1.0f, 1.0f));
+
+	/* b is inside a */
+	if(std::min(theta_d + b.theta_o, M_PI_F) <= a.theta_o)
+		return LightCone(a.axis, a.theta_o, theta_e);
+
+	/* cone spanning both, covers the full sphere if too wide */
+	float theta_o = 0.5f*(a.theta_o + theta_d + b.theta_o);
+
+	if(theta_o >= M_PI_F)
+		return LightCone(a.axis, M_PI_F, theta_e);
+
+	float3 rotation_axis = cross(a.axis, b.axis);
+
+	if(len(rotation_axis) < 1e-6f)
+		return LightCone(a.axis, M_PI_F, theta_e);
+
+	/* rotate axis of a towards b */
+	Transform rotation = transform_rotate(theta_o - a.theta_o, rotation_axis);
+	float3 axis = normalize(transform_direction(&rotation, a.axis));
+
+	return LightCone(axis, theta_o, theta_e);
+}
+
+/* measure of the solid angle the cone emits into, from "Importance Sampling of
+   Many Lights with Adaptive Tree Splitting", Conty and Kulla */
+static float light_cone_measure(const LightCone& cone)
+{
+	if(cone.empty())
+		return 0.0f;
+
+	float theta_o = cone.theta_o;
+	float theta_w = std::min(theta_o + cone.theta_e, M_PI_F);
+	float sin_o = sinf(theta_o);
+	float cos_o = cosf(theta_o);
+
+	return 2.0f*M_PI_F*(1.0f - cos_o) +
+		M_PI_2_F*(2.0f*theta_w*sin_o - cosf(theta_o - 2.0f*theta_w) - 2.0f*theta_o*sin_o + cos_o);
+}
+
+static float light_bounds_area(const BoundBox& bounds)
+{
+	if(!bounds.valid())
+		return 0.0f;
+
+	float3 d = bounds.max - bounds.min;
+	return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+static float3 light_bounds_center(const BoundBox& bounds)
+{
+	return 0.5f*(bounds.min + bounds.max);
+}
+
+/* Light Tree */
+
+struct LightTreeBin {
+	BoundBox bounds;
+	LightCone cone;
+	float energy;
+	int num;
+
+	LightTreeBin() : energy(0.0f), num(0) {}
+
+	void add(const BoundBox& bounds_, const LightCone& cone_, float energy_, int num_)
+	{
+		bounds.grow(bounds_);
+		cone = light_cone_union(cone, cone_);
+		energy += energy_;
+		num += num_;
+	}
+
+	float cost() const
+	{
+		return energy*light_bounds_area(bounds)*light_cone_measure(cone);
+	}
+};
+
+struct LightTreeBinCompare {
+	int axis;
+	int bin;
+	float min;
+	float scale;
+
+	LightTreeBinCompare(int axis_, int bin_, float min_, float scale_)
+	: axis(axis_), bin(bin_), min(min_), scale(scale_) {}
+
+	bool operator()(const LightTreeEmitter& emitter) const
+	{
+		float c = light_bounds_center(emitter.bounds)[axis];
+		int b = std::min((int)((c - min)*scale), LIGHT_TREE_NUM_BINS - 1);
+		return b < bin;
+	}
+};
+
+struct LightTreeCentroidCompare {
+	int axis;
+
+	LightTreeCentroidCompare(int axis_) : axis(axis_) {}
+
+	bool operator()(const LightTreeEmitter& a, const LightTreeEmitter& b) const
+	{
+		return light_bounds_center(a.bounds)[axis] < light_bounds_center(b.bounds)[axis];
+	}
+};
+
+LightTree::LightTree(vector<LightTreeEmitter>& emitters)
+{
+	if(emitters.size() == 0)
+		return;
+
+	nodes.reserve(emitters.size()/2 + 1);
+	build(emitters, 0, emitters.size(), -1);
+}
+
+int LightTree::build(vector<LightTreeEmitter>& emitters, int first, int num, int parent)
+{
+	int index = nodes.size();
+	nodes.push_back(LightTreeNode());
+
+	/* bounds, cone and energy of all emitters */
+	BoundBox bounds, centroid_bounds;
+	LightCone cone;
+	float energy = 0.0f;
+
+	for(int i = first; i < first + num; i++) {
+		const LightTreeEmitter& emitter = emitters[i];
+
+		bounds.grow(emitter.bounds);
+		centroid_bounds.grow(light_bounds_center(emitter.bounds));
+		cone = light_cone_union(cone, emitter.cone);
+		energy += emitter.energy;
+	}
+
+	/* split or create leaf, nodes may be reallocated by the recursion so
+	   we only access ours by index */
+	int middle;
+	int right = -1;
+
+	if(num > LIGHT_TREE_MAX_LEAF_SIZE && split(emitters, first, num, centroid_bounds, &middle)) {
+		build(emitters, first, middle - first, index);
+		right = build(emitters, middle, first + num - middle, index);
+	}
+
+	LightTreeNode& node = nodes[index];
+
+	node.bounds = bounds;
+	node.cone = cone;
+	node.energy = energy;
+	node.parent = parent;
+	node.right = right;
+
+	if(right == -1) {
+		node.first = first;
+		node.num = num;
+	}
+	else {
+		node.first = -1;
+		node.num = 0;
+	}
+
+	return index;
+}
+
+bool LightTree::split(vector<LightTreeEmitter>& emitters, int first, int num, const BoundBox& centroid_bounds, int *middle)
+{
+	vector<LightTreeEmitter>::iterator begin = emitters.begin() + first;
+	vector<LightTreeEmitter>::iterator end = begin + num;
+	float3 extent = centroid_bounds.max - centroid_bounds.min;
+
+	/* find split with the lowest cost, binning emitters along each axis by
+	   centroid and weighting energy by bounds area and cone measure */
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	int best_bin = 0;
+
+	for(int axis = 0; axis < 3; axis++) {
+		if(extent[axis] <= 0.0f)
+			continue;
+
+		float scale = LIGHT_TREE_NUM_BINS/extent[axis];
+		float min = centroid_bounds.min[axis];
+		LightTreeBin bins[LIGHT_TREE_NUM_BINS];
+
+		for(int i = first; i < first + num; i++) {
+			const LightTreeEmitter& emitter = emitters[i];
+			float c = light_bounds_center(emitter.bounds)[axis];
+			int b = std::min((int)((c - min)*scale), LIGHT_TREE_NUM_BINS - 1);
+
+			bins[b].add(emitter.bounds, emitter.cone, emitter.energy, 1);
+		}
+
+		/* sweep from the right, then evaluate splits from the left */
+		LightTreeBin right_bins[LIGHT_TREE_NUM_BINS];
+		LightTreeBin accum;
+
+		for(int b = LIGHT_TREE_NUM_BINS - 1; b > 0; b--) {
+			accum.add(bins[b].bounds, bins[b].cone, bins[b].energy, bins[b].num);
+			right_bins[b] = accum;
+		}
+
+		accum = LightTreeBin();
+
+		for(int b = 1; b < LIGHT_TREE_NUM_BINS; b++) {
+			accum.add(bins[b-1].bounds, bins[b-1].cone, bins[b-1].energy, bins[b-1].num);
+
+			if(accum.num == 0 || right_bins[b].num == 0)
+				continue;
+
+			float cost = accum.cost() + right_bins[b].cost();
+
+			if(cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	/* partition by best split, if all costs are zero, for example points on a
+	   line, the binning does not tell us anything and we split at the median */
+	if(best_axis != -1 && best_cost > 0.0f) {
+		float scale = LIGHT_TREE_NUM_BINS/extent[best_axis];
+		LightTreeBinCompare compare(best_axis, best_bin, centroid_bounds.min[best_axis], scale);
+
+		*middle = std::partition(begin, end, compare) - emitters.begin();
+
+		if(*middle > first && *middle < first + num)
+			return true;
+	}
+
+	/* median split along largest axis, or just half of the emitters if
+	   all centroids are in the same place */
+	int axis = (extent.x > extent.y)? ((extent.x > extent.z)? 0: 2): ((extent.y > extent.z)? 1: 2);
+
+	*middle = first + num/2;
+
+	if(extent[axis] > 0.0f)
+		std::nth_element(begin, emitters.begin() + *middle, end, LightTreeCentroidCompare(axis));
+
+	return true;
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "util_boundbox.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+#define LIGHT_TREE_MAX_LEAF_SIZE	4
+#define LIGHT_TREE_NUM_BINS			12
+
+/* Light Cone
+ *
+ * Bounds the directions light is emitted in: normals are within theta_o of
+ * the axis, and light leaves the surface within theta_e of the normal. An
+ * empty cone has a negative theta_o. */
+
+struct LightCone {
+	float3 axis;
+	float theta_o;
+	float theta_e;
+
+	LightCone()
+	: axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(-1.0f), theta_e(0.0f) {}
+
+	LightCone(const float3& axis_, float theta_o_, float theta_e_)
+	: axis(axis_), theta_o(theta_o_), theta_e(theta_e_) {}
+
+	bool empty() const { return theta_o < 0.0f; }
+};
+
+LightCone light_cone_union(const LightCone& a, const LightCone& b);
+
+/* Light Tree
+ *
+ * Bounding volume hierarchy over emitters, where each node stores the total
+ * energy and a cone bounding the emission directions below it. The kernel
+ * descends the tree choosing children in proportion to their estimated
+ * contribution at the shading point, see kernel_light.h.
+ *
+ * Building reorders the emitters so that each leaf references a contiguous
+ * range. Nodes are stored depth first, the left child of an inner node
+ * directly follows it. */
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	LightCone cone;
+	float energy;
+	int index;	/* position in the emitter list before building */
+};
+
+struct LightTreeNode {
+	BoundBox bounds;
+	LightCone cone;
+	float energy;
+	int parent;
+	int right;	/* inner nodes only */
+	int first;	/* leaf nodes only */
+	int num;	/* number of emitters, 0 for inner nodes */
+};
+
+class LightTree {
+public:
+	vector<LightTreeNode> nodes;
+
+	LightTree(vector<LightTreeEmitter>& emitters);
+
+protected:
+	int build(vector<LightTreeEmitter>& emitters, int first, int num, int parent);
+	bool split(vector<LightTreeEmitter>& emitters, int first, int num, const BoundBox& centroid_bounds, int *middle);
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
+
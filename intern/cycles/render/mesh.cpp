@@ -32,6 +32,8 @@
 #include "util_foreach.h"
 #include "util_progress.h"
 #include "util_set.h"
+#include "util_task.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -41,6 +43,8 @@ Mesh::Mesh()
 : attributes(this)
 {
 	need_update = true;
+	need_update_rebuild = true;
+	prepared = false;
 	transform_applied = false;
 	transform_negative_scaled = false;
 	displacement_method = DISPLACE_BUMP;
@@ -79,6 +83,7 @@ void Mesh::clear()
 
 	transform_applied = false;
 	transform_negative_scaled = false;
+	prepared = false;
 }
 
 void Mesh::add_triangle(int v0, int v1, int v2, int shader_, bool smooth_)
@@ -210,6 +215,38 @@ void Mesh::pack_normals(Scene *scene, float4 *normal, float4 *vnormal)
 		vnormal[i] = make_float4(vN[i].x, vN[i].y, vN[i].z, 0.0f);
 }
 
+void Mesh::pack_normals_compact(Scene *scene, uint *tri_shader, uint *normal, uint *vnormal)
+{
+	Attribute *attr_fN = attributes.find(Attribute::STD_FACE_NORMAL);
+	Attribute *attr_vN = attributes.find(Attribute::STD_VERTEX_NORMAL);
+
+	float3 *fN = attr_fN->data_float3();
+	float3 *vN = attr_vN->data_float3();
+	int shader_id = 0;
+	uint last_shader = -1;
+	bool last_smooth = false;
+
+	size_t triangles_size = triangles.size();
+	uint *shader_ptr = (shader.size())? &shader[0]: NULL;
+
+	for(size_t i = 0; i < triangles_size; i++) {
+		normal[i] = octahedral_encode(fN[i]);
+
+		if(shader_ptr[i] != last_shader || last_smooth != smooth[i]) {
+			last_shader = shader_ptr[i];
+			last_smooth = smooth[i];
+			shader_id = scene->shader_manager->get_shader_id(last_shader, this, last_smooth);
+		}
+
+		tri_shader[i] = shader_id;
+	}
+
+	size_t verts_size = verts.size();
+
+	for(size_t i = 0; i < verts_size; i++)
+		vnormal[i] = octahedral_encode(vN[i]);
+}
+
 void Mesh::pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset)
 {
 	size_t verts_size = verts.size();
@@ -240,36 +277,69 @@ void Mesh::pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset)
 	}
 }
 
-void Mesh::compute_bvh(SceneParams *params, Progress& progress)
+void Mesh::compute_bvh(SceneParams *params, bool use_qbvh, Progress *progress, int n, int total)
 {
+	if(progress->get_cancel())
+		return;
+
+	compute_bounds();
+
+	/* meshes with transform applied are part of the top level BVH */
+	if(transform_applied)
+		return;
+
+	string msg = "Updating Mesh BVH ";
+	if(name == "")
+		msg += string_printf("%u/%u", (uint)(n+1), (uint)total);
+	else
+		msg += string_printf("%s %u/%u", name.c_str(), (uint)(n+1), (uint)total);
+
 	Object object;
 	object.mesh = this;
 
 	vector<Object*> objects;
 	objects.push_back(&object);
 
-	if(bvh && !need_update_rebuild) {
-		progress.set_substatus("Refitting BVH");
+	if(bvh && !need_update_rebuild && bvh->params.use_qbvh == use_qbvh) {
+		progress->set_status(msg, "Refitting BVH");
 		bvh->objects = objects;
-		bvh->refit(progress);
+
+		/* refitted tree degraded too much, fall back to a full build */
+		if(bvh->refit(*progress))
+			return;
 	}
-	else {
-		progress.set_substatus("Building BVH");
 
-		BVHParams bparams;
-		bparams.use_cache = params->use_bvh_cache;
-		bparams.use_spatial_split = params->use_bvh_spatial_split;
-		bparams.use_qbvh = params->use_qbvh;
+	progress->set_status(msg, "Building BVH");
 
-		delete bvh;
-		bvh = BVH::create(bparams, objects);
-		bvh->build(progress);
-	}
+	/* node layout changes, the top level BVH must be rebuilt too */
+	need_update_rebuild = true;
+
+	BVHParams bparams;
+	bparams.use_cache = params->use_bvh_cache;
+	bparams.use_spatial_split = params->use_bvh_spatial_split;
+	bparams.use_qbvh = use_qbvh;
+
+	delete bvh;
+	bvh = BVH::create(bparams, objects);
+	bvh->build(*progress);
+}
+
+bool Mesh::has_true_displacement(Scene *scene)
+{
+	if(displacement_method == DISPLACE_BUMP)
+		return false;
+
+	foreach(uint sindex, used_shaders)
+		if(scene->shaders[sindex]->has_displacement)
+			return true;
+
+	return false;
 }
 
 void Mesh::tag_update(Scene *scene, bool rebuild)
 {
 	need_update = true;
+	prepared = false;
 
 	if(rebuild) {
 		need_update_rebuild = true;
@@ -287,9 +357,16 @@ void Mesh::tag_update(Scene *scene, bool rebuild)
 
 /* Mesh Manager */
 
+static void mesh_update_normals(Mesh *mesh)
+{
+	mesh->add_face_normals();
+	mesh->add_vertex_normals();
+}
+
 MeshManager::MeshManager()
 {
 	bvh = NULL;
+	bvh_time = 0.0;
 	need_update = true;
 }
 
@@ -420,100 +497,168 @@ void MeshManager::update_svm_attributes(Device *device, DeviceScene *dscene, Sce
 	device->tex_alloc("__attributes_map", dscene->attributes_map);
 }
 
-void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+static bool mesh_attribute_is_2d(Mesh *mesh, Attribute *mattr)
 {
-	progress.set_status("Updating Mesh", "Computing attributes");
+	size_t size = mattr->element_size(mesh->verts.size(), mesh->triangles.size());
+	float3 *data = mattr->data_float3();
 
-	/* gather per mesh requested attributes. as meshes may have multiple
-	 * shaders assigned, this merges the requested attributes that have
-	 * been set per shader by the shader manager */
-	vector<AttributeRequestSet> mesh_attributes(scene->meshes.size());
+	for(size_t k = 0; k < size; k++)
+		if(data[k].z != 0.0f)
+			return false;
 
-	for(size_t i = 0; i < scene->meshes.size(); i++) {
-		Mesh *mesh = scene->meshes[i];
+	return true;
+}
 
-		foreach(uint sindex, mesh->used_shaders) {
-			Shader *shader = scene->shaders[sindex];
-			mesh_attributes[i].add(shader->attributes);
+static void mesh_attribute_requests(Scene *scene, Mesh *mesh, AttributeRequestSet *attributes)
+{
+	/* as meshes may have multiple shaders assigned, this merges the requested
+	 * attributes that have been set per shader by the shader manager */
+	foreach(uint sindex, mesh->used_shaders) {
+		Shader *shader = scene->shaders[sindex];
+		attributes->add(shader->attributes);
+	}
+
+	/* todo: we now store std and name attributes from requests even if
+	   they actually refer to the same mesh attributes, optimize */
+	foreach(AttributeRequest& req, attributes->requests) {
+		Attribute *mattr = mesh->attributes.find(req);
+
+		/* todo: get rid of this exception */
+		if(!mattr && req.std == Attribute::STD_GENERATED) {
+			mattr = mesh->attributes.add(Attribute::STD_GENERATED);
+			if(mesh->verts.size())
+				memcpy(mattr->data_float3(), &mesh->verts[0], sizeof(float3)*mesh->verts.size());
 		}
+
+		/* attribute not found */
+		if(!mattr) {
+			req.element = ATTR_ELEMENT_NONE;
+			req.offset = 0;
+			continue;
+		}
+
+		/* we abuse AttributeRequest to pass on info like element and
+		   offset, it doesn't really make sense but is convenient */
+
+		/* store element and type */
+		if(mattr->element == Attribute::VERTEX)
+			req.element = ATTR_ELEMENT_VERTEX;
+		else if(mattr->element == Attribute::FACE)
+			req.element = ATTR_ELEMENT_FACE;
+		else if(mattr->element == Attribute::CORNER)
+			req.element = ATTR_ELEMENT_CORNER;
+
+		req.type = mattr->type;
+
+		/* with compact storage, texture coordinates are stored as half floats */
+		if(scene->params.use_compact_storage && req.element == ATTR_ELEMENT_CORNER &&
+		   mattr->type == TypeDesc::TypePoint && mesh_attribute_is_2d(mesh, mattr))
+			req.element = ATTR_ELEMENT_CORNER_HALF2;
 	}
+}
 
-	/* mesh attribute are stored in a single array per data type. here we fill
-	 * those arrays, and set the offset and element type to create attribute
-	 * maps next */
-	vector<float> attr_float;
-	vector<float4> attr_float3;
+static void mesh_attributes_pack(Mesh *mesh, AttributeRequestSet *attributes, float *attr_float, float4 *attr_float3, uint *attr_half2)
+{
+	foreach(AttributeRequest& req, attributes->requests) {
+		Attribute *mattr = mesh->attributes.find(req);
 
-	for(size_t i = 0; i < scene->meshes.size(); i++) {
-		Mesh *mesh = scene->meshes[i];
-		AttributeRequestSet& attributes = mesh_attributes[i];
+		if(!mattr)
+			continue;
 
-		/* todo: we now store std and name attributes from requests even if
-		   they actually refer to the same mesh attributes, optimize */
-		foreach(AttributeRequest& req, attributes.requests) {
-			Attribute *mattr = mesh->attributes.find(req);
+		/* store attribute data in arrays, at the offset computed for it */
+		size_t size = mattr->element_size(mesh->verts.size(), mesh->triangles.size());
 
-			/* todo: get rid of this exception */
-			if(!mattr && req.std == Attribute::STD_GENERATED) {
-				mattr = mesh->attributes.add(Attribute::STD_GENERATED);
-				if(mesh->verts.size())
-					memcpy(mattr->data_float3(), &mesh->verts[0], sizeof(float3)*mesh->verts.size());
-			}
+		if(mattr->type == TypeDesc::TypeFloat) {
+			float *data = mattr->data_float();
 
-			/* attribute not found */
-			if(!mattr) {
-				req.element = ATTR_ELEMENT_NONE;
-				req.offset = 0;
-				continue;
+			if(size)
+				memcpy(attr_float + req.offset, data, sizeof(float)*size);
+		}
+		else if(req.element == ATTR_ELEMENT_CORNER_HALF2) {
+			float3 *data = mattr->data_float3();
+
+			for(size_t k = 0; k < size; k++)
+				attr_half2[req.offset + k] = float2_to_half2(data[k].x, data[k].y);
+		}
+		else {
+			float3 *data = mattr->data_float3();
+
+			for(size_t k = 0; k < size; k++) {
+				float3 f3 = data[k];
+				attr_float3[req.offset + k] = make_float4(f3.x, f3.y, f3.z, 0.0f);
 			}
+		}
 
-			/* we abuse AttributeRequest to pass on info like element and
-			   offset, it doesn't really make sense but is convenient */
+		/* mesh vertex/triangle index is global, not per object, so we sneak
+		   a correction for that in here */
+		if(req.element == ATTR_ELEMENT_VERTEX)
+			req.offset -= mesh->vert_offset;
+		else if(mattr->element == Attribute::FACE)
+			req.offset -= mesh->tri_offset;
+		else if(mattr->element == Attribute::CORNER)
+			req.offset -= 3*mesh->tri_offset;
+	}
+}
 
-			/* store element and type */
-			if(mattr->element == Attribute::VERTEX)
-				req.element = ATTR_ELEMENT_VERTEX;
-			else if(mattr->element == Attribute::FACE)
-				req.element = ATTR_ELEMENT_FACE;
-			else if(mattr->element == Attribute::CORNER)
-				req.element = ATTR_ELEMENT_CORNER;
+void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+{
+	progress.set_status("Updating Mesh", "Computing attributes");
 
-			req.type = mattr->type;
+	/* gather per mesh requested attributes and look up the mesh attributes
+	 * they refer to, independently for each mesh */
+	vector<AttributeRequestSet> mesh_attributes(scene->meshes.size());
+	TaskPool pool;
+
+	for(size_t i = 0; i < scene->meshes.size(); i++)
+		pool.push(function_bind(&mesh_attribute_requests, scene, scene->meshes[i], &mesh_attributes[i]));
+
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
+	/* mesh attribute are stored in a single array per data type. here we
+	 * compute the offset of each attribute in those arrays, to fill them
+	 * and create the attribute maps next */
+	size_t attr_float_size = 0;
+	size_t attr_float3_size = 0;
+	size_t attr_half2_size = 0;
+
+	for(size_t i = 0; i < scene->meshes.size(); i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		foreach(AttributeRequest& req, mesh_attributes[i].requests) {
+			Attribute *mattr = mesh->attributes.find(req);
+
+			if(!mattr)
+				continue;
 
-			/* store attribute data in arrays */
 			size_t size = mattr->element_size(mesh->verts.size(), mesh->triangles.size());
 
 			if(mattr->type == TypeDesc::TypeFloat) {
-				float *data = mattr->data_float();
-				req.offset = attr_float.size();
-
-				for(size_t k = 0; k < size; k++)
-					attr_float.push_back(data[k]);
+				req.offset = attr_float_size;
+				attr_float_size += size;
+			}
+			else if(req.element == ATTR_ELEMENT_CORNER_HALF2) {
+				req.offset = attr_half2_size;
+				attr_half2_size += size;
 			}
 			else {
-				float3 *data = mattr->data_float3();
-				req.offset = attr_float3.size();
+				req.offset = attr_float3_size;
+				attr_float3_size += size;
+			}
+		}
+	}
 
-				for(size_t k = 0; k < size; k++) {
-					float3 f3 = data[k];
-					float4 f4 = make_float4(f3.x, f3.y, f3.z, 0.0f);
+	float *attr_float = dscene->attributes_float.resize(attr_float_size);
+	float4 *attr_float3 = dscene->attributes_float3.resize(attr_float3_size);
+	uint *attr_half2 = dscene->attributes_half2.resize(attr_half2_size);
 
-					attr_float3.push_back(f4);
-				}
-			}
+	for(size_t i = 0; i < scene->meshes.size(); i++)
+		pool.push(function_bind(&mesh_attributes_pack, scene->meshes[i], &mesh_attributes[i], attr_float, attr_float3, attr_half2));
 
-			/* mesh vertex/triangle index is global, not per object, so we sneak
-			   a correction for that in here */
-			if(req.element == ATTR_ELEMENT_VERTEX)
-				req.offset -= mesh->vert_offset;
-			else if(mattr->element == Attribute::FACE)
-				req.offset -= mesh->tri_offset;
-			else if(mattr->element == Attribute::CORNER)
-				req.offset -= 3*mesh->tri_offset;
+	pool.wait_work();
 
-			if(progress.get_cancel()) return;
-		}
-	}
+	if(progress.get_cancel()) return;
 
 	/* create attribute lookup maps */
 	if(scene->params.shadingsystem == SceneParams::OSL)
@@ -526,17 +671,15 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 	/* copy to device */
 	progress.set_status("Updating Mesh", "Copying Attributes to device");
 
-	if(attr_float.size()) {
-		dscene->attributes_float.copy(&attr_float[0], attr_float.size());
+	if(attr_float_size)
 		device->tex_alloc("__attributes_float", dscene->attributes_float);
-	}
-	if(attr_float3.size()) {
-		dscene->attributes_float3.copy(&attr_float3[0], attr_float3.size());
+	if(attr_float3_size)
 		device->tex_alloc("__attributes_float3", dscene->attributes_float3);
-	}
+	if(attr_half2_size)
+		device->tex_alloc("__attributes_half2", dscene->attributes_half2);
 }
 
-void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+bool MeshManager::pack_meshes(DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	/* count and update offsets */
 	size_t vert_size = 0;
@@ -551,47 +694,139 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 	}
 
 	if(tri_size == 0)
-		return;
+		return false;
 
 	/* normals */
-	progress.set_status("Updating Mesh", "Computing normals");
+	progress.set_status("Updating Mesh", "Packing normals and vertices");
 
-	float4 *normal = dscene->tri_normal.resize(tri_size);
-	float4 *vnormal = dscene->tri_vnormal.resize(vert_size);
 	float4 *tri_verts = dscene->tri_verts.resize(vert_size);
 	float4 *tri_vindex = dscene->tri_vindex.resize(tri_size);
 
-	foreach(Mesh *mesh, scene->meshes) {
-		mesh->pack_normals(scene, &normal[mesh->tri_offset], &vnormal[mesh->vert_offset]);
-		mesh->pack_verts(&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset);
+	/* compact storage replaces the float4 normals and shader by an uint
+	   shader and octahedral encoded normals */
+	bool compact = scene->params.use_compact_storage;
+	float4 *normal = NULL, *vnormal = NULL;
+	uint *tri_shader = NULL, *normal_oct = NULL, *vnormal_oct = NULL;
 
-		if(progress.get_cancel()) return;
+	if(compact) {
+		tri_shader = dscene->tri_shader.resize(tri_size);
+		normal_oct = dscene->tri_normal_oct.resize(tri_size);
+		vnormal_oct = dscene->tri_vnormal_oct.resize(vert_size);
 	}
+	else {
+		normal = dscene->tri_normal.resize(tri_size);
+		vnormal = dscene->tri_vnormal.resize(vert_size);
+	}
+
+	/* meshes are packed into separate ranges of the arrays, in parallel */
+	TaskPool pool;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(compact)
+			pool.push(function_bind(&Mesh::pack_normals_compact, mesh, scene,
+				&tri_shader[mesh->tri_offset], &normal_oct[mesh->tri_offset], &vnormal_oct[mesh->vert_offset]));
+		else
+			pool.push(function_bind(&Mesh::pack_normals, mesh, scene,
+				&normal[mesh->tri_offset], &vnormal[mesh->vert_offset]));
+
+		pool.push(function_bind(&Mesh::pack_verts, mesh,
+			&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset));
+	}
+
+	pool.wait_work();
+
+	return true;
+}
+
+void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+{
+	if(!pack_meshes(dscene, scene, progress))
+		return;
+
+	if(progress.get_cancel()) return;
+
+	device_copy_mesh(device, dscene, progress);
+}
+
+void MeshManager::device_copy_mesh(Device *device, DeviceScene *dscene, Progress& progress)
+{
+	if(dscene->tri_vindex.size() == 0)
+		return;
 
 	/* vertex coordinates */
 	progress.set_status("Updating Mesh", "Copying Mesh to device");
 
-	device->tex_alloc("__tri_normal", dscene->tri_normal);
-	device->tex_alloc("__tri_vnormal", dscene->tri_vnormal);
+	if(dscene->tri_normal.size()) {
+		device->tex_alloc("__tri_normal", dscene->tri_normal);
+		device->tex_alloc("__tri_vnormal", dscene->tri_vnormal);
+	}
+	else {
+		device->tex_alloc("__tri_shader", dscene->tri_shader);
+		device->tex_alloc("__tri_normal_oct", dscene->tri_normal_oct);
+		device->tex_alloc("__tri_vnormal_oct", dscene->tri_vnormal_oct);
+	}
+
 	device->tex_alloc("__tri_verts", dscene->tri_verts);
 	device->tex_alloc("__tri_vindex", dscene->tri_vindex);
 }
 
-void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+bool MeshManager::bvh_objects_modified(Scene *scene)
 {
+	if(bvh_meshes.size() != scene->objects.size())
+		return true;
+
+	for(size_t i = 0; i < scene->objects.size(); i++) {
+		Mesh *mesh = scene->objects[i]->mesh;
+
+		if(bvh_meshes[i] != mesh || bvh_transform_applied[i] != mesh->transform_applied)
+			return true;
+	}
+
+	return false;
+}
+
+void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, bool rebuild, Progress& progress)
+{
+	bool use_qbvh = scene->params.use_qbvh && device->support_qbvh();
+	bool refitted = false;
+
+	/* bvh refit, if only vertex positions and object transforms changed the
+	   tree topology and instance layout can be kept */
+	if(bvh && !rebuild && bvh->params.use_qbvh == use_qbvh && !bvh_objects_modified(scene)) {
+		progress.set_status("Updating Scene BVH", "Refitting");
+
+		bvh->objects = scene->objects;
+		refitted = bvh->refit(progress);
+	}
+
 	/* bvh build */
-	progress.set_status("Updating Scene BVH", "Building");
+	if(!refitted) {
+		progress.set_status("Updating Scene BVH", "Building");
 
-	BVHParams bparams;
-	bparams.top_level = true;
-	bparams.use_qbvh = scene->params.use_qbvh;
-	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
+		BVHParams bparams;
+		bparams.top_level = true;
+		bparams.use_qbvh = use_qbvh;
+		bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 
-	delete bvh;
-	bvh = BVH::create(bparams, scene->objects);
-	bvh->build(progress);
+		delete bvh;
+		bvh = BVH::create(bparams, scene->objects);
+		bvh->build(progress);
 
-	if(progress.get_cancel()) return;
+		bvh_meshes.clear();
+		bvh_transform_applied.clear();
+
+		foreach(Object *object, scene->objects) {
+			bvh_meshes.push_back(object->mesh);
+			bvh_transform_applied.push_back(object->mesh->transform_applied);
+		}
+	}
+
+	if(progress.get_cancel()) {
+		/* partially built or refitted, can't be reused */
+		delete bvh;
+		bvh = NULL;
+		return;
+	}
 
 	/* copy to device */
 	progress.set_status("Updating Scene BVH", "Copying BVH to device");
@@ -626,29 +861,125 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	dscene->data.bvh.root = pack.root_index;
 }
 
+void MeshManager::device_prepare(Device *device, DeviceScene *dscene_next, Scene *scene, Progress& progress)
+{
+	/* host side part of the device update, writing only to data the device
+	   is not using, so the device can keep rendering in the meantime */
+	if(!need_update)
+		return;
+
+	/* update normals */
+	progress.set_status("Preparing Mesh", "Computing normals");
+
+	TaskPool pool;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		foreach(uint shader, mesh->used_shaders)
+			if(scene->shaders[shader]->need_update_attributes)
+				mesh->need_update = true;
+
+		if(mesh->need_update)
+			pool.push(function_bind(&mesh_update_normals, mesh));
+	}
+
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
+	/* displacement and static transforms still modify the meshes in the
+	   device update, packing and building BVH's must wait for those */
+	if(scene->params.bvh_type == SceneParams::BVH_STATIC)
+		return;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->need_update && mesh->has_true_displacement(scene))
+			return;
+
+	/* pack into the next device scene */
+	pack_meshes(dscene_next, scene, progress);
+
+	if(progress.get_cancel()) return;
+
+	/* mesh BVH's, the top level BVH is built in the device update since the
+	   device is still using it */
+	bool use_qbvh = scene->params.use_qbvh && device->support_qbvh();
+	size_t i = 0, num_bvh = 0;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->need_update && !mesh->prepared)
+			num_bvh++;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->need_update && !mesh->prepared)
+			pool.push(function_bind(&Mesh::compute_bvh, mesh, &scene->params, use_qbvh, &progress, i++, num_bvh));
+
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->need_update)
+			mesh->prepared = true;
+
+	prepared_meshes = scene->meshes;
+}
+
 void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	if(!need_update)
 		return;
 
 	/* update normals */
+	progress.set_status("Updating Mesh", "Computing normals");
+
+	TaskPool pool;
+
+	/* data packed by device_prepare can be used if no meshes were added,
+	   removed or modified since */
+	bool use_prepared = (prepared_meshes.size() && prepared_meshes == scene->meshes);
+
 	foreach(Mesh *mesh, scene->meshes) {
 		foreach(uint shader, mesh->used_shaders)
 			if(scene->shaders[shader]->need_update_attributes)
 				mesh->need_update = true;
 
-		if(mesh->need_update) {
-			mesh->add_face_normals();
-			mesh->add_vertex_normals();
+		/* shader changes may have enabled displacement since */
+		if(mesh->prepared && mesh->has_true_displacement(scene))
+			mesh->prepared = false;
 
-			if(progress.get_cancel()) return;
+		if(mesh->need_update && !mesh->prepared) {
+			use_prepared = false;
+			pool.push(function_bind(&mesh_update_normals, mesh));
 		}
 	}
 
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
 	/* device update */
 	device_free(device, dscene);
 
-	device_update_mesh(device, dscene, scene, progress);
+	dscene->data.bvh.compact_storage = scene->params.use_compact_storage;
+
+	if(use_prepared) {
+		DeviceScene *dscene_next = &scene->dscene_next;
+
+		dscene->tri_normal.swap_data(dscene_next->tri_normal);
+		dscene->tri_vnormal.swap_data(dscene_next->tri_vnormal);
+		dscene->tri_shader.swap_data(dscene_next->tri_shader);
+		dscene->tri_normal_oct.swap_data(dscene_next->tri_normal_oct);
+		dscene->tri_vnormal_oct.swap_data(dscene_next->tri_vnormal_oct);
+		dscene->tri_verts.swap_data(dscene_next->tri_verts);
+		dscene->tri_vindex.swap_data(dscene_next->tri_vindex);
+
+		device_copy_mesh(device, dscene, progress);
+	}
+	else
+		device_update_mesh(device, dscene, scene, progress);
+
+	free_prepared(scene);
+
 	if(progress.get_cancel()) return;
 
 	device_update_attributes(device, dscene, scene, progress);
@@ -675,37 +1006,42 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		if(progress.get_cancel()) return;
 	}
 
-	/* update bvh */
-	size_t i = 0, num_instance_bvh = 0;
+	/* update bvh, layout must match the kernel traversal of the device. the
+	   mesh BVH's are built in parallel, and the top level BVH after they are
+	   all done */
+	bool use_qbvh = scene->params.use_qbvh && device->support_qbvh();
+	size_t i = 0, num_bvh = 0;
+	bool bvh_rebuild = false;
+	double bvh_start_time = time_dt();
 
 	foreach(Mesh *mesh, scene->meshes)
-		if(mesh->need_update && !mesh->transform_applied)
-			num_instance_bvh++;
+		if(mesh->need_update && !mesh->prepared && !mesh->transform_applied)
+			num_bvh++;
 
 	foreach(Mesh *mesh, scene->meshes) {
-		if(mesh->need_update) {
-			mesh->compute_bounds();
+		if(mesh->need_update && !mesh->prepared) {
+			pool.push(function_bind(&Mesh::compute_bvh, mesh, &scene->params, use_qbvh, &progress, i, num_bvh));
 
-			if(!mesh->transform_applied) {
-				string msg = "Updating Mesh BVH ";
-				if(mesh->name == "")
-					msg += string_printf("%u/%u", (uint)(i+1), (uint)num_instance_bvh);
-				else
-					msg += string_printf("%s %u/%u", mesh->name.c_str(), (uint)(i+1), (uint)num_instance_bvh);
-				progress.set_status(msg, "Building BVH");
+			if(!mesh->transform_applied)
+				i++;
+		}
+	}
 
-				mesh->compute_bvh(&scene->params, progress);
-			}
+	pool.wait_work();
 
-			if(progress.get_cancel()) return;
+	if(progress.get_cancel()) return;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(mesh->need_update) {
+			if(mesh->need_update_rebuild)
+				bvh_rebuild = true;
 
 			mesh->need_update = false;
 			mesh->need_update_rebuild = false;
+			mesh->prepared = false;
 		}
-
-		i++;
 	}
-	
+
 	foreach(Shader *shader, scene->shaders)
 		shader->need_update_attributes = false;
 
@@ -714,11 +1050,27 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	if(progress.get_cancel()) return;
 
-	device_update_bvh(device, dscene, scene, progress);
+	device_update_bvh(device, dscene, scene, bvh_rebuild, progress);
 
+	bvh_time = time_dt() - bvh_start_time;
 	need_update = false;
 }
 
+void MeshManager::free_prepared(Scene *scene)
+{
+	DeviceScene *dscene_next = &scene->dscene_next;
+
+	dscene_next->tri_normal.clear();
+	dscene_next->tri_vnormal.clear();
+	dscene_next->tri_shader.clear();
+	dscene_next->tri_normal_oct.clear();
+	dscene_next->tri_vnormal_oct.clear();
+	dscene_next->tri_verts.clear();
+	dscene_next->tri_vindex.clear();
+
+	prepared_meshes.clear();
+}
+
 void MeshManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->bvh_nodes);
@@ -731,9 +1083,13 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->tri_vnormal);
 	device->tex_free(dscene->tri_vindex);
 	device->tex_free(dscene->tri_verts);
+	device->tex_free(dscene->tri_shader);
+	device->tex_free(dscene->tri_normal_oct);
+	device->tex_free(dscene->tri_vnormal_oct);
 	device->tex_free(dscene->attributes_map);
 	device->tex_free(dscene->attributes_float);
 	device->tex_free(dscene->attributes_float3);
+	device->tex_free(dscene->attributes_half2);
 
 	dscene->bvh_nodes.clear();
 	dscene->object_node.clear();
@@ -745,9 +1101,13 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->tri_vnormal.clear();
 	dscene->tri_vindex.clear();
 	dscene->tri_verts.clear();
+	dscene->tri_shader.clear();
+	dscene->tri_normal_oct.clear();
+	dscene->tri_vnormal_oct.clear();
 	dscene->attributes_map.clear();
 	dscene->attributes_float.clear();
 	dscene->attributes_float3.clear();
+	dscene->attributes_half2.clear();
 }
 
 void MeshManager::tag_update(Scene *scene)
@@ -76,6 +76,7 @@ public:
 	/* Update Flags */
 	bool need_update;
 	bool need_update_rebuild;
+	bool prepared; /* normals and BVH done ahead by MeshManager::device_prepare */
 
 	/* BVH */
 	BVH *bvh;
@@ -95,8 +96,10 @@ public:
 	void add_vertex_normals();
 
 	void pack_normals(Scene *scene, float4 *normal, float4 *vnormal);
+	void pack_normals_compact(Scene *scene, uint *tri_shader, uint *normal, uint *vnormal);
 	void pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset);
-	void compute_bvh(SceneParams *params, Progress& progress);
+	void compute_bvh(SceneParams *params, bool use_qbvh, Progress *progress, int n, int total);
+	bool has_true_displacement(Scene *scene);
 
 	void tag_update(Scene *scene, bool rebuild);
 };
@@ -107,6 +110,16 @@ class MeshManager {
 public:
 	BVH *bvh;
 
+	/* object meshes the top level BVH was built with, to detect if it can be refitted */
+	vector<Mesh*> bvh_meshes;
+	vector<bool> bvh_transform_applied;
+
+	/* time in seconds spent building or refitting BVH's in the last update */
+	double bvh_time;
+
+	/* meshes packed into the next device scene by device_prepare, in order */
+	vector<Mesh*> prepared_meshes;
+
 	bool need_update;
 
 	MeshManager();
@@ -118,11 +131,16 @@ public:
 	void update_osl_attributes(Device *device, Scene *scene, vector<AttributeRequestSet>& mesh_attributes);
 	void update_svm_attributes(Device *device, DeviceScene *dscene, Scene *scene, vector<AttributeRequestSet>& mesh_attributes);
 
+	void device_prepare(Device *device, DeviceScene *dscene_next, Scene *scene, Progress& progress);
 	void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_object(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_mesh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+	void device_copy_mesh(Device *device, DeviceScene *dscene, Progress& progress);
+	bool pack_meshes(DeviceScene *dscene, Scene *scene, Progress& progress);
+	void free_prepared(Scene *scene);
 	void device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
-	void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+	void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, bool rebuild, Progress& progress);
+	bool bvh_objects_modified(Scene *scene);
 	void device_free(Device *device, DeviceScene *dscene);
 
 	void tag_update(Scene *scene);
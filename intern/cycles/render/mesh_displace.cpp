@@ -30,15 +30,7 @@ CCL_NAMESPACE_BEGIN
 bool MeshManager::displace(Device *device, Scene *scene, Mesh *mesh, Progress& progress)
 {
 	/* verify if we have a displacement shader */
-	bool has_displacement = false;
-
-	if(mesh->displacement_method != Mesh::DISPLACE_BUMP) {
-		foreach(uint sindex, mesh->used_shaders)
-			if(scene->shaders[sindex]->has_displacement)
-				has_displacement = true;
-	}
-	
-	if(!has_displacement)
+	if(!mesh->has_true_displacement(scene))
 		return false;
 
 	/* setup input for device task */
@@ -112,6 +104,15 @@ bool MeshManager::displace(Device *device, Scene *scene, Mesh *mesh, Progress& p
 	if(progress.get_cancel())
 		return false;
 
+	/* keep the positions from before displacement, so that on the next sync
+	 * we can detect that the mesh did not change and skip displacing again.
+	 * only done the first time, the mesh may be displaced again after an
+	 * attribute update without being synced in between */
+	if(!mesh->attributes.find(Attribute::STD_POSITION_UNDISPLACED)) {
+		Attribute *attr = mesh->attributes.add(Attribute::STD_POSITION_UNDISPLACED);
+		memcpy(attr->data_float3(), &mesh->verts[0], sizeof(float3)*mesh->verts.size());
+	}
+
 	/* read result */
 	done.clear();
 	done.resize(mesh->verts.size(), false);
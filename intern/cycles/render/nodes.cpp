@@ -21,6 +21,9 @@
 #include "svm.h"
 #include "osl.h"
 
+#include "svm_math_util.h"
+
+#include "util_color.h"
 #include "util_transform.h"
 
 CCL_NAMESPACE_BEGIN
@@ -73,6 +76,17 @@ bool TextureMapping::skip()
 	return true;
 }
 
+bool TextureMapping::equals(const TextureMapping& other)
+{
+	return translation == other.translation &&
+	       rotation == other.rotation &&
+	       scale == other.scale &&
+	       x_mapping == other.x_mapping &&
+	       y_mapping == other.y_mapping &&
+	       z_mapping == other.z_mapping &&
+	       projection == other.projection;
+}
+
 void TextureMapping::compile(SVMCompiler& compiler, int offset_in, int offset_out)
 {
 	if(offset_in == SVM_STACK_INVALID || offset_out == SVM_STACK_INVALID)
@@ -87,6 +101,14 @@ void TextureMapping::compile(SVMCompiler& compiler, int offset_in, int offset_ou
 	compiler.add_node(tfm.w);
 }
 
+/* Texture Node */
+
+bool TextureNode::equals(const ShaderNode *other)
+{
+	const TextureNode *tex_node = (const TextureNode*)other;
+	return ShaderNode::equals(other) && tex_mapping.equals(tex_node->tex_mapping);
+}
+
 /* Image Texture */
 
 static ShaderEnum color_space_init()
@@ -149,13 +171,23 @@ void ImageTextureNode::compile(SVMCompiler& compiler)
 		if(!tex_mapping.skip())
 			tex_mapping.compile(compiler, vector_in->stack_offset, vector_in->stack_offset);
 
+		/* for the default UV map, the texture cache can find the filter
+		   width from the ray differentials of the UV attribute */
+		int uv_id = 0;
+		ShaderOutput *vector_link = vector_in->link;
+
+		if(vector_link && vector_link->parent->name == ustring("texture_coordinate") &&
+		   strcmp(vector_link->name, "UV") == 0 && tex_mapping.skip())
+			uv_id = compiler.attribute(Attribute::STD_UV) + 1;
+
 		compiler.add_node(NODE_TEX_IMAGE,
 			slot,
 			compiler.encode_uchar4(
 				vector_in->stack_offset,
 				color_out->stack_offset,
 				alpha_out->stack_offset,
-				color_space_enum[color_space]));
+				color_space_enum[color_space]),
+			uv_id);
 	}
 	else {
 		/* image not found */
@@ -175,6 +207,18 @@ void ImageTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_image_texture");
 }
 
+bool ImageTextureNode::equals(const ShaderNode *other)
+{
+	const ImageTextureNode *node = (const ImageTextureNode*)other;
+	return TextureNode::equals(other) && filename == node->filename && color_space == node->color_space;
+}
+
+void ImageTextureNode::image_files(vector<string>& filenames)
+{
+	if(slot == -1)
+		filenames.push_back(filename);
+}
+
 /* Environment Texture */
 
 ShaderEnum EnvironmentTextureNode::color_space_enum = color_space_init();
@@ -253,6 +297,18 @@ void EnvironmentTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_environment_texture");
 }
 
+bool EnvironmentTextureNode::equals(const ShaderNode *other)
+{
+	const EnvironmentTextureNode *node = (const EnvironmentTextureNode*)other;
+	return TextureNode::equals(other) && filename == node->filename && color_space == node->color_space;
+}
+
+void EnvironmentTextureNode::image_files(vector<string>& filenames)
+{
+	if(slot == -1)
+		filenames.push_back(filename);
+}
+
 /* Sky Texture */
 
 static float2 sky_spherical_coordinates(float3 dir)
@@ -353,6 +409,12 @@ void SkyTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_sky_texture");
 }
 
+bool SkyTextureNode::equals(const ShaderNode *other)
+{
+	const SkyTextureNode *node = (const SkyTextureNode*)other;
+	return TextureNode::equals(other) && sun_direction == node->sun_direction && turbidity == node->turbidity;
+}
+
 /* Gradient Texture */
 
 static ShaderEnum gradient_type_init()
@@ -408,6 +470,12 @@ void GradientTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_gradient_texture");
 }
 
+bool GradientTextureNode::equals(const ShaderNode *other)
+{
+	const GradientTextureNode *node = (const GradientTextureNode*)other;
+	return TextureNode::equals(other) && type == node->type;
+}
+
 /* Noise Texture */
 
 NoiseTextureNode::NoiseTextureNode()
@@ -512,6 +580,12 @@ void VoronoiTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_voronoi_texture");
 }
 
+bool VoronoiTextureNode::equals(const ShaderNode *other)
+{
+	const VoronoiTextureNode *node = (const VoronoiTextureNode*)other;
+	return TextureNode::equals(other) && coloring == node->coloring;
+}
+
 /* Musgrave Texture */
 
 static ShaderEnum musgrave_type_init()
@@ -593,6 +667,12 @@ void MusgraveTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_musgrave_texture");
 }
 
+bool MusgraveTextureNode::equals(const ShaderNode *other)
+{
+	const MusgraveTextureNode *node = (const MusgraveTextureNode*)other;
+	return TextureNode::equals(other) && type == node->type;
+}
+
 /* Wave Texture */
 
 static ShaderEnum wave_type_init()
@@ -664,6 +744,12 @@ void WaveTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_marble_texture");
 }
 
+bool WaveTextureNode::equals(const ShaderNode *other)
+{
+	const WaveTextureNode *node = (const WaveTextureNode*)other;
+	return TextureNode::equals(other) && type == node->type;
+}
+
 /* Magic Texture */
 
 MagicTextureNode::MagicTextureNode()
@@ -713,6 +799,12 @@ void MagicTextureNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_magic_texture");
 }
 
+bool MagicTextureNode::equals(const ShaderNode *other)
+{
+	const MagicTextureNode *node = (const MagicTextureNode*)other;
+	return TextureNode::equals(other) && depth == node->depth;
+}
+
 /* Mapping */
 
 MappingNode::MappingNode()
@@ -741,6 +833,12 @@ void MappingNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_mapping");
 }
 
+bool MappingNode::equals(const ShaderNode *other)
+{
+	const MappingNode *node = (const MappingNode*)other;
+	return ShaderNode::equals(other) && tex_mapping.equals(node->tex_mapping);
+}
+
 /* Convert */
 
 ConvertNode::ConvertNode(ShaderSocketType from_, ShaderSocketType to_)
@@ -834,6 +932,36 @@ void ConvertNode::compile(OSLCompiler& compiler)
 		assert(0);
 }
 
+bool ConvertNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *in = inputs[0];
+
+	if(to == SHADER_SOCKET_FLOAT) {
+		if(from == SHADER_SOCKET_COLOR)
+			/* color to float */
+			optimized_value->x = linear_rgb_to_gray(in->value);
+		else
+			/* vector/point/normal to float */
+			optimized_value->x = (in->value.x + in->value.y + in->value.z)*(1.0f/3.0f);
+	}
+	else if(from == SHADER_SOCKET_FLOAT) {
+		/* float to float3 */
+		*optimized_value = make_float3(in->value.x, in->value.x, in->value.x);
+	}
+	else {
+		/* float3 to float3 */
+		*optimized_value = in->value;
+	}
+
+	return true;
+}
+
+bool ConvertNode::equals(const ShaderNode *other)
+{
+	const ConvertNode *node = (const ConvertNode*)other;
+	return ShaderNode::equals(other) && from == node->from && to == node->to;
+}
+
 /* BSDF Closure */
 
 BsdfNode::BsdfNode()
@@ -1497,6 +1625,18 @@ void ValueNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_value");
 }
 
+bool ValueNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	optimized_value->x = value;
+	return true;
+}
+
+bool ValueNode::equals(const ShaderNode *other)
+{
+	const ValueNode *node = (const ValueNode*)other;
+	return ShaderNode::equals(other) && value == node->value;
+}
+
 /* Color */
 
 ColorNode::ColorNode()
@@ -1525,6 +1665,18 @@ void ColorNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_value");
 }
 
+bool ColorNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	*optimized_value = value;
+	return true;
+}
+
+bool ColorNode::equals(const ShaderNode *other)
+{
+	const ColorNode *node = (const ColorNode*)other;
+	return ShaderNode::equals(other) && value == node->value;
+}
+
 /* Add Closure */
 
 AddClosureNode::AddClosureNode()
@@ -1594,6 +1746,15 @@ void InvertNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_invert");
 }
 
+bool InvertNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	float factor = input("Fac")->value.x;
+	float3 color = input("Color")->value;
+
+	*optimized_value = factor*(make_float3(1.0f, 1.0f, 1.0f) - color) + (1.0f - factor)*color;
+	return true;
+}
+
 /* Mix */
 
 MixNode::MixNode()
@@ -1657,6 +1818,12 @@ void MixNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_mix");
 }
 
+bool MixNode::equals(const ShaderNode *other)
+{
+	const MixNode *node = (const MixNode*)other;
+	return ShaderNode::equals(other) && type == node->type;
+}
+
 /* Combine RGB */
 CombineRGBNode::CombineRGBNode()
 : ShaderNode("combine_rgb")
@@ -1691,6 +1858,12 @@ void CombineRGBNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_combine_rgb");
 }
 
+bool CombineRGBNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	*optimized_value = make_float3(input("R")->value.x, input("G")->value.x, input("B")->value.x);
+	return true;
+}
+
 /* Separate RGB */
 SeparateRGBNode::SeparateRGBNode()
 : ShaderNode("separate_rgb")
@@ -1725,6 +1898,20 @@ void SeparateRGBNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_separate_rgb");
 }
 
+bool SeparateRGBNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	float3 color = input("Image")->value;
+
+	if(socket == output("R"))
+		optimized_value->x = color.x;
+	else if(socket == output("G"))
+		optimized_value->x = color.y;
+	else
+		optimized_value->x = color.z;
+
+	return true;
+}
+
 /* Separate RGB */
 HSVNode::HSVNode()
 : ShaderNode("hsv")
@@ -1832,6 +2019,12 @@ void AttributeNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_attribute");
 }
 
+bool AttributeNode::equals(const ShaderNode *other)
+{
+	const AttributeNode *node = (const AttributeNode*)other;
+	return ShaderNode::equals(other) && attribute == node->attribute;
+}
+
 /* Camera */
 
 CameraNode::CameraNode()
@@ -2014,6 +2207,21 @@ void MathNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_math");
 }
 
+bool MathNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	float value1 = input("Value1")->value.x;
+	float value2 = input("Value2")->value.x;
+
+	optimized_value->x = svm_math((NodeMath)type_enum[type], value1, value2);
+	return true;
+}
+
+bool MathNode::equals(const ShaderNode *other)
+{
+	const MathNode *node = (const MathNode*)other;
+	return ShaderNode::equals(other) && type == node->type;
+}
+
 /* VectorMath */
 
 VectorMathNode::VectorMathNode()
@@ -2065,6 +2273,29 @@ void VectorMathNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_vector_math");
 }
 
+bool VectorMathNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	float3 vector1 = input("Vector1")->value;
+	float3 vector2 = input("Vector2")->value;
+	float value;
+	float3 vector;
+
+	svm_vector_math(&value, &vector, (NodeVectorMath)type_enum[type], vector1, vector2);
+
+	if(socket == output("Value"))
+		optimized_value->x = value;
+	else
+		*optimized_value = vector;
+
+	return true;
+}
+
+bool VectorMathNode::equals(const ShaderNode *other)
+{
+	const VectorMathNode *node = (const VectorMathNode*)other;
+	return ShaderNode::equals(other) && type == node->type;
+}
+
 /* BumpNode */
 
 BumpNode::BumpNode()
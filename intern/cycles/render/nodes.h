@@ -35,6 +35,7 @@ public:
 	TextureMapping();
 	Transform compute_transform();
 	bool skip();
+	bool equals(const TextureMapping& other);
 	void compile(SVMCompiler& compiler, int offset_in, int offset_out);
 
 	float3 translation;
@@ -53,6 +54,8 @@ public:
 class TextureNode : public ShaderNode {
 public:
 	TextureNode(const char *name) : ShaderNode(name) {}
+	bool equals(const ShaderNode *other);
+
 	TextureMapping tex_mapping;
 };
 
@@ -61,6 +64,8 @@ public:
 	SHADER_NODE_NO_CLONE_CLASS(ImageTextureNode)
 	~ImageTextureNode();
 	ShaderNode *clone() const;
+	bool equals(const ShaderNode *other);
+	void image_files(vector<string>& filenames);
 
 	ImageManager *image_manager;
 	int slot;
@@ -75,6 +80,8 @@ public:
 	SHADER_NODE_NO_CLONE_CLASS(EnvironmentTextureNode)
 	~EnvironmentTextureNode();
 	ShaderNode *clone() const;
+	bool equals(const ShaderNode *other);
+	void image_files(vector<string>& filenames);
 
 	ImageManager *image_manager;
 	int slot;
@@ -87,6 +94,7 @@ public:
 class SkyTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(SkyTextureNode)
+	bool equals(const ShaderNode *other);
 
 	float3 sun_direction;
 	float turbidity;
@@ -100,6 +108,7 @@ public:
 class GradientTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(GradientTextureNode)
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 	static ShaderEnum type_enum;
@@ -113,6 +122,7 @@ public:
 class VoronoiTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(VoronoiTextureNode)
+	bool equals(const ShaderNode *other);
 
 	ustring coloring;
 
@@ -122,6 +132,7 @@ public:
 class MusgraveTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(MusgraveTextureNode)
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 
@@ -131,6 +142,7 @@ public:
 class WaveTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(WaveTextureNode)
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 	static ShaderEnum type_enum;
@@ -139,6 +151,7 @@ public:
 class MagicTextureNode : public TextureNode {
 public:
 	SHADER_NODE_CLASS(MagicTextureNode)
+	bool equals(const ShaderNode *other);
 
 	int depth;
 };
@@ -146,6 +159,7 @@ public:
 class MappingNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MappingNode)
+	bool equals(const ShaderNode *other);
 
 	TextureMapping tex_mapping;
 };
@@ -154,6 +168,8 @@ class ConvertNode : public ShaderNode {
 public:
 	ConvertNode(ShaderSocketType from, ShaderSocketType to);
 	SHADER_NODE_BASE_CLASS(ConvertNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 
 	ShaderSocketType from, to;
 };
@@ -263,6 +279,8 @@ public:
 class ValueNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ValueNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 
 	float value;
 };
@@ -270,6 +288,8 @@ public:
 class ColorNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ColorNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 
 	float3 value;
 };
@@ -287,11 +307,13 @@ public:
 class InvertNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(InvertNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
 };
 
 class MixNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MixNode)
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 	static ShaderEnum type_enum;
@@ -300,11 +322,13 @@ public:
 class CombineRGBNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(CombineRGBNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
 };
 
 class SeparateRGBNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(SeparateRGBNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
 };
 
 class HSVNode : public ShaderNode {
@@ -315,6 +339,7 @@ public:
 class AttributeNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(AttributeNode)
+	bool equals(const ShaderNode *other);
 	void attributes(AttributeRequestSet *attributes);
 
 	ustring attribute;
@@ -338,6 +363,8 @@ public:
 class MathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MathNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 	static ShaderEnum type_enum;
@@ -346,6 +373,8 @@ public:
 class VectorMathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(VectorMathNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 
 	ustring type;
 	static ShaderEnum type_enum;
@@ -199,7 +199,9 @@ void ObjectManager::device_update(Device *device, DeviceScene *dscene, Scene *sc
 
 	/* prepare for static BVH building */
 	/* todo: do before to support getting object level coords? */
-	if(scene->params.bvh_type == SceneParams::BVH_STATIC) {
+	/* with persistent data, meshes keep their own BVH so that only the top
+	   level needs to be rebuilt for the next frame */
+	if(scene->params.bvh_type == SceneParams::BVH_STATIC && !scene->params.persistent_data) {
 		progress.set_status("Updating Objects", "Applying Static Transformations");
 		apply_static_transforms(scene, progress);
 	}
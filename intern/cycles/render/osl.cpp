@@ -96,6 +96,7 @@ void OSLShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 
 		OSLCompiler compiler((void*)ss);
 		compiler.background = (shader == scene->shaders[scene->default_background]);
+		compiler.optimize = scene->params.use_shader_optimization;
 		compiler.compile(og, shader);
 	}
 
@@ -142,6 +143,7 @@ OSLCompiler::OSLCompiler(void *shadingsys_)
 	current_type = SHADER_TYPE_SURFACE;
 	current_shader = NULL;
 	background = false;
+	optimize = true;
 }
 
 string OSLCompiler::id(ShaderNode *node)
@@ -401,9 +403,9 @@ void OSLCompiler::compile(OSLGlobals *og, Shader *shader)
 			shader->graph_bump = shader->graph->copy();
 
 	/* finalize */
-	shader->graph->finalize(false, true);
+	shader->graph->finalize(false, true, optimize);
 	if(shader->graph_bump)
-		shader->graph_bump->finalize(true, true);
+		shader->graph_bump->finalize(true, true, optimize);
 
 	current_shader = shader;
 
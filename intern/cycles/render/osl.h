@@ -82,6 +82,7 @@ public:
 	ShaderType output_type() { return current_type; }
 
 	bool background;
+	bool optimize;
 
 private:
 	string id(ShaderNode *node);
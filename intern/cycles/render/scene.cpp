@@ -31,9 +31,11 @@
 #include "scene.h"
 #include "svm.h"
 #include "osl.h"
+#include "graph.h"
 
 #include "util_foreach.h"
 #include "util_progress.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -41,6 +43,7 @@ Scene::Scene(const SceneParams& params_)
 : params(params_)
 {
 	device = NULL;
+	update_time = 0.0;
 	memset(&dscene.data, 0, sizeof(dscene.data));
 
 	camera = new Camera();
@@ -53,6 +56,9 @@ Scene::Scene(const SceneParams& params_)
 	integrator = new Integrator();
 	image_manager = new ImageManager();
 	shader_manager = ShaderManager::create(this);
+
+	image_manager->set_texture_cache(params.use_texture_cache,
+		(size_t)params.texture_cache_size*1024*1024);
 }
 
 Scene::~Scene()
@@ -97,6 +103,29 @@ Scene::~Scene()
 	delete image_manager;
 }
 
+void Scene::device_prepare(Device *device_, Progress& progress)
+{
+	if(!device)
+		device = device_;
+
+	/* read ahead image files of modified shaders, the shader manager adds
+	   them to the image manager when compiling in the device update */
+	if(shader_manager->need_update) {
+		vector<string> filenames;
+
+		foreach(Shader *shader, shaders)
+			if(shader->need_update && shader->graph)
+				foreach(ShaderNode *node, shader->graph->nodes)
+					node->image_files(filenames);
+
+		image_manager->device_prepare(filenames, progress);
+	}
+
+	if(progress.get_cancel()) return;
+
+	mesh_manager->device_prepare(device, &dscene_next, this, progress);
+}
+
 void Scene::device_update(Device *device_, Progress& progress)
 {
 	if(!device)
@@ -111,6 +140,7 @@ void Scene::device_update(Device *device_, Progress& progress)
 	 * - Displacement shader must have all shader data available.
 	 * - Light manager needs final mesh data to compute emission CDF.
 	 */
+	double start_time = time_dt();
 
 	progress.set_status("Updating Background");
 	background->device_update(device, &dscene, this);
@@ -158,12 +188,19 @@ void Scene::device_update(Device *device_, Progress& progress)
 	if(progress.get_cancel()) return;
 
 	progress.set_status("Updating Film");
-	film->device_update(device, &dscene);
+	film->device_update(device, &dscene, this);
 
 	if(progress.get_cancel()) return;
 
 	progress.set_status("Updating Device", "Writing constant memory");
 	device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
+
+	update_time = time_dt() - start_time;
+}
+
+bool Scene::need_prepare()
+{
+	return (shader_manager->need_update || mesh_manager->need_update);
 }
 
 bool Scene::need_update()
@@ -67,6 +67,11 @@ public:
 	device_vector<float4> tri_vindex;
 	device_vector<float4> tri_verts;
 
+	/* mesh, compact storage */
+	device_vector<uint> tri_shader;
+	device_vector<uint> tri_normal_oct;
+	device_vector<uint> tri_vnormal_oct;
+
 	/* objects */
 	device_vector<float4> objects;
 
@@ -74,10 +79,13 @@ public:
 	device_vector<uint4> attributes_map;
 	device_vector<float> attributes_float;
 	device_vector<float4> attributes_float3;
+	device_vector<uint> attributes_half2;
 
 	/* lights */
 	device_vector<float4> light_distribution;
 	device_vector<float4> light_data;
+	device_vector<float4> light_tree_nodes;
+	device_vector<uint4> light_tree_triangles;
 
 	/* shaders */
 	device_vector<uint4> svm_nodes;
@@ -103,7 +111,13 @@ public:
 	enum BVHType { BVH_DYNAMIC, BVH_STATIC } bvh_type;
 	bool use_bvh_cache;
 	bool use_bvh_spatial_split;
-	bool use_qbvh;
+	bool use_qbvh; /* only used if the device supports it */
+	bool use_texture_cache;
+	int texture_cache_size; /* in megabytes, 0 is unlimited */
+	bool use_shader_optimization;
+	bool shader_statistics; /* count svm nodes without optimization too */
+	bool use_compact_storage; /* octahedral normals and half float uvs */
+	bool persistent_data; /* scene is kept and updated for next animation frames */
 
 	SceneParams()
 	{
@@ -111,11 +125,13 @@ public:
 		bvh_type = BVH_DYNAMIC;
 		use_bvh_cache = false;
 		use_bvh_spatial_split = false;
-#ifdef __QBVH__
 		use_qbvh = true;
-#else
-		use_qbvh = false;
-#endif
+		use_texture_cache = false;
+		texture_cache_size = 1024;
+		use_shader_optimization = true;
+		shader_statistics = false;
+		use_compact_storage = false;
+		persistent_data = false;
 	}
 
 	bool modified(const SceneParams& params)
@@ -123,7 +139,13 @@ public:
 		&& bvh_type == params.bvh_type
 		&& use_bvh_cache == params.use_bvh_cache
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
-		&& use_qbvh == params.use_qbvh); }
+		&& use_qbvh == params.use_qbvh
+		&& use_texture_cache == params.use_texture_cache
+		&& texture_cache_size == params.texture_cache_size
+		&& use_shader_optimization == params.use_shader_optimization
+		&& shader_statistics == params.shader_statistics
+		&& use_compact_storage == params.use_compact_storage
+		&& persistent_data == params.persistent_data); }
 };
 
 /* Scene */
@@ -159,17 +181,29 @@ public:
 	Device *device;
 	DeviceScene dscene;
 
+	/* back buffer filled by device_prepare while the device may still be
+	   rendering from dscene, swapped in by the next device_update */
+	DeviceScene dscene_next;
+
 	/* parameters */
 	SceneParams params;
 
 	/* mutex must be locked manually by callers */
 	thread_mutex mutex;
 
+	/* time in seconds the last device update took, for statistics */
+	double update_time;
+
 	Scene(const SceneParams& params);
 	~Scene();
 
+	/* host side part of the device update, that can run while the device is
+	   still rendering. must be called with the mutex locked, device_update
+	   after it then only has to swap in the results */
+	void device_prepare(Device *device, Progress& progress);
 	void device_update(Device *device, Progress& progress);
 
+	bool need_prepare();
 	bool need_update();
 	bool need_reset();
 };
@@ -22,26 +22,43 @@
 #include "buffers.h"
 #include "camera.h"
 #include "device.h"
+#include "film.h"
+#include "integrator.h"
 #include "scene.h"
 #include "session.h"
 
 #include "util_foreach.h"
 #include "util_function.h"
+#include "util_set.h"
+#include "util_task.h"
 #include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* number of samples between adaptive sampling convergence checks */
+#define ADAPTIVE_CHECK_INTERVAL 8
+
 Session::Session(const SessionParams& params_)
 : params(params_),
-  tile_manager(params.progressive, params.samples, params.tile_size, params.min_size)
+  tile_manager(params.progressive,
+	/* rendering tiles to their full sample count is for final renders on the
+	   CPU, or distributed over multiple devices */
+	params.tile_full_samples && params.background &&
+		(params.device_type == DEVICE_CPU || params.device_type == DEVICE_MULTI),
+	params.samples, params.tile_size, params.min_size)
 {
 	device_use_gl = ((params.device_type != DEVICE_CPU) && !params.background);
 
-	device = Device::create(params.device_type, params.background, params.threads);
+	TaskScheduler::init(params.threads);
+
+	device = Device::create(params.device_type, params.background, params.threads, params.servers);
 	buffers = new RenderBuffers(device);
 	display = new DisplayBuffer(device);
 
+	device->perf_counters_enable(params.perf_counters);
+
 	session_thread = NULL;
+	kernels_loaded = false;
 	scene = NULL;
 
 	start_time = 0.0;
@@ -55,6 +72,9 @@ Session::Session(const SessionParams& params_)
 	delayed_reset.h = 0;
 	delayed_reset.samples = 0;
 
+	async_update.running = false;
+	async_update.done = false;
+
 	display_outdated = false;
 	gpu_draw_ready = false;
 	gpu_need_tonemap = false;
@@ -89,6 +109,8 @@ Session::~Session()
 	delete display;
 	delete scene;
 	delete device;
+
+	TaskScheduler::exit();
 }
 
 void Session::start()
@@ -236,6 +258,9 @@ void Session::run_gpu()
 			/* update status and timing */
 			update_status_time();
 
+			if(!progress.get_cancel())
+				update_adaptive_tiles();
+
 			gpu_need_tonemap = true;
 			gpu_draw_ready = true;
 			progress.set_update();
@@ -391,10 +416,15 @@ void Session::run_cpu()
 				delayed_reset.do_reset = false;
 				reset_(delayed_reset.w, delayed_reset.h, delayed_reset.samples);
 			}
-			else if(need_tonemap) {
-				/* tonemap only if we do not reset, we don't we don't
-				   want to show the result of an incomplete sample*/
-				tonemap();
+			else {
+				if(!no_tiles)
+					update_adaptive_tiles();
+
+				if(need_tonemap) {
+					/* tonemap only if we do not reset, we don't we don't
+					   want to show the result of an incomplete sample*/
+					tonemap();
+				}
 			}
 
 			if(device->error_message() != "")
@@ -407,22 +437,30 @@ void Session::run_cpu()
 
 void Session::run()
 {
-	/* load kernels */
-	progress.set_status("Loading render kernels (may take a few minutes the first time)");
+	/* load kernels, only once if the session is started again for the
+	   next frame of an animation with persistent data */
+	if(!kernels_loaded) {
+		progress.set_status("Loading render kernels (may take a few minutes the first time)");
 
-	if(!device->load_kernels(params.experimental)) {
-		string message = device->error_message();
-		if(message == "")
-			message = "Failed loading render kernel, see console for errors";
+		if(!device->load_kernels(params.experimental)) {
+			string message = device->error_message();
+			if(message == "")
+				message = "Failed loading render kernel, see console for errors";
 
-		progress.set_status("Error", message);
-		progress.set_update();
-		return;
+			progress.set_status("Error", message);
+			progress.set_update();
+			return;
+		}
+
+		kernels_loaded = true;
 	}
 
 	/* session thread loop */
 	progress.set_status("Waiting for render to start");
 
+	if(params.perf_counters)
+		device->perf_counters_reset();
+
 	/* run */
 	if(!progress.get_cancel()) {
 		if(device_use_gl)
@@ -431,6 +469,18 @@ void Session::run()
 			run_cpu();
 	}
 
+	/* wait for scene preparation still running in the background */
+	async_update.pool.wait_work();
+
+	/* merge performance counters of all render threads */
+	if(params.perf_counters) {
+		PerfCounters perf_counters;
+
+		device->task_wait();
+		device->perf_counters_get(perf_counters);
+		progress.set_perf_counters(perf_counters);
+	}
+
 	/* progress update */
 	if(progress.get_cancel())
 		progress.set_status("Cancel", progress.get_cancel_message());
@@ -448,9 +498,17 @@ bool Session::draw(int w, int h)
 
 void Session::reset_(int w, int h, int samples)
 {
-	if(w != buffers->width || h != buffers->height) {
+	BufferParams buffer_params;
+
+	buffer_params.width = w;
+	buffer_params.height = h;
+
+	if(scene)
+		scene->film->get_buffer_params(scene, buffer_params);
+
+	if(buffer_params.modified(buffers->params)) {
 		gpu_draw_ready = false;
-		buffers->reset(device, w, h);
+		buffers->reset(device, buffer_params);
 		display->reset(device, w, h);
 	}
 
@@ -510,9 +568,15 @@ void Session::wait()
 
 void Session::update_scene()
 {
-	thread_scoped_lock scene_lock(scene->mutex);
+	/* while the scene is being prepared, keep rendering the previous state */
+	{
+		thread_scoped_lock async_lock(async_update.mutex);
 
-	progress.set_status("Updating Scene");
+		if(async_update.running && !async_update.done)
+			return;
+	}
+
+	thread_scoped_lock scene_lock(scene->mutex);
 
 	/* update camera if dimensions changed for progressive render */
 	Camera *cam = scene->camera;
@@ -525,9 +589,97 @@ void Session::update_scene()
 		cam->tag_update();
 	}
 
+	if(!scene->need_update())
+		return;
+
+	/* start preparing the scene in the background, unless there is no previous
+	   state to render yet. the device update that swaps in the prepared data
+	   is done here once it is finished */
+	{
+		thread_scoped_lock async_lock(async_update.mutex);
+
+		if(async_update.running) {
+			async_update.running = false;
+		}
+		else if(params.async_scene_update && !device_use_gl && scene->device && scene->need_prepare()) {
+			async_update.running = true;
+			async_update.done = false;
+			async_update.pool.push(function_bind(&Session::prepare_scene, this));
+			return;
+		}
+	}
+
 	/* update scene */
-	if(scene->need_update())
-		scene->device_update(device, progress);
+	progress.set_status("Updating Scene");
+	scene->device_update(device, progress);
+}
+
+void Session::prepare_scene()
+{
+	{
+		thread_scoped_lock scene_lock(scene->mutex);
+		scene->device_prepare(device, progress);
+	}
+
+	/* restart rendering, which will do the device update first. the reset is
+	   requested before marking done, so samples rendered after the update
+	   are never accumulated with those of the previous state */
+	{
+		thread_scoped_lock reset_lock(delayed_reset.mutex);
+		delayed_reset.samples = params.samples;
+		delayed_reset.do_reset = true;
+	}
+
+	{
+		thread_scoped_lock async_lock(async_update.mutex);
+		async_update.done = true;
+	}
+
+	/* wake up the session thread if it was done rendering */
+	{
+		thread_scoped_lock pause_lock(pause_mutex);
+	}
+	pause_cond.notify_all();
+}
+
+void Session::update_adaptive_tiles()
+{
+	/* with adaptive sampling, remove tiles of which all pixels converged, once
+	   all tiles are removed the tile manager reports the render as done */
+	if(buffers->params.get_pass_offset(PASS_ADAPTIVE) == -1 || tile_manager.state.resolution != 1)
+		return;
+
+	/* reading back the buffer is costly on GPU devices, so only check every
+	   few samples, pixels can't converge before the minimum samples anyway */
+	int sample = tile_manager.state.sample + tile_manager.state.num_samples;
+
+	if(sample < scene->integrator->adaptive_min_samples || sample % ADAPTIVE_CHECK_INTERVAL != 0)
+		return;
+
+	/* only copy the rows of tiles that have not converged yet */
+	list<Tile>& tiles = tile_manager.state.tiles;
+	list<Tile>::iterator it;
+	set< pair<int, int> > rows;
+
+	for(it = tiles.begin(); it != tiles.end(); it++)
+		rows.insert(pair<int, int>(it->y, it->h));
+
+	set< pair<int, int> >::iterator row;
+
+	for(row = rows.begin(); row != rows.end(); row++)
+		buffers->copy_rows_from_device(row->first, row->second);
+
+	it = tiles.begin();
+
+	while(it != tiles.end()) {
+		if(buffers->adaptive_converged(it->x, it->y, it->w, it->h))
+			it = tiles.erase(it);
+		else
+			it++;
+	}
+
+	if(tiles.empty())
+		tile_manager.state.converged = true;
 }
 
 void Session::update_status_time(bool show_pause, bool show_done)
@@ -540,6 +692,8 @@ void Session::update_status_time(bool show_pause, bool show_done)
 
 	if(!params.progressive)
 		substatus = "Path Tracing";
+	else if(tile_manager.state.num_samples > 1)
+		substatus = string_printf("Path Tracing Tiles, %d Samples", params.samples);
 	else if(params.samples == INT_MAX)
 		substatus = string_printf("Path Tracing Sample %d", sample+1);
 	else
@@ -580,7 +734,10 @@ void Session::path_trace(Tile& tile)
 	task.buffer = buffers->buffer.device_pointer;
 	task.rng_state = buffers->rng_state.device_pointer;
 	task.sample = tile_manager.state.sample;
+	task.num_samples = tile_manager.state.num_samples;
 	task.resolution = tile_manager.state.resolution;
+	task.stride = tile_manager.state.width;
+	task.pass_stride = buffers->params.get_passes_size();
 
 	device->task_add(task);
 }
@@ -596,8 +753,10 @@ void Session::tonemap()
 	task.h = tile_manager.state.height;
 	task.rgba = display->rgba.device_pointer;
 	task.buffer = buffers->buffer.device_pointer;
-	task.sample = tile_manager.state.sample;
+	task.sample = tile_manager.state.sample + tile_manager.state.num_samples - 1;
 	task.resolution = tile_manager.state.resolution;
+	task.stride = tile_manager.state.width;
+	task.pass_stride = buffers->params.get_passes_size();
 
 	if(task.w > 0 && task.h > 0) {
 		device->task_add(task);
@@ -23,6 +23,7 @@
 #include "tile.h"
 
 #include "util_progress.h"
+#include "util_task.h"
 #include "util_thread.h"
 
 CCL_NAMESPACE_BEGIN
@@ -43,11 +44,15 @@ public:
 	string output_path;
 
 	bool progressive;
+	bool tile_full_samples;
 	bool experimental;
+	bool perf_counters;
+	bool async_scene_update;
 	int samples;
 	int tile_size;
 	int min_size;
 	int threads;
+	string servers;
 
 	double cancel_timeout;
 	double reset_timeout;
@@ -60,11 +65,15 @@ public:
 		output_path = "";
 
 		progressive = false;
+		tile_full_samples = false;
 		experimental = false;
+		perf_counters = false;
+		async_scene_update = false;
 		samples = INT_MAX;
 		tile_size = 64;
 		min_size = 64;
 		threads = 0;
+		servers = "";
 
 		cancel_timeout = 0.1;
 		reset_timeout = 0.1;
@@ -77,10 +86,14 @@ public:
 		&& output_path == params.output_path
 		/* && samples == params.samples */
 		&& progressive == params.progressive
+		&& tile_full_samples == params.tile_full_samples
 		&& experimental == params.experimental
+		&& perf_counters == params.perf_counters
+		&& async_scene_update == params.async_scene_update
 		&& tile_size == params.tile_size
 		&& min_size == params.min_size
 		&& threads == params.threads
+		&& servers == params.servers
 		&& cancel_timeout == params.cancel_timeout
 		&& reset_timeout == params.reset_timeout
 		&& text_timeout == params.text_timeout); }
@@ -122,9 +135,20 @@ protected:
 		int samples;
 	} delayed_reset;
 
+	/* scene changes prepared in a background task while rendering continues
+	   with the previous state, only for CPU rendering */
+	struct AsyncUpdate {
+		thread_mutex mutex;
+		bool running;
+		bool done;
+		TaskPool pool;
+	} async_update;
+
 	void run();
 
 	void update_scene();
+	void prepare_scene();
+	void update_adaptive_tiles();
 	void update_status_time(bool show_pause = false, bool show_done = false);
 
 	void tonemap();
@@ -143,6 +167,7 @@ protected:
 	bool device_use_gl;
 
 	thread *session_thread;
+	bool kernels_loaded;
 
 	volatile bool display_outdated;
 
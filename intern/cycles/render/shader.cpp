@@ -48,6 +48,9 @@ Shader::Shader()
 	has_volume = false;
 	has_displacement = false;
 
+	num_svm_nodes = -1;
+	num_svm_nodes_unoptimized = -1;
+
 	need_update = true;
 	need_update_attributes = true;
 }
@@ -71,6 +71,11 @@ public:
 	bool has_volume;
 	bool has_displacement;
 
+	/* number of svm nodes after compiling, and without graph optimizations
+	   if shader statistics are enabled, -1 otherwise */
+	int num_svm_nodes;
+	int num_svm_nodes_unoptimized;
+
 	/* requested mesh attributes */
 	AttributeRequestSet attributes;
 
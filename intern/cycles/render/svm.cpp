@@ -74,6 +74,8 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 			use_multi_closure);
 		compiler.sunsky = (sunsky_done)? NULL: &dscene->data.sunsky;
 		compiler.background = ((int)i == scene->default_background);
+		compiler.optimize = scene->params.use_shader_optimization;
+		compiler.statistics = scene->params.shader_statistics;
 		compiler.compile(shader, svm_nodes, i);
 		if(!compiler.sunsky)
 			sunsky_done = true;
@@ -111,6 +113,8 @@ SVMCompiler::SVMCompiler(ShaderManager *shader_manager_, ImageManager *image_man
 	current_type = SHADER_TYPE_SURFACE;
 	current_shader = NULL;
 	background = false;
+	optimize = true;
+	statistics = false;
 	mix_weight_offset = SVM_STACK_INVALID;
 	use_multi_closure = use_multi_closure_;
 }
@@ -641,12 +645,18 @@ void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int in
 		if(!shader->graph_bump)
 			shader->graph_bump = shader->graph->copy();
 
+	/* count nodes without optimizations, only possible before the graph is
+	   finalized, otherwise we keep the count from the previous compile */
+	if(statistics && !shader->graph->finalized)
+		shader->num_svm_nodes_unoptimized = count_unoptimized(shader);
+
 	/* finalize */
-	shader->graph->finalize(false, false);
+	shader->graph->finalize(false, false, optimize);
 	if(shader->graph_bump)
-		shader->graph_bump->finalize(true, false);
+		shader->graph_bump->finalize(true, false, optimize);
 
 	current_shader = shader;
+	size_t start_num_svm_nodes = global_svm_nodes.size();
 
 	shader->has_surface = false;
 	shader->has_surface_emission = false;
@@ -677,6 +687,44 @@ void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int in
 	global_svm_nodes[index*2 + 0].w = global_svm_nodes.size();
 	global_svm_nodes[index*2 + 1].w = global_svm_nodes.size();
 	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+
+	shader->num_svm_nodes = global_svm_nodes.size() - start_num_svm_nodes;
+	if(!optimize)
+		shader->num_svm_nodes_unoptimized = shader->num_svm_nodes;
+}
+
+int SVMCompiler::count_unoptimized(Shader *shader)
+{
+	/* compile copies of the graphs without optimizations, the output is
+	   discarded, only the number of nodes is of interest */
+	ShaderGraph *graph = shader->graph->copy();
+	ShaderGraph *graph_bump = (shader->graph_bump)? shader->graph_bump->copy(): NULL;
+	int num_nodes = 0;
+
+	graph->finalize(false, false, false);
+	if(graph_bump)
+		graph_bump->finalize(true, false, false);
+
+	current_shader = shader;
+
+	compile_type(shader, graph, SHADER_TYPE_SURFACE);
+	num_nodes += svm_nodes.size();
+
+	if(graph_bump) {
+		compile_type(shader, graph_bump, SHADER_TYPE_SURFACE);
+		num_nodes += svm_nodes.size();
+	}
+
+	compile_type(shader, graph, SHADER_TYPE_VOLUME);
+	num_nodes += svm_nodes.size();
+
+	compile_type(shader, graph, SHADER_TYPE_DISPLACEMENT);
+	num_nodes += svm_nodes.size();
+
+	delete graph;
+	delete graph_bump;
+
+	return num_nodes;
 }
 
 CCL_NAMESPACE_END
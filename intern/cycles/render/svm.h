@@ -75,6 +75,8 @@ public:
 	ShaderManager *shader_manager;
 	KernelSunSky *sunsky;
 	bool background;
+	bool optimize;
+	bool statistics;
 
 protected:
 	struct Stack {
@@ -126,6 +128,7 @@ protected:
 	void generate_multi_closure(ShaderNode *node, set<ShaderNode*>& done, uint in_offset);
 
 	void compile_type(Shader *shader, ShaderGraph *graph, ShaderType type);
+	int count_unoptimized(Shader *shader);
 
 	vector<int4> svm_nodes;
 	ShaderType current_type;
@@ -22,9 +22,10 @@
 
 CCL_NAMESPACE_BEGIN
 
-TileManager::TileManager(bool progressive_, int samples_, int tile_size_, int min_size_)
+TileManager::TileManager(bool progressive_, bool full_samples_, int samples_, int tile_size_, int min_size_)
 {
 	progressive = progressive_;
+	full_samples = full_samples_;
 	tile_size = tile_size_;
 	min_size = min_size_;
 
@@ -58,7 +59,9 @@ void TileManager::reset(int width_, int height_, int samples_)
 	state.width = 0;
 	state.height = 0;
 	state.sample = -1;
+	state.num_samples = 1;
 	state.resolution = start_resolution;
+	state.converged = false;
 	state.tiles.clear();
 }
 
@@ -96,7 +99,7 @@ void TileManager::set_tiles()
 
 bool TileManager::done()
 {
-	return (state.sample+1 >= samples && state.resolution == 1);
+	return (state.sample+state.num_samples >= samples && state.resolution == 1) || state.converged;
 }
 
 bool TileManager::next()
@@ -104,15 +107,27 @@ bool TileManager::next()
 	if(done())
 		return false;
 
-	if(progressive && state.resolution > 1) {
+	if(full_samples) {
+		/* render all samples at once, each tile to its full sample count */
+		state.sample = 0;
+		state.num_samples = samples;
+		state.resolution = 1;
+		set_tiles();
+	}
+	else if(progressive && state.resolution > 1) {
 		state.sample = 0;
 		state.resolution /= 2;
 		set_tiles();
 	}
 	else {
 		state.sample++;
-		state.resolution = 1;
-		set_tiles();
+
+		/* at full resolution the tiles stay the same, keep the list so
+		   tiles removed by adaptive sampling are not rendered again */
+		if(state.resolution != 1 || state.tiles.empty()) {
+			state.resolution = 1;
+			set_tiles();
+		}
 	}
 
 	return true;
@@ -43,11 +43,14 @@ public:
 		int width;
 		int height;
 		int sample;
+		int num_samples;
 		int resolution;
+		/* with adaptive sampling, tiles are removed once converged */
+		bool converged;
 		list<Tile> tiles;
 	} state;
 
-	TileManager(bool progressive, int samples, int tile_size, int min_size);
+	TileManager(bool progressive, bool full_samples, int samples, int tile_size, int min_size);
 	~TileManager();
 
 	void reset(int width, int height, int samples);
@@ -59,6 +62,7 @@ protected:
 	void set_tiles();
 
 	bool progressive;
+	bool full_samples;
 	int samples;
 	int tile_size;
 	int min_size;
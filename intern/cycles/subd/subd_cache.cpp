@@ -0,0 +1,171 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include "mesh.h"
+
+#include "subd_cache.h"
+
+#include "util_foreach.h"
+#include "util_set.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Diced Patch */
+
+void DicedPatch::copy_from(Mesh *mesh)
+{
+	Attribute *attr_vN = mesh->attributes.find(Attribute::STD_VERTEX_NORMAL);
+	float3 *vN = (attr_vN)? attr_vN->data_float3(): NULL;
+
+	verts = mesh->verts;
+	normals.resize(verts.size());
+
+	for(size_t i = 0; i < verts.size(); i++)
+		normals[i] = (vN)? vN[i]: make_float3(0.0f, 0.0f, 0.0f);
+
+	/* the dicer reserves triangles by resizing the array and then appends,
+	   skip the unused degenerate triangles that leaves behind */
+	triangles.clear();
+	triangles.reserve(mesh->triangles.size());
+
+	foreach(Mesh::Triangle& t, mesh->triangles) {
+		if(t.v[0] == t.v[1] && t.v[1] == t.v[2])
+			continue;
+
+		triangles.push_back(make_int3(t.v[0], t.v[1], t.v[2]));
+	}
+}
+
+/* Dice Cache */
+
+SubdDiceCache::SubdDiceCache()
+{
+	mesh = NULL;
+	generation = 0;
+}
+
+SubdDiceCache::~SubdDiceCache()
+{
+	clear();
+}
+
+void SubdDiceCache::begin(Mesh *mesh_)
+{
+	mesh = mesh_;
+	generation++;
+	keys.clear();
+}
+
+void SubdDiceCache::end()
+{
+	/* free patches that this mesh used before but not anymore */
+	vector<uint64_t>& old_keys = mesh_keys[mesh];
+
+	foreach(uint64_t key, old_keys) {
+		map<uint64_t, Entry>::iterator it = entries.find(key);
+
+		if(it != entries.end()) {
+			Entry& entry = it->second;
+
+			if(entry.mesh == mesh && entry.generation != generation) {
+				delete entry.diced;
+				entries.erase(it);
+			}
+		}
+	}
+
+	old_keys.swap(keys);
+	keys.clear();
+
+	mesh = NULL;
+}
+
+DicedPatch *SubdDiceCache::find(uint64_t key)
+{
+	thread_scoped_lock lock(mutex);
+	map<uint64_t, Entry>::iterator it = entries.find(key);
+
+	if(it == entries.end())
+		return NULL;
+
+	it->second.mesh = mesh;
+	it->second.generation = generation;
+	keys.push_back(key);
+
+	return it->second.diced;
+}
+
+DicedPatch *SubdDiceCache::insert(uint64_t key, DicedPatch *diced)
+{
+	thread_scoped_lock lock(mutex);
+	map<uint64_t, Entry>::iterator it = entries.find(key);
+
+	/* another thread may have diced an identical patch in the meantime */
+	if(it != entries.end()) {
+		delete diced;
+		diced = it->second.diced;
+	}
+
+	Entry& entry = entries[key];
+	entry.diced = diced;
+	entry.mesh = mesh;
+	entry.generation = generation;
+	keys.push_back(key);
+
+	return diced;
+}
+
+void SubdDiceCache::free_unused(const vector<Mesh*>& meshes)
+{
+	set<Mesh*> used(meshes.begin(), meshes.end());
+	map<Mesh*, vector<uint64_t> >::iterator mit = mesh_keys.begin();
+
+	while(mit != mesh_keys.end()) {
+		Mesh *old_mesh = mit->first;
+
+		if(used.find(old_mesh) == used.end()) {
+			foreach(uint64_t key, mit->second) {
+				map<uint64_t, Entry>::iterator it = entries.find(key);
+
+				if(it != entries.end() && it->second.mesh == old_mesh) {
+					delete it->second.diced;
+					entries.erase(it);
+				}
+			}
+
+			mesh_keys.erase(mit++);
+		}
+		else
+			mit++;
+	}
+}
+
+void SubdDiceCache::clear()
+{
+	map<uint64_t, Entry>::iterator it;
+
+	for(it = entries.begin(); it != entries.end(); it++)
+		delete it->second.diced;
+
+	entries.clear();
+	mesh_keys.clear();
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __SUBD_CACHE_H__
+#define __SUBD_CACHE_H__
+
+#include "util_map.h"
+#include "util_thread.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class Mesh;
+
+/* Diced Patch
+ *
+ * Vertices, normals and triangles created by splitting and dicing a single
+ * patch, with vertex indices local to the patch. */
+
+class DicedPatch {
+public:
+	vector<float3> verts;
+	vector<float3> normals;
+	vector<int3> triangles;
+
+	void copy_from(Mesh *mesh);
+};
+
+/* Dice Cache
+ *
+ * Keeps diced patches between tesselations, keyed by a hash of the patch
+ * control points and the dicing parameters, so that on a frame change only
+ * patches that actually changed are diced again. The cache is shared by all
+ * meshes, each patch remembers the mesh that last used it, so that patches
+ * no longer used by a mesh can be freed after it is tesselated again.
+ *
+ * find() and insert() may be called from multiple threads at once. */
+
+class SubdDiceCache {
+public:
+	SubdDiceCache();
+	~SubdDiceCache();
+
+	/* call around the tesselation of a mesh */
+	void begin(Mesh *mesh);
+	void end();
+
+	DicedPatch *find(uint64_t key);
+	DicedPatch *insert(uint64_t key, DicedPatch *diced);
+
+	/* free patches of meshes that are not in the scene anymore */
+	void free_unused(const vector<Mesh*>& meshes);
+	void clear();
+
+protected:
+	struct Entry {
+		DicedPatch *diced;
+		Mesh *mesh;
+		uint generation;
+	};
+
+	thread_mutex mutex;
+	map<uint64_t, Entry> entries;
+	Mesh *mesh;
+	uint generation;
+
+	/* keys used by each mesh in its last tesselation, and by the mesh
+	   being tesselated, so end() doesn't have to go over all entries */
+	map<Mesh*, vector<uint64_t> > mesh_keys;
+	vector<uint64_t> keys;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __SUBD_CACHE_H__ */
+
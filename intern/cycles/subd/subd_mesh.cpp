@@ -28,7 +28,10 @@
 
 #include <stdio.h>
 
+#include "mesh.h"
+
 #include "subd_build.h"
+#include "subd_cache.h"
 #include "subd_edge.h"
 #include "subd_face.h"
 #include "subd_mesh.h"
@@ -38,6 +41,7 @@
 
 #include "util_debug.h"
 #include "util_foreach.h"
+#include "util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -285,25 +289,109 @@ void SubdMesh::link_boundary_edge(SubdEdge *edge)
 		edge->vert->edge = edge;
 }
 
-void SubdMesh::tesselate(DiagSplit *split, bool linear, Mesh *mesh, int shader, bool smooth)
+void SubdMesh::dice_faces(DiagSplit *split, bool linear, SubdDiceCache *cache,
+	vector<DicedPatch*> *diced, int start, int end)
 {
+	/* split state is modified while splitting, and the builder is not
+	   thread safe either, so each task gets its own */
+	DiagSplit local_split = *split;
 	SubdBuilder *builder = SubdBuilder::create(linear);
-	int num_faces = faces.size();
-		        
-	for(int f = 0; f < num_faces; f++) {
+	Mesh local_mesh;
+
+	for(int f = start; f < end; f++) {
 		SubdFace *face = faces[f];
 		Patch *patch = builder->run(face);
+		uint64_t key = 0;
+
+		if(cache) {
+			key = local_split.hash(patch);
+			(*diced)[f] = cache->find(key);
+
+			if((*diced)[f]) {
+				delete patch;
+				continue;
+			}
+		}
+
+		/* dice into a mesh of our own, shader and smooth are filled in when
+		   merging so don't matter here */
+		local_mesh.clear();
 
 		if(patch->is_triangle())
-			split->split_triangle(mesh, patch, shader, smooth);
+			local_split.split_triangle(&local_mesh, patch, 0, true);
 		else
-			split->split_quad(mesh, patch, shader, smooth);
+			local_split.split_quad(&local_mesh, patch, 0, true);
 
 		delete patch;
+
+		DicedPatch *patch_diced = new DicedPatch();
+		patch_diced->copy_from(&local_mesh);
+
+		(*diced)[f] = (cache)? cache->insert(key, patch_diced): patch_diced;
 	}
 
 	delete builder;
 }
 
+void SubdMesh::tesselate(DiagSplit *split, bool linear, Mesh *mesh, int shader, bool smooth, SubdDiceCache *cache)
+{
+	int num_faces = faces.size();
+	vector<DicedPatch*> diced(num_faces, NULL);
+
+	/* split and dice patches in parallel, in batches to amortize the task
+	   overhead, every face writes only to its own slot in the array */
+	TaskPool pool;
+	const int batch_size = 32;
+
+	for(int start = 0; start < num_faces; start += batch_size) {
+		int end = min(start + batch_size, num_faces);
+		pool.push(function_bind(&SubdMesh::dice_faces, this, split, linear, cache, &diced, start, end));
+	}
+
+	pool.wait_work();
+
+	/* merge in face order, so the result is the same regardless of which
+	   thread diced which patch */
+	size_t num_verts = mesh->verts.size();
+	size_t num_tris = mesh->triangles.size();
+	size_t vert_begin = num_verts;
+	size_t vert_offset = num_verts;
+
+	foreach(DicedPatch *patch_diced, diced) {
+		num_verts += patch_diced->verts.size();
+		num_tris += patch_diced->triangles.size();
+	}
+
+	mesh->verts.reserve(num_verts);
+	mesh->triangles.reserve(num_tris);
+	mesh->shader.reserve(num_tris);
+	mesh->smooth.reserve(num_tris);
+
+	foreach(DicedPatch *patch_diced, diced) {
+		mesh->verts.insert(mesh->verts.end(), patch_diced->verts.begin(), patch_diced->verts.end());
+
+		foreach(int3& t, patch_diced->triangles)
+			mesh->add_triangle(vert_offset + t.x, vert_offset + t.y, vert_offset + t.z, shader, smooth);
+
+		vert_offset += patch_diced->verts.size();
+	}
+
+	/* resize attributes and fill in vertex normals */
+	mesh->attributes.reserve(mesh->verts.size(), mesh->triangles.size());
+
+	Attribute *attr_vN = mesh->attributes.add(Attribute::STD_VERTEX_NORMAL);
+	float3 *vN = attr_vN->data_float3() + vert_begin;
+
+	foreach(DicedPatch *patch_diced, diced) {
+		if(patch_diced->normals.size())
+			memcpy(vN, &patch_diced->normals[0], sizeof(float3)*patch_diced->normals.size());
+		vN += patch_diced->normals.size();
+	}
+
+	if(!cache)
+		foreach(DicedPatch *patch_diced, diced)
+			delete patch_diced;
+}
+
 CCL_NAMESPACE_END
 
@@ -40,7 +40,9 @@ class SubdVert;
 class SubdEdge;
 
 class DiagSplit;
+class DicedPatch;
 class Mesh;
+class SubdDiceCache;
 
 /* Subd Mesh, half edge based for dynamic mesh manipulation */
 
@@ -62,7 +64,7 @@ public:
 
 	bool link_boundary();
 	void tesselate(DiagSplit *split, bool linear,
-		Mesh *mesh, int shader, bool smooth);
+		Mesh *mesh, int shader, bool smooth, SubdDiceCache *cache = NULL);
 
 protected:
 	bool can_add_face(int *index, int num);
@@ -70,6 +72,8 @@ protected:
 	SubdEdge *add_edge(int i, int j);
 	SubdEdge *find_edge(int i, int j);
 	void link_boundary_edge(SubdEdge *edge);
+	void dice_faces(DiagSplit *split, bool linear, SubdDiceCache *cache,
+		vector<DicedPatch*> *diced, int start, int end);
 	
 	struct Key {
 		Key() {}
@@ -22,6 +22,7 @@
 
 #include "subd_patch.h"
 
+#include "util_hash.h"
 #include "util_math.h"
 #include "util_types.h"
 
@@ -101,6 +102,14 @@ BoundBox LinearQuadPatch::bound()
 	return bbox;
 }
 
+uint64_t LinearQuadPatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 1);
+	h = hash_fnv_float3(h, hull, 4);
+
+	return h;
+}
+
 /* Linear Triangle Patch */
 
 void LinearTrianglePatch::eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v)
@@ -123,6 +132,14 @@ BoundBox LinearTrianglePatch::bound()
 	return bbox;
 }
 
+uint64_t LinearTrianglePatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 2);
+	h = hash_fnv_float3(h, hull, 3);
+
+	return h;
+}
+
 /* Bicubic Patch */
 
 void BicubicPatch::eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v)
@@ -140,6 +157,14 @@ BoundBox BicubicPatch::bound()
 	return bbox;
 }
 
+uint64_t BicubicPatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 3);
+	h = hash_fnv_float3(h, hull, 16);
+
+	return h;
+}
+
 /* Bicubic Patch with Tangent Fields */
 
 void BicubicTangentPatch::eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v)
@@ -160,6 +185,16 @@ BoundBox BicubicTangentPatch::bound()
 	return bbox;
 }
 
+uint64_t BicubicTangentPatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 4);
+	h = hash_fnv_float3(h, hull, 16);
+	h = hash_fnv_float3(h, utan, 12);
+	h = hash_fnv_float3(h, vtan, 12);
+
+	return h;
+}
+
 /* Gregory Patch */
 
 static float no_zero_div(float f)
@@ -213,6 +248,14 @@ BoundBox GregoryQuadPatch::bound()
 	return bbox;
 }
 
+uint64_t GregoryQuadPatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 5);
+	h = hash_fnv_float3(h, hull, 20);
+
+	return h;
+}
+
 void GregoryTrianglePatch::eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v)
 {
 	/*		      6
@@ -284,5 +327,13 @@ BoundBox GregoryTrianglePatch::bound()
 	return bbox;
 }
 
+uint64_t GregoryTrianglePatch::hash()
+{
+	uint64_t h = hash_fnv_uint(HASH_FNV_SEED, 6);
+	h = hash_fnv_float3(h, hull, 20);
+
+	return h;
+}
+
 CCL_NAMESPACE_END
 
@@ -34,6 +34,8 @@ public:
 	virtual void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v) = 0;
 	virtual bool is_triangle() = 0;
 	virtual BoundBox bound() = 0;
+	/* hash of the control points, patches with equal hash dice the same */
+	virtual uint64_t hash() = 0;
 };
 
 /* Linear Quad Patch */
@@ -45,6 +47,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return false; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 /* Linear Triangle Patch */
@@ -56,6 +59,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return true; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 /* Bicubic Patch */
@@ -67,6 +71,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return false; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 /* Bicubic Patch with Tangent Fields */
@@ -80,6 +85,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return false; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 /* Gregory Patches */
@@ -91,6 +97,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return false; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 class GregoryTrianglePatch : public Patch  {
@@ -100,6 +107,7 @@ public:
 	void eval(float3 *P, float3 *dPdu, float3 *dPdv, float u, float v);
 	bool is_triangle() { return true; }
 	BoundBox bound();
+	uint64_t hash();
 };
 
 CCL_NAMESPACE_END
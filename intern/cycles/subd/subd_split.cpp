@@ -24,6 +24,7 @@
 #include "subd_split.h"
 
 #include "util_debug.h"
+#include "util_hash.h"
 #include "util_math.h"
 #include "util_types.h"
 
@@ -321,5 +322,28 @@ void DiagSplit::split_quad(Mesh *mesh, Patch *patch, int shader, bool smooth)
 	edgefactors_quad.clear();
 }
 
+uint64_t DiagSplit::hash(Patch *patch)
+{
+	uint64_t h = patch->hash();
+
+	h = hash_fnv_uint(h, test_steps);
+	h = hash_fnv_uint(h, split_threshold);
+	h = hash_fnv_float(h, dicing_rate);
+
+	/* dicing rate in raster space depends on the camera */
+	if(camera) {
+		for(int i = 0; i < 4; i++) {
+			float4 row = camera->worldtoraster[i];
+
+			h = hash_fnv_float(h, row.x);
+			h = hash_fnv_float(h, row.y);
+			h = hash_fnv_float(h, row.z);
+			h = hash_fnv_float(h, row.w);
+		}
+	}
+
+	return h;
+}
+
 CCL_NAMESPACE_END
 
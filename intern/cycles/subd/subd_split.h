@@ -63,6 +63,9 @@ public:
 
 	void split_triangle(Mesh *mesh, Patch *patch, int shader, bool smooth);
 	void split_quad(Mesh *mesh, Patch *patch, int shader, bool smooth);
+
+	/* key for caching the diced patch, from patch and dicing parameters */
+	uint64_t hash(Patch *patch);
 };
 
 CCL_NAMESPACE_END
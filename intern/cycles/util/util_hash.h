@@ -19,6 +19,8 @@
 #ifndef __UTIL_HASH_H__
 #define __UTIL_HASH_H__
 
+#include "util_types.h"
+
 CCL_NAMESPACE_BEGIN
 
 static inline unsigned int hash_int_2d(unsigned int kx, unsigned int ky)
@@ -49,6 +51,46 @@ static inline unsigned int hash_int(unsigned int k)
 	return hash_int_2d(k, 0);
 }
 
+#ifndef __KERNEL_GPU__
+
+/* 64 bit FNV-1a hash, for identifying larger blocks of data by content where
+   collisions must practically never happen, e.g. cached geometry */
+
+#define HASH_FNV_SEED 14695981039346656037ULL
+
+static inline uint64_t hash_fnv_uint(uint64_t h, unsigned int k)
+{
+	for(int i = 0; i < 4; i++) {
+		h ^= (k >> (i*8)) & 0xff;
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+static inline uint64_t hash_fnv_float(uint64_t h, float f)
+{
+	union { float f; unsigned int i; } u;
+	u.f = f;
+
+	return hash_fnv_uint(h, u.i);
+}
+
+static inline uint64_t hash_fnv_float3(uint64_t h, const float3 *p, int num)
+{
+	/* hash components separately, float3 may contain uninitialized padding */
+	for(int i = 0; i < num; i++) {
+		h = hash_fnv_float(h, p[i].x);
+		h = hash_fnv_float(h, p[i].y);
+		h = hash_fnv_float(h, p[i].z);
+	}
+
+	return h;
+}
+
+#endif
+
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_HASH_H__ */
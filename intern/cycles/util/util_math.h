@@ -794,6 +794,129 @@ __device_inline void make_orthonormals(const float3 N, float3 *a, float3 *b)
 	*b = cross(N, *a);
 }
 
+/* Compact Storage
+ *
+ * Unit vectors are stored octahedral encoded as two 16 bit components in an
+ * uint, and float pairs as two half floats in an uint. Encoding is only done
+ * on the host, decoding in the kernel. */
+
+#ifndef __KERNEL_GPU__
+
+__device_inline uint octahedral_encode(float3 N)
+{
+	float l1 = fabsf(N.x) + fabsf(N.y) + fabsf(N.z);
+
+	/* degenerate normal */
+	if(l1 == 0.0f) {
+		N = make_float3(0.0f, 0.0f, 1.0f);
+		l1 = 1.0f;
+	}
+
+	float x = N.x/l1;
+	float y = N.y/l1;
+
+	/* fold lower hemisphere over the diagonals */
+	if(N.z < 0.0f) {
+		float tx = (1.0f - fabsf(y))*((x >= 0.0f)? 1.0f: -1.0f);
+		float ty = (1.0f - fabsf(x))*((y >= 0.0f)? 1.0f: -1.0f);
+		x = tx;
+		y = ty;
+	}
+
+	uint ux = (uint)(clamp(x*0.5f + 0.5f, 0.0f, 1.0f)*65535.0f + 0.5f);
+	uint uy = (uint)(clamp(y*0.5f + 0.5f, 0.0f, 1.0f)*65535.0f + 0.5f);
+
+	return ux | (uy << 16);
+}
+
+__device_inline uint float_to_half(float f)
+{
+	uint x = __float_as_uint(f);
+	uint sign = (x >> 16) & 0x8000;
+	uint float_exponent = (x >> 23) & 0xFF;
+	uint mantissa = x & 0x7FFFFF;
+	int exponent = (int)float_exponent - 127 + 15;
+
+	/* inf and nan */
+	if(float_exponent == 0xFF)
+		return sign | 0x7C00 | ((mantissa)? 0x200: 0);
+
+	/* overflow to inf */
+	if(exponent >= 31)
+		return sign | 0x7C00;
+
+	/* denormal or zero */
+	if(exponent <= 0) {
+		if(exponent < -10)
+			return sign;
+
+		mantissa |= 0x800000;
+
+		int shift = 14 - exponent;
+		uint h = mantissa >> shift;
+
+		if((mantissa >> (shift - 1)) & 1)
+			h++;
+
+		return sign | h;
+	}
+
+	/* round to nearest, a carry into the exponent gives the right result */
+	uint h = sign | ((uint)exponent << 10) | (mantissa >> 13);
+
+	if(mantissa & 0x1000)
+		h++;
+
+	return h;
+}
+
+__device_inline uint float2_to_half2(float x, float y)
+{
+	return float_to_half(x) | (float_to_half(y) << 16);
+}
+
+#endif
+
+__device_inline float3 octahedral_decode(uint n)
+{
+	float x = (float)(n & 0xFFFF)*(2.0f/65535.0f) - 1.0f;
+	float y = (float)(n >> 16)*(2.0f/65535.0f) - 1.0f;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	if(z < 0.0f) {
+		float tx = (1.0f - fabsf(y))*((x >= 0.0f)? 1.0f: -1.0f);
+		float ty = (1.0f - fabsf(x))*((y >= 0.0f)? 1.0f: -1.0f);
+		x = tx;
+		y = ty;
+	}
+
+	return normalize(make_float3(x, y, z));
+}
+
+__device_inline float half_to_float(uint h)
+{
+	uint sign = (h & 0x8000) << 16;
+	uint exponent = (h >> 10) & 0x1F;
+	uint mantissa = h & 0x3FF;
+
+	/* zero and denormals */
+	if(exponent == 0) {
+		float f = (float)mantissa*(1.0f/16777216.0f);
+		return (sign)? -f: f;
+	}
+
+	/* inf and nan */
+	if(exponent == 31)
+		return __uint_as_float(sign | 0x7F800000 | (mantissa << 13));
+
+	return __uint_as_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+__device_inline float3 half2_to_float3(uint h2)
+{
+	return make_float3(half_to_float(h2 & 0xFFFF), half_to_float(h2 >> 16), 0.0f);
+}
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_MATH_H__ */
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef __UTIL_PERF_COUNTERS_H__
+#define __UTIL_PERF_COUNTERS_H__
+
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Performance Counters
+ *
+ * Statistics gathered by the kernel while rendering, to find out which shaders
+ * make a render slow. Each render thread increments its own counters, so no
+ * locking is needed, the device merges them on request. Shaders are indexed
+ * by the shader index in the scene. */
+
+class PerfCounters {
+public:
+	uint64_t rays;
+	uint64_t bvh_nodes;
+	uint64_t triangle_tests;
+
+	vector<uint64_t> shader_evals;
+	vector<uint64_t> shader_svm_nodes;
+
+	PerfCounters()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		rays = 0;
+		bvh_nodes = 0;
+		triangle_tests = 0;
+
+		shader_evals.clear();
+		shader_svm_nodes.clear();
+	}
+
+	void add(const PerfCounters& other)
+	{
+		rays += other.rays;
+		bvh_nodes += other.bvh_nodes;
+		triangle_tests += other.triangle_tests;
+
+		resize_shaders(other.shader_evals.size());
+
+		for(size_t i = 0; i < other.shader_evals.size(); i++) {
+			shader_evals[i] += other.shader_evals[i];
+			shader_svm_nodes[i] += other.shader_svm_nodes[i];
+		}
+	}
+
+	void add_shader(int shader, uint64_t svm_nodes)
+	{
+		if(shader >= (int)shader_evals.size())
+			resize_shaders(shader + 1);
+
+		shader_evals[shader]++;
+		shader_svm_nodes[shader] += svm_nodes;
+	}
+
+protected:
+	void resize_shaders(size_t num)
+	{
+		if(num > shader_evals.size()) {
+			shader_evals.resize(num, 0);
+			shader_svm_nodes.resize(num, 0);
+		}
+	}
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_PERF_COUNTERS_H__ */
+
@@ -26,6 +26,7 @@
  * except for the constructor/destructor are thread safe. */
 
 #include "util_function.h"
+#include "util_perf_counters.h"
 #include "util_string.h"
 #include "util_thread.h"
 
@@ -138,6 +139,21 @@ public:
 		substatus_ = substatus;
 	}
 
+	/* kernel performance counters, merged from all devices at the end of
+	   the render, empty if they were not enabled */
+
+	void set_perf_counters(const PerfCounters& perf_counters_)
+	{
+		thread_scoped_lock lock(progress_mutex);
+		perf_counters = perf_counters_;
+	}
+
+	void get_perf_counters(PerfCounters& perf_counters_)
+	{
+		thread_scoped_lock lock(progress_mutex);
+		perf_counters_ = perf_counters;
+	}
+
 	/* callback */
 
 	void set_update()
@@ -164,6 +180,8 @@ protected:
 	string status;
 	string substatus;
 
+	PerfCounters perf_counters;
+
 	volatile bool cancel;
 	string cancel_message;
 };
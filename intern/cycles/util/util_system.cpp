@@ -24,10 +24,16 @@
 #include <intrin.h>
 #endif
 #include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
 #elif defined(__APPLE__)
+#include <sys/resource.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
 #else
+#include <sys/resource.h>
 #include <unistd.h>
 #endif
 
@@ -191,5 +197,29 @@ bool system_cpu_support_optimized()
 
 #endif
 
+size_t system_memory_peak()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+#ifdef __APPLE__
+	/* reported in bytes on Mac OS X, kilobytes elsewhere */
+	return usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss*1024;
+#endif
+#endif
+}
+
 CCL_NAMESPACE_END
 
@@ -28,6 +28,9 @@ string system_cpu_brand_string();
 int system_cpu_bits();
 bool system_cpu_support_optimized();
 
+/* peak resident memory of the process in bytes, 0 if unknown */
+size_t system_memory_peak();
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_SYSTEM_H__ */
@@ -0,0 +1,611 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "util_debug.h"
+#include "util_image.h"
+#include "util_math.h"
+#include "util_texture_cache.h"
+
+CCL_NAMESPACE_BEGIN
+
+TextureCache::TextureCache(size_t max_mem_, int tile_size_)
+{
+	max_mem = max_mem_;
+	tile_size = tile_size_;
+	hand_slot = 0;
+	hand_level = 0;
+	hand_index = 0;
+	mem_used = 0;
+	mem_peak = 0;
+	evictions = 0;
+}
+
+TextureCache::~TextureCache()
+{
+	for(size_t slot = 0; slot < images.size(); slot++)
+		remove_image(slot);
+}
+
+/* Images */
+
+bool TextureCache::set_image(int slot, const string& filename)
+{
+	remove_image(slot);
+
+	if(slot >= (int)images.size())
+		images.resize(slot+1, NULL);
+
+	Image *img = new Image();
+	img->filename = filename;
+	img->input = NULL;
+	img->tiled = false;
+	img->file_levels = 0;
+	img->tile_size = tile_size;
+	img->components = 0;
+	img->band_y = -1;
+	img->hits = 0;
+	img->misses = 0;
+
+	images[slot] = img;
+
+	/* on failure the image stays without levels and looks up as black */
+	return image_open(img);
+}
+
+void TextureCache::remove_image(int slot)
+{
+	if(slot >= (int)images.size() || !images[slot])
+		return;
+
+	Image *img = images[slot];
+
+	{
+		thread_unique_lock lock(img->mutex);
+
+		for(size_t level = 0; level < img->levels.size(); level++) {
+			Level& lvl = img->levels[level];
+
+			for(size_t i = 0; i < lvl.tiles.size(); i++) {
+				Tile *tile = &lvl.tiles[i];
+
+				tile_free(tile->data, tile->w, tile->h);
+				tile->data = NULL;
+			}
+		}
+
+		if(img->band.size())
+			mem_sub(img->band.size());
+
+		image_close(img);
+	}
+
+	images[slot] = NULL;
+	delete img;
+}
+
+bool TextureCache::image_open(Image *img)
+{
+	if(img->filename == "")
+		return false;
+
+	ImageInput *in = ImageInput::create(img->filename);
+
+	if(!in)
+		return false;
+
+	ImageSpec spec;
+
+	if(!in->open(img->filename, spec)) {
+		delete in;
+		return false;
+	}
+
+	/* we only handle certain number of components */
+	if(!(spec.nchannels == 1 || spec.nchannels == 3 || spec.nchannels == 4)) {
+		in->close();
+		delete in;
+		return false;
+	}
+
+	img->input = in;
+	img->components = spec.nchannels;
+
+	/* square tiled files are read tile by tile, using the tile size of the
+	   file, along with any mip levels stored in the file */
+	if(spec.tile_width > 0 && spec.tile_width == spec.tile_height && spec.tile_depth <= 1) {
+		ImageSpec level_spec;
+
+		img->tiled = true;
+		img->tile_size = spec.tile_width;
+
+		while(in->seek_subimage(0, img->file_levels, level_spec)) {
+			Level level;
+			level.width = level_spec.width;
+			level.height = level_spec.height;
+			img->levels.push_back(level);
+			img->file_levels++;
+		}
+
+		in->seek_subimage(0, 0, level_spec);
+	}
+
+	if(img->levels.empty()) {
+		Level level;
+		level.width = spec.width;
+		level.height = spec.height;
+		img->levels.push_back(level);
+	}
+
+	/* remaining mip levels down to a single pixel */
+	while(img->levels.back().width > 1 || img->levels.back().height > 1) {
+		Level level;
+		level.width = max(img->levels.back().width/2, 1);
+		level.height = max(img->levels.back().height/2, 1);
+		img->levels.push_back(level);
+	}
+
+	/* tile tables, the pixels themselves are loaded on demand */
+	for(size_t i = 0; i < img->levels.size(); i++) {
+		Level& level = img->levels[i];
+		Tile tile = {NULL, 0, 0, 0};
+
+		level.tiles_x = (level.width + img->tile_size - 1)/img->tile_size;
+		level.tiles_y = (level.height + img->tile_size - 1)/img->tile_size;
+		level.tiles.resize(level.tiles_x*level.tiles_y, tile);
+
+		for(int ty = 0; ty < level.tiles_y; ty++) {
+			for(int tx = 0; tx < level.tiles_x; tx++) {
+				Tile& t = level.tiles[tx + ty*level.tiles_x];
+				t.w = min(img->tile_size, level.width - tx*img->tile_size);
+				t.h = min(img->tile_size, level.height - ty*img->tile_size);
+			}
+		}
+	}
+
+	return true;
+}
+
+void TextureCache::image_close(Image *img)
+{
+	ImageInput *in = (ImageInput*)img->input;
+
+	if(in) {
+		in->close();
+		delete in;
+		img->input = NULL;
+	}
+}
+
+/* Tiles */
+
+uchar4 *TextureCache::tile_alloc(int w, int h)
+{
+	mem_add(w*h*sizeof(uchar4));
+
+	return new uchar4[w*h];
+}
+
+void TextureCache::tile_free(uchar4 *data, int w, int h)
+{
+	if(data) {
+		delete [] data;
+
+		mem_sub(w*h*sizeof(uchar4));
+	}
+}
+
+static void tile_convert_pixels(uchar4 *out, const uchar *in, int num, int components)
+{
+	for(int i = 0; i < num; i++, in += components) {
+		if(components == 4)
+			out[i] = make_uchar4(in[0], in[1], in[2], in[3]);
+		else if(components == 3)
+			out[i] = make_uchar4(in[0], in[1], in[2], 255);
+		else
+			out[i] = make_uchar4(in[0], in[0], in[0], 255);
+	}
+}
+
+uchar4 *TextureCache::tile_read(Image *img, int level, int tx, int ty)
+{
+	ImageInput *in = (ImageInput*)img->input;
+	Level& lvl = img->levels[level];
+	Tile *tile = &lvl.tiles[tx + ty*lvl.tiles_x];
+
+	int w = tile->w;
+	int h = tile->h;
+	int size = img->tile_size;
+	int components = img->components;
+
+	/* tiles at the border are stored in full size in the file */
+	vector<uchar> pixels(size*size*components);
+	ImageSpec spec;
+	bool success;
+
+	{
+		thread_scoped_lock lock(img->io_mutex);
+
+		success = in->seek_subimage(0, level, spec) &&
+			in->read_tile(tx*size, ty*size, 0, TypeDesc::UINT8, &pixels[0]);
+	}
+
+	uchar4 *data = tile_alloc(w, h);
+
+	if(success) {
+		for(int j = 0; j < h; j++)
+			tile_convert_pixels(data + j*w, &pixels[j*size*components], w, components);
+	}
+	else
+		memset(data, 0, sizeof(uchar4)*w*h);
+
+	return data;
+}
+
+uchar4 *TextureCache::tile_read_band(Image *img, int tx, int ty)
+{
+	/* scanline files can't read parts of a scanline, so we read a band of
+	   scanlines and keep it, neighbouring tiles in the same band are then
+	   converted without reading the file again */
+	ImageInput *in = (ImageInput*)img->input;
+	Level& lvl = img->levels[0];
+	Tile *tile = &lvl.tiles[tx + ty*lvl.tiles_x];
+	int components = img->components;
+	int stride = lvl.width*components;
+	int w = tile->w;
+	int h = tile->h;
+
+	uchar4 *data = tile_alloc(w, h);
+
+	thread_scoped_lock lock(img->io_mutex);
+
+	if(img->band_y != ty) {
+		int y = ty*img->tile_size;
+		bool success = true;
+
+		if(img->band.empty()) {
+			img->band.resize(stride*img->tile_size);
+			mem_add(img->band.size());
+		}
+
+		for(int j = 0; j < h && success; j++)
+			success = in->read_scanline(y + j, 0, TypeDesc::UINT8, &img->band[j*stride]);
+
+		if(!success) {
+			img->band_y = -1;
+			memset(data, 0, sizeof(uchar4)*w*h);
+			return data;
+		}
+
+		img->band_y = ty;
+	}
+
+	for(int j = 0; j < h; j++)
+		tile_convert_pixels(data + j*w, &img->band[j*stride + tx*img->tile_size*components], w, components);
+
+	return data;
+}
+
+uchar4 *TextureCache::tile_downsample(Image *img, int level, int tx, int ty)
+{
+	/* box filter 2x2 pixels from the level above */
+	Level& lvl = img->levels[level];
+	Level& parent = img->levels[level-1];
+	Tile *tile = &lvl.tiles[tx + ty*lvl.tiles_x];
+
+	int x = tx*img->tile_size;
+	int y = ty*img->tile_size;
+	int w = tile->w;
+	int h = tile->h;
+
+	uchar4 *data = tile_alloc(w, h);
+
+	for(int j = 0; j < h; j++) {
+		int py = min((y + j)*2, parent.height - 1);
+		int npy = min(py + 1, parent.height - 1);
+
+		for(int i = 0; i < w; i++) {
+			int px = min((x + i)*2, parent.width - 1);
+			int npx = min(px + 1, parent.width - 1);
+
+			uchar4 a = texel_get(img, level-1, px, py);
+			uchar4 b = texel_get(img, level-1, npx, py);
+			uchar4 c = texel_get(img, level-1, px, npy);
+			uchar4 d = texel_get(img, level-1, npx, npy);
+
+			data[i + j*w] = make_uchar4(
+				(a.x + b.x + c.x + d.x + 2)/4,
+				(a.y + b.y + c.y + d.y + 2)/4,
+				(a.z + b.z + c.z + d.z + 2)/4,
+				(a.w + b.w + c.w + d.w + 2)/4);
+		}
+	}
+
+	return data;
+}
+
+uchar4 *TextureCache::tile_get(Image *img, int level, int tx, int ty, int *misses)
+{
+	Level& lvl = img->levels[level];
+	Tile *tile = &lvl.tiles[tx + ty*lvl.tiles_x];
+	uchar4 *data = tile->data;
+
+	if(!data) {
+		/* statistics only count tiles accessed by lookups, not the tiles
+		   used to compute lower mip levels */
+		if(misses)
+			(*misses)++;
+
+		if(img->tiled && level < img->file_levels)
+			data = tile_read(img, level, tx, ty);
+		else if(level == 0)
+			data = tile_read_band(img, tx, ty);
+		else
+			data = tile_downsample(img, level, tx, ty);
+
+		/* another thread may have loaded the same tile in the meantime, in
+		   that case we keep theirs */
+		uchar4 *prev = (uchar4*)atomic_cas_ptr((void * volatile *)&tile->data, NULL, data);
+
+		if(prev) {
+			tile_free(data, tile->w, tile->h);
+			data = prev;
+		}
+	}
+
+	/* avoid writing to shared memory on every hit */
+	if(!tile->referenced)
+		tile->referenced = 1;
+
+	return data;
+}
+
+uchar4 TextureCache::texel_get(Image *img, int level, int x, int y, int *misses)
+{
+	Level& lvl = img->levels[level];
+	int tx = x/img->tile_size;
+	int ty = y/img->tile_size;
+	int w = lvl.tiles[tx + ty*lvl.tiles_x].w;
+	uchar4 *data = tile_get(img, level, tx, ty, misses);
+
+	return data[(x - tx*img->tile_size) + (y - ty*img->tile_size)*w];
+}
+
+/* Lookup */
+
+static int texture_wrap_periodic(int x, int width)
+{
+	x %= width;
+	if(x < 0)
+		x += width;
+	return x;
+}
+
+static int texture_wrap_clamp(int x, int width)
+{
+	return clamp(x, 0, width-1);
+}
+
+static float texture_frac(float x, int *ix)
+{
+	int i = (int)x - ((x < 0.0f)? 1: 0);
+	*ix = i;
+	return x - (float)i;
+}
+
+static float4 texture_read(uchar4 r)
+{
+	float f = 1.0f/255.0f;
+	return make_float4(r.x*f, r.y*f, r.z*f, r.w*f);
+}
+
+float4 TextureCache::lookup(int slot, float x, float y, float width, bool periodic)
+{
+	if(slot < 0 || slot >= (int)images.size() || !images[slot])
+		return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	Image *img = images[slot];
+	int misses = 0;
+	float4 r;
+
+	{
+		thread_shared_lock lock(img->mutex);
+
+		if(img->levels.empty())
+			return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+		/* pick the mip level where the filter width covers about one pixel */
+		int level = 0;
+		float texels = width*max(img->levels[0].width, img->levels[0].height);
+
+		while(texels > 2.0f && level+1 < (int)img->levels.size()) {
+			texels *= 0.5f;
+			level++;
+		}
+
+		/* bilinear interpolation, same as texture_image on the CPU */
+		int w = img->levels[level].width;
+		int h = img->levels[level].height;
+		int ix, iy, nix, niy;
+		float tx = texture_frac(x*w, &ix);
+		float ty = texture_frac(y*h, &iy);
+
+		if(periodic) {
+			ix = texture_wrap_periodic(ix, w);
+			iy = texture_wrap_periodic(iy, h);
+
+			nix = texture_wrap_periodic(ix+1, w);
+			niy = texture_wrap_periodic(iy+1, h);
+		}
+		else {
+			ix = texture_wrap_clamp(ix, w);
+			iy = texture_wrap_clamp(iy, h);
+
+			nix = texture_wrap_clamp(ix+1, w);
+			niy = texture_wrap_clamp(iy+1, h);
+		}
+
+		/* image rows are stored top to bottom as in the file */
+		iy = h - 1 - iy;
+		niy = h - 1 - niy;
+
+		r = (1.0f - ty)*(1.0f - tx)*texture_read(texel_get(img, level, ix, iy, &misses));
+		r += (1.0f - ty)*tx*texture_read(texel_get(img, level, nix, iy, &misses));
+		r += ty*(1.0f - tx)*texture_read(texel_get(img, level, ix, niy, &misses));
+		r += ty*tx*texture_read(texel_get(img, level, nix, niy, &misses));
+	}
+
+	if(misses)
+		atomic_add_uint64(&img->misses, misses);
+	if(misses < 4)
+		atomic_add_uint64(&img->hits, 4 - misses);
+
+	if(max_mem && mem_used > max_mem)
+		evict();
+
+	return r;
+}
+
+/* Memory */
+
+void TextureCache::set_max_mem(size_t max_mem_)
+{
+	max_mem = max_mem_;
+
+	if(max_mem && mem_used > max_mem)
+		evict();
+}
+
+void TextureCache::mem_add(size_t size)
+{
+	thread_scoped_lock lock(mem_mutex);
+
+	mem_used += size;
+
+	if(mem_used > mem_peak)
+		mem_peak = mem_used;
+}
+
+void TextureCache::mem_sub(size_t size)
+{
+	thread_scoped_lock lock(mem_mutex);
+
+	mem_used -= size;
+}
+
+void TextureCache::evict()
+{
+	/* only one thread needs to evict, others continue rendering */
+	if(!evict_mutex.try_lock())
+		return;
+
+	/* free tiles until we are below the budget with some margin, so we don't
+	   have to evict again on the next miss. the first round of the hand over
+	   all images may only clear referenced flags, the second frees tiles */
+	size_t target = max_mem - max_mem/8;
+	int num_slots = images.size();
+
+	for(int round = 0; round <= 2*num_slots && mem_used > target; round++) {
+		if(hand_slot >= num_slots) {
+			hand_slot = 0;
+			hand_level = 0;
+			hand_index = 0;
+		}
+
+		Image *img = images[hand_slot];
+
+		if(img) {
+			/* tiles can only be freed while no lookups use the image, they
+			   hold the lock for a single lookup so we only wait briefly */
+			thread_unique_lock lock(img->mutex);
+
+			for(; hand_level < (int)img->levels.size(); hand_level++, hand_index = 0) {
+				Level& lvl = img->levels[hand_level];
+
+				for(; hand_index < (int)lvl.tiles.size() && mem_used > target; hand_index++) {
+					Tile *tile = &lvl.tiles[hand_index];
+
+					if(!tile->data)
+						continue;
+
+					if(tile->referenced) {
+						tile->referenced = 0;
+					}
+					else {
+						tile_free(tile->data, tile->w, tile->h);
+						tile->data = NULL;
+						evictions++;
+					}
+				}
+
+				if(mem_used <= target)
+					break;
+			}
+
+			if(mem_used <= target)
+				break;
+		}
+
+		hand_slot++;
+		hand_level = 0;
+		hand_index = 0;
+	}
+
+	evict_mutex.unlock();
+}
+
+/* Statistics */
+
+void TextureCache::get_stats(TextureCacheStats& stats)
+{
+	stats = TextureCacheStats();
+
+	for(size_t slot = 0; slot < images.size(); slot++) {
+		Image *img = images[slot];
+
+		if(img) {
+			stats.hits += img->hits;
+			stats.misses += img->misses;
+		}
+	}
+
+	thread_scoped_lock lock(mem_mutex);
+	stats.evictions = evictions;
+	stats.mem_used = mem_used;
+	stats.mem_peak = mem_peak;
+}
+
+void TextureCache::reset_stats()
+{
+	for(size_t slot = 0; slot < images.size(); slot++) {
+		Image *img = images[slot];
+
+		if(img) {
+			img->hits = 0;
+			img->misses = 0;
+		}
+	}
+
+	thread_scoped_lock lock(mem_mutex);
+	evictions = 0;
+	mem_peak = mem_used;
+}
+
+CCL_NAMESPACE_END
+
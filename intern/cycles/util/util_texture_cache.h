@@ -0,0 +1,151 @@
+/*
+ * Copyright 2011, Blender Foundation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __UTIL_TEXTURE_CACHE_H__
+#define __UTIL_TEXTURE_CACHE_H__
+
+/* Texture Cache
+ *
+ * Image textures for the CPU device that are loaded on demand, one tile of
+ * one mip level at a time, instead of being read fully into memory before
+ * rendering. Lookups choose the mip level from the filter width, so surfaces
+ * seen from afar or through blurry indirect bounces only load low resolution
+ * tiles. Once the total size of the loaded tiles exceeds the memory budget,
+ * tiles that were not used recently are freed again.
+ *
+ * Files that are tiled and mipmapped, as written by maketx, have their tiles
+ * read directly. For other files, scanline bands of the full resolution image
+ * are read, and lower mip levels are computed from the level above. */
+
+#include "util_string.h"
+#include "util_thread.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class TextureCacheStats {
+public:
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t mem_used;
+	size_t mem_peak;
+
+	TextureCacheStats()
+	{
+		hits = 0;
+		misses = 0;
+		evictions = 0;
+		mem_used = 0;
+		mem_peak = 0;
+	}
+};
+
+class TextureCache {
+public:
+	TextureCache(size_t max_mem = 0, int tile_size = 64);
+	~TextureCache();
+
+	/* images are identified by the same slot as the image manager uses */
+	bool set_image(int slot, const string& filename);
+	void remove_image(int slot);
+
+	/* bilinear lookup, width is the filter width in 0..1 image coordinates */
+	float4 lookup(int slot, float x, float y, float width, bool periodic = true);
+
+	/* memory budget in bytes, 0 means unlimited */
+	void set_max_mem(size_t max_mem);
+
+	void get_stats(TextureCacheStats& stats);
+	void reset_stats();
+
+protected:
+	/* Lookups hold a shared lock on the image, so tiles are only freed by
+	 * eviction and image removal, which take an exclusive lock. Loaded tiles
+	 * are published with an atomic compare and swap of the data pointer, so
+	 * cache hits don't lock at all, and reading or computing a missing tile
+	 * doesn't block other threads using the same image. */
+
+	struct Tile {
+		uchar4 * volatile data;
+		int w, h;
+		volatile int referenced;
+	};
+
+	struct Level {
+		int width, height;
+		int tiles_x, tiles_y;
+		vector<Tile> tiles;
+	};
+
+	struct Image {
+		string filename;
+		void *input;
+		bool tiled;
+		int file_levels;
+		int tile_size;
+		int components;
+		vector<Level> levels;
+
+		/* decoded scanlines of the last band read from a scanline file */
+		vector<uchar> band;
+		int band_y;
+
+		volatile uint64_t hits;
+		volatile uint64_t misses;
+		thread_shared_mutex mutex;
+		thread_mutex io_mutex;	/* image input is not thread safe */
+	};
+
+	bool image_open(Image *img);
+	void image_close(Image *img);
+
+	uchar4 *tile_get(Image *img, int level, int tx, int ty, int *misses);
+	uchar4 texel_get(Image *img, int level, int x, int y, int *misses = NULL);
+	uchar4 *tile_read(Image *img, int level, int tx, int ty);
+	uchar4 *tile_read_band(Image *img, int tx, int ty);
+	uchar4 *tile_downsample(Image *img, int level, int tx, int ty);
+	uchar4 *tile_alloc(int w, int h);
+	void tile_free(uchar4 *data, int w, int h);
+
+	void mem_add(size_t size);
+	void mem_sub(size_t size);
+	void evict();
+
+	vector<Image*> images;
+	int tile_size;
+
+	/* Eviction uses the clock algorithm: a hand sweeps over the tiles, tiles
+	 * referenced since the hand last passed get a second chance, others are
+	 * freed. The hand position persists between evictions, so no list of all
+	 * tiles has to be built or sorted. */
+	int hand_slot, hand_level, hand_index;
+
+	thread_mutex mem_mutex;
+	thread_mutex evict_mutex;
+	size_t max_mem;
+	size_t mem_used;
+	size_t mem_peak;
+	uint64_t evictions;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_TEXTURE_CACHE_H__ */
+
@@ -20,7 +20,15 @@
 #define __UTIL_THREAD_H__
 
 #include <boost/thread.hpp>
+#include <deque>
 #include <queue>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "util_types.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -41,6 +49,40 @@ using boost::thread;
 typedef boost::mutex thread_mutex;
 typedef boost::mutex::scoped_lock thread_scoped_lock;
 typedef boost::condition_variable thread_condition_variable;
+typedef boost::shared_mutex thread_shared_mutex;
+typedef boost::shared_lock<boost::shared_mutex> thread_shared_lock;
+typedef boost::unique_lock<boost::shared_mutex> thread_unique_lock;
+
+#endif
+
+/* Atomic Operations
+ *
+ * For counters and pointers shared between render threads, where taking a
+ * mutex on every access would serialize the threads. */
+
+#ifdef _MSC_VER
+
+static inline uint64_t atomic_add_uint64(volatile uint64_t *p, uint64_t x)
+{
+	return (uint64_t)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)x) + x;
+}
+
+static inline void *atomic_cas_ptr(void * volatile *p, void *old, void *x)
+{
+	return _InterlockedCompareExchangePointer(p, x, old);
+}
+
+#else
+
+static inline uint64_t atomic_add_uint64(volatile uint64_t *p, uint64_t x)
+{
+	return __sync_add_and_fetch(p, x);
+}
+
+static inline void *atomic_cas_ptr(void * volatile *p, void *old, void *x)
+{
+	return __sync_val_compare_and_swap(p, old, x);
+}
 
 #endif
 
@@ -171,6 +213,233 @@ protected:
 	volatile int tot, tot_done;
 };
 
+/* Thread Safe Work Stealing Queue. Same usage as ThreadQueue, but each worker
+ * thread has its own deque. Workers pop from the front of their own deque,
+ * which keeps the data a task touches in the cache of the thread it was given
+ * to, and once it runs empty steal from the back of the fullest deque of
+ * another worker, so no thread idles while others still have work queued. */
+
+template<typename T> class ThreadStealQueue
+{
+public:
+	ThreadStealQueue()
+	{
+		tot = 0;
+		tot_done = 0;
+		tot_queued = 0;
+		next_worker = 0;
+		do_stop = false;
+		do_cancel = false;
+	}
+
+	~ThreadStealQueue()
+	{
+		for(size_t i = 0; i < workers.size(); i++)
+			delete workers[i];
+	}
+
+	/* Main thread functions */
+
+	/* set number of worker deques, must be called before pushing tasks */
+	void set_num_workers(int num)
+	{
+		for(size_t i = 0; i < workers.size(); i++)
+			delete workers[i];
+
+		workers.resize(num);
+
+		for(size_t i = 0; i < workers.size(); i++)
+			workers[i] = new WorkerDeque();
+	}
+
+	/* push a task to be executed, distributing round robin over workers */
+	void push(const T& value)
+	{
+		push(value, next_worker);
+		next_worker = (next_worker + 1) % workers.size();
+	}
+
+	/* push a task to be executed, preferably by the given worker */
+	void push(const T& value, int worker)
+	{
+		WorkerDeque *wd = workers[worker];
+		thread_scoped_lock lock(wd->mutex);
+		wd->deque.push_back(value);
+
+		{
+			thread_scoped_lock queue_lock(queue_mutex);
+			tot++;
+			tot_queued++;
+		}
+
+		lock.unlock();
+
+		queue_cond.notify_one();
+	}
+
+	/* wait until all tasks are done */
+	void wait_done()
+	{
+		thread_scoped_lock lock(done_mutex);
+
+		while(tot_done != tot)
+			done_cond.wait(lock);
+	}
+
+	/* stop all worker threads */
+	void stop()
+	{
+		clear();
+
+		{
+			thread_scoped_lock queue_lock(queue_mutex);
+			do_stop = true;
+		}
+
+		queue_cond.notify_all();
+	}
+
+	/* cancel all tasks, but keep worker threads running */
+	void cancel()
+	{
+		clear();
+		do_cancel = true;
+		wait_done();
+		do_cancel = false;
+	}
+
+	/* Worker thread functions, same as ThreadQueue except that a worker
+	 * passes its own index when popping */
+
+	bool worker_wait_pop(T& value, int worker)
+	{
+		while(1) {
+			if(pop_front(value, worker) || steal(value, worker))
+				return true;
+
+			thread_scoped_lock lock(queue_mutex);
+
+			while(tot_queued == 0 && !do_stop)
+				queue_cond.wait(lock);
+
+			if(tot_queued == 0)
+				return false;
+		}
+	}
+
+	void worker_done()
+	{
+		thread_scoped_lock lock(done_mutex);
+		tot_done++;
+		lock.unlock();
+
+		assert(tot_done <= tot);
+
+		done_cond.notify_all();
+	}
+
+	bool worker_cancel()
+	{
+		return do_cancel;
+	}
+
+protected:
+	struct WorkerDeque {
+		std::deque<T> deque;
+		thread_mutex mutex;
+	};
+
+	bool pop_front(T& value, int worker)
+	{
+		WorkerDeque *wd = workers[worker];
+		thread_scoped_lock lock(wd->mutex);
+
+		if(wd->deque.empty())
+			return false;
+
+		value = wd->deque.front();
+		wd->deque.pop_front();
+
+		thread_scoped_lock queue_lock(queue_mutex);
+		tot_queued--;
+
+		return true;
+	}
+
+	bool steal(T& value, int worker)
+	{
+		/* find the worker with the most remaining tasks */
+		int victim = -1;
+		size_t victim_size = 0;
+
+		for(size_t i = 0; i < workers.size(); i++) {
+			if((int)i == worker)
+				continue;
+
+			thread_scoped_lock lock(workers[i]->mutex);
+			size_t size = workers[i]->deque.size();
+
+			if(size > victim_size) {
+				victim = i;
+				victim_size = size;
+			}
+		}
+
+		if(victim == -1)
+			return false;
+
+		/* take from the back, the tasks the victim would get to last */
+		WorkerDeque *wd = workers[victim];
+		thread_scoped_lock lock(wd->mutex);
+
+		if(wd->deque.empty())
+			return false;
+
+		value = wd->deque.back();
+		wd->deque.pop_back();
+
+		thread_scoped_lock queue_lock(queue_mutex);
+		tot_queued--;
+
+		return true;
+	}
+
+	void clear()
+	{
+		int removed = 0;
+
+		for(size_t i = 0; i < workers.size(); i++) {
+			WorkerDeque *wd = workers[i];
+			thread_scoped_lock lock(wd->mutex);
+			int num = wd->deque.size();
+
+			wd->deque.clear();
+			removed += num;
+
+			thread_scoped_lock queue_lock(queue_mutex);
+			tot_queued -= num;
+		}
+
+		thread_scoped_lock done_lock(done_mutex);
+		tot_done += removed;
+		done_lock.unlock();
+
+		done_cond.notify_all();
+	}
+
+	std::vector<WorkerDeque*> workers;
+	int next_worker;
+
+	thread_mutex queue_mutex;
+	thread_mutex done_mutex;
+	thread_condition_variable queue_cond;
+	thread_condition_variable done_cond;
+	volatile bool do_stop;
+	volatile bool do_cancel;
+	volatile int tot, tot_done;
+	int tot_queued;
+};
+
 /* Thread Local Storage
  *
  * Boost implementation is a bit slow, and Mac OS X __thread is not supported
@@ -46,13 +46,12 @@
 
 /* SIMD Types */
 
-/* not needed yet, will be for qbvh
-#ifndef __KERNEL_GPU__
+#if !defined(__KERNEL_GPU__) && defined(__KERNEL_SSE__)
 
 #include <emmintrin.h>
 #include <xmmintrin.h>
 
-#endif*/
+#endif
 
 #ifndef _WIN32
 #ifndef __KERNEL_GPU__
@@ -122,6 +122,17 @@ public:
 		return datasize;
 	}
 
+	void swap(array& other)
+	{
+		T *tmp_data = data;
+		size_t tmp_datasize = datasize;
+
+		data = other.data;
+		datasize = other.datasize;
+		other.data = tmp_data;
+		other.datasize = tmp_datasize;
+	}
+
 	T& operator[](size_t i) const
 	{
 		return data[i];
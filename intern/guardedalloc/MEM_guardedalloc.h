@@ -143,7 +143,9 @@ extern "C" {
 	int MEM_check_memory_integrity(void);
 
 	/** Set thread locking functions for safe memory allocation from multiple
-	    threads, pass NULL pointers to disable thread locking again. */
+	    threads, pass NULL pointers to disable thread locking again. Only
+	    used by compilers without atomic operations, otherwise allocation
+	    is always thread safe. */
 	void MEM_set_lock_callback(void (*lock)(void), void (*unlock)(void));
 	
 	/** Attempt to enforce OSX (or other OS's) to have malloc and stack nonzero */
@@ -56,6 +56,12 @@
 #include <sys/mman.h>
 #endif
 
+#if defined(_WIN32)
+#include <windows.h>	/* Interlocked functions, SwitchToThread */
+#else
+#include <sched.h>	/* sched_yield */
+#endif
+
 #include "MEM_guardedalloc.h"
 
 /* Only for debugging:
@@ -97,7 +103,8 @@ typedef struct MemHead {
 	const char * name;
 	const char * nextname;
 	int tag2;
-	int mmap;	/* if true, memory was mmapped */
+	short mmap;	/* if true, memory was mmapped */
+	short list;	/* index in memlists */
 #ifdef DEBUG_MEMCOUNTER
 	int _count;
 #endif
@@ -117,6 +124,7 @@ static void remlink(volatile localListBase *listbase, void *vlink);
 static void rem_memblock(MemHead *memh);
 static void MemorY_ErroR(const char *block, const char *error);
 static const char *check_memlist(MemHead *memh);
+static const char *check_memlist_base(volatile localListBase *membase, MemHead *memh);
 
 /* --------------------------------------------------------------------- */
 /* locally used defines                                                  */
@@ -143,8 +151,29 @@ static const char *check_memlist(MemHead *memh);
 static volatile int totblock= 0;
 static volatile uintptr_t mem_in_use= 0, mmap_in_use= 0, peak_mem = 0;
 
-static volatile struct localListBase _membase;
-static volatile struct localListBase *membase = &_membase;
+/* Memory blocks are kept in a number of lists, each with their own lock.
+ * Every thread adds blocks to its own list, so threads only wait for each
+ * other when freeing blocks allocated by another thread that shares the
+ * list. Statistics are kept with atomic operations. */
+#define MEM_LISTS	32
+
+#if defined(_MSC_VER)
+#  define MEM_ALIGN_CACHE_LINE __declspec(align(64))
+#elif defined(__GNUC__)
+#  define MEM_ALIGN_CACHE_LINE __attribute__((aligned(64)))
+#else
+#  define MEM_ALIGN_CACHE_LINE
+#endif
+
+/* each list on its own cache line */
+typedef struct MEM_ALIGN_CACHE_LINE MemList {
+	volatile localListBase base;
+	volatile int lock;
+	char pad[64 - sizeof(localListBase) - sizeof(int)];
+} MemList;
+
+static MemList memlists[MEM_LISTS];
+
 static void (*error_callback)(const char *) = NULL;
 static void (*thread_lock_callback)(void) = NULL;
 static void (*thread_unlock_callback)(void) = NULL;
@@ -181,6 +210,90 @@ static void print_error(const char *str, ...)
 	if (error_callback) error_callback(buf);
 }
 
+/* atomic operations, without support for them in the compiler the thread
+ * lock callback is used for all lists together */
+
+#if defined(__GNUC__)
+#  define MEM_USE_ATOMIC
+
+static uintptr_t atomic_add_z(volatile uintptr_t *p, uintptr_t x)
+{
+	return __sync_add_and_fetch(p, x);
+}
+
+static uintptr_t atomic_sub_z(volatile uintptr_t *p, uintptr_t x)
+{
+	return __sync_sub_and_fetch(p, x);
+}
+
+static uintptr_t atomic_cas_z(volatile uintptr_t *p, uintptr_t old, uintptr_t x)
+{
+	return __sync_val_compare_and_swap(p, old, x);
+}
+
+static int atomic_add_int(volatile int *p, int x)
+{
+	return __sync_add_and_fetch(p, x);
+}
+
+static int atomic_test_and_set(volatile int *p)
+{
+	return __sync_lock_test_and_set(p, 1);
+}
+
+static void atomic_release(volatile int *p)
+{
+	__sync_lock_release(p);
+}
+
+#elif defined(_MSC_VER)
+#  define MEM_USE_ATOMIC
+
+#if defined(_WIN64)
+static uintptr_t atomic_add_z(volatile uintptr_t *p, uintptr_t x)
+{
+	return InterlockedExchangeAdd64((volatile LONGLONG *)p, (LONGLONG)x) + x;
+}
+
+static uintptr_t atomic_cas_z(volatile uintptr_t *p, uintptr_t old, uintptr_t x)
+{
+	return InterlockedCompareExchange64((volatile LONGLONG *)p, (LONGLONG)x, (LONGLONG)old);
+}
+#else
+static uintptr_t atomic_add_z(volatile uintptr_t *p, uintptr_t x)
+{
+	return InterlockedExchangeAdd((volatile LONG *)p, (LONG)x) + x;
+}
+
+static uintptr_t atomic_cas_z(volatile uintptr_t *p, uintptr_t old, uintptr_t x)
+{
+	return InterlockedCompareExchange((volatile LONG *)p, (LONG)x, (LONG)old);
+}
+#endif
+
+static uintptr_t atomic_sub_z(volatile uintptr_t *p, uintptr_t x)
+{
+	return atomic_add_z(p, (uintptr_t)(-(intptr_t)x));
+}
+
+static int atomic_add_int(volatile int *p, int x)
+{
+	return InterlockedExchangeAdd((volatile LONG *)p, x) + x;
+}
+
+static int atomic_test_and_set(volatile int *p)
+{
+	return InterlockedExchange((volatile LONG *)p, 1);
+}
+
+static void atomic_release(volatile int *p)
+{
+	InterlockedExchange((volatile LONG *)p, 0);
+}
+
+#else
+
+/* all changes are done with the lock callback held */
 static void mem_lock_thread(void)
 {
 	if (thread_lock_callback)
@@ -193,15 +306,150 @@ static void mem_unlock_thread(void)
 		thread_unlock_callback();
 }
 
+static uintptr_t atomic_add_z(volatile uintptr_t *p, uintptr_t x) { return (*p += x); }
+static uintptr_t atomic_sub_z(volatile uintptr_t *p, uintptr_t x) { return (*p -= x); }
+static int atomic_add_int(volatile int *p, int x) { return (*p += x); }
+
+#endif
+
+/* thread local list index, without thread local storage the stack address
+ * is used, stacks of different threads are far apart */
+#if defined(__GNUC__) && !defined(__APPLE__)
+#  define MEM_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#  define MEM_THREAD_LOCAL __declspec(thread)
+#endif
+
+static int mem_thread_list(void)
+{
+#ifdef MEM_THREAD_LOCAL
+	static volatile int totthread= 0;
+	static MEM_THREAD_LOCAL int list= -1;
+
+	if (list == -1)
+		list= (atomic_add_int(&totthread, 1) - 1) % MEM_LISTS;
+
+	return list;
+#else
+	int local;
+
+	return (int)((((uintptr_t)&local) >> 16) % MEM_LISTS);
+#endif
+}
+
+#ifdef MEM_USE_ATOMIC
+
+/* spins before giving up the time slice to the thread holding the lock */
+#define MEM_SPIN_COUNT	1000
+
+static void mem_cpu_pause(void)
+{
+#if defined(_MSC_VER)
+	YieldProcessor();
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__asm__ __volatile__("pause");
+#endif
+}
+
+static void mem_thread_yield(void)
+{
+#if defined(_WIN32)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+#endif
+
+static void memlist_lock(MemList *ml)
+{
+#ifdef MEM_USE_ATOMIC
+	int spin= 0;
+
+	while (atomic_test_and_set(&ml->lock)) {
+		while (ml->lock) {
+			if (++spin < MEM_SPIN_COUNT) {
+				mem_cpu_pause();
+			}
+			else {
+				mem_thread_yield();
+				spin= 0;
+			}
+		}
+	}
+#else
+	(void)ml;
+	mem_lock_thread();
+#endif
+}
+
+static void memlist_unlock(MemList *ml)
+{
+#ifdef MEM_USE_ATOMIC
+	atomic_release(&ml->lock);
+#else
+	(void)ml;
+	mem_unlock_thread();
+#endif
+}
+
+/* in order, for going over all blocks */
+static void memlist_lock_all(void)
+{
+#ifdef MEM_USE_ATOMIC
+	int a;
+
+	for (a=0; a<MEM_LISTS; a++)
+		memlist_lock(&memlists[a]);
+#else
+	mem_lock_thread();
+#endif
+}
+
+static void memlist_unlock_all(void)
+{
+#ifdef MEM_USE_ATOMIC
+	int a;
+
+	for (a=MEM_LISTS-1; a>=0; a--)
+		memlist_unlock(&memlists[a]);
+#else
+	mem_unlock_thread();
+#endif
+}
+
+static void update_peak(uintptr_t in_use)
+{
+#ifdef MEM_USE_ATOMIC
+	uintptr_t peak= peak_mem;
+
+	while (in_use > peak) {
+		uintptr_t old= atomic_cas_z(&peak_mem, peak, in_use);
+		if (old == peak) break;
+		peak= old;
+	}
+#else
+	peak_mem = in_use > peak_mem ? in_use : peak_mem;
+#endif
+}
+
 int MEM_check_memory_integrity(void)
 {
 	const char* err_val = NULL;
 	MemHead* listend;
+	int a;
+
+	memlist_lock_all();
+
 	/* check_memlist starts from the front, and runs until it finds
 	 * the requested chunk. For this test, that's the last one. */
-	listend = membase->last;
-	
-	err_val = check_memlist(listend);
+	for (a=0; a<MEM_LISTS && err_val == NULL; a++) {
+		listend = memlists[a].base.last;
+		err_val = check_memlist_base(&memlists[a].base, listend);
+	}
+
+	memlist_unlock_all();
 
 	if (err_val == NULL) return 0;
 	return 1;
@@ -278,42 +526,49 @@ void *MEM_reallocN(void *vmemh, size_t len)
 	return newp;
 }
 
-static void make_memhead_header(MemHead *memh, size_t len, const char *str)
+static void make_memhead_header(MemHead *memh, size_t len, const char *str, int mmap)
 {
 	MemTail *memt;
+	MemList *ml;
+	int list= mem_thread_list();
 	
 	memh->tag1 = MEMTAG1;
 	memh->name = str;
 	memh->nextname = NULL;
 	memh->len = len;
-	memh->mmap = 0;
+	memh->mmap = mmap;
+	memh->list = list;
 	memh->tag2 = MEMTAG2;
 	
 	memt = (MemTail *)(((char *) memh) + sizeof(MemHead) + len);
 	memt->tag3 = MEMTAG3;
+
+	ml= &memlists[list];
+	memlist_lock(ml);
 	
-	addtail(membase,&memh->next);
+	addtail(&ml->base,&memh->next);
 	if (memh->next) memh->nextname = MEMNEXT(memh->next)->name;
 	
-	totblock++;
-	mem_in_use += len;
-
-	peak_mem = mem_in_use > peak_mem ? mem_in_use : peak_mem;
+	/* counters are changed with the list locked, so totblock matches
+	 * the lists when all of them are locked */
+	atomic_add_int(&totblock, 1);
+	update_peak(atomic_add_z(&mem_in_use, len));
+	if (mmap)
+		update_peak(atomic_add_z(&mmap_in_use, len));
+
+	memlist_unlock(ml);
 }
 
 void *MEM_mallocN(size_t len, const char *str)
 {
 	MemHead *memh;
 
-	mem_lock_thread();
-
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 	
 	memh= (MemHead *)malloc(len+sizeof(MemHead)+sizeof(MemTail));
 
 	if(memh) {
-		make_memhead_header(memh, len, str);
-		mem_unlock_thread();
+		make_memhead_header(memh, len, str, 0);
 		if(malloc_debug_memset && len)
 			memset(memh+1, 255, len);
 
@@ -324,7 +579,6 @@ void *MEM_mallocN(size_t len, const char *str)
 #endif
 		return (++memh);
 	}
-	mem_unlock_thread();
 	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mem_in_use);
 	return NULL;
 }
@@ -333,15 +587,12 @@ void *MEM_callocN(size_t len, const char *str)
 {
 	MemHead *memh;
 
-	mem_lock_thread();
-
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 
 	memh= (MemHead *)calloc(len+sizeof(MemHead)+sizeof(MemTail),1);
 
 	if(memh) {
-		make_memhead_header(memh, len, str);
-		mem_unlock_thread();
+		make_memhead_header(memh, len, str, 0);
 #ifdef DEBUG_MEMCOUNTER
 		if(_mallocn_count==DEBUG_MEMCOUNTER_ERROR_VAL)
 			memcount_raise("MEM_callocN");
@@ -349,7 +600,6 @@ void *MEM_callocN(size_t len, const char *str)
 #endif
 		return (++memh);
 	}
-	mem_unlock_thread();
 	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mem_in_use);
 	return NULL;
 }
@@ -358,8 +608,6 @@ void *MEM_callocN(size_t len, const char *str)
 void *MEM_mapallocN(size_t len, const char *str)
 {
 	MemHead *memh;
-
-	mem_lock_thread();
 	
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 
@@ -367,11 +615,7 @@ void *MEM_mapallocN(size_t len, const char *str)
 			PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
 
 	if(memh!=(MemHead *)-1) {
-		make_memhead_header(memh, len, str);
-		memh->mmap= 1;
-		mmap_in_use += len;
-		peak_mem = mmap_in_use > peak_mem ? mmap_in_use : peak_mem;
-		mem_unlock_thread();
+		make_memhead_header(memh, len, str, 1);
 #ifdef DEBUG_MEMCOUNTER
 		if(_mallocn_count==DEBUG_MEMCOUNTER_ERROR_VAL)
 			memcount_raise("MEM_mapallocN");
@@ -380,7 +624,6 @@ void *MEM_mapallocN(size_t len, const char *str)
 		return (++memh);
 	}
 	else {
-		mem_unlock_thread();
 		print_error("Mapalloc returns null, fallback to regular malloc: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mmap_in_use);
 		return MEM_callocN(len, str);
 	}
@@ -420,7 +663,7 @@ void MEM_printmemlist_stats(void)
 	MemPrintBlock *pb, *printblock;
 	int totpb, a, b;
 
-	mem_lock_thread();
+	memlist_lock_all();
 
 	/* put memory blocks into array */
 	printblock= malloc(sizeof(MemPrintBlock)*totblock);
@@ -428,20 +671,22 @@ void MEM_printmemlist_stats(void)
 	pb= printblock;
 	totpb= 0;
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_LISTS; a++) {
+		membl = memlists[a].base.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		pb->name= membl->name;
-		pb->len= membl->len;
-		pb->items= 1;
+		while(membl) {
+			pb->name= membl->name;
+			pb->len= membl->len;
+			pb->items= 1;
 
-		totpb++;
-		pb++;
+			totpb++;
+			pb++;
 
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
 	/* sort by name and add together blocks with the same name */
@@ -470,7 +715,7 @@ void MEM_printmemlist_stats(void)
 
 	free(printblock);
 	
-	mem_unlock_thread();
+	memlist_unlock_all();
 
 #if 0 /* GLIBC only */
 	malloc_stats();
@@ -481,29 +726,32 @@ void MEM_printmemlist_stats(void)
 static void MEM_printmemlist_internal( int pydict )
 {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
-
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	memlist_lock_all();
 	
 	if (pydict) {
 		print_error("# membase_debug.py\n");
 		print_error("membase = [\\\n");
 	}
-	while(membl) {
-		if (pydict) {
-			fprintf(stderr, "{'len':" SIZET_FORMAT ", 'name':'''%s''', 'pointer':'%p'},\\\n", SIZET_ARG(membl->len), membl->name, (void *)(membl+1));
-		} else {
+	for(a=0; a<MEM_LISTS; a++) {
+		membl = memlists[a].base.first;
+		if (membl) membl = MEMNEXT(membl);
+
+		while(membl) {
+			if (pydict) {
+				fprintf(stderr, "{'len':" SIZET_FORMAT ", 'name':'''%s''', 'pointer':'%p'},\\\n", SIZET_ARG(membl->len), membl->name, (void *)(membl+1));
+			} else {
 #ifdef DEBUG_MEMCOUNTER
-			print_error("%s len: " SIZET_FORMAT " %p, count: %d\n", membl->name, SIZET_ARG(membl->len), membl+1, membl->_count);
+				print_error("%s len: " SIZET_FORMAT " %p, count: %d\n", membl->name, SIZET_ARG(membl->len), membl+1, membl->_count);
 #else
-			print_error("%s len: " SIZET_FORMAT " %p\n", membl->name, SIZET_ARG(membl->len), membl+1);
+				print_error("%s len: " SIZET_FORMAT " %p\n", membl->name, SIZET_ARG(membl->len), membl+1);
 #endif
+			}
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
 		}
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
 	}
 	if (pydict) {
 		fprintf(stderr, "]\n\n");
@@ -525,47 +773,53 @@ static void MEM_printmemlist_internal( int pydict )
 		);
 	}
 	
-	mem_unlock_thread();
+	memlist_unlock_all();
 }
 
 void MEM_callbackmemlist(void (*func)(void*)) {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
+	memlist_lock_all();
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_LISTS; a++) {
+		membl = memlists[a].base.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		func(membl+1);
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+		while(membl) {
+			func(membl+1);
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
-	mem_unlock_thread();
+	memlist_unlock_all();
 }
 
 short MEM_testN(void *vmemh) {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
+	memlist_lock_all();
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_LISTS; a++) {
+		membl = memlists[a].base.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		if (vmemh == membl+1) {
-			mem_unlock_thread();
-			return 1;
-		}
+		while(membl) {
+			if (vmemh == membl+1) {
+				memlist_unlock_all();
+				return 1;
+			}
 
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
-	mem_unlock_thread();
+	memlist_unlock_all();
 
 	print_error("Memoryblock %p: pointer not in memlist\n", vmemh);
 	return 0;
@@ -610,8 +864,9 @@ short MEM_freeN(void *vmemh)		/* anders compileertie niet meer */
 		return(-1);
 	}
 
-	mem_lock_thread();
-	if ((memh->tag1 == MEMTAG1) && (memh->tag2 == MEMTAG2) && ((memh->len & 0x3) == 0)) {
+	if ((memh->tag1 == MEMTAG1) && (memh->tag2 == MEMTAG2) && ((memh->len & 0x3) == 0) &&
+	    (memh->list >= 0 && memh->list < MEM_LISTS))
+	{
 		memt = (MemTail *)(((char *) memh) + sizeof(MemHead) + memh->len);
 		if (memt->tag3 == MEMTAG3){
 			
@@ -620,19 +875,19 @@ short MEM_freeN(void *vmemh)		/* anders compileertie niet meer */
 			memt->tag3 = MEMFREE;
 			/* after tags !!! */
 			rem_memblock(memh);
-
-			mem_unlock_thread();
 			
 			return(0);
 		}
 		error = 2;
 		MemorY_ErroR(memh->name,"end corrupt");
+		memlist_lock_all();
 		name = check_memlist(memh);
 		if (name != NULL){
 			if (name != memh->name) MemorY_ErroR(name,"is also corrupt");
 		}
 	} else{
 		error = -1;
+		memlist_lock_all();
 		name = check_memlist(memh);
 		if (name == NULL)
 			MemorY_ErroR("free","pointer not in memlist");
@@ -640,10 +895,10 @@ short MEM_freeN(void *vmemh)		/* anders compileertie niet meer */
 			MemorY_ErroR(name,"error in header");
 	}
 
-	totblock--;
+	atomic_add_int(&totblock, -1);
 	/* here a DUMP should happen */
 
-	mem_unlock_thread();
+	memlist_unlock_all();
 
 	return(error);
 }
@@ -683,7 +938,11 @@ static void remlink(volatile localListBase *listbase, void *vlink)
 
 static void rem_memblock(MemHead *memh)
 {
-	remlink(membase,&memh->next);
+	MemList *ml= &memlists[memh->list];
+
+	memlist_lock(ml);
+
+	remlink(&ml->base,&memh->next);
 	if (memh->prev) {
 		if (memh->next)
 			MEMNEXT(memh->prev)->nextname = MEMNEXT(memh->next)->name;
@@ -691,11 +950,14 @@ static void rem_memblock(MemHead *memh)
 			MEMNEXT(memh->prev)->nextname = NULL;
 	}
 
-	totblock--;
-	mem_in_use -= memh->len;
+	atomic_add_int(&totblock, -1);
+	atomic_sub_z(&mem_in_use, memh->len);
+	if(memh->mmap)
+		atomic_sub_z(&mmap_in_use, memh->len);
+
+	memlist_unlock(ml);
 
 	if(memh->mmap) {
-		mmap_in_use -= memh->len;
 		if (munmap(memh, memh->len + sizeof(MemHead) + sizeof(MemTail)))
 			printf("Couldn't unmap memory %s\n", memh->name);
 	}
@@ -715,7 +977,20 @@ static void MemorY_ErroR(const char *block, const char *error)
 #endif
 }
 
+/* all lists must be locked */
 static const char *check_memlist(MemHead *memh)
+{
+	const char *name;
+	int a;
+
+	for(a=0; a<MEM_LISTS; a++)
+		if((name= check_memlist_base(&memlists[a].base, memh)))
+			return name;
+
+	return NULL;
+}
+
+static const char *check_memlist_base(volatile localListBase *membase, MemHead *memh)
 {
 	MemHead *forw,*back,*forwok,*backok;
 	const char *name;
@@ -800,55 +1075,31 @@ static const char *check_memlist(MemHead *memh)
 	return(name);
 }
 
+/* statistics are word sized and changed atomically, no lock needed to read */
+
 uintptr_t MEM_get_peak_memory(void)
 {
-	uintptr_t _peak_mem;
-
-	mem_lock_thread();
-	_peak_mem = peak_mem;
-	mem_unlock_thread();
-
-	return _peak_mem;
+	return peak_mem;
 }
 
 void MEM_reset_peak_memory(void)
 {
-	mem_lock_thread();
 	peak_mem = 0;
-	mem_unlock_thread();
 }
 
 uintptr_t MEM_get_memory_in_use(void)
 {
-	uintptr_t _mem_in_use;
-
-	mem_lock_thread();
-	_mem_in_use= mem_in_use;
-	mem_unlock_thread();
-
-	return _mem_in_use;
+	return mem_in_use;
 }
 
 uintptr_t MEM_get_mapped_memory_in_use(void)
 {
-	uintptr_t _mmap_in_use;
-
-	mem_lock_thread();
-	_mmap_in_use= mmap_in_use;
-	mem_unlock_thread();
-
-	return _mmap_in_use;
+	return mmap_in_use;
 }
 
 int MEM_get_memory_blocks_in_use(void)
 {
-	int _totblock;
-
-	mem_lock_thread();
-	_totblock= totblock;
-	mem_unlock_thread();
-
-	return _totblock;
+	return totblock;
 }
 
 #ifndef NDEBUG
@@ -141,6 +141,7 @@ typedef struct Global {
 #define G_FILE_RECOVER			 (1 << 23)
 #define G_FILE_RELATIVE_REMAP	 (1 << 24)
 #define G_FILE_HISTORY			 (1 << 25)
+#define G_FILE_COMPRESS_FAST	 (1 << 26)				/* with G_FILE_COMPRESS, faster but larger */
 
 /* G.windowstate */
 #define G_WINDOWSTATE_USERDEF		0
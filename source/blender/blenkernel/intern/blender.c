@@ -559,6 +559,15 @@ void BKE_write_undo(bContext *C, const char *name)
 		memused= MEM_get_memory_in_use();
 		/* success= */ /* UNUSED */ BLO_write_file_mem(CTX_data_main(C), prevfile, &curundo->memfile, G.fileflags);
 		curundo->undosize= MEM_get_memory_in_use() - memused;
+
+		if(G.f & G_DEBUG) {
+			size_t unique_size, total_size;
+
+			BLO_memfile_stats(&unique_size, &total_size);
+			printf("undo push %s: %.2f MB new, %.2f MB stored, %.2f MB shared\n", name,
+			       curundo->memfile.size/(1024.0*1024.0), unique_size/(1024.0*1024.0),
+			       (total_size - unique_size)/(1024.0*1024.0));
+		}
 	}
 
 	if(U.undomemory != 0) {
@@ -36,8 +36,8 @@
 typedef struct {
 	void *next, *prev;
 	
-	char *buf;
-	unsigned int ident, size;
+	char *buf;				/* shared by content with other chunks and undo steps */
+	unsigned int ident, size;	/* ident: data was already stored before */
 	
 } MemFileChunk;
 
@@ -52,6 +52,7 @@ extern void add_memfilechunk(MemFile *compare, MemFile *current, char *buf, unsi
 /* exports */
 extern void BLO_free_memfile(MemFile *memfile);
 extern void BLO_merge_memfile(MemFile *first, MemFile *second);
+extern void BLO_memfile_stats(size_t *unique_size, size_t *total_size);
 
 #endif
 
@@ -42,6 +42,8 @@
 
 #ifndef WIN32
 	#include <unistd.h> // for read close
+	#include <sys/mman.h> // for mmap
+	#include <sys/stat.h> // for fstat
 #else
 	#include <io.h> // for open close read
 #include "winsock2.h"
@@ -51,6 +53,12 @@
 /* allow readfile to use deprecated functionality */
 #define DNA_DEPRECATED_ALLOW
 
+/* uncompressed files are read through a memory mapping, block data is then
+ * used from the mapping which is not always aligned, so only on x86 */
+#if !defined(WIN32) && (defined(__i386__) || defined(__x86_64__))
+	#define USE_MMAP_READ
+#endif
+
 #include "DNA_anim_types.h"
 #include "DNA_armature_types.h"
 #include "DNA_actuator_types.h"
@@ -237,40 +245,104 @@ typedef struct OldNew {
 typedef struct OldNewMap {
 	OldNew *entries;
 	int nentries, entriessize;
-	int sorted;
 	int lasthit;
+
+	/* open addressing hash of entry indices by old address, -1 is empty,
+	 * for duplicate old addresses only the first entry is in it */
+	int *hash;
+	int hashsize, hashshift;
+
+	/* statistics */
+	int totlookup, totlasthit, totprobe;
 } OldNewMap;
 
+#define ONM_HASH_INITSIZE	2048
+
 
 /* local prototypes */
 static void *read_struct(FileData *fd, BHead *bh, const char *blockname);
 static void direct_link_modifiers(FileData *fd, ListBase *lb);
 static void convert_tface_mt(FileData *fd, Main *main);
 
+static void oldnewmap_hash_clear(OldNewMap *onm)
+{
+	memset(onm->hash, 0xff, sizeof(*onm->hash)*onm->hashsize);
+}
+
 static OldNewMap *oldnewmap_new(void) 
 {
 	OldNewMap *onm= MEM_callocN(sizeof(*onm), "OldNewMap");
 	
 	onm->entriessize= 1024;
 	onm->entries= MEM_mallocN(sizeof(*onm->entries)*onm->entriessize, "OldNewMap.entries");
+
+	onm->hashsize= ONM_HASH_INITSIZE;
+	onm->hashshift= 32 - 11;
+	onm->hash= MEM_mallocN(sizeof(*onm->hash)*onm->hashsize, "OldNewMap.hash");
+	oldnewmap_hash_clear(onm);
 	
 	return onm;
 }
 
-static int verg_oldnewmap(const void *v1, const void *v2)
+/* old addresses are aligned and often close together, so mix all bits
+ * and use the high bits of a multiplicative hash */
+static int oldnewmap_hash_index(OldNewMap *onm, const void *addr)
 {
-	const struct OldNew *x1=v1, *x2=v2;
-	
-	if( x1->old > x2->old) return 1;
-	else if( x1->old < x2->old) return -1;
-	return 0;
+	uintptr_t key= ((uintptr_t)addr) >> 3;
+	unsigned int h= (unsigned int)key;
+
+	if(sizeof(key) > 4)
+		h ^= (unsigned int)((key >> 16) >> 16);
+
+	return (int)((h * 2654435761u) >> onm->hashshift);
+}
+
+/* returns index of the first entry with this old address, or -1 */
+static int oldnewmap_hash_find(OldNewMap *onm, const void *addr)
+{
+	int mask= onm->hashsize - 1;
+	int i= oldnewmap_hash_index(onm, addr);
+
+	while(onm->hash[i] != -1) {
+		if(onm->entries[onm->hash[i]].old == addr)
+			return onm->hash[i];
+
+		onm->totprobe++;
+		i= (i + 1) & mask;
+	}
+
+	return -1;
 }
 
+static void oldnewmap_hash_insert(OldNewMap *onm, int index)
+{
+	void *addr= onm->entries[index].old;
+	int mask= onm->hashsize - 1;
+	int i= oldnewmap_hash_index(onm, addr);
+
+	while(onm->hash[i] != -1) {
+		if(onm->entries[onm->hash[i]].old == addr)
+			return;
+		i= (i + 1) & mask;
+	}
 
-static void oldnewmap_sort(FileData *fd) 
+	onm->hash[i]= index;
+}
+
+/* keep the hash at most half full */
+static void oldnewmap_hash_grow(OldNewMap *onm)
 {
-	qsort(fd->libmap->entries, fd->libmap->nentries, sizeof(OldNew), verg_oldnewmap);
-	fd->libmap->sorted= 1;
+	int i;
+
+	MEM_freeN(onm->hash);
+
+	onm->hashsize*= 2;
+	onm->hashshift--;
+	onm->hash= MEM_mallocN(sizeof(*onm->hash)*onm->hashsize, "OldNewMap.hash");
+	oldnewmap_hash_clear(onm);
+
+	for(i=0; i<onm->nentries; i++)
+		oldnewmap_hash_insert(onm, i);
 }
 
 /* nr is zero for data, and ID code for libdata */
@@ -295,6 +367,11 @@ static void oldnewmap_insert(OldNewMap *onm, void *oldaddr, void *newaddr, int n
 	entry->old= oldaddr;
 	entry->newp= newaddr;
 	entry->nr= nr;
+
+	if(2*onm->nentries > onm->hashsize)
+		oldnewmap_hash_grow(onm);
+	else
+		oldnewmap_hash_insert(onm, onm->nentries-1);
 }
 
 static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr) 
@@ -303,24 +380,28 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, void *addr)
 
 	if(addr==NULL) return NULL;
 
+	onm->totlookup++;
+
+	/* linking is mostly done in the same sequence as writing */
 	if (onm->lasthit<onm->nentries-1) {
 		OldNew *entry= &onm->entries[++onm->lasthit];
 
 		if (entry->old==addr) {
+			onm->totlasthit++;
 			entry->nr++;
 			return entry->newp;
 		}
 	}
 
-	for (i=0; i<onm->nentries; i++) {
+	i= oldnewmap_hash_find(onm, addr);
+
+	if (i != -1) {
 		OldNew *entry= &onm->entries[i];
 
-		if (entry->old==addr) {
-			onm->lasthit= i;
+		onm->lasthit= i;
 
-			entry->nr++;
-			return entry->newp;
-		}
+		entry->nr++;
+		return entry->newp;
 	}
 
 	return NULL;
@@ -332,24 +413,16 @@ static void *oldnewmap_liblookup(OldNewMap *onm, void *addr, void *lib)
 	int i;
 	
 	if(addr==NULL) return NULL;
+
+	onm->totlookup++;
 	
-	/* lasthit works fine for non-libdata, linking there is done in same sequence as writing */
-	if(onm->sorted) {
-		OldNew entry_s, *entry;
-		
-		entry_s.old= addr;
-		
-		entry= bsearch(&entry_s, onm->entries, onm->nentries, sizeof(OldNew), verg_oldnewmap);
-		if(entry) {
-			ID *id= entry->newp;
-			
-			if (id && (!lib || id->lib)) {
-				return entry->newp;
-			}
-		}
-	}
-	
-	for (i=0; i<onm->nentries; i++) {
+	/* the hash gives the first entry, in the rare case it is not usable,
+	 * check the following entries for the same address */
+	i= oldnewmap_hash_find(onm, addr);
+	if(i == -1)
+		return NULL;
+
+	for (; i<onm->nentries; i++) {
 		OldNew *entry= &onm->entries[i];
 
 		if (entry->old==addr) {
@@ -379,16 +452,39 @@ static void oldnewmap_free_unused(OldNewMap *onm)
 
 static void oldnewmap_clear(OldNewMap *onm) 
 {
+	/* the datamap is cleared for every ID block, shrink the hash again
+	 * after a big block so clearing stays cheap */
+	if(onm->hashsize > ONM_HASH_INITSIZE) {
+		MEM_freeN(onm->hash);
+		onm->hashsize= ONM_HASH_INITSIZE;
+		onm->hashshift= 32 - 11;
+		onm->hash= MEM_mallocN(sizeof(*onm->hash)*onm->hashsize, "OldNewMap.hash");
+		oldnewmap_hash_clear(onm);
+	}
+	else if(onm->nentries)
+		oldnewmap_hash_clear(onm);
+
 	onm->nentries= 0;
 	onm->lasthit= 0;
 }
 
 static void oldnewmap_free(OldNewMap *onm) 
 {
+	MEM_freeN(onm->hash);
 	MEM_freeN(onm->entries);
 	MEM_freeN(onm);
 }
 
+static void oldnewmap_print_stats(const char *name, OldNewMap *onm)
+{
+	if(onm == NULL)
+		return;
+
+	printf("  %s: %d entries, %d lookups, %d sequential hits, %.2f probes per hashed lookup\n",
+	       name, onm->nentries, onm->totlookup, onm->totlasthit,
+	       (onm->totlookup > onm->totlasthit)? (float)onm->totprobe/(float)(onm->totlookup - onm->totlasthit): 0.0f);
+}
+
 /***/
 
 static void read_libraries(FileData *basefd, ListBase *mainlist);
@@ -669,10 +765,24 @@ static BHeadN *get_bhead(FileData *fd)
 			// bhead now contains the (converted) bhead structure. Now read
 			// the associated data and put everything in a BHeadN (creative naming !)
 
-			if ( ! fd->eof) {
+			if ( ! fd->eof && fd->mmap_buffer) {
+				// memory mapped file, the data is only read when it is used
+				if ((size_t)bhead.len <= fd->mmap_size - fd->mmap_seek) {
+					new_bhead = MEM_mallocN(sizeof(BHeadN), "new_bhead");
+					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = fd->mmap_buffer + fd->mmap_seek;
+					new_bhead->bhead = bhead;
+
+					fd->mmap_seek += bhead.len;
+				} else {
+					fd->eof = 1;
+				}
+			}
+			else if ( ! fd->eof) {
 				new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
 				if (new_bhead) {
 					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = new_bhead + 1;
 					new_bhead->bhead = bhead;
 
 					readsize = fd->read(fd, new_bhead + 1, bhead.len);
@@ -719,6 +829,13 @@ BHead *blo_firstbhead(FileData *fd)
 	return(bhead);
 }
 
+void *blo_bhead_data(BHead *bhead)
+{
+	BHeadN *bheadn= (BHeadN *) (((char *) bhead) - GET_INT_FROM_POINTER( &((BHeadN*)0)->bhead) );
+
+	return bheadn->data;
+}
+
 BHead *blo_prevbhead(FileData *UNUSED(fd), BHead *thisblock)
 {
 	BHeadN *bheadn= (BHeadN *) (((char *) thisblock) - GET_INT_FROM_POINTER( &((BHeadN*)0)->bhead) );
@@ -802,11 +919,11 @@ static int read_file_dna(FileData *fd)
 		if (bhead->code==DNA1) {
 			int do_endian_swap= (fd->flags&FD_FLAGS_SWITCH_ENDIAN)?1:0;
 
-			fd->filesdna= DNA_sdna_from_data(&bhead[1], bhead->len, do_endian_swap);
+			fd->filesdna= DNA_sdna_from_data(blo_bhead_data(bhead), bhead->len, do_endian_swap);
 			if (fd->filesdna) {
 				
 				fd->compflags= DNA_struct_get_compareflags(fd->filesdna, fd->memsdna);
-				/* used to retrieve ID names from (bhead+1) */
+				/* used to retrieve ID names from the bhead data */
 				fd->id_name_offs= DNA_elem_offset(fd->filesdna, "ID", "char", "name[]");
 			}
 
@@ -855,6 +972,19 @@ static int fd_read_from_memory(FileData *filedata, void *buffer, unsigned int si
 	return (readsize);
 }
 
+#ifdef USE_MMAP_READ
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
+{
+	// don't read more bytes then there are available in the mapping
+	size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+
+	memcpy(buffer, filedata->mmap_buffer + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+
+	return ((int)readsize);
+}
+#endif
+
 static int fd_read_from_memfile(FileData *filedata, void *buffer, unsigned int size)
 {
 	static unsigned int seek= 1<<30;	/* the current position */
@@ -954,11 +1084,65 @@ static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
 	return fd;
 }
 
+#ifdef USE_MMAP_READ
+/* map uncompressed files, block data is then only paged in when a block
+ * is actually read, and not copied twice. returns NULL for compressed files
+ * or when mapping fails, these fall back to reading with zlib */
+static FileData *blo_openblenderfile_mmap(const char *filepath)
+{
+	FileData *fd;
+	struct stat st;
+	unsigned char magic[2];
+	void *buffer;
+	int file;
+
+	file= open(filepath, O_BINARY|O_RDONLY);
+	if (file == -1)
+		return NULL;
+
+	if (read(file, magic, sizeof(magic)) != sizeof(magic) ||
+	    (magic[0] == 0x1f && magic[1] == 0x8b) ||
+	    fstat(file, &st) == -1 ||
+	    st.st_size < SIZEOFBLENDERHEADER ||
+	    (off_t)(size_t)st.st_size != st.st_size)
+	{
+		close(file);
+		return NULL;
+	}
+
+	/* private writable mapping, switching endian is done in place */
+	buffer= mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (buffer == MAP_FAILED)
+		return NULL;
+
+	fd = filedata_new();
+	fd->mmap_buffer= buffer;
+	fd->mmap_size= (size_t)st.st_size;
+	fd->read= fd_read_from_mmap;
+
+	/* needed for library_append and read_libraries */
+	BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+
+	return fd;
+}
+#endif
+
 /* cannot be called with relative paths anymore! */
 /* on each new library added, it now checks for the current FileData and expands relativeness */
 FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 {
 	gzFile gzfile;
+
+#ifdef USE_MMAP_READ
+	{
+		FileData *fd= blo_openblenderfile_mmap(filepath);
+		if (fd)
+			return blo_decode_and_check(fd, reports);
+	}
+#endif
+
 	errno= 0;
 	gzfile= gzopen(filepath, "rb");
 
@@ -1023,6 +1207,13 @@ void blo_freefiledata(FileData *fd)
 			gzclose(fd->gzfiledes);
 		}
 
+#ifdef USE_MMAP_READ
+		if (fd->mmap_buffer) {
+			munmap(fd->mmap_buffer, fd->mmap_size);
+			fd->mmap_buffer = NULL;
+		}
+#endif
+
 		if (fd->buffer && !(fd->flags & FD_FLAGS_NOT_MY_BUFFER)) {
 			MEM_freeN(fd->buffer);
 			fd->buffer = NULL;
@@ -1337,7 +1528,7 @@ static void switch_endian_structs(struct SDNA *filesdna, BHead *bhead)
 	int blocksize, nblocks;
 	char *data;
 
-	data= (char *)(bhead+1);
+	data= blo_bhead_data(bhead);
 	blocksize= filesdna->typelens[ filesdna->structs[bhead->SDNAnr][0] ];
 
 	nblocks= bhead->nr;
@@ -1359,10 +1550,10 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 
 		if (fd->compflags[bh->SDNAnr]) {	/* flag==0: doesn't exist anymore */
 			if(fd->compflags[bh->SDNAnr]==2) {
-				temp= DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				temp= DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, blo_bhead_data(bh));
 			} else {
 				temp= MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, blo_bhead_data(bh), bh->len);
 			}
 		}
 	}
@@ -12687,8 +12878,6 @@ static void do_versions_after_linking(FileData *fd, Library *lib, Main *main)
 
 static void lib_link_all(FileData *fd, Main *main)
 {
-	oldnewmap_sort(fd);
-	
 	lib_link_windowmanager(fd, main);
 	lib_link_screen(fd, main);
 	lib_link_scene(fd, main);
@@ -12790,6 +12979,7 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 {
 	BHead *bhead= blo_firstbhead(fd);
 	BlendFileData *bfd;
+	double starttime= PIL_check_seconds_timer(), readtime, libtime;
 
 	bfd= MEM_callocN(sizeof(BlendFileData), "blendfiledata");
 	bfd->main= MEM_callocN(sizeof(Main), "readfile_Main");
@@ -12853,16 +13043,31 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 //	if(fd->memfile==NULL) (the mesh shuffle hacks don't work yet? ton)
 		do_versions(fd, NULL, bfd->main);
 
+	readtime= PIL_check_seconds_timer();
+
 	read_libraries(fd, &fd->mainlist);
 	
 	blo_join_main(&fd->mainlist);
 
+	libtime= PIL_check_seconds_timer();
+
 	lib_link_all(fd, bfd->main);
 	//do_versions_after_linking(fd, NULL, bfd->main); // XXX: not here (or even in this function at all)! this causes crashes on many files - Aligorith (July 04, 2010)
 	lib_verify_nodetree(bfd->main, TRUE);
 	fix_relpaths_library(fd->relabase, bfd->main); /* make all relative paths, relative to the open blend file */
 	
 	link_global(fd, bfd);	/* as last */
+
+	if(G.f & G_DEBUG) {
+		double endtime= PIL_check_seconds_timer();
+
+		printf("read file %s\n", filepath);
+		printf("  time: %.3fs read, %.3fs libraries, %.3fs link\n",
+		       readtime - starttime, libtime - readtime, endtime - libtime);
+		oldnewmap_print_stats("datamap", fd->datamap);
+		oldnewmap_print_stats("globmap", fd->globmap);
+		oldnewmap_print_stats("libmap", fd->libmap);
+	}
 	
 	return bfd;
 }
@@ -12949,7 +13154,7 @@ static BHead *find_bhead(FileData *fd, void *old)
 
 char *bhead_id_name(FileData *fd, BHead *bhead)
 {
-	return ((char *)(bhead+1)) + fd->id_name_offs;
+	return ((char *)blo_bhead_data(bhead)) + fd->id_name_offs;
 }
 
 static ID *is_yet_read(FileData *fd, Main *mainvar, BHead *bhead)
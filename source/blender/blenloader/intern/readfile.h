@@ -58,6 +58,10 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from memory mapped file
+	char *mmap_buffer;
+	size_t mmap_size, mmap_seek;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -71,7 +75,7 @@ typedef struct FileData {
 	char *compflags;
 	
 	int fileversion;
-	int id_name_offs;		/* used to retrieve ID names from (bhead+1) */
+	int id_name_offs;		/* used to retrieve ID names from the bhead data */
 	int globalf, fileflags;	/* for do_versions patching */
 	
 	struct OldNewMap *datamap;
@@ -94,6 +98,7 @@ typedef struct FileData {
 
 typedef struct BHeadN {
 	struct BHeadN *next, *prev;
+	void *data;	/* follows the BHeadN, or points into the memory mapped file */
 	struct BHead bhead;
 } BHeadN;
 
@@ -130,6 +135,7 @@ void blo_freefiledata( FileData *fd);
 BHead *blo_firstbhead(FileData *fd);
 BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
+void *blo_bhead_data(BHead *bhead);
 
 char *bhead_id_name(FileData *fd, BHead *bhead);
 
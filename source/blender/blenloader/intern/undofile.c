@@ -44,19 +44,84 @@
 #include "BLO_undofile.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
 #include "BLI_linklist.h"
 
 
 
 /* **************** support for memory-write, for undo buffers *************** */
 
+/* Chunk buffers are shared by content over all undo steps. Each buffer has
+ * this header in front, and is in a hash so that a new chunk with the same
+ * data can use it, also when the data moved to another position in the file.
+ * Buffers are freed when the last chunk using them is freed. */
+typedef struct MemFileBuf {
+	unsigned int hash, size;
+	int users;
+	char *data;		/* follows the header, or the new data in a lookup */
+} MemFileBuf;
+
+static GHash *memfile_bufs= NULL;
+static size_t memfile_unique_size= 0, memfile_total_size= 0;
+
+#define MEMFILEBUF_FROM_CHUNK(chunk)	(((MemFileBuf *)(chunk)->buf) - 1)
+
+static unsigned int memfilebuf_hash(const void *key)
+{
+	return ((const MemFileBuf *)key)->hash;
+}
+
+static int memfilebuf_cmp(const void *a, const void *b)
+{
+	const MemFileBuf *bufa= a, *bufb= b;
+
+	if(bufa->hash != bufb->hash || bufa->size != bufb->size)
+		return 1;
+
+	return memcmp(bufa->data, bufb->data, bufa->size);
+}
+
+/* word based FNV-1a variant, chunks are mostly aligned struct data */
+static unsigned int memfile_data_hash(const char *buf, unsigned int size)
+{
+	unsigned int hash= 2166136261u, word;
+	unsigned int a, words= size/4;
+
+	for(a=0; a<words; a++) {
+		memcpy(&word, buf + 4*a, 4);
+		hash= (hash ^ word) * 16777619u;
+	}
+	for(a=4*words; a<size; a++)
+		hash= (hash ^ (unsigned char)buf[a]) * 16777619u;
+
+	return hash ^ size;
+}
+
+static void memfile_chunk_free(MemFileChunk *chunk)
+{
+	MemFileBuf *mbuf= MEMFILEBUF_FROM_CHUNK(chunk);
+
+	memfile_total_size -= mbuf->size;
+
+	if(--mbuf->users == 0) {
+		memfile_unique_size -= mbuf->size;
+		BLI_ghash_remove(memfile_bufs, mbuf, NULL, NULL);
+		MEM_freeN(mbuf);
+
+		if(BLI_ghash_size(memfile_bufs) == 0) {
+			BLI_ghash_free(memfile_bufs, NULL, NULL);
+			memfile_bufs= NULL;
+		}
+	}
+}
+
 /* not memfile itself */
 void BLO_free_memfile(MemFile *memfile)
 {
 	MemFileChunk *chunk;
 	
 	while( (chunk = (memfile->chunks.first) ) ) {
-		if(chunk->ident==0) MEM_freeN(chunk->buf);
+		memfile_chunk_free(chunk);
 		BLI_remlink(&memfile->chunks, chunk);
 		MEM_freeN(chunk);
 	}
@@ -67,73 +132,65 @@ void BLO_free_memfile(MemFile *memfile)
 /* result is that 'first' is being freed */
 void BLO_merge_memfile(MemFile *first, MemFile *second)
 {
-	MemFileChunk *fc, *sc;
-	
-	fc= first->chunks.first;
-	sc= second->chunks.first;
-	while (fc || sc) {
-		if(fc && sc) {
-			if(sc->ident) {
-				sc->ident= 0;
-				fc->ident= 1;
-			}
-		}
-		if(fc) fc= fc->next;
-		if(sc) sc= sc->next;
-	}
+	/* buffers are reference counted, so the ones still used by
+	 * 'second' stay */
+	(void)second;
 	
 	BLO_free_memfile(first);
 }
 
-static int my_memcmp(int *mem1, int *mem2, int len)
+/* memory used by all undo steps, and what it would be without sharing */
+void BLO_memfile_stats(size_t *unique_size, size_t *total_size)
 {
-	register int a= len, *mema= mem1, *memb= mem2;
-	
-	while(a--) {
-		if( *mema != *memb) return 1;
-		mema++;
-		memb++;
-	}
-	return 0;
+	*unique_size= memfile_unique_size;
+	*total_size= memfile_total_size;
 }
 
 void add_memfilechunk(MemFile *compare, MemFile *current, char *buf, unsigned int size)
 {
-	static MemFileChunk *compchunk=NULL;
 	MemFileChunk *curchunk;
+	MemFileBuf key, *mbuf;
 	
-	/* this function inits when compare != NULL or when current==NULL */
-	if(compare) {
-		compchunk= compare->chunks.first;
-		return;
-	}
-	if(current==NULL) {
-		compchunk= NULL;
+	/* calls with compare != NULL or with current==NULL were used to init
+	 * comparing with the previous memfile, not needed with shared buffers */
+	if(compare || current==NULL)
 		return;
-	}
 	
 	curchunk= MEM_mallocN(sizeof(MemFileChunk), "MemFileChunk");
 	curchunk->size= size;
-	curchunk->buf= NULL;
 	curchunk->ident= 0;
 	BLI_addtail(&current->chunks, curchunk);
+
+	if(memfile_bufs == NULL)
+		memfile_bufs= BLI_ghash_new(memfilebuf_hash, memfilebuf_cmp, "MemFile buffers");
 	
-	/* we compare compchunk with buf */
-	if(compchunk) {
-		if(compchunk->size == curchunk->size) {
-			if( my_memcmp((int *)compchunk->buf, (int *)buf, size/4)==0) {
-				curchunk->buf= compchunk->buf;
-				curchunk->ident= 1;
-			}
-		}
-		compchunk= compchunk->next;
+	/* find buffer with the same data, from any undo step */
+	key.hash= memfile_data_hash(buf, size);
+	key.size= size;
+	key.data= buf;
+
+	mbuf= BLI_ghash_lookup(memfile_bufs, &key);
+
+	if(mbuf) {
+		curchunk->ident= 1;
 	}
-	
-	/* not equal... */
-	if(curchunk->buf==NULL) {
-		curchunk->buf= MEM_mallocN(size, "Chunk buffer");
-		memcpy(curchunk->buf, buf, size);
+	else {
+		/* not equal... */
+		mbuf= MEM_mallocN(sizeof(MemFileBuf) + size, "Chunk buffer");
+		mbuf->hash= key.hash;
+		mbuf->size= size;
+		mbuf->users= 0;
+		mbuf->data= (char *)(mbuf + 1);
+		memcpy(mbuf->data, buf, size);
+
+		BLI_ghash_insert(memfile_bufs, mbuf, mbuf);
+
 		current->size += size;
+		memfile_unique_size += size;
 	}
+
+	mbuf->users++;
+	memfile_total_size += size;
+	curchunk->buf= mbuf->data;
 }
 
@@ -136,6 +136,7 @@ Any case: direct data is ALWAYS after the lib block
 #include "BLI_linklist.h"
 #include "BLI_bpath.h"
 #include "BLI_math.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_action.h"
@@ -166,6 +167,11 @@ Any case: direct data is ALWAYS after the lib block
 #define MYWRITE_BUFFER_SIZE	100000
 #define MYWRITE_MAX_CHUNK	32768
 
+/* max number of chunks waiting for compression, limits memory use when
+ * compressing is slower than writing the blocks. chunks are passed back to
+ * the writer through a second queue, which blocks when all are in use */
+#define MYWRITE_MAX_QUEUE	64
+
 typedef struct {
 	struct SDNA *sdna;
 
@@ -174,9 +180,36 @@ typedef struct {
 	MemFile *compare, *current;
 	
 	int tot, count, error, memsize;
+
+	/* compressed writing, zlib runs in a thread */
+	gzFile gzfile;
+	ThreadQueue *gzqueue, *gzfree;
+	ListBase gzthreads;
 } WriteData;
 
-static WriteData *writedata_new(int file)
+typedef struct WriteChunk {
+	int len, maxlen;
+	/* data follows */
+} WriteChunk;
+
+static void *writedata_compress_thread(void *data)
+{
+	WriteData *wd= data;
+	WriteChunk *chunk;
+
+	while((chunk= BLI_thread_queue_pop(wd->gzqueue))) {
+		if (!wd->error && gzwrite(wd->gzfile, chunk+1, chunk->len) != chunk->len)
+			wd->error= 1;
+
+		/* give back to the writer for reuse */
+		BLI_thread_queue_push(wd->gzfree, chunk);
+	}
+
+	return NULL;
+}
+
+/* compress: 0 for uncompressed, else G_FILE_COMPRESS and G_FILE_COMPRESS_FAST flags */
+static WriteData *writedata_new(int file, int compress)
 {
 	WriteData *wd= MEM_callocN(sizeof(*wd), "writedata");
 
@@ -192,6 +225,32 @@ static WriteData *writedata_new(int file)
 
 	wd->buf= MEM_mallocN(MYWRITE_BUFFER_SIZE, "wd->buf");
 
+	if (compress) {
+		/* the RLE strategy is a lot faster than deflate, and is still gzip so
+		 * any version reads it. the file handle is duplicated since gzclose
+		 * closes it, and the caller closes its own */
+		const char *mode= (compress & G_FILE_COMPRESS_FAST)? "wb1R": "wb1";
+
+		wd->gzfile= gzdopen(dup(file), mode);
+
+		if (wd->gzfile == NULL) {
+			wd->error= 1;
+		}
+		else {
+			int a;
+
+			wd->gzqueue= BLI_thread_queue_init();
+			wd->gzfree= BLI_thread_queue_init();
+
+			/* empty chunks, buffers are allocated when first used */
+			for(a=0; a<MYWRITE_MAX_QUEUE; a++)
+				BLI_thread_queue_push(wd->gzfree, MEM_callocN(sizeof(WriteChunk), "WriteChunk"));
+
+			BLI_init_threads(&wd->gzthreads, writedata_compress_thread, 1);
+			BLI_insert_thread(&wd->gzthreads, wd);
+		}
+	}
+
 	return wd;
 }
 
@@ -204,6 +263,22 @@ static void writedata_do_write(WriteData *wd, void *mem, int memlen)
 	if(wd->current) {
 		add_memfilechunk(NULL, wd->current, mem, memlen);
 	}
+	else if(wd->gzqueue) {
+		/* copy into a free chunk, waits while the compress thread has
+		 * all of them queued */
+		WriteChunk *chunk= BLI_thread_queue_pop(wd->gzfree);
+
+		if (chunk->maxlen < memlen) {
+			MEM_freeN(chunk);
+			chunk= MEM_mallocN(sizeof(WriteChunk) + memlen, "WriteChunk");
+			chunk->maxlen= memlen;
+		}
+
+		chunk->len= memlen;
+		memcpy(chunk+1, mem, memlen);
+
+		BLI_thread_queue_push(wd->gzqueue, chunk);
+	}
 	else {
 		if (write(wd->file, mem, memlen) != memlen)
 			wd->error= 1;
@@ -211,6 +286,31 @@ static void writedata_do_write(WriteData *wd, void *mem, int memlen)
 	}
 }
 
+/* wait for the compress thread to write the remaining chunks */
+static void writedata_end_compress(WriteData *wd)
+{
+	if (wd->gzqueue) {
+		WriteChunk *chunk;
+
+		BLI_thread_queue_nowait(wd->gzqueue);
+		BLI_end_threads(&wd->gzthreads);
+		BLI_thread_queue_free(wd->gzqueue);
+		wd->gzqueue= NULL;
+
+		BLI_thread_queue_nowait(wd->gzfree);
+		while((chunk= BLI_thread_queue_pop(wd->gzfree)))
+			MEM_freeN(chunk);
+		BLI_thread_queue_free(wd->gzfree);
+		wd->gzfree= NULL;
+	}
+
+	if (wd->gzfile) {
+		if (gzclose(wd->gzfile) != Z_OK)
+			wd->error= 1;
+		wd->gzfile= NULL;
+	}
+}
+
 static void writedata_free(WriteData *wd)
 {
 	DNA_sdna_free(wd->sdna);
@@ -280,9 +380,9 @@ static void mywrite( WriteData *wd, void *adr, int len)
  * @param write_flags Write parameters
  * @warning Talks to other functions with global parameters
  */
-static WriteData *bgnwrite(int file, MemFile *compare, MemFile *current)
+static WriteData *bgnwrite(int file, int compress, MemFile *compare, MemFile *current)
 {
-	WriteData *wd= writedata_new(file);
+	WriteData *wd= writedata_new(file, compress);
 
 	if (wd == NULL) return NULL;
 
@@ -309,6 +409,8 @@ static int endwrite(WriteData *wd)
 		wd->count= 0;
 	}
 	
+	writedata_end_compress(wd);
+	
 	err= wd->error;
 	writedata_free(wd);
 
@@ -2616,7 +2718,11 @@ static int write_file_handle(Main *mainvar, int handle, MemFile *compare, MemFil
 
 	blo_split_main(&mainlist, mainvar);
 
-	wd= bgnwrite(handle, compare, current);
+	/* compression only for file save */
+	if((write_flags & G_FILE_COMPRESS) && current==NULL)
+		wd= bgnwrite(handle, write_flags & (G_FILE_COMPRESS|G_FILE_COMPRESS_FAST), compare, current);
+	else
+		wd= bgnwrite(handle, 0, compare, current);
 	
 	sprintf(buf, "BLENDER%c%c%.3d", (sizeof(void*)==8)?'-':'_', (ENDIAN_ORDER==B_ENDIAN)?'V':'v', BLENDER_VERSION);
 	mywrite(wd, buf, 12);
@@ -2778,34 +2884,9 @@ int BLO_write_file(Main *mainvar, const char *filepath, int write_flags, ReportL
 		}
 	}
 
-	if(write_flags & G_FILE_COMPRESS) {
-		/* compressed files have the same ending as regular files... only from 2.4!!! */
-		char gzname[FILE_MAX+4];
-		int ret;
-
-		/* first write compressed to separate @.gz */
-		BLI_snprintf(gzname, sizeof(gzname), "%s@.gz", filepath);
-		ret = BLI_file_gzip(tempname, gzname);
-		
-		if(0==ret) {
-			/* now rename to real file name, and delete temp @ file too */
-			if(BLI_rename(gzname, filepath) != 0) {
-				BKE_report(reports, RPT_ERROR, "Can't change old file. File saved with @.");
-				return 0;
-			}
-
-			BLI_delete(tempname, 0, 0);
-		}
-		else if(-1==ret) {
-			BKE_report(reports, RPT_ERROR, "Failed opening .gz file.");
-			return 0;
-		}
-		else if(-2==ret) {
-			BKE_report(reports, RPT_ERROR, "Failed opening .blend file for compression.");
-			return 0;
-		}
-	}
-	else if(BLI_rename(tempname, filepath) != 0) {
+	/* compressed files were already compressed while writing, and have
+	 * the same ending as regular files... only from 2.4!!! */
+	if(BLI_rename(tempname, filepath) != 0) {
 		BKE_report(reports, RPT_ERROR, "Can't change old file. File saved with @");
 		return 0;
 	}
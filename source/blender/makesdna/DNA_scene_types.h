@@ -1012,6 +1012,7 @@ typedef struct Scene {
 #define R_NO_OVERWRITE	0x400000 /* skip existing files */
 #define R_TOUCH			0x800000 /* touch files before rendering */
 #define R_SIMPLIFY		0x1000000
+#define R_PERSISTENT_DATA	0x2000000 /* keep external engine data between frames */
 
 /* seq_flag */
 #define R_SEQ_GL_PREV 1
@@ -60,6 +60,7 @@ struct RayObject;
 struct RayFace;
 struct ReportList;
 struct Main;
+struct RenderEngine;
 
 #define TABLEINITSIZE 1024
 #define LAMPINITSIZE 256
@@ -183,6 +184,9 @@ struct Render
 	struct Object *camera_override;
 	unsigned int lay;
 	
+	/* external render engine kept between frames of an animation, for persistent data */
+	struct RenderEngine *engine;
+	
 	ListBase parts;
 	
 	/* octree tables and variables for raytrace */
@@ -207,6 +211,7 @@ struct Render
 	ListBase lampren;	/* storage, for free */
 	
 	ListBase objecttable;
+	ListBase *objectpost;	/* when set, object post processing is queued here */
 
 	struct ObjectInstanceRen *objectinstance;
 	ListBase instancetable;
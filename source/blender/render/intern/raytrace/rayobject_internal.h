@@ -24,6 +24,7 @@ typedef int  (*RE_rayobjectcontrol_test_break_callback)(void *data);
 typedef struct RayObjectControl {
 	void *data;
 	RE_rayobjectcontrol_test_break_callback test_break;	
+	int threads;	/* max number of threads to use during build, 0 or 1 builds on the calling thread */
 } RayObjectControl;
 
 /* Returns true if for some reason a heavy processing function should stop
@@ -42,6 +42,12 @@
 #include "BLI_math.h"
 #include "BLI_utildefines.h"
 
+#include "DNA_listBase.h"
+
+extern "C" {
+#include "BLI_threads.h"
+}
+
 static bool selected_node(RTBuilder::Object *node)
 {
 	return node->selected;
@@ -155,8 +161,46 @@ static void object_sort(Item *begin, Item *end, int axis)
 	assert(false);
 }
 
+/* below this size sorting is too quick to be worth starting threads */
+#define RTBUILD_THREADED_SORT_MIN_SIZE	10000
+
+typedef struct RTBuilderSortTask
+{
+	RTBuilder *b;
+	int axis;
+} RTBuilderSortTask;
+
+static void *rtbuild_sort_thread(void *data)
+{
+	RTBuilderSortTask *task = (RTBuilderSortTask*)data;
+
+	object_sort( task->b->sorted_begin[task->axis], task->b->sorted_end[task->axis], task->axis );
+	return NULL;
+}
+
 void rtbuild_done(RTBuilder *b, RayObjectControl* ctrl)
 {
+	/* the three axes are sorted independently, so sort them in parallel */
+	if(ctrl->threads > 1 && rtbuild_size(b) >= RTBUILD_THREADED_SORT_MIN_SIZE)
+	{
+		ListBase threads;
+		RTBuilderSortTask task[3];
+
+		if(RE_rayobjectcontrol_test_break(ctrl)) return;
+
+		BLI_init_threads(&threads, rtbuild_sort_thread, 3);
+
+		for(int i=0; i<3; i++)
+		{
+			task[i].b = b;
+			task[i].axis = i;
+			BLI_insert_thread(&threads, &task[i]);
+		}
+
+		BLI_end_threads(&threads);
+		return;
+	}
+
 	for(int i=0; i<3; i++)
 	if(b->sorted_begin[i])
 	{
@@ -329,6 +373,118 @@ struct SweepCost
 	float cost;
 };
 
+/* Binned Surface Area Heuristic, for large nodes where evaluating the cost
+ * at every object is not worth it. objects are put in bins by the centroid of
+ * their bounding box, and splits are only evaluated between bins. with enough
+ * bins this gives nearly the same trees, in time linear in the number of
+ * objects and without allocating memory. */
+#define RTBUILD_BINS				32
+#define RTBUILD_BINNED_MIN_SIZE		1024
+
+static inline int rtbuild_bin_index(RTBuilder::Object *obj, int axis, float cmin, float scale)
+{
+	int bin = (int)(((obj->bb[axis] + obj->bb[axis+3]) - cmin) * scale);
+	return CLAMPIS(bin, 0, RTBUILD_BINS-1);
+}
+
+/* marks the objects for the left child as selected and returns how many, or
+ * returns 0 if all objects fall into one bin */
+static int rtbuild_binned_split(RTBuilder *b, int size)
+{
+	SweepCost bins[RTBUILD_BINS], right[RTBUILD_BINS];
+	int count[RTBUILD_BINS];
+	float cmin[3], cmax[3], scale[3];
+	float bcost = FLT_MAX;
+	int baxis = -1, bbin = 0;
+	RTBuilder::Object **obj = b->sorted_begin[0];
+
+	/* bounds of centroids, not divided by two since only their order matters */
+	INIT_MINMAX(cmin, cmax);
+	for(int i=0; i<size; i++)
+	{
+		for(int axis=0; axis<3; axis++)
+		{
+			float c = obj[i]->bb[axis] + obj[i]->bb[axis+3];
+			cmin[axis] = MIN2(cmin[axis], c);
+			cmax[axis] = MAX2(cmax[axis], c);
+		}
+	}
+
+	for(int axis=0; axis<3; axis++)
+	{
+		if(cmax[axis] <= cmin[axis])
+			continue;
+
+		scale[axis] = RTBUILD_BINS*(1.0f - FLT_EPSILON)/(cmax[axis] - cmin[axis]);
+
+		for(int j=0; j<RTBUILD_BINS; j++)
+		{
+			INIT_MINMAX(bins[j].bb, bins[j].bb+3);
+			bins[j].cost = 0.0f;
+			count[j] = 0;
+		}
+
+		for(int i=0; i<size; i++)
+		{
+			int j = rtbuild_bin_index(obj[i], axis, cmin[axis], scale[axis]);
+
+			DO_MIN( obj[i]->bb,   bins[j].bb   );
+			DO_MAX( obj[i]->bb+3, bins[j].bb+3 );
+			bins[j].cost += obj[i]->cost;
+			count[j]++;
+		}
+
+		/* sweep from the right, then evaluate splits sweeping from the left */
+		right[RTBUILD_BINS-1] = bins[RTBUILD_BINS-1];
+		for(int j=RTBUILD_BINS-2; j>=0; j--)
+		{
+			right[j] = right[j+1];
+			DO_MIN( bins[j].bb,   right[j].bb   );
+			DO_MAX( bins[j].bb+3, right[j].bb+3 );
+			right[j].cost += bins[j].cost;
+		}
+
+		SweepCost left = bins[0];
+		int left_count = count[0];
+
+		for(int j=1; j<RTBUILD_BINS; j++)
+		{
+			/* empty bins don't change bounds and cost, skip splits that
+			   would give the same result or an empty child */
+			if(count[j] && left_count)
+			{
+				float hcost = bb_area(left.bb, left.bb+3)*left.cost
+				            + bb_area(right[j].bb, right[j].bb+3)*right[j].cost;
+
+				if(hcost < bcost)
+				{
+					bcost = hcost;
+					baxis = axis;
+					bbin = j;
+				}
+			}
+
+			DO_MIN( bins[j].bb,   left.bb   );
+			DO_MAX( bins[j].bb+3, left.bb+3 );
+			left.cost += bins[j].cost;
+			left_count += count[j];
+		}
+	}
+
+	if(baxis == -1)
+		return 0;
+
+	int boffset = 0;
+
+	for(int i=0; i<size; i++)
+	{
+		obj[i]->selected = (rtbuild_bin_index(obj[i], baxis, cmin[baxis], scale[baxis]) < bbin);
+		boffset += obj[i]->selected;
+	}
+
+	return boffset;
+}
+
 /* Object Surface Area Heuristic splitter */
 int rtbuild_heuristic_object_split(RTBuilder *b, int nchilds)
 {
@@ -337,7 +493,14 @@ int rtbuild_heuristic_object_split(RTBuilder *b, int nchilds)
 	assert(size > 1);
 	int baxis = -1, boffset = 0;
 
-	if(size > nchilds)
+	if(size >= RTBUILD_BINNED_MIN_SIZE)
+		boffset = rtbuild_binned_split(b, size);
+
+	if(boffset)
+	{
+		/* objects were selected by the binned split */
+	}
+	else if(size > nchilds)
 	{
 		float bcost = FLT_MAX;
 		baxis = -1, boffset = size/2;
@@ -441,8 +604,11 @@ int rtbuild_heuristic_object_split(RTBuilder *b, int nchilds)
 	
 
 	/* Adjust sorted arrays for childs */
-	for(int i=0; i<boffset; i++) b->sorted_begin[baxis][i]->selected = true;
-	for(int i=boffset; i<size; i++) b->sorted_begin[baxis][i]->selected = false;
+	if(baxis != -1)
+	{
+		for(int i=0; i<boffset; i++) b->sorted_begin[baxis][i]->selected = true;
+		for(int i=boffset; i<size; i++) b->sorted_begin[baxis][i]->selected = false;
+	}
 	for(int i=0; i<3; i++)
 		std::stable_partition( b->sorted_begin[i], b->sorted_end[i], selected_node );
 
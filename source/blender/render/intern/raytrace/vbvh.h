@@ -32,9 +32,16 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <vector>
 
 #include "BLI_memarena.h"
 
+#include "DNA_listBase.h"
+
+extern "C" {
+#include "BLI_threads.h"
+}
+
 #include "rayobject_rtbuild.h"
 
 /*
@@ -107,12 +114,23 @@ void append_sibling(Node *node, Node *sibling)
 /*
  * Builds a binary VBVH from a rtbuild
  */
+/* builds in parallel when there are more primitives than this */
+#define VBVH_PARALLEL_MIN_SIZE	10000
+/* number of subtrees per thread, more gives better load balancing */
+#define VBVH_TASKS_PER_THREAD	8
+/* nodes allocated at once by each thread, to avoid locking for every node */
+#define VBVH_NODE_CHUNK			256
+
 template<class Node>
 struct BuildBinaryVBVH
 {
 	MemArena *arena;
 	RayObjectControl *control;
 
+	/* only used while building in parallel */
+	ThreadMutex *arena_mutex;
+	Node *chunk_begin, *chunk_end;
+
 	void test_break()
 	{
 		if(RE_rayobjectcontrol_test_break(control))
@@ -123,11 +141,29 @@ struct BuildBinaryVBVH
 	{
 		arena = a;
 		control = c;
+		arena_mutex = NULL;
+		chunk_begin = chunk_end = NULL;
 	}
 
 	Node *create_node()
 	{
-		Node *node = (Node*)BLI_memarena_alloc( arena, sizeof(Node) );
+		Node *node;
+
+		if(arena_mutex)
+		{
+			if(chunk_begin == chunk_end)
+			{
+				BLI_mutex_lock(arena_mutex);
+				chunk_begin = (Node*)BLI_memarena_alloc( arena, sizeof(Node)*VBVH_NODE_CHUNK );
+				BLI_mutex_unlock(arena_mutex);
+				chunk_end = chunk_begin + VBVH_NODE_CHUNK;
+			}
+
+			node = chunk_begin++;
+		}
+		else
+			node = (Node*)BLI_memarena_alloc( arena, sizeof(Node) );
+
 		assert( RE_rayobject_isAligned(node) );
 
 		node->sibling = NULL;
@@ -145,6 +181,9 @@ struct BuildBinaryVBVH
 	{
 		try
 		{
+			if(control->threads > 1 && rtbuild_size(builder) >= VBVH_PARALLEL_MIN_SIZE)
+				return parallel_transform(builder);
+
 			return _transform(builder);
 			
 		} catch(...)
@@ -195,6 +234,167 @@ struct BuildBinaryVBVH
 			return node;
 		}
 	}
+
+	/*
+	 * Parallel build: the top of the tree is split on the calling thread
+	 * until the remaining subtrees are small enough, then those are built by
+	 * worker threads, each taking the next unbuilt subtree until none are
+	 * left. Subtrees use disjoint ranges of the sorted arrays, so they can
+	 * be split independently, and as splitting is deterministic the tree is
+	 * the same as when built on a single thread.
+	 */
+	struct BuildTask
+	{
+		RTBuilder builder;
+		Node *node;
+	};
+
+	/* top node, children are indices into top nodes, or -(task index+1) */
+	struct TopNode
+	{
+		Node *node;
+		int child[2];
+	};
+
+	struct BuildState
+	{
+		BuildBinaryVBVH *build;
+		std::vector<BuildTask> *tasks;
+		size_t next_task;
+		ThreadMutex mutex;
+		bool canceled;
+	};
+
+	int _transform_top(RTBuilder *builder, int task_size, std::vector<BuildTask>& tasks, std::vector<TopNode>& top_nodes)
+	{
+		int size = rtbuild_size(builder);
+
+		if(size <= task_size)
+		{
+			BuildTask task;
+			task.builder = *builder;
+			task.node = NULL;
+			tasks.push_back(task);
+
+			return -(int)tasks.size();
+		}
+
+		test_break();
+
+		int index = top_nodes.size();
+		TopNode top;
+		top.node = create_node();
+		top_nodes.push_back(top);
+
+		int nc = rtbuild_split(builder);
+		assert(nc == 2);
+
+		for(int i=0; i<nc; i++)
+		{
+			RTBuilder tmp;
+			rtbuild_get_child(builder, i, &tmp);
+
+			int child = _transform_top(&tmp, task_size, tasks, top_nodes);
+			top_nodes[index].child[i] = child;
+		}
+
+		return index;
+	}
+
+	static void *build_thread(void *data)
+	{
+		BuildState *state = (BuildState*)data;
+		BuildBinaryVBVH build(state->build->arena, state->build->control);
+
+		build.arena_mutex = state->build->arena_mutex;
+
+		while(1)
+		{
+			BuildTask *task = NULL;
+
+			BLI_mutex_lock(&state->mutex);
+			if(!state->canceled && state->next_task < state->tasks->size())
+				task = &(*state->tasks)[state->next_task++];
+			BLI_mutex_unlock(&state->mutex);
+
+			if(!task)
+				break;
+
+			try
+			{
+				task->node = build._transform(&task->builder);
+			} catch(...)
+			{
+				BLI_mutex_lock(&state->mutex);
+				state->canceled = true;
+				BLI_mutex_unlock(&state->mutex);
+			}
+		}
+
+		return NULL;
+	}
+
+	Node *parallel_transform(RTBuilder *builder)
+	{
+		int size = rtbuild_size(builder);
+		int threads = MIN2(control->threads, BLENDER_MAX_THREADS);
+		int task_size = MAX2(size/(threads*VBVH_TASKS_PER_THREAD), 1);
+		std::vector<BuildTask> tasks;
+		std::vector<TopNode> top_nodes;
+
+		int root = _transform_top(builder, task_size, tasks, top_nodes);
+
+		/* build subtrees */
+		ThreadMutex mutex;
+		BuildState state;
+		ListBase threadbase;
+
+		BLI_mutex_init(&mutex);
+		BLI_mutex_init(&state.mutex);
+		arena_mutex = &mutex;
+
+		state.build = this;
+		state.tasks = &tasks;
+		state.next_task = 0;
+		state.canceled = false;
+
+		BLI_init_threads(&threadbase, build_thread, threads);
+		for(int i=0; i<threads; i++)
+			BLI_insert_thread(&threadbase, &state);
+		BLI_end_threads(&threadbase);
+
+		arena_mutex = NULL;
+		chunk_begin = chunk_end = NULL;
+		BLI_mutex_end(&state.mutex);
+		BLI_mutex_end(&mutex);
+
+		if(state.canceled)
+			throw "Stop";
+
+		/* link subtrees, children are created after their parent, so going
+		   in reverse order the bounds of the children are known */
+		for(int i=top_nodes.size()-1; i>=0; i--)
+		{
+			Node *node = top_nodes[i].node;
+			Node **child = &node->child;
+
+			INIT_MINMAX(node->bb, node->bb+3);
+
+			for(int j=0; j<2; j++)
+			{
+				int index = top_nodes[i].child[j];
+
+				*child = (index >= 0)? top_nodes[index].node: tasks[-index-1].node;
+				DO_MIN((*child)->bb, node->bb);
+				DO_MAX((*child)->bb+3, node->bb+3);
+				child = &((*child)->sibling);
+			}
+
+			*child = 0;
+		}
+
+		return (root >= 0)? top_nodes[root].node: tasks[-root-1].node;
+	}
 };
 
 /*
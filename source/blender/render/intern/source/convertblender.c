@@ -42,6 +42,7 @@
 #include "BLI_rand.h"
 #include "BLI_memarena.h"
 #include "BLI_ghash.h"
+#include "BLI_threads.h"
 
 #include "DNA_armature_types.h"
 #include "DNA_camera_types.h"
@@ -123,6 +124,26 @@
 /* or for checking vertex normal flips */
 #define FLT_EPSILON10 1.19209290e-06F
 
+/* Post processing of a converted object. Evaluating object data uses the
+ * DerivedMesh, particles and textures and is done serially, but what comes
+ * after (autosmooth, normals, stress, quad splitting, bounds) only touches
+ * the ObjectRen, so during database creation it is queued and threaded */
+typedef struct ObjectRenPost {
+	struct ObjectRenPost *next, *prev;
+	ObjectRen *obr;
+	int timeoffset;
+
+	/* mesh settings, filled in by init_render_mesh */
+	short do_autosmooth, recalc_normals, need_tangent, need_nmap_tangent, need_stress;
+	int autosmooth_degr;
+	float mat[4][4];
+	float texloc[3], texsize[3];
+
+	/* result, applied to the object in conversion order */
+	short set_smoothresh;
+	float smoothresh;
+} ObjectRenPost;
+
 /* ------------------------------------------------------------------------- */
 
 /* Stuff for stars. This sits here because it uses gl-things. Part of
@@ -391,15 +412,13 @@ static void calc_edge_stress_add(float *accum, VertRen *v1, VertRen *v2)
 	acc[1]+= 1.0f;
 }
 
-static void calc_edge_stress(Render *UNUSED(re), ObjectRen *obr, Mesh *me)
+static void calc_edge_stress(Render *UNUSED(re), ObjectRen *obr, float *loc, float *size)
 {
-	float loc[3], size[3], *accum, *acc, *accumoffs, *stress;
+	float *accum, *acc, *accumoffs, *stress;
 	int a;
 	
 	if(obr->totvert==0) return;
 	
-	mesh_get_texspace(me, loc, NULL, size);
-	
 	accum= MEM_callocN(2*sizeof(float)*obr->totvert, "temp accum for stress");
 	
 	/* de-normalize orco */
@@ -3233,7 +3252,7 @@ static void add_volume(Render *re, ObjectRen *obr, Material *ma)
 	BLI_addtail(&re->volumes, vo);
 }
 
-static void init_render_mesh(Render *re, ObjectRen *obr, int timeoffset)
+static void init_render_mesh(Render *re, ObjectRen *obr, int timeoffset, ObjectRenPost *post)
 {
 	Object *ob= obr->ob;
 	Mesh *me;
@@ -3547,16 +3566,22 @@ static void init_render_mesh(Render *re, ObjectRen *obr, int timeoffset)
 				do_displacement(re, obr, NULL, NULL);
 		}
 
+		/* autosmooth, normals and stress are done in post processing */
 		if(do_autosmooth) {
 			recalc_normals= 1;
-			autosmooth(re, obr, mat, me->smoothresh);
+			post->do_autosmooth= 1;
+			post->autosmooth_degr= me->smoothresh;
+			copy_m4_m4(post->mat, mat);
 		}
 
-		if(recalc_normals!=0 || need_tangent!=0)
-			calc_vertexnormals(re, obr, need_tangent, need_nmap_tangent);
-		
-		if(need_stress)
-			calc_edge_stress(re, obr, me);
+		post->recalc_normals= recalc_normals;
+		post->need_tangent= need_tangent;
+		post->need_nmap_tangent= need_nmap_tangent;
+
+		if(need_stress) {
+			post->need_stress= 1;
+			mesh_get_texspace(me, post->texloc, NULL, post->texsize);
+		}
 	}
 
 	dm->release(dm);
@@ -4040,7 +4065,7 @@ void init_render_world(Render *re)
 /* ------------------------------------------------------------------------- */
 
 /* prevent phong interpolation for giving ray shadow errors (terminator problem) */
-static void set_phong_threshold(ObjectRen *obr)
+static float set_phong_threshold(ObjectRen *obr)
 {
 //	VertRen *ver;
 	VlakRen *vlr;
@@ -4083,8 +4108,10 @@ static void set_phong_threshold(ObjectRen *obr)
 	
 	if(tot) {
 		thresh/= (float)tot;
-		obr->ob->smoothresh= cosf(0.5f*(float)M_PI-saacos(thresh));
+		return cosf(0.5f*(float)M_PI-saacos(thresh));
 	}
+
+	return 0.0f;
 }
 
 /* per face check if all samples should be taken.
@@ -4281,9 +4308,9 @@ static void check_non_flat_quads(ObjectRen *obr)
 	}
 }
 
-static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
+static void finalize_render_object(Render *re, ObjectRenPost *post)
 {
-	Object *ob= obr->ob;
+	ObjectRen *obr= post->obr;
 	VertRen *ver= NULL;
 	StrandRen *strand= NULL;
 	StrandBound *sbound= NULL;
@@ -4291,18 +4318,13 @@ static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
 	int a, b;
 
 	if(obr->totvert || obr->totvlak || obr->tothalo || obr->totstrand) {
-		/* the exception below is because displace code now is in init_render_mesh call, 
-		I will look at means to have autosmooth enabled for all object types 
-		and have it as general postprocess, like displace */
-		if(ob->type!=OB_MESH && test_for_displace(re, ob)) 
-			do_displacement(re, obr, NULL, NULL);
-	
-		if(!timeoffset) {
+		if(!post->timeoffset) {
 			/* phong normal interpolation can cause error in tracing
-			 * (terminator problem) */
-			ob->smoothresh= 0.0;
+			 * (terminator problem), ob->smoothresh is set after threads */
+			post->set_smoothresh= 1;
+			post->smoothresh= 0.0f;
 			if((re->r.mode & R_RAYTRACE) && (re->r.mode & R_SHADOW)) 
-				set_phong_threshold(obr);
+				post->smoothresh= set_phong_threshold(obr);
 			
 			if (re->flag & R_BAKING && re->r.bake_quad_split != 0) {
 				/* Baking lets us define a quad split order */
@@ -4357,6 +4379,86 @@ static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
 	}
 }
 
+static void object_post_process(Render *re, ObjectRenPost *post)
+{
+	ObjectRen *obr= post->obr;
+
+	if(post->do_autosmooth)
+		autosmooth(re, obr, post->mat, post->autosmooth_degr);
+
+	if(post->recalc_normals || post->need_tangent)
+		calc_vertexnormals(re, obr, post->need_tangent, post->need_nmap_tangent);
+	
+	if(post->need_stress)
+		calc_edge_stress(re, obr, post->texloc, post->texsize);
+
+	finalize_render_object(re, post);
+}
+
+/* not threaded, results go to the object and render in conversion order */
+static void object_post_apply(Render *re, ObjectRenPost *post)
+{
+	ObjectRen *obr= post->obr;
+
+	if(post->set_smoothresh)
+		obr->ob->smoothresh= post->smoothresh;
+
+	re->totvert += obr->totvert;
+	re->totvlak += obr->totvlak;
+	re->tothalo += obr->tothalo;
+	re->totstrand += obr->totstrand;
+}
+
+typedef struct ObjectPostThread {
+	Render *re;
+	ThreadQueue *work;
+} ObjectPostThread;
+
+static void *do_object_post_thread(void *data)
+{
+	ObjectPostThread *pt= (ObjectPostThread*)data;
+	ObjectRenPost *post;
+
+	while((post= BLI_thread_queue_pop(pt->work)))
+		object_post_process(pt->re, post);
+
+	return NULL;
+}
+
+static void object_post_process_threaded(Render *re, ListBase *postlist)
+{
+	ObjectRenPost *post;
+	int a, totthread= MIN2(re->r.threads, BLI_countlist(postlist));
+
+	if(totthread > 1) {
+		ObjectPostThread pt;
+		ListBase threads;
+
+		pt.re= re;
+		pt.work= BLI_thread_queue_init();
+
+		for(post= postlist->first; post; post= post->next)
+			BLI_thread_queue_push(pt.work, post);
+		BLI_thread_queue_nowait(pt.work);
+
+		BLI_init_threads(&threads, do_object_post_thread, totthread);
+		for(a=0; a<totthread; a++)
+			BLI_insert_thread(&threads, &pt);
+		BLI_end_threads(&threads);
+
+		BLI_thread_queue_free(pt.work);
+	}
+	else {
+		for(post= postlist->first; post; post= post->next)
+			object_post_process(re, post);
+	}
+
+	for(post= postlist->first; post; post= post->next)
+		object_post_apply(re, post);
+
+	BLI_freelistN(postlist);
+}
+
 /* ------------------------------------------------------------------------- */
 /* Database																	 */
 /* ------------------------------------------------------------------------- */
@@ -4490,9 +4592,14 @@ static void set_dupli_tex_mat(Render *re, ObjectInstanceRen *obi, DupliObject *d
 static void init_render_object_data(Render *re, ObjectRen *obr, int timeoffset)
 {
 	Object *ob= obr->ob;
+	ObjectRenPost *post;
 	ParticleSystem *psys;
 	int i;
 
+	post= MEM_callocN(sizeof(ObjectRenPost), "ObjectRenPost");
+	post->obr= obr;
+	post->timeoffset= timeoffset;
+
 	if(obr->psysindex) {
 		if((!obr->prev || obr->prev->ob != ob || (obr->prev->flag & R_INSTANCEABLE)==0) && ob->type==OB_MESH) {
 			/* the emitter mesh wasn't rendered so the modifier stack wasn't
@@ -4513,17 +4620,25 @@ static void init_render_object_data(Render *re, ObjectRen *obr, int timeoffset)
 		else if(ob->type==OB_SURF)
 			init_render_surf(re, obr, timeoffset);
 		else if(ob->type==OB_MESH)
-			init_render_mesh(re, obr, timeoffset);
+			init_render_mesh(re, obr, timeoffset, post);
 		else if(ob->type==OB_MBALL)
 			init_render_mball(re, obr);
 	}
 
-	finalize_render_object(re, obr, timeoffset);
+	/* displacement uses textures, so it can't be deferred to post processing,
+	 * for meshes it was already done in init_render_mesh */
+	if(obr->totvert || obr->totvlak || obr->tothalo || obr->totstrand)
+		if(ob->type!=OB_MESH && test_for_displace(re, ob)) 
+			do_displacement(re, obr, NULL, NULL);
 
-	re->totvert += obr->totvert;
-	re->totvlak += obr->totvlak;
-	re->tothalo += obr->tothalo;
-	re->totstrand += obr->totstrand;
+	if(re->objectpost) {
+		BLI_addtail(re->objectpost, post);
+	}
+	else {
+		object_post_process(re, post);
+		object_post_apply(re, post);
+		MEM_freeN(post);
+	}
 }
 
 static void add_render_object(Render *re, Object *ob, Object *par, DupliObject *dob, int timeoffset)
@@ -4842,9 +4957,14 @@ static void database_init_objects(Render *re, unsigned int renderlay, int nolamp
 	Group *group;
 	ObjectInstanceRen *obi;
 	Scene *sce_iter;
+	ListBase postlist= {NULL, NULL};
 	float mat[4][4];
 	int lay, vectorlay;
 
+	/* queue object post processing to run it threaded at the end */
+	if(re->r.threads > 1)
+		re->objectpost= &postlist;
+
 	/* for duplis we need the Object texture mapping to work as if
 	 * untransformed, set_dupli_tex_mat sets the matrix to allow that
 	 * NULL is just for init */
@@ -5005,6 +5125,11 @@ static void database_init_objects(Render *re, unsigned int renderlay, int nolamp
 	for(group= re->main->group.first; group; group=group->id.next)
 		add_group_render_dupli_obs(re, group, nolamps, onlyselected, actob, timeoffset, 0);
 
+	if(re->objectpost) {
+		re->objectpost= NULL;
+		object_post_process_threaded(re, &postlist);
+	}
+
 	if(!re->test_break(re->tbh))
 		RE_makeRenderInstances(re);
 }
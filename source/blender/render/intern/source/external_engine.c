@@ -294,9 +294,20 @@ int RE_engine_render(Render *re, int do_all)
 	BLI_strncpy(re->i.scenename, re->scene->id.name+2, sizeof(re->i.scenename));
 	re->i.totface=re->i.totvert=re->i.totstrand=re->i.totlamp=re->i.tothalo= 0;
 
-	/* render */
-	engine = RE_engine_create(type);
+	/* render, reusing the engine of the previous frame of an animation if
+	   persistent data is enabled, so it can keep its data in memory */
+	engine= re->engine;
+
+	if(engine && engine->type != type) {
+		RE_engine_free(engine);
+		re->engine= engine= NULL;
+	}
+
+	if(!engine)
+		engine = RE_engine_create(type);
+
 	engine->re= re;
+	engine->flag &= ~(RE_ENGINE_ANIMATION|RE_ENGINE_PREVIEW);
 
 	if(re->flag & R_ANIMATION)
 		engine->flag |= RE_ENGINE_ANIMATION;
@@ -313,7 +324,13 @@ int RE_engine_render(Render *re, int do_all)
 
 	free_render_result(&engine->fullresult, engine->fullresult.first);
 
-	RE_engine_free(engine);
+	if((re->r.mode & R_PERSISTENT_DATA) && (re->flag & R_ANIMATION) && !(re->r.scemode & R_PREVIEWBUTS)) {
+		re->engine= engine;
+	}
+	else {
+		RE_engine_free(engine);
+		re->engine= NULL;
+	}
 
 	return 1;
 }
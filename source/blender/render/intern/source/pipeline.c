@@ -1234,6 +1234,9 @@ void RE_FreeRender(Render *re)
 {
 	BLI_rw_mutex_end(&re->resultmutex);
 	
+	if(re->engine)
+		RE_engine_free(re->engine);
+
 	free_renderdata_tables(re);
 	free_sample_tables(re);
 	
@@ -1634,6 +1637,90 @@ static RenderPart *find_next_part(Render *re, int minx)
 	return best;
 }
 
+/* towards the end of a render, there are fewer parts left than threads, and
+ * a single slow part can keep one thread busy while the others wait. while
+ * fewer parts are waiting than there are threads, the largest waiting part is
+ * split in two, until no waiting part is larger than the waiting work divided
+ * over the threads, so the remaining work is spread over all threads.
+ * splitting is only done on parts that did not start yet, merging works with
+ * any part rect so needs no changes */
+#define PART_SPLIT_MIN_SIZE	16
+
+static int count_waiting_parts(Render *re)
+{
+	RenderPart *pa;
+	int tot= 0;
+	
+	for(pa= re->parts.first; pa; pa= pa->next)
+		if(pa->ready==0 && pa->nr==0)
+			tot++;
+	
+	return tot;
+}
+
+static int part_size(RenderPart *pa)
+{
+	return (pa->rectx - 2*pa->crop)*(pa->recty - 2*pa->crop);
+}
+
+/* returns largest waiting part and total size of waiting parts */
+static RenderPart *find_largest_waiting_part(Render *re, int *totsize)
+{
+	RenderPart *pa, *best= NULL;
+	
+	*totsize= 0;
+	
+	for(pa= re->parts.first; pa; pa= pa->next) {
+		if(pa->ready==0 && pa->nr==0) {
+			*totsize += part_size(pa);
+			
+			if(best==NULL || part_size(pa) > part_size(best))
+				best= pa;
+		}
+	}
+	
+	return best;
+}
+
+static int split_part(Render *re, RenderPart *pa)
+{
+	RenderPart *newpa;
+	int crop= pa->crop;
+	int sizex= pa->rectx - 2*crop;
+	int sizey= pa->recty - 2*crop;
+	
+	if(MAX2(sizex, sizey) < 2*PART_SPLIT_MIN_SIZE)
+		return 0;
+	
+	newpa= MEM_callocN(sizeof(RenderPart), "split part");
+	newpa->crop= crop;
+	newpa->disprect= pa->disprect;
+	
+	/* split the uncropped rect, both halves get their own filter border */
+	if(sizex > sizey) {
+		int mid= pa->disprect.xmin + crop + sizex/2;
+		
+		pa->disprect.xmax= mid + crop;
+		newpa->disprect.xmin= mid - crop;
+	}
+	else {
+		int mid= pa->disprect.ymin + crop + sizey/2;
+		
+		pa->disprect.ymax= mid + crop;
+		newpa->disprect.ymin= mid - crop;
+	}
+	
+	pa->rectx= pa->disprect.xmax - pa->disprect.xmin;
+	pa->recty= pa->disprect.ymax - pa->disprect.ymin;
+	newpa->rectx= newpa->disprect.xmax - newpa->disprect.xmin;
+	newpa->recty= newpa->disprect.ymax - newpa->disprect.ymin;
+	
+	BLI_insertlinkafter(&re->parts, pa, newpa);
+	re->i.totpart++;
+	
+	return 1;
+}
+
 static void print_part_stats(Render *re, RenderPart *pa)
 {
 	char str[64];
@@ -1663,7 +1750,7 @@ static void threaded_tile_processor(Render *re)
 	ListBase threads;
 	RenderPart *pa, *nextpa;
 	rctf viewplane= re->viewplane;
-	int rendering=1, counter= 1, drawtimer=0, hasdrawn, minx=0;
+	int rendering=1, counter= 1, drawtimer=0, hasdrawn, minx=0, do_split, totwaiting;
 	
 	BLI_rw_mutex_lock(&re->resultmutex, THREAD_LOCK_WRITE);
 
@@ -1708,6 +1795,10 @@ static void threaded_tile_processor(Render *re)
 	/* set threadsafe break */
 	R.test_break= thread_break;
 	
+	/* exr tiles have to match the part grid, panorama renders slices */
+	do_split= !(re->result->exrhandle || (re->r.mode & R_PANORAMA));
+	totwaiting= count_waiting_parts(re);
+	
 	/* timer loop demands to sleep when no parts are left, so we enter loop with a part */
 	if(re->r.mode & R_PANORAMA)
 		nextpa= find_next_pano_slice(re, &minx, &viewplane);
@@ -1720,6 +1811,20 @@ static void threaded_tile_processor(Render *re)
 			PIL_sleep_ms(50);
 		else if(nextpa && BLI_available_threads(&threads)) {
 			drawtimer= 0;
+			
+			if(do_split) {
+				while(totwaiting < re->r.threads) {
+					int totsize;
+					RenderPart *largest= find_largest_waiting_part(re, &totsize);
+					
+					if(part_size(largest) <= totsize/re->r.threads || !split_part(re, largest))
+						break;
+					
+					totwaiting++;
+				}
+			}
+			
+			totwaiting--;
 			nextpa->nr= counter++;	/* for nicest part, and for stats */
 			nextpa->thread= BLI_available_thread_index(&threads);	/* sample index */
 			BLI_insert_thread(&threads, nextpa);
@@ -3212,6 +3317,12 @@ void RE_BlenderAnim(Render *re, Main *bmain, Scene *scene, Object *camera_overri
 
 	re->flag &= ~R_ANIMATION;
 
+	/* free engine data kept between frames */
+	if(re->engine) {
+		RE_engine_free(re->engine);
+		re->engine= NULL;
+	}
+
 	/* UGLY WARNING */
 	G.rendering= 0;
 }
@@ -91,6 +91,7 @@ static void RE_rayobject_config_control(RayObject *r, Render *re)
 		r = RE_rayobject_align( r );
 		r->control.data = re;
 		r->control.test_break = test_break;
+		r->control.threads = re->r.threads;
 	}
 }
 
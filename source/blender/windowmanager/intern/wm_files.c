@@ -774,6 +774,9 @@ int WM_write_file(bContext *C, const char *target, int fileflags, ReportList *re
 		if(fileflags & G_FILE_COMPRESS) G.fileflags |= G_FILE_COMPRESS;
 		else G.fileflags &= ~G_FILE_COMPRESS;
 		
+		if(fileflags & G_FILE_COMPRESS_FAST) G.fileflags |= G_FILE_COMPRESS_FAST;
+		else G.fileflags &= ~G_FILE_COMPRESS_FAST;
+
 		if(fileflags & G_FILE_AUTOPLAY) G.fileflags |= G_FILE_AUTOPLAY;
 		else G.fileflags &= ~G_FILE_AUTOPLAY;
 
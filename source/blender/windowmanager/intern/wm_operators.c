@@ -1922,6 +1922,13 @@ static void save_set_compress(wmOperator *op)
 		else /* use userdef for new file */
 			RNA_boolean_set(op->ptr, "compress", U.flag & USER_FILECOMPRESS);
 	}
+
+	if(!RNA_property_is_set(op->ptr, "compress_fast")) {
+		if(G.save_over) /* keep flag for existing file */
+			RNA_boolean_set(op->ptr, "compress_fast", G.fileflags & G_FILE_COMPRESS_FAST);
+		else /* no user preference, new files use the default compression */
+			RNA_boolean_set(op->ptr, "compress_fast", 0);
+	}
 }
 
 static int wm_save_as_mainfile_invoke(bContext *C, wmOperator *op, wmEvent *UNUSED(event))
@@ -1970,6 +1977,8 @@ static int wm_save_as_mainfile_exec(bContext *C, wmOperator *op)
 	/* set compression flag */
 	if(RNA_boolean_get(op->ptr, "compress"))		fileflags |=  G_FILE_COMPRESS;
 	else											fileflags &= ~G_FILE_COMPRESS;
+	if(RNA_boolean_get(op->ptr, "compress_fast"))	fileflags |=  G_FILE_COMPRESS_FAST;
+	else											fileflags &= ~G_FILE_COMPRESS_FAST;
 	if(RNA_boolean_get(op->ptr, "relative_remap"))	fileflags |=  G_FILE_RELATIVE_REMAP;
 	else											fileflags &= ~G_FILE_RELATIVE_REMAP;
 
@@ -2009,6 +2018,7 @@ static void WM_OT_save_as_mainfile(wmOperatorType *ot)
 
 	WM_operator_properties_filesel(ot, FOLDERFILE|BLENDERFILE, FILE_BLENDER, FILE_SAVE, WM_FILESEL_FILEPATH);
 	RNA_def_boolean(ot->srna, "compress", 0, "Compress", "Write compressed .blend file");
+	RNA_def_boolean(ot->srna, "compress_fast", 0, "Fast Compression", "Compress faster, at the cost of a larger file");
 	RNA_def_boolean(ot->srna, "relative_remap", 1, "Remap Relative", "Remap relative paths when saving in a different directory");
 	RNA_def_boolean(ot->srna, "copy", 0, "Save Copy", "Save a copy of the actual working state but does not make saved file active");
 }
@@ -2073,6 +2083,7 @@ static void WM_OT_save_mainfile(wmOperatorType *ot)
 	
 	WM_operator_properties_filesel(ot, FOLDERFILE|BLENDERFILE, FILE_BLENDER, FILE_SAVE, WM_FILESEL_FILEPATH);
 	RNA_def_boolean(ot->srna, "compress", 0, "Compress", "Write compressed .blend file");
+	RNA_def_boolean(ot->srna, "compress_fast", 0, "Fast Compression", "Compress faster, at the cost of a larger file");
 	RNA_def_boolean(ot->srna, "relative_remap", 0, "Remap Relative", "Remap relative paths when saving in a different directory");
 }
 